@@ -1,11 +1,17 @@
 #include <iostream>
 #include <Eigen/Core>
 #include <chrono>
+#include <cmath>
 #include "systemSimulator.hpp"
+#include "integrator.hpp"
+#include "fixedSystem.hpp"
+#include "commandLine.hpp"
 
 // Main function for simulating the solar system
 int main(int argc, char* argv[]) {
 
+    n_body::CommandLine command_line(argc, argv);
+
     // Display help message if no arguments are provided or help flag is used
     if (argc == 1 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"){
         std::cout << "Usage: solarSystemSimulator [options]" << "\n";
@@ -13,23 +19,40 @@ int main(int argc, char* argv[]) {
         std::cout << "  -h, --help      Display this help message" << "\n";
         std::cout << "  -dt <value>     Set the timestep for the simulation" << "\n";
         std::cout << "  -len_time <years>  Set the total length of time to simulate" << "\n";
+        std::cout << "  --integrator <euler|leapfrog|verlet|yoshida4|hermite|block>     Select the time integration scheme (default euler)" << "\n";
+        std::cout << "  --integrator block --eta <float>     Individual power-of-two timesteps of at most dt, each at most eta |a| / |jerk| (default 0.01)" << "\n";
+        std::cout << "  --engine <fixed|generic>     Unrolled nine-body engine on the stack, or the general particle system (default fixed, generic for hermite and block)" << "\n";
         std::cout << "  For example: solarSystemSimulator 0.01 100" << "\n";
         std::cout << "  This mean 100 years of 0.01 each timestep to simulate" << std::endl;
         return 0;
     }
 
-    else{
+    // The timestep and length of time are required
+    else if (command_line.numPositional() < 2) {
+        std::cerr << "Expected 2 arguments (dt, len_time), got " << command_line.numPositional() << ", see --help" << std::endl;
+        return 1;
+    }
+
+    // Bad values and unknown flags are reported instead of ending the program with an exception
+    try {
+        command_line.requireKnownOptions({"integrator", "eta", "engine"});
 
         // Parse command line arguments for timestep and simulation length
-        double dt = std::atof(argv[1]);
-        double len_time = std::atof(argv[2]);
+        double dt = std::atof(command_line.positional()[0].c_str());
+        double len_time = std::atof(command_line.positional()[1].c_str());
         double tot_timestpes = len_time * ((2 * M_PI)/dt);
 
         // Initialize the simulator with the solar system generator
         n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::SolarSystemGenerator>());
-        std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
-        std::vector<double> kinetic_energy_list = simulator.kineticEnergy(particle_list);
-        std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_list);
+        n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+        n_body::ForceEngine force_engine;
+        n_body::IntegratorScheme scheme = n_body::parseIntegratorScheme(command_line.option("integrator", "euler"));
+        n_body::Integrator integrator(scheme);
+        n_body::SolarSystemEngine engine = n_body::parseSolarSystemEngine(command_line.option("engine", "fixed"));
+        bool fixed = engine == n_body::SolarSystemEngine::Fixed && n_body::SolarSystem::supports(scheme);
+        integrator.setTimestepAccuracy(command_line.optionDouble("eta", 0.01));
+        std::vector<double> kinetic_energy_list = simulator.kineticEnergy(particle_system);
+        std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_system);
         std::vector<double> total_energy_list = simulator.totalEnergy();
         double sum_total_energy = simulator.sumTotalEnergy();
 
@@ -43,24 +66,23 @@ int main(int argc, char* argv[]) {
         // Start the timer
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        std::vector<n_body::particleAcceleration*> particle_ptr_list;
-        for (auto& p : particle_list) {
-            particle_ptr_list.push_back(&p);
+        // All steps on the unrolled nine-body engine when it supports the scheme
+        long body_evaluations = 0;
+        if (fixed) {
+            n_body::SolarSystem solar_system(particle_system);
+            solar_system.run(scheme, dt, static_cast<long>(std::ceil(tot_timestpes)));
+            solar_system.copyTo(particle_system);
+            body_evaluations = solar_system.getForceEvaluations() * static_cast<long>(particle_system.size());
         }
-
-        for (int timestep = 0; timestep < tot_timestpes; ++timestep){
-            // Update gravitational acceleration for all bodies
-            for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                p_i->sumAcceleration(particle_ptr_list);
-            } 
-
-            // Update position and velocity of each body
-            for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                p_i->update(dt);
-            }
+        for (int timestep = 0; !fixed && timestep < tot_timestpes; ++timestep){
+            // Update the acceleration, position and velocity of each body
+            integrator.step(particle_system, force_engine, dt);
+        }
+        if (!fixed) {
+            body_evaluations = integrator.getBodyEvaluations();
         }
-        std::vector<double> kinetic_energy_list_final = simulator.kineticEnergy(particle_list);
-        std::vector<double> potential_energy_list_final = simulator.potentialEnergy(particle_list);
+        std::vector<double> kinetic_energy_list_final = simulator.kineticEnergy(particle_system);
+        std::vector<double> potential_energy_list_final = simulator.potentialEnergy(particle_system);
         std::vector<double> total_energy_list_final = simulator.totalEnergy();
         double sum_total_energy_final = simulator.sumTotalEnergy();
 
@@ -72,7 +94,8 @@ int main(int argc, char* argv[]) {
         double total_time = elapsed_time.count();
         double avg_time_per_timestep = total_time / tot_timestpes;
         std::cout << "\n" <<"Total time: " << total_time/60 << " mins" << std::endl;
-        std::cout << "Average time per timestep: " << avg_time_per_timestep << " seconds" << std::endl;
+        std::cout << "Average time per timestep: " << avg_time_per_timestep << " seconds (" << 1.0 / avg_time_per_timestep << " steps per second, " << (fixed ? "fixed" : "generic") << " engine)" << std::endl;
+        std::cout << "Force evaluations per body: " << body_evaluations / static_cast<double>(particle_system.size()) << std::endl;
         std::cout << std::endl;
         std::cout << "Final Energy: " << std::endl;
         for (int i = 0; i < total_energy_list.size(); ++i) {
@@ -82,5 +105,9 @@ int main(int argc, char* argv[]) {
         std::cout << "sum of total energy: " << sum_total_energy_final << " total energy drop: " << 100 * (sum_total_energy_final - sum_total_energy)/sum_total_energy << "%" << std::endl;
 
     }
+    catch (const std::exception& error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return 1;
+    }
 
 }
@@ -2,157 +2,793 @@
 #include <Eigen/Core>
 #include <chrono>
 #include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cmath>
 #include <omp.h>
+#include <sys/resource.h>
 #include "systemSimulator.hpp"
+#include "forceEngine.hpp"
+#include "commandLine.hpp"
+#include "tiledKernel.hpp"
+#include "mixedKernel.hpp"
+#include "integrator.hpp"
+#include "energyDiagnostics.hpp"
+#include "persistentStepper.hpp"
+#include "trajectory.hpp"
+#include "checkpoint.hpp"
+#include "fileSystemGenerator.hpp"
+#include "philoxGenerator.hpp"
+#include "profiler.hpp"
+#include "scalingStudy.hpp"
+#include "ensemble.hpp"
+#include "spatialSort.hpp"
+
+// Files written or read by a run of runRandomSystem.
+struct RunFiles {
+    // Initial conditions file read instead of generating the random system
+    std::string initial;
+
+    // Trajectory frames every output_every steps, with values of the given precision
+    std::string trajectory;
+    int output_every;
+    n_body::TrajectoryPrecision precision;
+
+    // Checkpoints every checkpoint_every steps, and the checkpoint to continue from
+    std::string checkpoint;
+    int checkpoint_every;
+    std::string restart;
+
+    // Per-phase profile of the run, JSON or CSV by extension (needs a build with NBODY_PROFILING)
+    std::string profile;
+};
+
+// Path of the file of one system size: the size goes before the extension, so out.csv becomes out.64.csv
+// and keeps the format chosen by its extension.
+std::string sizedPath(const std::string& path, int num_particles) {
+    if (path.empty()) {
+        return path;
+    }
+    const std::size_t name = path.find_last_of('/') == std::string::npos ? 0 : path.find_last_of('/') + 1;
+    std::size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || dot <= name) {
+        dot = path.size();
+    }
+    return path.substr(0, dot) + "." + std::to_string(num_particles) + path.substr(dot);
+}
+
+// Settings of a run of runRandomSystem.
+struct RunOptions {
+    // Integrator, with the timestep accuracy of block steps
+    n_body::IntegratorScheme scheme;
+    double eta;
+
+    // Bodies used to report the force error of approximate kernels against direct summation
+    int error_samples;
+
+    // Total energy printed every energy_every steps, 0 for never
+    int energy_every;
+
+    // All steps inside one parallel region (direct summation only)
+    bool persistent;
+
+    // Distribution of the parallel Philox generator ("disc", "plummer" or "clumps"), empty for the random generator
+    std::string distribution;
+
+    // Keep the bodies sorted in memory along a space-filling curve, with the settings of SpatialSorter
+    bool reorder;
+    n_body::SpaceFillingCurve curve;
+    long reorder_every;
+    double reorder_degradation;
+};
+
+// Peak resident memory of the program in megabytes (ru_maxrss is in kilobytes on Linux).
+double peakResidentMegabytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+// Print the time, throughput and thread imbalance of every phase, and write the report as CSV if the
+// path ends in .csv, JSON otherwise.
+void reportProfile(const std::string& path) {
+    n_body::ProfileReport report = n_body::Profiler::global().report();
+    std::cout << "Profile (" << report.wall_seconds << " s wall):" << std::endl;
+    for (const n_body::PhaseProfile& phase : report.phases) {
+        if (phase.calls == 0) {
+            continue;
+        }
+        std::cout << "  " << n_body::profilePhaseName(phase.phase) << ": " << phase.seconds << " s (" << 100 * phase.seconds / report.wall_seconds << "%), "
+                  << phase.calls << " calls";
+        if (phase.seconds > 0.0 && phase.flops > 0.0) {
+            std::cout << ", " << phase.flops / phase.seconds / 1e9 << " GFLOP/s";
+        }
+        if (phase.seconds > 0.0 && phase.bytes > 0.0) {
+            std::cout << ", " << phase.bytes / phase.seconds / 1e9 << " GB/s";
+        }
+        if (phase.threads > 0) {
+            std::cout << ", " << phase.threads << " threads busy " << phase.min_thread_seconds << " to " << phase.max_thread_seconds
+                      << " s (imbalance " << phase.max_thread_seconds / phase.mean_thread_seconds << ")";
+        }
+        std::cout << std::endl;
+    }
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+        n_body::writeProfileCsv(path, report);
+    }
+    else {
+        n_body::writeProfileJson(path, report);
+    }
+    std::cout << "Profile written to " << path << std::endl;
+}
+
+// Simulate a random system of num_particles bodies and print its timing and energy drop.
+// The settings of the run are described by RunOptions and its files by RunFiles.
+void runRandomSystem(int seed, int num_particles, double dt, double tot_timestpes, n_body::ForceEngine& force_engine, const RunOptions& options, const RunFiles& files) {
+    std::unique_ptr<n_body::SpatialSorter> sorter;
+    if (options.reorder) {
+        sorter = std::make_unique<n_body::SpatialSorter>(options.curve, options.reorder_every, options.reorder_degradation);
+    }
+
+    // Initialize the system simulator with the specified number of particles, or the bodies of a file.
+    std::shared_ptr<n_body::InitialConditionGenerator> generator;
+    std::string generator_name = "random";
+    if (!files.initial.empty()) {
+        generator = std::make_shared<n_body::FileSystemGenerator>(files.initial);
+        generator_name = "file " + files.initial;
+    }
+    else if (!options.distribution.empty()) {
+        generator = std::make_shared<n_body::PhiloxSystemGenerator>(seed, num_particles, n_body::parseSystemDistribution(options.distribution));
+        generator_name = "philox " + options.distribution;
+    }
+    else {
+        generator = std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles);
+    }
+    n_body::sysSimulator simulator = n_body::sysSimulator(generator);
+
+    // Start the timer
+    auto start_time = std::chrono::high_resolution_clock::now();
+    n_body::Profiler::global().reset();
+
+    // Calculates energy values by using initial particle state, or continue from a checkpoint
+    n_body::ParticleSystem particle_system;
+    n_body::CheckpointMetadata restart;
+    n_body::IntegratorState restart_state;
+    if (files.restart.empty()) {
+        particle_system = simulator.particleSystemGenerator();
+    }
+    else {
+        restart = n_body::loadCheckpoint(files.restart, particle_system, restart_state);
+        if (restart.dt != dt || restart.epsilon != force_engine.getEpsilon() || restart.scheme != options.scheme) {
+            std::cerr << "Warning: the checkpoint was written with dt " << restart.dt << ", epsilon " << restart.epsilon << " and integrator "
+                      << n_body::integratorSchemeName(restart.scheme) << ", the run will not continue the same trajectory" << std::endl;
+        }
+        std::cout << "Restarting from step " << restart.step << " of " << restart.generator << " system (seed " << restart.seed << ", " << restart.num_generated << " particles)" << std::endl;
+    }
+    const long first_step = static_cast<long>(restart.step);
+    n_body::Integrator integrator(options.scheme);
+    integrator.setTimestepAccuracy(options.eta);
+    if (!files.restart.empty() && !options.persistent) {
+        integrator.setState(restart_state);
+    }
+    n_body::EnergyDiagnostics energy;
+    n_body::FmmSolver fmm_solver(force_engine.getExpansionOrder(), force_engine.getOpeningAngle());
+    auto totalEnergy = [&](bool from_force_pass) {
+        energy.computeKinetic(particle_system);
+        // The force pass of the integrator leaves the potentials behind, so the energy on the fly costs O(N)
+        if (from_force_pass && !options.persistent && force_engine.getComputePotential() && integrator.synchronise(particle_system, force_engine)) {
+            energy.computePotential(particle_system, particle_system.potential());
+        }
+        // The fmm kernel also gives linear-time energy diagnostics
+        else if (force_engine.getKernel() == n_body::ForceKernel::Fmm) {
+            fmm_solver.evaluate(particle_system, force_engine.getEpsilon());
+            energy.computePotential(particle_system, fmm_solver.potential().data());
+        }
+        else {
+            energy.computePotential(particle_system, force_engine.getEpsilon());
+        }
+        return energy.totalEnergy();
+    };
+    // After a restart the drop is still measured from the energy at step 0
+    double sum_total_energy = totalEnergy(false);
+    if (!files.restart.empty()) {
+        sum_total_energy = restart.initial_energy;
+    }
+    auto printEnergy = [&](long timestep) {
+        double sum_energy = totalEnergy(true);
+        std::cout << "Step " << timestep << " total energy: " << sum_energy << " drop: " << 100 * (sum_energy - sum_total_energy) / sum_total_energy << "%" << std::endl;
+    };
+
+    // Frames are copied into a buffer and written by a background thread while the steps go on
+    std::unique_ptr<n_body::TrajectoryWriter> trajectory;
+    if (!files.trajectory.empty() && files.output_every > 0) {
+        trajectory = std::make_unique<n_body::TrajectoryWriter>(files.trajectory, particle_system.size(), files.precision);
+        trajectory->write(particle_system, first_step, first_step * dt);
+    }
+
+    // Checkpoints are copied and written in the background in the same way
+    std::unique_ptr<n_body::CheckpointWriter> checkpoint;
+    n_body::CheckpointMetadata metadata;
+    if (!files.checkpoint.empty() && files.checkpoint_every > 0) {
+        checkpoint = std::make_unique<n_body::CheckpointWriter>(files.checkpoint);
+        metadata.dt = dt;
+        metadata.epsilon = force_engine.getEpsilon();
+        metadata.scheme = options.scheme;
+        metadata.generator = files.restart.empty() ? generator_name : restart.generator;
+        metadata.seed = files.restart.empty() ? seed : restart.seed;
+        metadata.num_generated = files.restart.empty() ? num_particles : restart.num_generated;
+        metadata.initial_energy = sum_total_energy;
+    }
+
+    // Energy and output after a step, when due
+    auto afterStep = [&](long timestep) {
+        // Energy on the fly, from the potentials of the force pass
+        if (options.energy_every > 0 && timestep % options.energy_every == 0) {
+            printEnergy(timestep);
+        }
+        if (trajectory && timestep % files.output_every == 0) {
+            trajectory->write(particle_system, timestep, timestep * dt);
+        }
+        if (checkpoint && timestep % files.checkpoint_every == 0) {
+            metadata.step = timestep;
+            metadata.time = timestep * dt;
+            // The persistent stepper keeps no state that cannot be evaluated again from the positions
+            checkpoint->save(particle_system, options.persistent ? n_body::IntegratorState() : integrator.getState(), metadata);
+        }
+    };
+
+    // All steps in one parallel region, split into runs that end where the energy or a frame is due
+    n_body::PersistentStepper stepper(options.persistent ? options.scheme : n_body::IntegratorScheme::Euler, force_engine.getEpsilon());
+    if (options.persistent) {
+        const long num_steps = static_cast<long>(std::ceil(tot_timestpes));
+        long done = first_step;
+        while (done < num_steps) {
+            long next = num_steps;
+            if (options.energy_every > 0) {
+                next = std::min(next, (done / options.energy_every + 1) * options.energy_every);
+            }
+            if (trajectory) {
+                next = std::min(next, (done / files.output_every + 1) * files.output_every);
+            }
+            if (checkpoint) {
+                next = std::min(next, (done / files.checkpoint_every + 1) * files.checkpoint_every);
+            }
+            stepper.run(particle_system, dt, next - done);
+            done = next;
+            afterStep(done);
+        }
+    }
+
+    for (long timestep = first_step; !options.persistent && timestep < tot_timestpes; ++timestep){
+
+        // Keep bodies that are close in space close in memory
+        if (sorter) {
+            sorter->update(particle_system, integrator);
+        }
+
+        // Update the acceleration, position and velocity of each body
+        integrator.step(particle_system, force_engine, dt);
+        afterStep(timestep + 1);
+    }
+
+    // Calculates energy values by using updated particle state
+    double sum_total_energy_final = totalEnergy(false);
+
+    // End the timer
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed_time = end_time - start_time;
+
+    // Calculate and print the total time and average time per timestep
+    double total_time = elapsed_time.count();
+    double avg_time_per_timestep = total_time / tot_timestpes;
+    std::cout << "\n" << (files.initial.empty() ? num_particles : static_cast<long>(particle_system.size())) << " number of initial particles "<< "Inital Energy: "<<std::endl;
+    std::cout <<"Total time: " << total_time/60 << " mins" << std::endl;
+    std::cout << "Average time per timestep: " << avg_time_per_timestep << " seconds" << std::endl;
+    double body_evaluations = options.persistent ? stepper.getForceEvaluations() * static_cast<double>(particle_system.size()) : integrator.getBodyEvaluations();
+    std::cout << "Force evaluations per body: " << body_evaluations / static_cast<double>(particle_system.size()) << std::endl;
+    std::cout << std::endl;
+    std::cout << "Final Energy: " << std::endl;
+    std::cout << "sum of total energy: " << sum_total_energy_final << " total energy drop: " << 100 * (sum_total_energy_final - sum_total_energy)/sum_total_energy << "%" << std::endl;
+    if (trajectory) {
+        trajectory->close();
+        std::cout << "Trajectory: " << trajectory->getFramesWritten() << " frames written to " << files.trajectory << ", " << trajectory->getWaitSeconds() << " s spent waiting for the writer" << std::endl;
+    }
+    if (sorter && !options.persistent) {
+        std::cout << "Reordering: " << sorter->getReorders() << " sorts along the " << n_body::spaceFillingCurveName(sorter->getCurve()) << " curve, "
+                  << sorter->getSeconds() << " s (" << 100 * sorter->getSeconds() / total_time << "% of the run)" << std::endl;
+    }
+    if (checkpoint) {
+        checkpoint->wait();
+        std::cout << "Checkpoints: " << checkpoint->getSaves() << " saved to " << files.checkpoint << ", " << checkpoint->getSaveSeconds() << " s spent copying the state (" << 100 * checkpoint->getSaveSeconds() / total_time << "% of the run)" << std::endl;
+    }
+    if (!files.profile.empty()) {
+        reportProfile(files.profile);
+    }
+    std::cout << "Memory usage: simulator " << simulator.memoryUsage() / (1024.0 * 1024.0) << " MB, particle system " << particle_system.memoryUsage() / (1024.0 * 1024.0) << " MB, peak resident " << peakResidentMegabytes() << " MB" << std::endl;
+
+    // Force error of the approximate kernels on the final particle state
+    if (force_engine.isApproximate() && options.error_samples > 0) {
+        force_engine.computeAcceleration(particle_system);
+        n_body::ForceError error = n_body::sampleForceError(particle_system, force_engine.getEpsilon(), options.error_samples);
+        std::cout << "Force error against direct summation (" << error.num_samples << " bodies): mean " << error.mean_relative << " max " << error.max_relative << std::endl;
+    }
+}
+
+// Time the untiled and the tiled direct-summation loops over a range of system sizes and write
+// a CSV (num_particles, untiled and tiled seconds per force evaluation, speedup) for a scaling plot.
+// The untiled loop is the tiled kernel with one tile spanning the whole system, so the only
+// difference between the two columns is the cache blocking.
+void runTileCrossover(const std::string& csv_path, double epsilon, std::size_t tile_size, int seed) {
+    std::vector<int> num_particles_list = {1024, 2048, 4096, 8192, 16384, 32768, 65536};
+    if (tile_size == 0) {
+        tile_size = n_body::detectTileSize();
+    }
+    std::ofstream csv(csv_path);
+    csv << "num_particles,untiled_seconds,tiled_seconds,speedup" << "\n";
+    std::cout << "Tile size: " << tile_size << " bodies, " << omp_get_max_threads() << " threads" << std::endl;
+
+    for (int num_particles : num_particles_list) {
+        n_body::RandomSystemGenerator generator(seed, num_particles);
+        n_body::ParticleSystem particle_system(generator.generateInitialConditions());
+
+        // Median of three force evaluations
+        auto timeKernel = [&](std::size_t tile) {
+            std::vector<double> times;
+            for (int repeat = 0; repeat < 3; ++repeat) {
+                auto start_time = std::chrono::high_resolution_clock::now();
+                n_body::tiledSumAcceleration(particle_system, epsilon, tile);
+                std::chrono::duration<double> elapsed_time = std::chrono::high_resolution_clock::now() - start_time;
+                times.push_back(elapsed_time.count());
+            }
+            std::sort(times.begin(), times.end());
+            return times[1];
+        };
+        double untiled_time = timeKernel(particle_system.size());
+        double tiled_time = timeKernel(tile_size);
+
+        csv << num_particles << "," << untiled_time << "," << tiled_time << "," << untiled_time / tiled_time << "\n";
+        std::cout << num_particles << " particles: untiled " << untiled_time << " s, tiled " << tiled_time << " s, speedup " << untiled_time / tiled_time << std::endl;
+    }
+    std::cout << "Crossover written to " << csv_path << std::endl;
+}
+
+// Compare the mixed-precision direct loop with the same loop in double over a range of system sizes and
+// write a CSV for the accuracy/throughput trade-off: seconds per force evaluation of both and of the
+// simd kernel, the fastest double kernel, the speedups over them, the force error of the mixed loop against direct summation on error_samples bodies, and the relative
+// drift of sumTotalEnergy over num_steps steps of the given integrator with each.
+void runMixedTradeoff(const std::string& csv_path, double epsilon, std::size_t tile_size, n_body::IntegratorScheme scheme, double dt, long num_steps,
+                      int error_samples, int seed) {
+    std::vector<int> num_particles_list = {1024, 2048, 4096, 8192, 16384};
+    std::ofstream csv(csv_path);
+    csv << "num_particles,double_seconds,simd_seconds,mixed_seconds,speedup_double,speedup_simd,mean_force_error,max_force_error,double_energy_drift,mixed_energy_drift" << "\n";
+    std::cout << omp_get_max_threads() << " threads, " << num_steps << " " << n_body::integratorSchemeName(scheme) << " steps of " << dt << " for the energy drift" << std::endl;
+
+    for (int num_particles : num_particles_list) {
+        n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+        n_body::ParticleSystem initial_system = simulator.particleSystemGenerator();
+        n_body::ParticleSystem particle_system = initial_system;
+
+        // Median of three force evaluations
+        auto timeKernel = [&](const std::function<void()>& run) {
+            std::vector<double> times;
+            for (int repeat = 0; repeat < 3; ++repeat) {
+                auto start_time = std::chrono::high_resolution_clock::now();
+                run();
+                std::chrono::duration<double> elapsed_time = std::chrono::high_resolution_clock::now() - start_time;
+                times.push_back(elapsed_time.count());
+            }
+            std::sort(times.begin(), times.end());
+            return times[1];
+        };
+        double double_time = timeKernel([&]() { n_body::precisionSumAcceleration<double>(particle_system, epsilon, tile_size); });
+        double simd_time = timeKernel([&]() { n_body::simdSumAcceleration(particle_system, epsilon); });
+        double mixed_time = timeKernel([&]() { n_body::precisionSumAcceleration<float>(particle_system, epsilon, tile_size); });
+        n_body::ForceError error = n_body::sampleForceError(particle_system, epsilon, error_samples, seed);
+
+        // Relative change of the total energy of the double loop (tiled kernel) and the mixed loop
+        auto energyDrift = [&](n_body::ForceKernel kernel) {
+            particle_system = initial_system;
+            n_body::ForceEngine force_engine(kernel, epsilon);
+            force_engine.setTileSize(tile_size);
+            n_body::Integrator integrator(scheme);
+            auto totalEnergy = [&]() {
+                simulator.kineticEnergyPara(particle_system);
+                simulator.potentialEnergyPara(particle_system, epsilon);
+                simulator.totalEnergy();
+                return simulator.sumTotalEnergy();
+            };
+            double initial_energy = totalEnergy();
+            for (long step = 0; step < num_steps; ++step) {
+                integrator.step(particle_system, force_engine, dt);
+            }
+            return (totalEnergy() - initial_energy) / std::abs(initial_energy);
+        };
+        double double_drift = energyDrift(n_body::ForceKernel::Tiled);
+        double mixed_drift = energyDrift(n_body::ForceKernel::Mixed);
+
+        csv << num_particles << "," << double_time << "," << simd_time << "," << mixed_time << "," << double_time / mixed_time << "," << simd_time / mixed_time << "," << error.mean_relative << "," << error.max_relative
+            << "," << double_drift << "," << mixed_drift << "\n";
+        std::cout << num_particles << " particles: double " << double_time << " s, simd " << simd_time << " s, mixed " << mixed_time << " s, speedup "
+                  << double_time / mixed_time << " over double, " << simd_time / mixed_time << " over simd"
+                  << ", force error mean " << error.mean_relative << " max " << error.max_relative << ", energy drift double " << double_drift << " mixed " << mixed_drift << std::endl;
+    }
+    std::cout << "Trade-off written to " << csv_path << std::endl;
+}
+
+// Random disc of num_particles bodies with seven in eight of them pulled into four tight clumps,
+// so the tree walks of the bodies differ widely in cost.
+n_body::ParticleSystem clusteredSystem(int seed, int num_particles) {
+    n_body::RandomSystemGenerator generator(seed, num_particles);
+    n_body::ParticleSystem particle_system(generator.generateInitialConditions());
+    std::vector<Eigen::Vector3d> centres;
+    for (int c = 0; c < 4 && c < num_particles; ++c) {
+        centres.push_back(particle_system.getPosition(c));
+    }
+    for (int i = 0; i < num_particles; ++i) {
+        if (i % 8 != 0) {
+            const Eigen::Vector3d& centre = centres[i % centres.size()];
+            particle_system.uploadPosition(i, centre + 0.01 * (particle_system.getPosition(i) - centre));
+        }
+    }
+    return particle_system;
+}
+
+// Time the Barnes-Hut force pass and the potential energy double loop on clustered bodies with
+// OpenMP scheduling and with the work-stealing pool, printing the counters of the pool.
+void runScheduleComparison(n_body::ForceEngine& force_engine, int seed) {
+    std::vector<int> num_particles_list = {4096, 8192, 16384};
+    std::cout << omp_get_max_threads() << " threads, opening angle " << force_engine.getOpeningAngle() << std::endl;
+
+    for (int num_particles : num_particles_list) {
+        n_body::ParticleSystem particle_system = clusteredSystem(seed, num_particles);
+        n_body::ForceEngine tree_engine(n_body::ForceKernel::BarnesHut, force_engine.getEpsilon());
+        tree_engine.setOpeningAngle(force_engine.getOpeningAngle());
+        n_body::EnergyDiagnostics energy;
+
+        // Median of three runs
+        auto median = [](const std::function<void()>& run) {
+            std::vector<double> times;
+            for (int repeat = 0; repeat < 3; ++repeat) {
+                auto start_time = std::chrono::high_resolution_clock::now();
+                run();
+                std::chrono::duration<double> elapsed_time = std::chrono::high_resolution_clock::now() - start_time;
+                times.push_back(elapsed_time.count());
+            }
+            std::sort(times.begin(), times.end());
+            return times[1];
+        };
+        auto forcePass = [&]() { tree_engine.computeAcceleration(particle_system); };
+        auto potentialPass = [&]() { energy.computePotential(particle_system, force_engine.getEpsilon()); };
+
+        double force_openmp = median(forcePass);
+        double potential_openmp = median(potentialPass);
+        tree_engine.setWorkStealing(true);
+        energy.setTaskPool(tree_engine.getTaskPool());
+        tree_engine.getTaskPool()->resetStatistics();
+        double force_stealing = median(forcePass);
+        double potential_stealing = median(potentialPass);
+        n_body::TaskPoolStatistics statistics = tree_engine.getTaskPool()->statistics();
+
+        std::cout << num_particles << " clustered particles: bh force " << force_openmp << " s (openmp) " << force_stealing << " s (stealing), "
+                  << "potential " << potential_openmp << " s (openmp) " << potential_stealing << " s (stealing), "
+                  << statistics.tasks << " tasks, " << statistics.steals << " steals, " << statistics.failed_steals << " failed steals" << std::endl;
+    }
+}
+
+// Advance num_systems independent systems that differ only in seed, seed + k for system k, together
+// in an ensemble, then one at a time with the integrator and force engine for comparison. Prints the
+// throughput of both in systems x steps per second and the mean and largest relative energy drift,
+// and writes the drift of every system as CSV if csv_path is not empty.
+void runEnsemble(const std::string& csv_path, int num_systems, const std::string& system, int num_particles, double epsilon, n_body::IntegratorScheme scheme,
+                 double dt, long num_steps, n_body::ForceEngine& force_engine, int seed) {
+    if (num_systems < 1) {
+        throw std::invalid_argument("--ensemble needs at least one system");
+    }
+    if (system != "random" && system != "solar") {
+        throw std::invalid_argument("Unknown ensemble system: " + system + " (expected random or solar)");
+    }
+    std::vector<n_body::ParticleSystem> systems;
+    for (int k = 0; k < num_systems; ++k) {
+        std::shared_ptr<n_body::InitialConditionGenerator> generator;
+        if (system == "solar") {
+            generator = std::make_shared<n_body::SolarSystemGenerator>(seed + k);
+        }
+        else {
+            generator = std::make_shared<n_body::RandomSystemGenerator>(seed + k, num_particles);
+        }
+        systems.emplace_back(generator->generateInitialConditions());
+    }
+
+    n_body::Ensemble ensemble(systems, epsilon);
+    std::vector<double> initial_energy = ensemble.totalEnergy();
+    auto start_time = std::chrono::high_resolution_clock::now();
+    ensemble.run(scheme, dt, num_steps);
+    std::chrono::duration<double> ensemble_time = std::chrono::high_resolution_clock::now() - start_time;
+    std::vector<double> final_energy = ensemble.totalEnergy();
+
+    // The same systems one at a time
+    start_time = std::chrono::high_resolution_clock::now();
+    for (n_body::ParticleSystem& particle_system : systems) {
+        n_body::Integrator integrator(scheme);
+        for (long step = 0; step < num_steps; ++step) {
+            integrator.step(particle_system, force_engine, dt);
+        }
+    }
+    std::chrono::duration<double> single_time = std::chrono::high_resolution_clock::now() - start_time;
+
+    double mean_drift = 0.0, max_drift = 0.0;
+    std::ofstream csv;
+    if (!csv_path.empty()) {
+        csv.open(csv_path);
+        csv << std::setprecision(9);
+        csv << "system,seed,initial_energy,final_energy,drift" << "\n";
+    }
+    for (int k = 0; k < num_systems; ++k) {
+        double drift = (final_energy[k] - initial_energy[k]) / std::abs(initial_energy[k]);
+        mean_drift += std::abs(drift) / num_systems;
+        max_drift = std::max(max_drift, std::abs(drift));
+        if (csv.is_open()) {
+            csv << k << "," << seed + k << "," << initial_energy[k] << "," << final_energy[k] << "," << drift << "\n";
+        }
+    }
+
+    double system_steps = static_cast<double>(num_systems) * num_steps;
+    std::cout << omp_get_max_threads() << " threads, " << num_systems << " " << system << " systems of " << ensemble.numBodies() << " bodies, " << num_steps << " "
+              << n_body::integratorSchemeName(scheme) << " steps of " << dt << std::endl;
+    std::cout << "Ensemble: " << ensemble_time.count() << " s, " << system_steps / ensemble_time.count() << " system steps per second" << std::endl;
+    std::cout << "One at a time (" << n_body::forceKernelName(force_engine.getKernel()) << " kernel): " << single_time.count() << " s, "
+              << system_steps / single_time.count() << " system steps per second, speedup " << single_time.count() / ensemble_time.count() << std::endl;
+    std::cout << "Relative energy drift: mean " << mean_drift << ", max " << max_drift << std::endl;
+    if (csv.is_open()) {
+        std::cout << "Ensemble drifts written to " << csv_path << std::endl;
+    }
+}
+
+// Time integrator steps over thread counts and system sizes for a strong or weak scaling study,
+// printing the median seconds per step, speedup and parallel efficiency of every point and writing
+// them as CSV if the output path ends in .csv, JSON otherwise.
+void runScaling(const n_body::CommandLine& command_line, n_body::ForceEngine& force_engine, n_body::IntegratorScheme scheme, double dt) {
+    n_body::ScalingOptions options;
+    options.mode = n_body::parseScalingMode(command_line.option("scaling"));
+    options.scheme = scheme;
+    options.dt = dt;
+
+    // Powers of two up to the OpenMP thread count by default, and that count itself
+    std::vector<long> default_threads;
+    for (long p = 1; p < omp_get_max_threads(); p *= 2) {
+        default_threads.push_back(p);
+    }
+    default_threads.push_back(omp_get_max_threads());
+    std::vector<long> default_sizes = {1024, 4096};
+    if (command_line.numPositional() == 4) {
+        default_sizes = {std::stol(command_line.positional()[3])};
+    }
+    options.sizes = command_line.optionList("sizes", default_sizes);
+    options.threads.clear();
+    for (long p : command_line.optionList("threads", default_threads)) {
+        options.threads.push_back(static_cast<int>(p));
+    }
+    options.binding = n_body::parseThreadBinding(command_line.option("bind", "none"));
+    options.warmup_steps = command_line.optionInt("warmup", 1);
+    options.repeats = command_line.optionInt("repeats", 5);
+    options.steps = command_line.optionInt("steps", 5);
+
+    n_body::ScalingReport report = n_body::runScalingStudy(options, force_engine);
+    std::cout << n_body::scalingModeName(options.mode) << " scaling, kernel " << report.kernel << ", integrator " << n_body::integratorSchemeName(scheme)
+              << ", binding " << n_body::threadBindingName(options.binding) << ", " << report.num_procs << " processors" << std::endl;
+    for (const n_body::ScalingPoint& point : report.points) {
+        std::cout << point.threads << " threads, " << point.num_bodies << " particles: " << point.median_seconds << " s per step (min " << point.min_seconds
+                  << ", max " << point.max_seconds << "), speedup " << point.speedup << ", efficiency " << point.efficiency << std::endl;
+    }
+    const std::string path = command_line.option("scaling_out", "");
+    if (!path.empty()) {
+        if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+            n_body::writeScalingCsv(path, report);
+        }
+        else {
+            n_body::writeScalingJson(path, report);
+        }
+        std::cout << "Scaling results written to " << path << std::endl;
+    }
+}
+
+// Flags of the program, all listed by printUsage.
+const std::vector<std::string> known_options = {
+    "kernel", "simd", "theta", "order", "tile", "integrator", "eta", "mixed_tradeoff", "crossover", "energy_every", "loop", "schedule",
+    "trajectory", "output_every", "precision", "distribution", "reorder", "reorder_every", "reorder_degradation", "initial", "checkpoint",
+    "checkpoint_every", "restart", "profile", "scaling", "threads", "sizes", "bind", "warmup", "repeats", "steps", "scaling_out",
+    "ensemble", "ensemble_system", "ensemble_out", "error_samples"};
+
+// Usage instructions of the program.
+void printUsage(std::ostream& out) {
+    out << "Usage: solarSystemSimulator [options]" << "\n";
+    out << "Options:" << "\n";
+    out << "  -h, --help      Display this help message" << "\n";
+    out << "  -dt <float><value>     Set the timestep for the simulation" << "\n";
+    out << "  -len_time <float><years>  Set the total length of time to simulate" << "\n";
+    out << "  -epsilon <float><softening factor>     Set the epsilon for the simulation" << "\n";
+    out << "  -num_particles <integer><number of inital particles>     Set the number of inital particles for the simulation" << "\n";
+    out << "  --kernel <direct|simd|symmetric|tiled|bh|fmm|mixed>     Select the force kernel (default direct)" << "\n";
+    out << "  --simd <auto|scalar|avx2|avx512>     Select the instruction set of the simd kernel (default auto)" << "\n";
+    out << "  --kernel bh --theta <float>     Barnes-Hut octree kernel with opening angle theta (default 0.5)" << "\n";
+    out << "  --kernel fmm --order <integer>     Fast multipole kernel with expansion order p (default 4), also used for the energies" << "\n";
+    out << "  --kernel tiled --tile <integer>     Cache-blocked direct kernel with the given tile size in bodies (default detected from the L1 cache)" << "\n";
+    out << "  --integrator <euler|leapfrog|verlet|yoshida4|hermite|block>     Select the time integration scheme (default euler)" << "\n";
+    out << "  --integrator block --eta <float>     Individual power-of-two timesteps of at most dt, each at most eta |a| / |jerk| (default 0.01)" << "\n";
+    out << "  --kernel mixed     Cache-blocked direct kernel with float pair terms and double sums, for large low-accuracy runs" << "\n";
+    out << "  --mixed_tradeoff <file.csv>     Time the mixed and double direct loops for 1024 to 16384 particles, with the force error and the energy drift over the given length of time, and write a CSV" << "\n";
+    out << "  --crossover <file.csv>     Time the untiled and tiled direct loops for 1024 to 65536 particles and write a CSV" << "\n";
+    out << "  --energy_every <integer>     Print the total energy every given number of steps, from the potentials of the force pass (default 0, off)" << "\n";
+    out << "  --loop <steps|persistent>     Fork threads for every force pass, or run all steps in one parallel region with direct summation and euler, leapfrog or verlet (default steps)" << "\n";
+    out << "  --schedule <openmp|stealing|compare>     Share irregular per-body work out with OpenMP loops or a work-stealing pool (default openmp); compare times both on clustered bodies" << "\n";
+    out << "  --trajectory <file> --output_every <integer>     Stream positions and velocities to a binary trajectory file every given number of steps, written in the background (default off, every 100 steps)" << "\n";
+    out << "  --precision <32|64>     Store trajectory values as float32 or float64 (default 64)" << "\n";
+    out << "  --distribution <disc|plummer|clumps>     Draw the bodies in parallel with a counter-based generator: the random disc, a Plummer sphere or cold clumps (default: the sequential random disc)" << "\n";
+    out << "  --reorder <none|morton|hilbert>     Keep the bodies sorted in memory along a space-filling curve, body ids and output order stay the same (default none)" << "\n";
+    out << "  --reorder_every <integer> --reorder_degradation <float>     Sort every given number of steps, or when the mean distance between bodies next in memory has grown by the given factor since the last sort (default 0, 2)" << "\n";
+    out << "  --initial <file>     Read the bodies from a CSV (x,y,z,vx,vy,vz,mass per line) or binary initial conditions file instead of the random system" << "\n";
+    out << "  --checkpoint <file> --checkpoint_every <integer>     Save the full state every given number of steps, written in the background (default off, every 1000 steps)" << "\n";
+    out << "  --restart <file>     Continue a run from a checkpoint, with the same arguments as the run that wrote it" << "\n";
+    out << "  --profile <file.json|file.csv>     Write the time, flops, bytes and thread imbalance of the force, integration, energy and output phases (needs cmake -DNBODY_PROFILING=ON)" << "\n";
+    out << "  --scaling <strong|weak>     Time steps over thread counts and sizes instead of simulating, weak scaling grows the sizes with the threads" << "\n";
+    out << "  --threads <list> --sizes <list>     Comma-separated thread counts (default powers of two up to the OpenMP maximum) and sizes (default the given number of particles, or 1024,4096)" << "\n";
+    out << "  --bind <none|close|spread>     Pin the threads of each scaling point to neighbouring or spread-out CPUs (default none)" << "\n";
+    out << "  --warmup <integer> --repeats <integer> --steps <integer>     Untimed steps, then timed repeats of the given number of steps, the median is reported (default 1, 5, 5)" << "\n";
+    out << "  --scaling_out <file.json|file.csv>     Write the scaling results with speedup and parallel efficiency" << "\n";
+    out << "  --ensemble <integer>     Advance the given number of systems with seeds seed, seed + 1, ... together, with euler, leapfrog, verlet or yoshida4, and compare with simulating them one at a time" << "\n";
+    out << "  --ensemble_system <random|solar>     Systems of the ensemble: random discs of the given number of particles (default 8) or the Solar System with random planet phases (default random)" << "\n";
+    out << "  --ensemble_out <file.csv>     Write the initial and final energy and the relative drift of every system of the ensemble" << "\n";
+    out << "  --error_samples <integer>     Number of bodies used to report the bh/fmm force error against direct summation (default 100)" << "\n";
+    out << "  For example_1: solarSystemSimulator 0.01 100 0.001" << "\n";
+    out << "  This mean 100 years of 0.01 each timestep to simulate at epsilon equal to 0.001" << "\n";
+    out << "  For example_2: solarSystemSimulator 0.01 100 0.001 2048" << "\n";
+    out << "  This mean 100 years of 0.01 each timestep to simulate 2048 particles at epsilon equal to 0.001" << "\n";
+    out << "  For example_3: solarSystemSimulator 0.01 100 0.001 2048 --kernel simd" << "\n";
+    out << "  This mean the same simulation as example_2 using the vectorised force kernel" << std::endl;
+}
 
 // This program simulates an n-body solar system using parallel programming techniques.
 // It accepts command line arguments for time step size, total simulation time, softening factor epsilon value, and the number of initial particles.
 int main(int argc, char* argv[]) {
 
+    n_body::CommandLine command_line(argc, argv);
+
     // If no arguments are provided or the user requests help, display usage instructions.
     if (argc == 1 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"){
-        std::cout << "Usage: solarSystemSimulator [options]" << "\n";
-        std::cout << "Options:" << "\n";
-        std::cout << "  -h, --help      Display this help message" << "\n";
-        std::cout << "  -dt <float><value>     Set the timestep for the simulation" << "\n";
-        std::cout << "  -len_time <float><years>  Set the total length of time to simulate" << "\n";
-        std::cout << "  -epsilon <float><softening factor>     Set the epsilon for the simulation" << "\n";
-        std::cout << "  -num_particles <integer><number of inital particles>     Set the number of inital particles for the simulation" << "\n";
-        std::cout << "  For example_1: solarSystemSimulator 0.01 100 0.001" << "\n";
-        std::cout << "  This mean 100 years of 0.01 each timestep to simulate at epsilon equal to 0.001" << "\n";
-        std::cout << "  For example_2: solarSystemSimulator 0.01 100 0.001 2048" << "\n";
-        std::cout << "  This mean 100 years of 0.01 each timestep to simulate 2048 particles at epsilon equal to 0.001" << std::endl;
+        printUsage(std::cout);
         return 0;
     }
 
-    else{
+    // The timestep, length of time and epsilon are required
+    else if (command_line.numPositional() < 3) {
+        std::cerr << "Expected at least 3 arguments (dt, len_time, epsilon), got " << command_line.numPositional() << "\n\n";
+        printUsage(std::cerr);
+        return 1;
+    }
+
+    // Bad values and unknown flags are reported instead of ending the program with an exception
+    try {
+        command_line.requireKnownOptions(known_options);
 
         // Create a list of default particle numbers for benchmarking.
         std::vector<int> num_particles_list = {8, 64, 256, 1024, 2048};
-        double dt = std::atof(argv[1]);
-        double len_time = std::atof(argv[2]);
+        const std::vector<std::string>& args = command_line.positional();
+        double dt = std::atof(args[0].c_str());
+        double len_time = std::atof(args[1].c_str());
         double tot_timestpes = len_time * ((2 * M_PI)/dt);
-        double epsilon = std::atof(argv[3]);
+        double epsilon = std::atof(args[2].c_str());
         int seed = 42; // Developer can modify seed value here, set as default number 42
 
-        // If the user provides the number of particles as an argument,
-        // run the simulation with the specified number of particles.
-        if (argc == 5) {
-            
-            // Start the timer
-            auto start_time = std::chrono::high_resolution_clock::now();
-
-            // Calculates energy values by using initial particle state
-            int num_particles = std::stoi(argv[4]);
-            n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
-            std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
-            std::vector<double> kinetic_energy_list = simulator.kineticEnergy(particle_list);
-            std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_list);
-            std::vector<double> total_energy_list = simulator.totalEnergy();
-            double sum_total_energy = simulator.sumTotalEnergy();
-            
-            // Create a vector of pointers to particleAcceleration objects
-            std::vector<n_body::particleAcceleration*> particle_ptr_list;
-            for (auto& p : particle_list) {
-                particle_ptr_list.push_back(&p);
-            }
+        // Select the force kernel used in the timestep loop
+        n_body::ForceEngine force_engine(n_body::parseForceKernel(command_line.option("kernel", "direct")), epsilon);
+        force_engine.setSimdPath(n_body::parseSimdPath(command_line.option("simd", "auto")));
+        force_engine.setOpeningAngle(command_line.optionDouble("theta", 0.5));
+        force_engine.setExpansionOrder(command_line.optionInt("order", 4));
+        force_engine.setTileSize(command_line.optionInt("tile", 0));
+        // The force pass accumulates the potentials only when the energy is sampled on the fly
+        int energy_every = command_line.optionInt("energy_every", 0);
+        force_engine.setComputePotential(energy_every > 0);
+        bool persistent = command_line.option("loop", "steps") == "persistent";
+        std::string schedule = command_line.option("schedule", "openmp");
+        force_engine.setWorkStealing(schedule == "stealing");
+        if (persistent && force_engine.getKernel() != n_body::ForceKernel::Direct) {
+            std::cerr << "--loop persistent uses its own direct summation, --kernel is ignored" << std::endl;
+        }
+        int error_samples = command_line.optionInt("error_samples", 100);
+        n_body::IntegratorScheme scheme = n_body::parseIntegratorScheme(command_line.option("integrator", "euler"));
+        double eta = command_line.optionDouble("eta", 0.01);
+        RunFiles files;
+        files.trajectory = command_line.option("trajectory", "");
+        files.output_every = command_line.optionInt("output_every", 100);
+        files.precision = command_line.optionInt("precision", 64) == 32 ? n_body::TrajectoryPrecision::Float32 : n_body::TrajectoryPrecision::Float64;
+        files.checkpoint = command_line.option("checkpoint", "");
+        files.checkpoint_every = command_line.optionInt("checkpoint_every", 1000);
+        files.restart = command_line.option("restart", "");
+        files.initial = command_line.option("initial", "");
+        files.profile = command_line.option("profile", "");
+        if (!files.profile.empty() && !n_body::profiling_enabled) {
+            std::cerr << "--profile needs a build with cmake -DNBODY_PROFILING=ON, no profile will be written" << std::endl;
+            files.profile.clear();
+        }
+        std::string distribution = command_line.option("distribution", "");
 
-            for (int timestep = 0; timestep < tot_timestpes; ++timestep){
-
-                // developer can uncomment the codes blow to parallelise the loop. 
-                // Update gravitational acceleration for all body
-                #pragma omp parallel for
-                for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                    p_i->sumAcceleration(particle_ptr_list);
-                } 
-
-                // developer can uncomment the codes blow to parallelise the loop. 
-                // Update position and velocity of each body
-                #pragma omp parallel for
-                for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                    p_i->update(dt);
-                }
-            }
+        RunOptions options;
+        options.scheme = scheme;
+        options.eta = eta;
+        options.error_samples = error_samples;
+        options.energy_every = energy_every;
+        options.persistent = persistent;
+        options.distribution = distribution;
+
+        // Sort the bodies along a space-filling curve as they move
+        std::string reorder = command_line.option("reorder", "none");
+        options.reorder = reorder != "none";
+        options.curve = options.reorder ? n_body::parseSpaceFillingCurve(reorder) : n_body::SpaceFillingCurve::Hilbert;
+        options.reorder_every = command_line.optionInt("reorder_every", 0);
+        options.reorder_degradation = command_line.optionDouble("reorder_degradation", 2.0);
+        if (options.reorder && persistent) {
+            std::cerr << "--loop persistent does not reorder the bodies, --reorder is ignored" << std::endl;
+        }
+        if (force_engine.getKernel() == n_body::ForceKernel::Simd) {
+            n_body::SimdPath path = command_line.hasOption("simd") ? n_body::parseSimdPath(command_line.option("simd")) : n_body::detectSimdPath();
+            std::cout << "Force kernel: simd (" << n_body::simdPathName(path) << ")" << std::endl;
+        }
 
-            // Calculates energy values by using updated particle state
-            std::vector<double> kinetic_energy_list_final = simulator.kineticEnergy(particle_list);
-            std::vector<double> potential_energy_list_final = simulator.potentialEnergy(particle_list);
-            std::vector<double> total_energy_list_final = simulator.totalEnergy();
-            double sum_total_energy_final = simulator.sumTotalEnergy();
+        // Benchmark the scheduling of irregular work instead of simulating
+        if (schedule == "compare") {
+            runScheduleComparison(force_engine, seed);
+        }
 
-            // End the timer
-            auto end_time = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double> elapsed_time = end_time - start_time;
+        // Strong or weak scaling study instead of simulating
+        else if (command_line.hasOption("scaling")) {
+            runScaling(command_line, force_engine, scheme, dt);
+        }
+
+        // Many independent small systems advanced together instead of one simulation
+        else if (command_line.hasOption("ensemble")) {
+            int num_particles = command_line.numPositional() == 4 ? std::stoi(args[3]) : 8;
+            runEnsemble(command_line.option("ensemble_out", ""), command_line.optionInt("ensemble", 1), command_line.option("ensemble_system", "random"), num_particles,
+                        epsilon, scheme, dt, static_cast<long>(std::ceil(tot_timestpes)), force_engine, seed);
+        }
 
-            // Calculate and print the total time and average time per timestep
-            double total_time = elapsed_time.count();
-            double avg_time_per_timestep = total_time / tot_timestpes;
-            std::cout << "\n" << num_particles << " number of initial particles "<< "Inital Energy: "<<std::endl;
-            std::cout <<"Total time: " << total_time/60 << " mins" << std::endl;
-            std::cout << "Average time per timestep: " << avg_time_per_timestep << " seconds" << std::endl;
-            std::cout << std::endl;
-            std::cout << "Final Energy: " << std::endl;
-            std::cout << "sum of total energy: " << sum_total_energy_final << " total energy drop: " << 100 * (sum_total_energy_final - sum_total_energy)/sum_total_energy << "%" << std::endl;
-            
+        // Accuracy and throughput of the mixed-precision direct loop instead of simulating
+        else if (command_line.hasOption("mixed_tradeoff")) {
+            runMixedTradeoff(command_line.option("mixed_tradeoff"), epsilon, force_engine.getTileSize(), scheme, dt, static_cast<long>(std::ceil(tot_timestpes)), error_samples, seed);
+        }
+
+        // Benchmark the cache blocking of the direct loop instead of simulating
+        else if (command_line.hasOption("crossover")) {
+            runTileCrossover(command_line.option("crossover"), epsilon, force_engine.getTileSize(), seed);
+        }
+
+        // If the user provides the number of particles as an argument,
+        // run the simulation with the specified number of particles.
+        else if (command_line.numPositional() == 4) {
+            int num_particles = std::stoi(args[3]);
+            runRandomSystem(seed, num_particles, dt, tot_timestpes, force_engine, options, files);
         }
 
         // If the user doesn't provide the number of particles as an argument,
         // run the simulation for a range of particle numbers to benchmark performance.
         else{
             for (int num_particles : num_particles_list){
-
-                // Initialize the system simulator with the specified number of particles.
-                n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
-                
-                // Start the timer
-                auto start_time = std::chrono::high_resolution_clock::now();
-                
-                // Calculates energy values by using initial particle state
-                std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
-                std::vector<double> kinetic_energy_list = simulator.kineticEnergy(particle_list);
-                std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_list);
-                std::vector<double> total_energy_list = simulator.totalEnergy();
-                double sum_total_energy = simulator.sumTotalEnergy();
-
-                std::vector<n_body::particleAcceleration*> particle_ptr_list;
-                for (auto& p : particle_list) {
-                    particle_ptr_list.push_back(&p);
-                }
-
-                for (int timestep = 0; timestep < tot_timestpes; ++timestep){
-                    // Update gravitational acceleration for all bodies
-                    for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                        p_i->sumAcceleration(particle_ptr_list);
-                    } 
-
-                    // Update position and velocity of each body
-                    for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                        p_i->update(dt);
-                    }
-                }
-
-                // Calculates energy values by using updated particle state
-                std::vector<double> kinetic_energy_list_final = simulator.kineticEnergy(particle_list);
-                std::vector<double> potential_energy_list_final = simulator.potentialEnergy(particle_list);
-                std::vector<double> total_energy_list_final = simulator.totalEnergy();
-                double sum_total_energy_final = simulator.sumTotalEnergy();
-
-                // End the timer
-                auto end_time = std::chrono::high_resolution_clock::now();
-                std::chrono::duration<double> elapsed_time = end_time - start_time;
-
-                // Calculate and print the total time and average time per timestep
-                double total_time = elapsed_time.count();
-                double avg_time_per_timestep = total_time / tot_timestpes;
-                std::cout << "\n" << num_particles << " number of initial particles "<< "Inital Energy: "<<std::endl;
-                std::cout <<"Total time: " << total_time/60 << " mins" << std::endl;
-                std::cout << "Average time per timestep: " << avg_time_per_timestep << " seconds" << std::endl;
-                std::cout << std::endl;
-                std::cout << "Final Energy: " << std::endl;
-                std::cout << "sum of total energy: " << sum_total_energy_final << " total energy drop: " << 100 * (sum_total_energy_final - sum_total_energy)/sum_total_energy << "%" << std::endl;
+                // One trajectory, checkpoint and profile file per system size
+                RunFiles size_files = files;
+                size_files.trajectory = sizedPath(files.trajectory, num_particles);
+                size_files.checkpoint = sizedPath(files.checkpoint, num_particles);
+                size_files.restart = sizedPath(files.restart, num_particles);
+                size_files.profile = sizedPath(files.profile, num_particles);
+                runRandomSystem(seed, num_particles, dt, tot_timestpes, force_engine, options, size_files);
             }
         }
     }
+    catch (const std::exception& error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return 1;
+    }
     return 0;
 
 }
@@ -1,10 +1,16 @@
 #include <iostream>
+#include <cmath>
 #include <Eigen/Core>
 #include "systemSimulator.hpp"
+#include "integrator.hpp"
+#include "fixedSystem.hpp"
+#include "commandLine.hpp"
 
 // Main function for simulating the solar system
 int main(int argc, char* argv[]) {
 
+    n_body::CommandLine command_line(argc, argv);
+
     // Display help message if no arguments are provided or help flag is used
     if (argc == 1 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"){
         std::cout << "Usage: solarSystemSimulator [options]" << "\n";
@@ -12,47 +18,58 @@ int main(int argc, char* argv[]) {
         std::cout << "  -h, --help      Display this help message" << "\n";
         std::cout << "  -dt <value>     Set the timestep for the simulation" << "\n";
         std::cout << "  -len_time <years>  Set the total length of time to simulate" << "\n";
+        std::cout << "  --integrator <euler|leapfrog|verlet|yoshida4|hermite|block>     Select the time integration scheme (default euler)" << "\n";
+        std::cout << "  --engine <fixed|generic>     Unrolled nine-body engine on the stack, or the general particle system (default fixed, generic for hermite and block)" << "\n";
         std::cout << "  For example: solarSystemSimulator 0.01 100" << "\n";
         std::cout << "  This mean 100 years of 0.01 each timestep to simulate" << std::endl;
         return 0;
     }
 
-    else{
+    // The timestep and length of time are required
+    else if (command_line.numPositional() < 2) {
+        std::cerr << "Expected 2 arguments (dt, len_time), got " << command_line.numPositional() << ", see --help" << std::endl;
+        return 1;
+    }
+
+    // Bad values and unknown flags are reported instead of ending the program with an exception
+    try {
+        command_line.requireKnownOptions({"integrator", "engine"});
 
         // Parse command line arguments for timestep and simulation length
-        double dt = std::atof(argv[1]);
-        double len_time = std::atof(argv[2]);
+        double dt = std::atof(command_line.positional()[0].c_str());
+        double len_time = std::atof(command_line.positional()[1].c_str());
         double tot_timestpes = len_time * (2 * M_PI / dt);
 
         // Initialize the simulator with the solar system generator
         n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::SolarSystemGenerator>());
-        std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
+        n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+        n_body::ForceEngine force_engine;
+        n_body::IntegratorScheme scheme = n_body::parseIntegratorScheme(command_line.option("integrator", "euler"));
+        n_body::Integrator integrator(scheme);
+        n_body::SolarSystemEngine engine = n_body::parseSolarSystemEngine(command_line.option("engine", "fixed"));
+        bool fixed = engine == n_body::SolarSystemEngine::Fixed && n_body::SolarSystem::supports(scheme);
 
         // Print initial positions
-        simulator.printPosition (particle_list, "Initial");
+        simulator.printPosition (particle_system, "Initial");
 
-        // Convert particle_list to particle_ptr_list for easier manipulation
-        std::vector<n_body::particleAcceleration*> particle_ptr_list;
-        for (auto& p : particle_list) {
-            particle_ptr_list.push_back(&p);
+        // Main simulation loop, all steps on the unrolled nine-body engine when it supports the scheme
+        if (fixed) {
+            n_body::SolarSystem solar_system(particle_system);
+            solar_system.run(scheme, dt, static_cast<long>(std::ceil(tot_timestpes)));
+            solar_system.copyTo(particle_system);
         }
+        for (int timestep = 0; !fixed && timestep < tot_timestpes; ++timestep){
 
-        // Main simulation loop
-        for (int timestep = 0; timestep < tot_timestpes; ++timestep){
-
-            // Update gravitational acceleration for all bodies
-            for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                p_i->sumAcceleration(particle_ptr_list);
-            } 
-
-            // Update position and velocity of each body
-            for (n_body::particleAcceleration* p_i : particle_ptr_list){
-                p_i->update(dt);
-            }
+            // Update the acceleration, position and velocity of each body
+            integrator.step(particle_system, force_engine, dt);
         }
 
         // Print final positions
         std::cout << "\n" << std::endl;
-        simulator.printPosition (particle_list, "Final");
+        simulator.printPosition (particle_system, "Final");
+    }
+    catch (const std::exception& error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return 1;
     }
 }
@@ -0,0 +1,316 @@
+#include <benchmark/benchmark.h>
+#include <Eigen/Dense>
+#include <memory>
+#include <vector>
+#include <omp.h>
+#include "systemSimulator.hpp"
+#include "forceEngine.hpp"
+#include "energyDiagnostics.hpp"
+#include "philoxGenerator.hpp"
+#include "integrator.hpp"
+#include "fixedSystem.hpp"
+#include "ensemble.hpp"
+#include "spatialSort.hpp"
+
+// Microbenchmarks of the core kernels. Only the kernel is inside the timed loop: the bodies are
+// generated beforehand. Every benchmark reports its work as a rate, interactions_per_second for
+// the pair loops and bodies_per_second for the linear ones, and the benchmarks with a second
+// argument run on that many OpenMP threads. Run with --benchmark_format=json (or
+// --benchmark_out=<file> --benchmark_out_format=json) to keep the results for comparison.
+
+namespace {
+
+const double epsilon = 0.01;
+
+// Random disc of exactly num_bodies bodies
+n_body::ParticleSystem randomSystem(long num_bodies) {
+    return n_body::PhiloxSystemGenerator(42, num_bodies - 1).generateParticleSystem();
+}
+
+// Pairs visited by a force or potential pass over num_bodies bodies
+benchmark::Counter interactions(long num_bodies) {
+    return benchmark::Counter(static_cast<double>(num_bodies) * (num_bodies - 1), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+benchmark::Counter bodies(long num_bodies) {
+    return benchmark::Counter(static_cast<double>(num_bodies), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Runs OpenMP on the given number of threads while in scope, then restores the previous count so
+// the benchmarks registered later are not left on it
+class OmpThreads {
+public:
+    explicit OmpThreads(long num_threads) : previous_(omp_get_max_threads()) {
+        omp_set_num_threads(static_cast<int>(num_threads));
+    }
+    ~OmpThreads() {
+        omp_set_num_threads(previous_);
+    }
+    OmpThreads(const OmpThreads&) = delete;
+    OmpThreads& operator=(const OmpThreads&) = delete;
+
+private:
+    int previous_;
+};
+
+// Arguments {N} for the serial benchmarks
+void sizes(benchmark::internal::Benchmark* b) {
+    for (long n : {256, 1024, 4096}) {
+        b->Args({n});
+    }
+    b->ArgName("N");
+}
+
+// Arguments {N, threads}, with powers of two up to the OpenMP maximum
+void sizesAndThreads(benchmark::internal::Benchmark* b) {
+    for (long n : {256, 1024, 4096}) {
+        for (long t = 1; t <= omp_get_max_threads(); t *= 2) {
+            b->Args({n, t});
+        }
+    }
+    b->ArgNames({"N", "threads"});
+}
+
+// Pairwise acceleration of particleAcceleration::calcAcceleration, all pairs
+void BM_CalcAcceleration(benchmark::State& state) {
+    const long n = state.range(0);
+    std::vector<n_body::particleAcceleration> particle_list = randomSystem(n).toParticleList();
+    for (auto _ : state) {
+        Eigen::Vector3d total = Eigen::Vector3d::Zero();
+        for (long i = 0; i < n; ++i) {
+            for (long j = 0; j < n; ++j) {
+                if (i != j) {
+                    total += n_body::particleAcceleration::calcAcceleration(&particle_list[i], &particle_list[j], epsilon);
+                }
+            }
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.counters["interactions_per_second"] = interactions(n);
+}
+BENCHMARK(BM_CalcAcceleration)->Apply(sizes)->Unit(benchmark::kMillisecond);
+
+// particleAcceleration::sumAcceleration over the shared particle list, one body per loop iteration
+void BM_SumAccelerationList(benchmark::State& state) {
+    const long n = state.range(0);
+    const OmpThreads threads(state.range(1));
+    std::vector<n_body::particleAcceleration> particle_list = randomSystem(n).toParticleList();
+    for (auto _ : state) {
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < n; ++i) {
+            particle_list[i].sumAcceleration(particle_list, epsilon);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.counters["interactions_per_second"] = interactions(n);
+}
+BENCHMARK(BM_SumAccelerationList)->Apply(sizesAndThreads)->Unit(benchmark::kMillisecond);
+
+// ParticleSystem::sumAcceleration over the structure of arrays
+void BM_SumAcceleration(benchmark::State& state) {
+    const long n = state.range(0);
+    const OmpThreads threads(state.range(1));
+    n_body::ParticleSystem particle_system = randomSystem(n);
+    for (auto _ : state) {
+        particle_system.sumAcceleration(epsilon);
+        benchmark::ClobberMemory();
+    }
+    state.counters["interactions_per_second"] = interactions(n);
+}
+BENCHMARK(BM_SumAcceleration)->Apply(sizesAndThreads)->Unit(benchmark::kMillisecond);
+
+// One force pass of every ForceEngine kernel; bh and fmm count the N (N - 1) pairs they replace
+void BM_ForceKernel(benchmark::State& state) {
+    const n_body::ForceKernel kernel = static_cast<n_body::ForceKernel>(state.range(0));
+    const long n = state.range(1);
+    const OmpThreads threads(state.range(2));
+    n_body::ParticleSystem particle_system = randomSystem(n);
+    n_body::ForceEngine force_engine(kernel, epsilon);
+    for (auto _ : state) {
+        force_engine.computeAcceleration(particle_system);
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(n_body::forceKernelName(kernel));
+    state.counters["interactions_per_second"] = interactions(n);
+}
+void kernelsSizesAndThreads(benchmark::internal::Benchmark* b) {
+    for (n_body::ForceKernel kernel : {n_body::ForceKernel::Direct, n_body::ForceKernel::Simd, n_body::ForceKernel::Symmetric,
+                                       n_body::ForceKernel::Tiled, n_body::ForceKernel::BarnesHut, n_body::ForceKernel::Fmm,
+                                       n_body::ForceKernel::Mixed}) {
+        for (long n : {1024, 4096, 16384}) {
+            for (long t = 1; t <= omp_get_max_threads(); t *= 2) {
+                b->Args({static_cast<long>(kernel), n, t});
+            }
+        }
+    }
+    b->ArgNames({"kernel", "N", "threads"});
+}
+BENCHMARK(BM_ForceKernel)->Apply(kernelsSizesAndThreads)->Unit(benchmark::kMillisecond);
+
+// Particle::update on every particle of a list
+void BM_ParticleUpdate(benchmark::State& state) {
+    const long n = state.range(0);
+    std::vector<n_body::particleAcceleration> particle_list = randomSystem(n).toParticleList();
+    double dt = 1e-6;
+    for (auto _ : state) {
+        for (n_body::particleAcceleration& particle : particle_list) {
+            particle.update(dt);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.counters["bodies_per_second"] = bodies(n);
+}
+BENCHMARK(BM_ParticleUpdate)->Apply(sizes);
+
+// ParticleSystem::update, the same Euler update over the structure of arrays
+void BM_ParticleSystemUpdate(benchmark::State& state) {
+    const long n = state.range(0);
+    const OmpThreads threads(state.range(1));
+    n_body::ParticleSystem particle_system = randomSystem(n);
+    for (auto _ : state) {
+        particle_system.update(1e-6);
+        benchmark::ClobberMemory();
+    }
+    state.counters["bodies_per_second"] = bodies(n);
+}
+BENCHMARK(BM_ParticleSystemUpdate)->Apply(sizesAndThreads);
+
+// Kinetic energy of the simulator and of the diagnostics
+void BM_KineticEnergy(benchmark::State& state) {
+    const long n = state.range(0);
+    const OmpThreads threads(state.range(1));
+    n_body::sysSimulator simulator(std::make_shared<n_body::PhiloxSystemGenerator>(42, n - 1));
+    std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(simulator.kineticEnergyPara(particle_list));
+    }
+    state.counters["bodies_per_second"] = bodies(n);
+}
+BENCHMARK(BM_KineticEnergy)->Apply(sizesAndThreads);
+
+// Potential energy double loop of the simulator over the particle list
+void BM_PotentialEnergyList(benchmark::State& state) {
+    const long n = state.range(0);
+    const OmpThreads threads(state.range(1));
+    n_body::sysSimulator simulator(std::make_shared<n_body::PhiloxSystemGenerator>(42, n - 1));
+    std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(simulator.potentialEnergyPara(particle_list));
+    }
+    state.counters["interactions_per_second"] = interactions(n);
+}
+BENCHMARK(BM_PotentialEnergyList)->Apply(sizesAndThreads)->Unit(benchmark::kMillisecond);
+
+// Potential energy double loop of the allocation-free diagnostics
+void BM_PotentialEnergyDiagnostics(benchmark::State& state) {
+    const long n = state.range(0);
+    const OmpThreads threads(state.range(1));
+    n_body::ParticleSystem particle_system = randomSystem(n);
+    n_body::EnergyDiagnostics energy;
+    for (auto _ : state) {
+        energy.computePotential(particle_system, epsilon);
+        benchmark::DoNotOptimize(energy.potentialEnergy());
+    }
+    state.counters["interactions_per_second"] = interactions(n);
+}
+BENCHMARK(BM_PotentialEnergyDiagnostics)->Apply(sizesAndThreads)->Unit(benchmark::kMillisecond);
+
+// sysSimulator::addSysInput, which stores the list and builds the particle system from it
+void BM_AddSysInput(benchmark::State& state) {
+    const long n = state.range(0);
+    n_body::sysSimulator simulator(std::make_shared<n_body::PhiloxSystemGenerator>(42, 0));
+    std::vector<n_body::particleAcceleration> particle_list = randomSystem(n).toParticleList();
+    for (auto _ : state) {
+        simulator.addSysInput(particle_list);
+        benchmark::ClobberMemory();
+    }
+    state.counters["bodies_per_second"] = bodies(n);
+}
+BENCHMARK(BM_AddSysInput)->Apply(sizes);
+
+// Leapfrog steps of the Solar System with Integrator on a particle system, and with the unrolled
+// nine-body engine; steps_per_second is what long-term stability studies are limited by
+void BM_SolarSystemStep(benchmark::State& state) {
+    const bool fixed = state.range(0) == 1;
+    n_body::ParticleSystem particle_system = n_body::SolarSystemGenerator().generateParticleSystem();
+    n_body::SolarSystem solar_system(particle_system);
+    n_body::ForceEngine force_engine;
+    n_body::Integrator integrator(n_body::IntegratorScheme::Leapfrog);
+    for (auto _ : state) {
+        if (fixed) {
+            solar_system.step(n_body::IntegratorScheme::Leapfrog, 1e-3);
+        }
+        else {
+            integrator.step(particle_system, force_engine, 1e-3);
+        }
+        benchmark::DoNotOptimize(solar_system);
+    }
+    state.SetLabel(fixed ? "fixed" : "generic");
+    state.counters["steps_per_second"] = benchmark::Counter(1.0, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_SolarSystemStep)->Arg(0)->Arg(1)->ArgName("fixed");
+
+// Leapfrog steps of 64 Solar Systems with different planet phases, advanced together in an ensemble
+// or one at a time with the unrolled engine; system_steps_per_second counts one step of one system
+void BM_EnsembleStep(benchmark::State& state) {
+    const bool together = state.range(0) == 1;
+    const int num_systems = 64;
+    std::vector<n_body::ParticleSystem> systems;
+    std::vector<n_body::SolarSystem> solar_systems;
+    for (int k = 0; k < num_systems; ++k) {
+        systems.push_back(n_body::SolarSystemGenerator(42 + k).generateParticleSystem());
+        solar_systems.emplace_back(systems.back());
+    }
+    n_body::Ensemble ensemble(systems);
+    for (auto _ : state) {
+        if (together) {
+            ensemble.run(n_body::IntegratorScheme::Leapfrog, 1e-3, 1);
+        }
+        else {
+            for (n_body::SolarSystem& solar_system : solar_systems) {
+                solar_system.step(n_body::IntegratorScheme::Leapfrog, 1e-3);
+            }
+        }
+        benchmark::DoNotOptimize(solar_systems);
+    }
+    state.SetLabel(together ? "ensemble" : "fixed");
+    state.counters["system_steps_per_second"] = benchmark::Counter(num_systems, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_EnsembleStep)->Arg(0)->Arg(1)->ArgName("ensemble");
+
+// Sorting the bodies along a Morton (curve 0) or Hilbert (curve 1) curve: keys, radix sort and the
+// permutation of every array, what the spatial sorter costs each time it reorders
+void BM_SpatialReorder(benchmark::State& state) {
+    const long n = state.range(0);
+    const n_body::SpaceFillingCurve curve = state.range(1) == 1 ? n_body::SpaceFillingCurve::Hilbert : n_body::SpaceFillingCurve::Morton;
+    const n_body::ParticleSystem generated = randomSystem(n);
+    n_body::ParticleSystem particle_system = generated;
+    for (auto _ : state) {
+        state.PauseTiming();
+        particle_system = generated;
+        state.ResumeTiming();
+        particle_system.permute(n_body::spaceFillingOrder(particle_system, curve));
+        benchmark::DoNotOptimize(particle_system.x());
+    }
+    state.counters["bodies_per_second"] = bodies(n);
+}
+BENCHMARK(BM_SpatialReorder)->ArgsProduct({{4096, 65536}, {0, 1}})->ArgNames({"N", "curve"});
+
+// Barnes-Hut force pass on bodies in generator order and sorted along a Hilbert curve
+void BM_BarnesHutOrder(benchmark::State& state) {
+    const long n = state.range(0);
+    n_body::ParticleSystem particle_system = randomSystem(n);
+    if (state.range(1) == 1) {
+        particle_system.permute(n_body::spaceFillingOrder(particle_system, n_body::SpaceFillingCurve::Hilbert));
+    }
+    n_body::ForceEngine force_engine(n_body::ForceKernel::BarnesHut, epsilon);
+    for (auto _ : state) {
+        force_engine.computeAcceleration(particle_system);
+        benchmark::DoNotOptimize(particle_system.ax());
+    }
+    state.counters["bodies_per_second"] = bodies(n);
+}
+BENCHMARK(BM_BarnesHutOrder)->ArgsProduct({{16384, 65536}, {0, 1}})->ArgNames({"N", "sorted"})->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK_MAIN();
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <Eigen/Dense>
 #include <vector>
 
@@ -17,15 +19,22 @@ class particleAcceleration : public n_body::Particle { // inherit all function a
         void addParticle (n_body::particleAcceleration& add_particle);
 
         // Get the list of particles.
-        std::vector <n_body::particleAcceleration*> getParticle ();
+        const std::vector <n_body::particleAcceleration*>& getParticle () const;
 
         // Calculate the acceleration of particle p_i due to particle p_j.
         // Epsilon is a softening factor to avoid numerical instability when particles are too close.
         static Vector3d calcAcceleration (const particleAcceleration* p_i, const particleAcceleration* p_j, const double& epsilon = 0.0);
         
         // Calculate the net acceleration of the current particle due to all other particles in the list.
-        void sumAcceleration (std::vector<n_body::particleAcceleration*> particles_list, const double& epsilon = 0.0);
-        
+        void sumAcceleration (const std::vector<n_body::particleAcceleration*>& particles_list, const double& epsilon = 0.0);
+
+        // Calculate the net acceleration of the current particle due to all other particles of a shared system,
+        // without building a list of pointers to them. The current particle must be an element of the system.
+        void sumAcceleration (const std::vector<n_body::particleAcceleration>& system, const double& epsilon = 0.0);
+
+        // Bytes held by the particle list.
+        std::size_t memoryUsage () const;
+
         // Release memory allocated to the particle list.
         void releaseMemory();
         
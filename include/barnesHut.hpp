@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "octree.hpp"
+#include "particleSystem.hpp"
+#include "taskPool.hpp"
+
+namespace n_body
+{
+
+// The BarnesHutSolver class approximates the net acceleration of every body in O(N log N).
+// The octree is rebuilt each step; a cell of side s whose centre of mass lies at distance d
+// from the target is replaced by a point mass when d > s / theta + delta, where theta is the
+// opening angle and delta the offset of the centre of mass from the cell centre; otherwise
+// the cell is opened. theta = 0 reproduces direct summation, larger theta is faster and
+// less accurate.
+class BarnesHutSolver {
+    public:
+        BarnesHutSolver(double theta = 0.5, int leaf_size = 16);
+
+        // Rebuild the tree and calculate the net acceleration of every body in the particle system.
+        // With with_potential, the monopole potential of every body is stored as well.
+        void computeAcceleration(ParticleSystem& particle_system, const double& epsilon = 0.0, bool with_potential = false);
+
+        // Accessor methods
+        double getOpeningAngle() const;
+        void setOpeningAngle(double theta);
+        const Octree& tree() const;
+
+        // Share the tree walks out with a work-stealing pool, or with OpenMP dynamic scheduling if null (the default).
+        void setTaskPool(std::shared_ptr<TaskPool> task_pool);
+
+    protected:
+        double theta_;
+        Octree tree_;
+        std::vector<double> open_radius2_;
+        std::shared_ptr<TaskPool> task_pool_;
+};
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+struct IntegratorState;
+
+// The BlockTimestepper class advances every body with its own power-of-two timestep.
+// Body i steps with dt / 2^k_i, where dt is the step passed to step() and the level k_i is the
+// smallest one with dt / 2^k_i <= eta * |a_i| / |j_i| (a the acceleration, j the jerk). Steps of
+// one level are nested in those of the level above, so bodies due at the same time form a block:
+// each substep predicts every body to that time, evaluates forces on the active block only and
+// corrects it. Inner orbits take many short steps while the outer ones take few long steps.
+//
+// The predictor is x + v t + a t^2 / 2 + j t^3 / 6 and the corrector the trapezoidal rule
+// v1 = v0 + (a0 + a1) t / 2, x1 = x0 + (v0 + v1) t / 2 + (a0 - a1) t^2 / 12, second order in t.
+// A body moves to a coarser level only at times that are multiples of the coarser step.
+// Every body is synchronised at the end of step(), so energies can be measured as usual.
+class BlockTimestepper {
+    public:
+        BlockTimestepper(double eta = 0.01, int max_level = 30);
+
+        // Advance every body of the particle system by dt, the largest individual step.
+        void step(ParticleSystem& particle_system, const double& epsilon, const double& dt);
+
+        // Forget the stored accelerations, jerks and levels, the next step starts again.
+        void reset();
+
+        // Accessor methods
+        double getAccuracy() const;
+        void setAccuracy(double eta);
+
+        // Number of single-body force evaluations, N for every full evaluation.
+        long getBodyEvaluations() const;
+
+        // Number of bodies on each level k, whose step is dt / 2^k.
+        std::vector<long> levelCounts() const;
+
+        // Copy the jerks and levels into a state, or continue from them. The stored accelerations are used as they are.
+        void getState(IntegratorState& state) const;
+        void setState(const IntegratorState& state);
+
+    protected:
+        // Calculate the accelerations and jerks of every body and pick the initial levels.
+        void initialise(ParticleSystem& particle_system, const double& epsilon, const double& dt);
+
+        // Smallest level whose step dt / 2^k is at most eta |a| / |j|.
+        int desiredLevel(const double acceleration[3], const double jerk[3], const double& dt) const;
+
+        double eta_;
+        int max_level_;
+        bool initialised_;
+        long body_evaluations_;
+
+        // Time of every body in ticks of dt / 2^max_level within the current step, and its level
+        std::vector<std::int64_t> time_;
+        std::vector<int> level_;
+
+        // Jerk of every body at its own time
+        AlignedVector<double> jx_, jy_, jz_;
+
+        // Every body predicted to the time of the current block, and the active bodies
+        ParticleSystem predicted_;
+        std::vector<std::size_t> active_;
+};
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "integrator.hpp"
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Everything besides the bodies that a run needs to continue where it stopped.
+struct CheckpointMetadata {
+    std::uint64_t step = 0;
+    double time = 0.0;
+    double dt = 0.0;
+    double epsilon = 0.0;
+    IntegratorScheme scheme = IntegratorScheme::Euler;
+
+    // Initial conditions the run started from, e.g. generator "random" with its seed and size,
+    // and the total energy at step 0 so the energy drop can still be reported after a restart.
+    std::string generator;
+    std::int64_t seed = 0;
+    std::int64_t num_generated = 0;
+    double initial_energy = 0.0;
+};
+
+// Checkpoint file layout, version 2, all little-endian:
+//   header, 96 bytes: char magic[8] = "NBCHKPT", uint32 version, uint32 scheme, uint64 num_bodies,
+//                     uint64 step, float64 time, dt, epsilon, initial_energy, int64 seed,
+//                     int64 num_generated, uint64 length of the generator name,
+//                     uint32 acceleration_valid, uint32 flags (bit 0: jerks stored, bit 1: levels stored)
+//   the generator name, then the float64 blocks x, y, z, vx, vy, vz, ax, ay, az, potential, mass
+//   of num_bodies values each, a uint64 block of the body ids, then the integrator state: float64
+//   blocks jx, jy, jz and an int32 block of levels, when flagged.
+// Every array of the particle system and of the integrator state is stored exactly, so a restarted
+// run follows the same trajectory bit for bit. The file is written under a temporary name and
+// renamed into place, so an interruption while saving leaves the previous checkpoint intact.
+constexpr std::uint32_t checkpoint_version = 2;
+
+// Write a checkpoint, throws std::runtime_error if the file cannot be written and std::invalid_argument
+// if the integrator state does not match the particle system.
+void saveCheckpoint(const std::string& path, const ParticleSystem& particle_system, const IntegratorState& state,
+                    const CheckpointMetadata& metadata);
+
+// Read a checkpoint into a particle system, resized to fit, and an integrator state, and return its
+// metadata. Throws std::runtime_error if the file is missing, truncated, or not a checkpoint of this version.
+CheckpointMetadata loadCheckpoint(const std::string& path, ParticleSystem& particle_system, IntegratorState& state);
+
+// The CheckpointWriter class saves checkpoints from a background thread. save() copies the
+// particle system into a snapshot and returns, so the steps go on while the file is written;
+// it only waits if the previous checkpoint is still being written.
+class CheckpointWriter {
+    public:
+        explicit CheckpointWriter(const std::string& path);
+
+        // Finish the pending checkpoint.
+        ~CheckpointWriter();
+
+        CheckpointWriter(const CheckpointWriter&) = delete;
+        CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+        // Queue a checkpoint of the particle system. Throws std::runtime_error if the previous one failed.
+        void save(const ParticleSystem& particle_system, const IntegratorState& state, const CheckpointMetadata& metadata);
+
+        // Block until the queued checkpoint is on disk, rethrowing any write error.
+        void wait();
+
+        // Checkpoints handed to save(), and the seconds save() spent copying and waiting.
+        long getSaves() const;
+        double getSaveSeconds() const;
+
+    protected:
+        // Background thread, writes the snapshot whenever one is queued
+        void writerLoop();
+
+        std::string path_;
+        ParticleSystem snapshot_;
+        IntegratorState state_;
+        CheckpointMetadata metadata_;
+        bool pending_;
+        bool closing_;
+        std::exception_ptr error_;
+        std::mutex mutex_;
+        std::condition_variable queued_;
+        std::condition_variable written_;
+        std::thread thread_;
+
+        long saves_;
+        double save_seconds_;
+};
+}
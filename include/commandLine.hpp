@@ -0,0 +1,40 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace n_body
+{
+
+// Splits the command line of the simulator apps into positional arguments and
+// optional "--name value" flags, e.g. "solarSystemSimulator3 0.01 1 0.001 2048 --kernel simd".
+class CommandLine {
+    public:
+        CommandLine(int argc, char* argv[]);
+
+        // Positional arguments, in order, excluding the program name.
+        const std::vector<std::string>& positional() const;
+        std::size_t numPositional() const;
+
+        // Check if a flag was given, e.g. hasOption("kernel") for "--kernel simd".
+        bool hasOption(const std::string& name) const;
+
+        // Throws std::invalid_argument naming the first flag that is not one of names, e.g. "--kernal".
+        void requireKnownOptions(const std::vector<std::string>& names) const;
+
+        // Value of a flag, or default_value if it was not given. The numeric versions throw
+        // std::invalid_argument if the value is missing or not a number.
+        std::string option(const std::string& name, const std::string& default_value = "") const;
+        double optionDouble(const std::string& name, double default_value) const;
+        int optionInt(const std::string& name, int default_value) const;
+
+        // Comma-separated integers of a flag, e.g. "--threads 1,2,4", or default_value if it was not given.
+        // Throws std::invalid_argument if an entry is not an integer.
+        std::vector<long> optionList(const std::string& name, const std::vector<long>& default_value) const;
+
+    protected:
+        std::vector<std::string> positional_;
+        std::map<std::string, std::string> options_;
+};
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "particleSystem.hpp"
+#include "taskPool.hpp"
+
+namespace n_body
+{
+
+// The EnergyDiagnostics class measures the kinetic, potential and total energy of a particle system.
+// Per-body energies are written into buffers owned by the object, which are only resized when the
+// number of bodies changes, so measuring every step allocates nothing. Each body's entry is written
+// by exactly one thread and the sums are OpenMP reductions, so threads never share a list or wait
+// on a critical section.
+class EnergyDiagnostics {
+    public:
+        EnergyDiagnostics() = default;
+
+        // Kinetic energy 0.5 m_i |v_i|^2 of every body.
+        void computeKinetic(const ParticleSystem& particle_system);
+
+        // Potential energy of every body with the direct double loop, each pair shared between its
+        // two bodies: -0.5 sum_j m_i m_j / sqrt(r_ij^2 + epsilon^2).
+        void computePotential(const ParticleSystem& particle_system, const double& epsilon = 0.0);
+
+        // Potential energy 0.5 m_i phi_i of every body from per-body potentials phi, such as the ones
+        // stored by a force pass (ParticleSystem::potential()) or FmmSolver::potential(), in O(N).
+        void computePotential(const ParticleSystem& particle_system, const double* potential);
+
+        // Kinetic and potential energy, the direct double loop for the potential.
+        void compute(const ParticleSystem& particle_system, const double& epsilon = 0.0);
+
+        // Sums over all bodies from the last computations.
+        double kineticEnergy() const;
+        double potentialEnergy() const;
+        double totalEnergy() const;
+
+        // Share the rows of the potential double loop out with a work-stealing pool, or with OpenMP if null (the default).
+        void setTaskPool(std::shared_ptr<TaskPool> task_pool);
+
+        // Per-body energies from the last computations, valid until the next one.
+        const std::vector<double>& kinetic() const;
+        const std::vector<double>& potential() const;
+
+    protected:
+        std::vector<double> kinetic_;
+        std::vector<double> potential_;
+        double sum_kinetic_ = 0.0;
+        double sum_potential_ = 0.0;
+        std::shared_ptr<TaskPool> task_pool_;
+};
+}
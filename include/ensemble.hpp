@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "integrator.hpp"
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// The Ensemble class advances K independent systems of N bodies each together, such as realisations
+// of a generator that differ only in seed. Small systems leave most of a core idle when simulated
+// one at a time, so the ensemble interleaves them: component c of body i of system k is stored at
+// c[i * K + k], and every pair (i, j) is evaluated for a run of consecutive systems at once, with
+// the systems in the SIMD lanes. The systems are split between the OpenMP threads in runs of whole
+// cache lines, and as the systems never interact each thread advances its own systems through all
+// steps of run() without any barriers.
+//
+// Euler, Leapfrog, VelocityVerlet and Yoshida4 follow the same trajectories as Integrator on each
+// system up to rounding (the pairs are summed in a different order), and reuse the accelerations
+// between steps in the same way. Hermite and Block are not supported.
+class Ensemble {
+    public:
+        // Interleave the systems, throws std::invalid_argument if there are none or their sizes differ.
+        Ensemble(const std::vector<ParticleSystem>& systems, double epsilon = 0.0);
+
+        // Advance every body of every system by num_steps steps of dt, throws std::invalid_argument
+        // for Hermite and Block.
+        void run(IntegratorScheme scheme, const double& dt, long num_steps);
+
+        // Total energy of every system, kinetic plus the potential of each pair counted once.
+        std::vector<double> totalEnergy() const;
+
+        // Copy of system k.
+        ParticleSystem getSystem(std::size_t k) const;
+
+        // Forget the stored accelerations, the next step evaluates them again.
+        void reset();
+
+        // Accessor methods
+        std::size_t numSystems() const;
+        std::size_t numBodies() const;
+        double getEpsilon() const;
+
+        // Force evaluations of every system so far.
+        long getForceEvaluations() const;
+
+        // Check if a scheme is supported by run().
+        static bool supports(IntegratorScheme scheme);
+
+    protected:
+        // Phases of a step for the systems [k_begin, k_end)
+        void computeAcceleration(std::size_t k_begin, std::size_t k_end);
+        void kick(const double& h, std::size_t k_begin, std::size_t k_end);
+        void drift(const double& h, std::size_t k_begin, std::size_t k_end);
+        void leapfrogStep(const double& h, std::size_t k_begin, std::size_t k_end);
+
+        // One step of the systems [k_begin, k_end), acceleration_valid tells if their accelerations belong to the positions
+        void step(IntegratorScheme scheme, const double& dt, std::size_t k_begin, std::size_t k_end, bool& acceleration_valid);
+
+        std::size_t num_systems_;
+        std::size_t num_bodies_;
+        double epsilon_;
+        bool acceleration_valid_;
+        long force_evaluations_;
+        AlignedVector<double> x_, y_, z_;
+        AlignedVector<double> vx_, vy_, vz_;
+        AlignedVector<double> ax_, ay_, az_;
+        AlignedVector<double> mass_;
+};
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "particleSystem.hpp"
+#include "systemSimulator.hpp"
+
+namespace n_body
+{
+
+// Formats of initial-condition files.
+// Csv: one body per line, "x,y,z,vx,vy,vz,mass", separated by commas or white space. Lines starting
+//      with '#' are comments, and the first other non-empty line is a header if it does not start with
+//      a number.
+// Binary: a 64-byte header (char magic[8] = "NBINIT1", uint32 bytes per value = 8, uint32 flags = 0,
+//         uint64 num_bodies, zero padding), then the float64 blocks x, y, z, vx, vy, vz, mass of
+//         num_bodies values each, little-endian. The blocks are copied straight into the arrays of
+//         the particle system, so loading is bound by the disk rather than by parsing.
+enum class InitialConditionFormat { Csv, Binary };
+
+// Write the positions, velocities and masses of a particle system to an initial-condition file,
+// throws std::runtime_error if it cannot be written.
+void saveInitialConditions(const std::string& path, const ParticleSystem& particle_system,
+                           InitialConditionFormat format = InitialConditionFormat::Binary);
+
+// File initial condition generator, reads a CSV or binary catalogue (told apart by the binary magic).
+// The file is mapped into memory read-only and the bodies go straight into a particle system.
+class FileSystemGenerator : public InitialConditionGenerator {
+    public:
+        // Throws std::runtime_error when the file is generated if it is missing or malformed.
+        explicit FileSystemGenerator(const std::string& path);
+
+        // Read the bodies into a particle system, with zero accelerations.
+        ParticleSystem generateParticleSystem() override;
+
+        // The same bodies as a list of particles.
+        std::vector<particleAcceleration> generateInitialConditions() override;
+
+        // Format of the file, read from its first bytes.
+        InitialConditionFormat format() const;
+
+    protected:
+        std::string path_;
+};
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "integrator.hpp"
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Number of bodies made by SolarSystemGenerator: the Sun and the eight planets.
+constexpr std::size_t num_solar_system_bodies = 9;
+
+// Call f(std::integral_constant<std::size_t, I>) for I = Begin, ..., End - 1, unrolled at compile time.
+template <std::size_t Begin, std::size_t End, typename F>
+inline void unrolledFor(F&& f);
+
+// The FixedSystem class simulates a system whose number of bodies N is known at compile time, such
+// as the Solar System. The bodies live in std::array members, so the system needs no heap memory
+// and a small one stays in registers and the stack, and the pair loop is unrolled at compile time
+// into N (N - 1) / 2 straight-line interactions, each applied to both bodies (Newton's third law).
+// With Softened false, epsilon is zero at compile time and its addition is left out.
+//
+// Euler, Leapfrog, VelocityVerlet and Yoshida4 follow the same trajectories as Integrator up to
+// rounding (the pairs are summed in a different order), and reuse the accelerations between steps
+// in the same way. Hermite and Block are not supported.
+template <std::size_t N, bool Softened>
+class FixedSystem {
+    public:
+        // Copy the bodies of a particle system, throws std::invalid_argument unless it has N bodies,
+        // or if epsilon is not zero without Softened.
+        explicit FixedSystem(const ParticleSystem& particle_system, double epsilon = 0.0);
+
+        // Calculate the net acceleration of every body.
+        void computeAcceleration();
+
+        // Advance every body by dt, throws std::invalid_argument for Hermite and Block.
+        void step(IntegratorScheme scheme, const double& dt);
+
+        // Advance every body by num_steps steps of dt.
+        void run(IntegratorScheme scheme, const double& dt, long num_steps);
+
+        // Kinetic, potential and total energy, each pair of the potential counted once.
+        double kineticEnergy() const;
+        double potentialEnergy() const;
+        double totalEnergy() const;
+
+        // Write the positions, velocities and accelerations back into a particle system of N bodies.
+        void copyTo(ParticleSystem& particle_system) const;
+
+        // Forget the stored accelerations, the next step evaluates them again.
+        void reset();
+
+        // Accessor methods
+        double getEpsilon() const;
+        long getForceEvaluations() const;
+
+        // Check if a scheme is supported by step().
+        static bool supports(IntegratorScheme scheme);
+
+    protected:
+        // Kick-drift-kick substep of length h, leaving the accelerations at the new positions.
+        void leapfrogStep(const double& h);
+        void kick(const double& h);
+        void drift(const double& h);
+
+        std::array<double, N> x_, y_, z_;
+        std::array<double, N> vx_, vy_, vz_;
+        std::array<double, N> ax_, ay_, az_;
+        std::array<double, N> mass_;
+        double eps2_;
+        bool acceleration_valid_;
+        long force_evaluations_;
+};
+
+// The nine bodies of SolarSystemGenerator, unsoftened as in solarSystemSimulator.
+using SolarSystem = FixedSystem<num_solar_system_bodies, false>;
+
+// Engine of the Solar System apps: the unrolled FixedSystem or the general Integrator.
+enum class SolarSystemEngine { Fixed, Generic };
+
+// Parse an engine name, "fixed" or "generic", throws std::invalid_argument otherwise.
+inline SolarSystemEngine parseSolarSystemEngine(const std::string& name) {
+    if (name == "fixed") {
+        return SolarSystemEngine::Fixed;
+    }
+    if (name == "generic") {
+        return SolarSystemEngine::Generic;
+    }
+    throw std::invalid_argument("Unknown engine: " + name);
+}
+
+namespace detail
+{
+template <std::size_t Begin, typename F, std::size_t... I>
+inline void unrolledFor(F&& f, std::index_sequence<I...>) {
+    (f(std::integral_constant<std::size_t, Begin + I>{}), ...);
+}
+}
+
+// Call f for every index of [Begin, End), unrolled at compile time
+template <std::size_t Begin, std::size_t End, typename F>
+inline void unrolledFor(F&& f) {
+    if constexpr (End > Begin) {
+        detail::unrolledFor<Begin>(std::forward<F>(f), std::make_index_sequence<End - Begin>{});
+    }
+}
+
+// Copy the bodies of a particle system
+template <std::size_t N, bool Softened>
+FixedSystem<N, Softened>::FixedSystem(const ParticleSystem& particle_system, double epsilon)
+    : eps2_(epsilon * epsilon), acceleration_valid_(false), force_evaluations_(0) {
+    if (particle_system.size() != N) {
+        throw std::invalid_argument("A fixed system of " + std::to_string(N) + " bodies cannot hold " + std::to_string(particle_system.size()));
+    }
+    if (!Softened && epsilon != 0.0) {
+        throw std::invalid_argument("An unsoftened fixed system needs epsilon == 0");
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+        x_[i] = particle_system.x()[i];
+        y_[i] = particle_system.y()[i];
+        z_[i] = particle_system.z()[i];
+        vx_[i] = particle_system.vx()[i];
+        vy_[i] = particle_system.vy()[i];
+        vz_[i] = particle_system.vz()[i];
+        ax_[i] = particle_system.ax()[i];
+        ay_[i] = particle_system.ay()[i];
+        az_[i] = particle_system.az()[i];
+        mass_[i] = particle_system.mass()[i];
+    }
+}
+
+// Calculate the net acceleration of every body, pair by pair
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::computeAcceleration() {
+    std::array<double, N> ax {}, ay {}, az {};
+    unrolledFor<0, N>([&](auto i) {
+        unrolledFor<decltype(i)::value + 1, N>([&](auto j) {
+            const double dx = x_[j] - x_[i];
+            const double dy = y_[j] - y_[i];
+            const double dz = z_[j] - z_[i];
+            double r2 = dx * dx + dy * dy + dz * dz;
+            if constexpr (Softened) {
+                r2 += eps2_;
+            }
+            const double inv_r = 1.0 / std::sqrt(r2);
+            const double inv_r3 = inv_r * inv_r * inv_r;
+            const double scale_i = mass_[j] * inv_r3;
+            const double scale_j = mass_[i] * inv_r3;
+            ax[i] += scale_i * dx;
+            ay[i] += scale_i * dy;
+            az[i] += scale_i * dz;
+            ax[j] -= scale_j * dx;
+            ay[j] -= scale_j * dy;
+            az[j] -= scale_j * dz;
+        });
+    });
+    ax_ = ax;
+    ay_ = ay;
+    az_ = az;
+    ++force_evaluations_;
+    acceleration_valid_ = true;
+}
+
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::kick(const double& h) {
+    unrolledFor<0, N>([&](auto i) {
+        vx_[i] += h * ax_[i];
+        vy_[i] += h * ay_[i];
+        vz_[i] += h * az_[i];
+    });
+}
+
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::drift(const double& h) {
+    unrolledFor<0, N>([&](auto i) {
+        x_[i] += h * vx_[i];
+        y_[i] += h * vy_[i];
+        z_[i] += h * vz_[i];
+    });
+}
+
+// Kick-drift-kick substep of length h
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::leapfrogStep(const double& h) {
+    kick(0.5 * h);
+    drift(h);
+    computeAcceleration();
+    kick(0.5 * h);
+}
+
+// Advance every body by dt, with the updates of Integrator::step
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::step(IntegratorScheme scheme, const double& dt) {
+    if (!supports(scheme)) {
+        throw std::invalid_argument("Fixed systems do not support the " + integratorSchemeName(scheme) + " integrator");
+    }
+    if (!acceleration_valid_) {
+        computeAcceleration();
+    }
+    switch (scheme) {
+        case IntegratorScheme::Euler:
+            drift(dt);
+            kick(dt);
+            acceleration_valid_ = false;
+            break;
+
+        case IntegratorScheme::Leapfrog:
+            leapfrogStep(dt);
+            break;
+
+        case IntegratorScheme::VelocityVerlet: {
+            const double half_dt2 = 0.5 * dt * dt;
+            unrolledFor<0, N>([&](auto i) {
+                x_[i] += dt * vx_[i] + half_dt2 * ax_[i];
+                y_[i] += dt * vy_[i] + half_dt2 * ay_[i];
+                z_[i] += dt * vz_[i] + half_dt2 * az_[i];
+            });
+            kick(0.5 * dt);
+            computeAcceleration();
+            kick(0.5 * dt);
+            break;
+        }
+
+        case IntegratorScheme::Yoshida4: {
+            // Substep weights w1, w0, w1 with 2 w1 + w0 = 1, as in Integrator
+            const double cbrt2 = std::cbrt(2.0);
+            const double w1 = 1.0 / (2.0 - cbrt2);
+            const double w0 = -cbrt2 / (2.0 - cbrt2);
+            leapfrogStep(w1 * dt);
+            leapfrogStep(w0 * dt);
+            leapfrogStep(w1 * dt);
+            break;
+        }
+
+        case IntegratorScheme::Hermite:
+        case IntegratorScheme::Block:
+            break;
+    }
+}
+
+// Advance every body by num_steps steps of dt
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::run(IntegratorScheme scheme, const double& dt, long num_steps) {
+    for (long s = 0; s < num_steps; ++s) {
+        step(scheme, dt);
+    }
+}
+
+// Kinetic energy 0.5 m |v|^2 of all bodies
+template <std::size_t N, bool Softened>
+double FixedSystem<N, Softened>::kineticEnergy() const {
+    double kinetic = 0.0;
+    unrolledFor<0, N>([&](auto i) {
+        kinetic += 0.5 * mass_[i] * (vx_[i] * vx_[i] + vy_[i] * vy_[i] + vz_[i] * vz_[i]);
+    });
+    return kinetic;
+}
+
+// Potential energy -m_i m_j / r of every pair
+template <std::size_t N, bool Softened>
+double FixedSystem<N, Softened>::potentialEnergy() const {
+    double potential = 0.0;
+    unrolledFor<0, N>([&](auto i) {
+        unrolledFor<decltype(i)::value + 1, N>([&](auto j) {
+            const double dx = x_[j] - x_[i];
+            const double dy = y_[j] - y_[i];
+            const double dz = z_[j] - z_[i];
+            double r2 = dx * dx + dy * dy + dz * dz;
+            if constexpr (Softened) {
+                r2 += eps2_;
+            }
+            potential -= mass_[i] * mass_[j] / std::sqrt(r2);
+        });
+    });
+    return potential;
+}
+
+template <std::size_t N, bool Softened>
+double FixedSystem<N, Softened>::totalEnergy() const {
+    return kineticEnergy() + potentialEnergy();
+}
+
+// Write the bodies back into a particle system
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::copyTo(ParticleSystem& particle_system) const {
+    if (particle_system.size() != N) {
+        throw std::invalid_argument("A fixed system of " + std::to_string(N) + " bodies cannot be copied to " + std::to_string(particle_system.size()));
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+        particle_system.x()[i] = x_[i];
+        particle_system.y()[i] = y_[i];
+        particle_system.z()[i] = z_[i];
+        particle_system.vx()[i] = vx_[i];
+        particle_system.vy()[i] = vy_[i];
+        particle_system.vz()[i] = vz_[i];
+        particle_system.ax()[i] = ax_[i];
+        particle_system.ay()[i] = ay_[i];
+        particle_system.az()[i] = az_[i];
+    }
+}
+
+// Forget the stored accelerations
+template <std::size_t N, bool Softened>
+void FixedSystem<N, Softened>::reset() {
+    acceleration_valid_ = false;
+}
+
+// Accessor methods
+template <std::size_t N, bool Softened>
+double FixedSystem<N, Softened>::getEpsilon() const {
+    return std::sqrt(eps2_);
+}
+
+template <std::size_t N, bool Softened>
+long FixedSystem<N, Softened>::getForceEvaluations() const {
+    return force_evaluations_;
+}
+
+// Check if a scheme is supported by step()
+template <std::size_t N, bool Softened>
+bool FixedSystem<N, Softened>::supports(IntegratorScheme scheme) {
+    return scheme == IntegratorScheme::Euler || scheme == IntegratorScheme::Leapfrog || scheme == IntegratorScheme::VelocityVerlet
+           || scheme == IntegratorScheme::Yoshida4;
+}
+}
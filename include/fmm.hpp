@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+
+#include "octree.hpp"
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// The FmmSolver class evaluates accelerations and potentials of every body with a fast
+// multipole method in O(N). Cells carry Cartesian Taylor expansions up to order p about their
+// centres of mass z, which removes the dipole term: multipoles M_n = sum_j m_j (x_j - z)^n, and local expansions
+// phi(x) = sum_n L_n (x - z)^n. Derivatives of the softened kernel 1/sqrt(r^2 + epsilon^2)
+// come from a recurrence, so forces and potentials use the same epsilon as the direct kernels.
+//
+// Cells A and B interact through their expansions when (r_A + r_B) < theta * |z_A - z_B|,
+// with r the radius of a sphere about z holding all bodies of the cell; otherwise the larger cell is opened, and two leaves
+// interact directly. The error falls roughly as theta^(p+1): higher order p is more accurate
+// and slower. p = 4 with theta = 0.5 gives mean relative force errors of about 1e-3 on the
+// random disc, p = 6 about 1e-4.
+class FmmSolver {
+    public:
+        FmmSolver(int order = 4, double theta = 0.5, int leaf_size = 32);
+
+        // Rebuild the tree and evaluate accelerations and potentials for the current positions.
+        // Results are kept by the solver, in the order of the particle system.
+        void evaluate(const ParticleSystem& particle_system, const double& epsilon = 0.0);
+
+        // Evaluate and store the net acceleration of every body in the particle system,
+        // and with with_potential the potential of every body as well.
+        void computeAcceleration(ParticleSystem& particle_system, const double& epsilon = 0.0, bool with_potential = false);
+
+        // Potential phi_i = -sum_j m_j / sqrt(r_ij^2 + epsilon^2) of every body from the last evaluation.
+        const std::vector<double>& potential() const;
+
+        // Accessor methods
+        int getOrder() const;
+        void setOrder(int order);
+        double getOpeningAngle() const;
+        void setOpeningAngle(double theta);
+
+    protected:
+        // Build the multi-index tables of the expansion operators for the current order.
+        void buildTables();
+
+        // Dual tree traversal of target cell a against source cell b, derivative is a scratch buffer.
+        void interact(int a, int b, double* derivative);
+
+        // Translate the multipole of source cell b into the local expansion of target cell a.
+        void multipoleToLocal(int a, int b, double* derivative);
+
+        // Direct interaction of the bodies of leaf a with the bodies of leaf b.
+        void particleToParticle(int a, int b);
+
+        int order_;
+        double theta_;
+        double eps2_;
+        Octree tree_;
+
+        // Multi-index tables: terms up to order p and derivatives up to order 2p
+        int num_terms_;
+        int num_derivatives_;
+        std::vector<int> exponent_;             // (nx, ny, nz) of every derivative index
+        std::vector<int> index_;                // index of (nx, ny, nz), laid out as a (2p+1)^3 cube
+        std::vector<int> lower_;                // per derivative index: indices of n - e_i then n - 2e_i, -1 if negative
+        struct Term { int source; int target; double coefficient; };
+        std::vector<std::vector<Term>> m2l_;    // per local term n: (k, n+k, (-1)^|k| C(n+k, n))
+        std::vector<std::vector<Term>> shift_;  // per term n: (k, n-k, C(n, k)) for k <= n
+
+        // Radius and expansions of every cell, num_terms_ coefficients each
+        std::vector<double> radius_;
+        std::vector<double> multipole_;
+        std::vector<double> local_;
+
+        // Results in sorted order and in particle order
+        std::vector<double> sorted_ax_, sorted_ay_, sorted_az_, sorted_potential_;
+        std::vector<double> ax_, ay_, az_, potential_;
+};
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "barnesHut.hpp"
+#include "fmm.hpp"
+#include "mixedKernel.hpp"
+#include "particleSystem.hpp"
+#include "simdKernel.hpp"
+#include "symmetricKernel.hpp"
+#include "taskPool.hpp"
+#include "tiledKernel.hpp"
+
+namespace n_body
+{
+
+// Force kernels that can compute the accelerations of a particle system.
+// Direct: per-body direct summation, the same expression as calcAcceleration.
+// Simd: vectorised direct summation with a refined fast reciprocal square root.
+// Symmetric: direct summation over unordered pairs, each pair evaluated once.
+// Tiled: cache-blocked direct summation, source tiles reused by a block of targets.
+// BarnesHut: octree approximation with opening angle theta, O(N log N).
+// Fmm: fast multipole method with expansions of order p, O(N).
+// Mixed: cache-blocked direct summation with float pair terms and double sums, within mixed_kernel_tolerance.
+enum class ForceKernel { Direct, Simd, Symmetric, Tiled, BarnesHut, Fmm, Mixed };
+
+// Parse a kernel name such as "direct", "simd", "symmetric", "tiled", "bh", "fmm" or "mixed", throws std::invalid_argument otherwise.
+ForceKernel parseForceKernel(const std::string& name);
+
+// Name of a force kernel, e.g. "simd".
+std::string forceKernelName(ForceKernel kernel);
+
+// The ForceEngine class computes the accelerations of all bodies in a particle system
+// with the selected force kernel and softening factor epsilon.
+class ForceEngine {
+    public:
+        ForceEngine(ForceKernel kernel = ForceKernel::Direct, double epsilon = 0.0);
+
+        // Calculate the net acceleration of every body in the particle system.
+        void computeAcceleration(ParticleSystem& particle_system);
+
+        // Accessor methods
+        ForceKernel getKernel() const;
+        double getEpsilon() const;
+
+        // Force a particular instruction set for the Simd kernel, Auto by default.
+        void setSimdPath(SimdPath path);
+
+        // Tile size of the Tiled and Mixed kernels in bodies, 0 (detected from the cache size) by default.
+        void setTileSize(std::size_t tile_size);
+        std::size_t getTileSize() const;
+
+        // Opening angle of the BarnesHut and Fmm kernels, 0.5 by default.
+        void setOpeningAngle(double theta);
+        double getOpeningAngle() const;
+
+        // Accumulate the potential of every body in the same pass as the accelerations, off by default.
+        // The potentials are left in ParticleSystem::potential() and use the same epsilon as the forces.
+        void setComputePotential(bool compute_potential);
+        bool getComputePotential() const;
+
+        // Share the irregular per-body work of the Direct and BarnesHut kernels out with a work-stealing
+        // TaskPool instead of OpenMP loops, off by default. The pool is created on first use.
+        void setWorkStealing(bool work_stealing);
+        bool getWorkStealing() const;
+
+        // The pool used when work stealing is on, for its counters. Null until it is first turned on.
+        std::shared_ptr<TaskPool> getTaskPool() const;
+
+        // Expansion order p of the Fmm kernel, 4 by default.
+        void setExpansionOrder(int order);
+        int getExpansionOrder() const;
+
+        // Check if the kernel approximates direct summation.
+        bool isApproximate() const;
+
+    protected:
+        ForceKernel kernel_;
+        double epsilon_;
+        SimdPath simd_path_;
+        std::size_t tile_size_;
+        bool compute_potential_;
+        std::shared_ptr<TaskPool> task_pool_;
+        bool work_stealing_;
+        BarnesHutSolver barnes_hut_;
+        FmmSolver fmm_;
+};
+
+// Relative error of approximate accelerations against direct summation.
+struct ForceError {
+    double mean_relative;
+    double max_relative;
+    std::size_t num_samples;
+};
+
+// Compare the accelerations currently stored in the particle system with direct summation
+// on num_samples bodies picked at random (all bodies if the system is smaller).
+ForceError sampleForceError(const ParticleSystem& particle_system, const double& epsilon, std::size_t num_samples, int seed = 42);
+}
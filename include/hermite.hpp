@@ -0,0 +1,47 @@
+#pragma once
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+struct IntegratorState;
+
+// The HermiteIntegrator class advances a particle system with the fourth-order Hermite
+// predictor-corrector scheme and a shared timestep dt. With a the acceleration and j the jerk,
+// every body is predicted to x + v dt + a dt^2 / 2 + j dt^3 / 6, v + a dt + j dt^2 / 2, the
+// acceleration a1 and jerk j1 are evaluated there in one fused pass over the pairs
+// (sumAccelerationJerk), and the prediction is corrected with
+//   v1 = v0 + (a0 + a1) dt / 2 + (j0 - j1) dt^2 / 12
+//   x1 = x0 + (v0 + v1) dt / 2 + (a0 - a1) dt^2 / 12.
+// The acceleration and jerk at the end of a step start the next one, so each step costs one
+// force evaluation. Call reset() if positions, velocities or masses are changed outside of step().
+class HermiteIntegrator {
+    public:
+        HermiteIntegrator() = default;
+
+        // Advance every body of the particle system by dt.
+        void step(ParticleSystem& particle_system, const double& epsilon, const double& dt);
+
+        // Forget the stored accelerations and jerks, the next step evaluates them again.
+        void reset();
+
+        // Number of single-body force evaluations, N for every full evaluation.
+        long getBodyEvaluations() const;
+
+        // Copy the jerks into a state, or continue from them. The stored accelerations are used as they are.
+        void getState(IntegratorState& state) const;
+        void setState(const IntegratorState& state);
+
+    protected:
+        void computeAccelerationJerk(ParticleSystem& particle_system, const double& epsilon);
+
+        bool initialised_ = false;
+        long body_evaluations_ = 0;
+
+        // Jerk of every body, and the state at the start of the step for the corrector
+        AlignedVector<double> jx_, jy_, jz_;
+        ParticleSystem previous_;
+        AlignedVector<double> previous_jx_, previous_jy_, previous_jz_;
+};
+}
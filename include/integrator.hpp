@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "blockTimestep.hpp"
+#include "forceEngine.hpp"
+#include "hermite.hpp"
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Time integration schemes for a particle system.
+// Euler: explicit Euler as Particle::update, first order, the energy drifts.
+// Leapfrog: kick-drift-kick leapfrog, second order and symplectic.
+// VelocityVerlet: x += v dt + a dt^2 / 2, then v += (a_old + a_new) dt / 2. Algebraically the
+//                 same trajectory as Leapfrog, with the updates grouped as in the textbook form.
+// Yoshida4: fourth-order Yoshida / Forest-Ruth composition of three leapfrog substeps.
+// Hermite: fourth-order Hermite predictor-corrector (HermiteIntegrator), one fused acceleration
+//          and jerk evaluation per step.
+// Block: individual power-of-two timesteps up to dt (BlockTimestepper).
+// Hermite and Block use direct-summation forces and the softening of the force engine, whatever its kernel.
+enum class IntegratorScheme { Euler, Leapfrog, VelocityVerlet, Yoshida4, Hermite, Block };
+
+// Parse a scheme name such as "euler", "leapfrog", "verlet", "yoshida4", "hermite" or "block", throws std::invalid_argument otherwise.
+IntegratorScheme parseIntegratorScheme(const std::string& name);
+
+// Name of an integration scheme, e.g. "leapfrog".
+std::string integratorSchemeName(IntegratorScheme scheme);
+
+// State an Integrator carries from one step to the next besides the particle system, so a run can be
+// checkpointed and continued exactly: whether the stored accelerations belong to the current
+// positions, the jerks of Hermite and Block, and the levels of Block. The arrays are empty when
+// the scheme keeps no such state or has not taken a step yet.
+struct IntegratorState {
+    bool acceleration_valid = false;
+    std::vector<double> jx, jy, jz;
+    std::vector<int> level;
+};
+
+// The Integrator class advances a particle system by one timestep with the selected scheme,
+// calling the force engine for the accelerations.
+//
+// The accelerations stored in the particle system at the end of a step belong to the new
+// positions, so the symplectic schemes reuse them for the first kick of the next step: after the
+// first step Leapfrog and VelocityVerlet need one force evaluation per step and Yoshida4 three.
+// Call reset() if positions or masses are changed outside of step().
+class Integrator {
+    public:
+        Integrator(IntegratorScheme scheme = IntegratorScheme::Euler);
+
+        // Advance every body of the particle system by dt.
+        void step(ParticleSystem& particle_system, ForceEngine& force_engine, const double& dt);
+
+        // Forget the stored accelerations, the next step evaluates them again.
+        void reset();
+
+        // Make sure the accelerations stored in the particle system, and the potentials when the force
+        // engine computes them, belong to the current positions. After a Leapfrog, VelocityVerlet or
+        // Yoshida4 step they already do; after Euler the forces of the next step are evaluated early,
+        // so the next step() does not repeat them. Returns false for Hermite and Block, whose force
+        // passes bypass the force engine.
+        bool synchronise(ParticleSystem& particle_system, ForceEngine& force_engine);
+
+        // State carried between steps, and continuing from a state saved with the current particle system.
+        IntegratorState getState() const;
+        void setState(const IntegratorState& state);
+
+        // Reorder the per-body state after ParticleSystem::permute(order), so the next step continues
+        // the same trajectory.
+        void permute(const std::vector<std::size_t>& order);
+
+        // Accessor methods
+        IntegratorScheme getScheme() const;
+        long getForceEvaluations() const;
+
+        // Number of single-body force evaluations: N per full evaluation, or the active bodies of every Block substep.
+        long getBodyEvaluations() const;
+
+        // Accuracy parameter eta of the Block scheme, 0.01 by default.
+        void setTimestepAccuracy(double eta);
+
+    protected:
+        // Make sure the stored accelerations belong to the current positions.
+        void ensureAcceleration(ParticleSystem& particle_system, ForceEngine& force_engine);
+
+        // Kick-drift-kick substep of length h, leaving the accelerations at the new positions.
+        void leapfrogStep(ParticleSystem& particle_system, ForceEngine& force_engine, const double& h);
+
+        void computeAcceleration(ParticleSystem& particle_system, ForceEngine& force_engine);
+
+        IntegratorScheme scheme_;
+        bool acceleration_valid_;
+        long force_evaluations_;
+        long body_evaluations_;
+        HermiteIntegrator hermite_;
+        BlockTimestepper block_;
+};
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Calculate the acceleration of body i and its time derivative (the jerk) due to all other
+// bodies in the system, in one pass over the sources so both share the separation and its
+// softened distance:
+//   a_i = sum_j m_j r_ij / (r_ij^2 + epsilon^2)^(3/2)
+//   j_i = sum_j m_j [v_ij / (r_ij^2 + epsilon^2)^(3/2) - 3 (r_ij . v_ij) r_ij / (r_ij^2 + epsilon^2)^(5/2)]
+// with r_ij = x_j - x_i and v_ij = v_j - v_i. Bodies with r^2 + epsilon^2 == 0 contribute nothing.
+void sumAccelerationJerk(const ParticleSystem& particle_system, std::size_t i, const double& epsilon,
+                         double acceleration[3], double jerk[3]);
+
+// Calculate the acceleration and jerk of every body. Accelerations are stored in the particle
+// system and jerks in jx, jy and jz, each of length size().
+void sumAccelerationJerk(ParticleSystem& particle_system, const double& epsilon, double* jx, double* jy, double* jz);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Relative tolerance of the mixed-precision kernel against direct summation in double.
+// Positions relative to the centre of the system, masses and pair terms are single precision
+// (about 6e-8), partial sums over a source tile are single precision and the sum over tiles is
+// double, so the error grows with the square root of the tile size rather than of N. On random
+// discs of 1024 to 16384 bodies the mean error is 1e-6 to 4e-6 and the largest 7e-5, on bodies
+// whose net force is the near-cancellation of much larger ones.
+constexpr double mixed_kernel_tolerance = 1e-4;
+
+// Calculate the net acceleration of every body with cache-blocked direct summation in which the
+// pair interactions are evaluated in Scalar, float or double, and the sum of every target is
+// accumulated in double. Positions are copied into Scalar arrays relative to the centre of the
+// bounding box of the system, so separations keep their relative precision wherever the system
+// lies. With float, twice as many bodies fit every SIMD register and cache line as with double,
+// and on AVX2 or AVX-512 CPUs 1/r is a refined rsqrt estimate instead of a square root and a division.
+// With double, the result is that of tiledSumAcceleration to within rounding, which makes it the
+// reference of the float path in accuracy and throughput comparisons.
+// A tile_size of 0 uses detectTileSize() scaled to the size of Scalar. Bodies with
+// r^2 + epsilon^2 == 0 contribute nothing. With with_potential, the potential of every body is
+// accumulated in the same sweep, also in double across tiles.
+// Instantiated for float and double.
+template <typename Scalar>
+void precisionSumAcceleration(ParticleSystem& particle_system, const double& epsilon = 0.0, std::size_t tile_size = 0,
+                              bool with_potential = false);
+}
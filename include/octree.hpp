@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// A cubic cell of the octree. Bodies are stored sorted along a Morton curve, so every
+// cell covers the contiguous range [begin, end) of sorted bodies and the children of a
+// cell are stored contiguously in nodes[first_child, first_child + num_children).
+struct OctreeNode {
+    double centre[3];       // geometric centre of the cube
+    double half_width;      // half of the side length of the cube
+    double com[3];          // centre of mass of the bodies in the cell
+    double mass;            // total mass of the bodies in the cell
+    int begin;
+    int end;
+    int first_child;        // -1 for a leaf
+    int num_children;
+    int level;
+};
+
+// The Octree class sorts the bodies of a particle system by Morton key and builds an
+// adaptive octree over them. Cells are split until they hold at most leaf_size bodies.
+// The tree is rebuilt from scratch by build(), which runs in parallel with OpenMP:
+// keys are computed in parallel and the subtrees below the top levels are built concurrently.
+class Octree {
+    public:
+        Octree(int leaf_size = 16);
+
+        // Sort the bodies and rebuild the tree for the current positions.
+        void build(const ParticleSystem& particle_system);
+
+        // The cells, nodes()[0] is the root.
+        const std::vector<OctreeNode>& nodes() const;
+
+        // Body index in the particle system of the k-th sorted body.
+        const std::vector<std::size_t>& order() const;
+
+        // Positions and masses of the bodies in sorted order.
+        const double* x() const { return x_.data(); }
+        const double* y() const { return y_.data(); }
+        const double* z() const { return z_.data(); }
+        const double* mass() const { return mass_.data(); }
+
+        int getLeafSize() const;
+        std::size_t size() const;
+
+        // Morton key of a point with integer coordinates below 2^21 on each axis.
+        static std::uint64_t mortonKey(std::uint32_t ix, std::uint32_t iy, std::uint32_t iz);
+
+    protected:
+        // Build the subtree of nodes[node_index], appending its descendants to nodes.
+        void buildSubtree(std::vector<OctreeNode>& nodes, int node_index, int stop_level) const;
+
+        // Set mass and centre of mass of a cell from its bodies or its children.
+        void computeMoments(std::vector<OctreeNode>& nodes, OctreeNode& node) const;
+
+        int leaf_size_;
+        std::vector<OctreeNode> nodes_;
+        std::vector<std::size_t> order_;
+        std::vector<std::uint64_t> keys_;
+        AlignedVector<double> x_, y_, z_, mass_;
+};
+}
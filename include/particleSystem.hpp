@@ -0,0 +1,165 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <vector>
+#include <cstddef>
+#include <new>
+
+#include "acceleration.hpp"
+
+using Eigen::Vector3d;
+
+namespace n_body
+{
+
+// Allocator that hands out storage aligned to a cache line, so every component array
+// of the particle store starts on a 64-byte boundary and can be loaded with aligned SIMD loads.
+template <typename T, std::size_t Alignment = 64>
+class AlignedAllocator {
+    public:
+        using value_type = T;
+
+        template <typename U>
+        struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+        AlignedAllocator() noexcept = default;
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+        }
+        void deallocate(T* p, std::size_t) noexcept {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// The ParticleSystem class stores a whole n-body system as a structure of arrays.
+// Positions, velocities, accelerations, potentials and masses live in contiguous, aligned per-component
+// arrays (x[], y[], z[], ...) instead of one Particle object per body, so force loops stream
+// unit-stride data rather than chasing pointers.
+//
+// Bodies may be reordered in memory with permute(), for example along a space-filling curve. Every
+// body keeps the id it was created with, its index before any reordering, so output that names or
+// orders bodies (planet names, trajectory frames) can stay the same.
+class ParticleSystem {
+    public:
+        ParticleSystem() = default;
+
+        // Constructs a system of num_particles bodies with every component set to zero.
+        explicit ParticleSystem(std::size_t num_particles);
+
+        // Constructs a system from a list of particles, keeping their order.
+        explicit ParticleSystem(const std::vector<particleAcceleration>& particle_list);
+
+        // Number of bodies in the system.
+        std::size_t size() const;
+
+        // Bytes held by the component arrays.
+        std::size_t memoryUsage() const;
+
+        // Resize every component array, new bodies are zero-initialised and get the next ids. After a
+        // shrink the ids of the bodies kept are renumbered to [0, size()) in the same relative order.
+        void resize(std::size_t num_particles);
+
+        // Append a body to the end of the system.
+        void addParticle(const Eigen::Vector3d& position, const Eigen::Vector3d& velocity, double mass);
+
+        // Accessor methods for body i
+        Eigen::Vector3d getPosition(std::size_t i) const;
+        Eigen::Vector3d getVelocity(std::size_t i) const;
+        Eigen::Vector3d getAcceleration(std::size_t i) const;
+        double getMass(std::size_t i) const;
+
+        // Potential phi_i = -sum_j m_j / sqrt(r_ij^2 + epsilon^2) of body i, as left by the last force
+        // pass that was asked for it.
+        double getPotential(std::size_t i) const;
+
+        // Id of body i, its index when the system was built.
+        std::size_t getId(std::size_t i) const;
+
+        // Index of every body by id, the inverse of the ids.
+        std::vector<std::size_t> indexById() const;
+
+        // Move body order[k] to index k for every k, every array including the ids. The accelerations
+        // and potentials move with their bodies, so they stay valid. Throws std::invalid_argument
+        // unless order is a permutation of the indices.
+        void permute(const std::vector<std::size_t>& order);
+
+        // Update methods for body i
+        void uploadPosition(std::size_t i, const Eigen::Vector3d& position);
+        void uploadVelocity(std::size_t i, const Eigen::Vector3d& velocity);
+        void initialAcceleration(std::size_t i, const Eigen::Vector3d& acceleration);
+
+        // Raw component arrays, each of length size() and 64-byte aligned.
+        double* x() { return x_.data(); }
+        double* y() { return y_.data(); }
+        double* z() { return z_.data(); }
+        double* vx() { return vx_.data(); }
+        double* vy() { return vy_.data(); }
+        double* vz() { return vz_.data(); }
+        double* ax() { return ax_.data(); }
+        double* ay() { return ay_.data(); }
+        double* az() { return az_.data(); }
+        double* mass() { return mass_.data(); }
+        double* potential() { return potential_.data(); }
+        const double* x() const { return x_.data(); }
+        const double* y() const { return y_.data(); }
+        const double* z() const { return z_.data(); }
+        const double* vx() const { return vx_.data(); }
+        const double* vy() const { return vy_.data(); }
+        const double* vz() const { return vz_.data(); }
+        const double* ax() const { return ax_.data(); }
+        const double* ay() const { return ay_.data(); }
+        const double* az() const { return az_.data(); }
+        const double* mass() const { return mass_.data(); }
+        const double* potential() const { return potential_.data(); }
+
+        // Ids of the bodies, each of them once.
+        std::size_t* id() { return id_.data(); }
+        const std::size_t* id() const { return id_.data(); }
+
+        // Calculate the net acceleration of body i due to all other bodies in the system.
+        // Uses the same softened expression as particleAcceleration::calcAcceleration.
+        // With with_potential, the potential of body i is accumulated in the same loop.
+        void sumAcceleration(std::size_t i, const double& epsilon = 0.0, bool with_potential = false);
+
+        // Calculate the net acceleration of every body in the system.
+        void sumAcceleration(const double& epsilon = 0.0, bool with_potential = false);
+
+        // Updates the position and velocity of body i with explicit Euler, as Particle::update does.
+        void update(std::size_t i, const double& dt);
+
+        // Updates the position and velocity of every body in the system.
+        void update(const double& dt);
+
+        // Advance every velocity by dt times the current acceleration.
+        void kick(const double& dt);
+
+        // Advance every position by dt times the current velocity.
+        void drift(const double& dt);
+
+        // Advance every position by dt times the velocity plus dt^2 / 2 times the acceleration,
+        // the position update of velocity Verlet.
+        void driftAccelerated(const double& dt);
+
+        // Convert the system back into a list of particles.
+        std::vector<particleAcceleration> toParticleList() const;
+
+    protected:
+        AlignedVector<double> x_, y_, z_;
+        AlignedVector<double> vx_, vy_, vz_;
+        AlignedVector<double> ax_, ay_, az_;
+        AlignedVector<double> potential_;
+        AlignedVector<double> mass_;
+        std::vector<std::size_t> id_;
+};
+}
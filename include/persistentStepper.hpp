@@ -0,0 +1,45 @@
+#pragma once
+
+#include "integrator.hpp"
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// The PersistentStepper class runs many timesteps of direct summation inside one OpenMP parallel
+// region, instead of forking and joining threads for every force evaluation and update. The
+// steps are separated by the barriers of worksharing loops, and the force and update phases of a
+// step are fused into one loop: positions are double buffered, so body i can move as soon as its
+// acceleration is known while the other threads still read the old positions.
+//
+// Euler, Leapfrog and VelocityVerlet are supported, with the same trajectories as Integrator and
+// one barrier per step. Leapfrog and VelocityVerlet join the closing half kick of one step with
+// the opening half kick and drift of the next, and keep the accelerations for the next run().
+// The team has at most one thread per 32 bodies, so small systems such as the Solar System run
+// on one thread without any barriers. Call reset() if positions or masses are changed outside
+// of run().
+class PersistentStepper {
+    public:
+        // Throws std::invalid_argument for schemes other than Euler, Leapfrog and VelocityVerlet.
+        PersistentStepper(IntegratorScheme scheme = IntegratorScheme::Leapfrog, double epsilon = 0.0);
+
+        // Advance every body of the particle system by num_steps steps of dt.
+        void run(ParticleSystem& particle_system, const double& dt, long num_steps);
+
+        // Forget the stored accelerations, the next run evaluates them again.
+        void reset();
+
+        // Accessor methods
+        IntegratorScheme getScheme() const;
+        long getForceEvaluations() const;
+
+    protected:
+        IntegratorScheme scheme_;
+        double epsilon_;
+        bool acceleration_valid_;
+        long force_evaluations_;
+
+        // Second position buffer, the positions of the next step are written here
+        AlignedVector<double> x_next_, y_next_, z_next_;
+};
+}
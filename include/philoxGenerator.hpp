@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "particleSystem.hpp"
+#include "systemSimulator.hpp"
+
+namespace n_body
+{
+
+// Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3", SC11): ten rounds of multiply and xor scramble a 128-bit counter under a
+// 64-bit key into four random 32-bit words. Every counter gives its own independent output, so
+// any body can draw its numbers without stepping a shared sequential state.
+std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> counter, std::array<std::uint32_t, 2> key);
+
+// Distributions of the parallel random generator.
+// Disc: the RandomSystemGenerator layout, a central star of mass 1 and num_particles bodies on
+//       circular orbits in the plane at radii uniform in [0.4, 30], with masses in [1/6000000, 1/1000].
+// Plummer: a Plummer sphere of total mass 1 and scale radius 1 in equilibrium (G = 1), equal masses,
+//          sampled as in Aarseth, Henon & Wielen (1974) and cut off at 10 scale radii.
+// Clumps: cold clumps, num_particles equal masses of total 1 at rest, in uniform spheres of
+//         radius 0.1 whose centres are uniform within radius 10.
+// Plummer and Clumps are shifted to their centre of mass.
+enum class SystemDistribution { Disc, Plummer, Clumps };
+
+// Parse a distribution name such as "disc", "plummer" or "clumps", throws std::invalid_argument otherwise.
+SystemDistribution parseSystemDistribution(const std::string& name);
+
+// Name of a distribution, e.g. "plummer".
+std::string systemDistributionName(SystemDistribution distribution);
+
+// Parallel random initial condition generator. Body i draws only from the Philox counters (i, k)
+// under the seed, so the arrays are filled by parallel loops and the output for a given seed does
+// not depend on the number of threads. Sums such as the centre of mass are taken over fixed blocks
+// of bodies in a fixed order for the same reason.
+class PhiloxSystemGenerator : public InitialConditionGenerator {
+    public:
+        PhiloxSystemGenerator(std::uint64_t seed = 42, long num_particles = 8,
+                              SystemDistribution distribution = SystemDistribution::Disc, int num_clumps = 8);
+
+        // Fill a particle system in parallel.
+        ParticleSystem generateParticleSystem() override;
+
+        // The same bodies as a list of particles.
+        std::vector<particleAcceleration> generateInitialConditions() override;
+
+    protected:
+        std::uint64_t seed_;
+        long num_particles_;
+        SystemDistribution distribution_;
+        int num_clumps_;
+};
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace n_body
+{
+
+// Phases of a run timed by the profiler.
+// Force: force passes of every kernel, the acceleration and jerk passes of Hermite and Block, and
+//        the fused force and update loop of the PersistentStepper.
+// Integration: kicks, drifts and the other updates of the integrators, without their force passes.
+// Energy: kinetic and potential energy diagnostics.
+// Output: trajectory frames and checkpoints copied for the background writers.
+enum class ProfilePhase { Force, Integration, Energy, Output };
+constexpr int num_profile_phases = 4;
+
+// Name of a phase, e.g. "force".
+std::string profilePhaseName(ProfilePhase phase);
+
+// Totals of one phase since the profiler was reset. The seconds of a phase exclude the phases
+// nested inside it, so the force passes of an integrator step are not counted twice. Interactions
+// are body-body contributions, N (N - 1) for a direct force pass whatever the kernel, and bytes
+// count every array read or written once, the least traffic the pass can cause.
+struct PhaseProfile {
+    ProfilePhase phase;
+    long calls;
+    double seconds;
+    double interactions;
+    double flops;
+    double bytes;
+
+    // Busy time per thread in the parallel loops of the phase, the gap between the slowest thread
+    // and the mean is time the other threads spent waiting at the barrier
+    int threads;
+    double min_thread_seconds;
+    double mean_thread_seconds;
+    double max_thread_seconds;
+};
+
+// Report of a profiled run, with the wall time since the profiler was reset.
+struct ProfileReport {
+    double wall_seconds;
+    std::vector<PhaseProfile> phases;
+};
+
+// The Profiler class accumulates the time, calls and throughput counters of each phase. Scopes and
+// counters are recorded from serial code, busy times from inside parallel regions, each thread in
+// its own cache line. Use the NBODY_PROFILE_* macros below rather than calling it directly, so the
+// instrumentation disappears from builds without NBODY_PROFILING.
+class Profiler {
+    public:
+        Profiler();
+
+        // The profiler the macros record into.
+        static Profiler& global();
+
+        // Clear every total and restart the wall clock.
+        void reset();
+
+        // Record one call of a phase lasting seconds, exclusive of nested phases.
+        void addTime(ProfilePhase phase, double seconds);
+
+        // Record busy time of one thread inside a parallel loop of a phase.
+        void addThreadTime(ProfilePhase phase, int thread, double seconds);
+
+        // Add work done in a phase.
+        void count(ProfilePhase phase, double interactions, double flops, double bytes);
+
+        // Make room for the busy times of num_threads threads, called from serial code.
+        void reserveThreads(int num_threads);
+
+        // Totals of every phase.
+        ProfileReport report() const;
+
+    protected:
+        struct alignas(64) ThreadTimes {
+            double seconds[num_profile_phases];
+        };
+
+        std::chrono::steady_clock::time_point start_;
+        std::array<long, num_profile_phases> calls_;
+        std::array<double, num_profile_phases> seconds_;
+        std::array<double, num_profile_phases> interactions_;
+        std::array<double, num_profile_phases> flops_;
+        std::array<double, num_profile_phases> bytes_;
+        std::vector<ThreadTimes> thread_times_;
+};
+
+// Times a phase from construction to destruction on the calling thread. Scopes nest: the time of
+// an inner scope is taken out of the outer one.
+class ProfileScope {
+    public:
+        explicit ProfileScope(ProfilePhase phase);
+        ~ProfileScope();
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    protected:
+        ProfilePhase phase_;
+        std::chrono::steady_clock::time_point start_;
+        double nested_seconds_;
+        ProfileScope* parent_;
+};
+
+// Times the share of one thread inside a parallel region. Place it before a worksharing loop with
+// nowait, so the time spent waiting at the barrier is left out.
+class ProfileThreadScope {
+    public:
+        explicit ProfileThreadScope(ProfilePhase phase);
+        ~ProfileThreadScope();
+        ProfileThreadScope(const ProfileThreadScope&) = delete;
+        ProfileThreadScope& operator=(const ProfileThreadScope&) = delete;
+
+    protected:
+        ProfilePhase phase_;
+        int thread_;
+        std::chrono::steady_clock::time_point start_;
+};
+
+// Body-body interactions of a direct pass over num_bodies bodies, N (N - 1).
+inline double pairInteractions(std::size_t num_bodies) {
+    return static_cast<double>(num_bodies) * (static_cast<double>(num_bodies) - 1.0);
+}
+
+// Write a report as JSON, or as CSV with one row per phase, throws std::runtime_error if the file cannot be written.
+void writeProfileJson(const std::string& path, const ProfileReport& report);
+void writeProfileCsv(const std::string& path, const ProfileReport& report);
+
+// Whether the library was built with the instrumentation (cmake -DNBODY_PROFILING=ON).
+#ifdef NBODY_PROFILING
+constexpr bool profiling_enabled = true;
+#else
+constexpr bool profiling_enabled = false;
+#endif
+}
+
+// Instrumentation macros, empty unless NBODY_PROFILING is defined, so that disabled builds neither
+// read the clock nor evaluate the counter arguments.
+#ifdef NBODY_PROFILING
+#define NBODY_PROFILE_CONCAT_INNER(a, b) a##b
+#define NBODY_PROFILE_CONCAT(a, b) NBODY_PROFILE_CONCAT_INNER(a, b)
+#define NBODY_PROFILE_SCOPE(phase) n_body::ProfileScope NBODY_PROFILE_CONCAT(profile_scope_, __LINE__)(n_body::ProfilePhase::phase)
+#define NBODY_PROFILE_THREAD(phase) n_body::ProfileThreadScope NBODY_PROFILE_CONCAT(profile_thread_, __LINE__)(n_body::ProfilePhase::phase)
+#define NBODY_PROFILE_COUNT(phase, interactions, flops, bytes) n_body::Profiler::global().count(n_body::ProfilePhase::phase, (interactions), (flops), (bytes))
+#else
+#define NBODY_PROFILE_SCOPE(phase)
+#define NBODY_PROFILE_THREAD(phase)
+#define NBODY_PROFILE_COUNT(phase, interactions, flops, bytes)
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "forceEngine.hpp"
+#include "integrator.hpp"
+
+namespace n_body
+{
+
+// Placement of the OpenMP threads on the CPUs the process may run on.
+// None: every thread may run on any of them, the scheduler decides.
+// Close: thread t is pinned to the t-th CPU, filling neighbouring cores (and their shared caches) first.
+// Spread: the threads are pinned as far apart as possible, spreading them over sockets and caches.
+enum class ThreadBinding { None, Close, Spread };
+
+// Parse a binding name such as "none", "close" or "spread", throws std::invalid_argument otherwise.
+ThreadBinding parseThreadBinding(const std::string& name);
+
+// Name of a binding, e.g. "close".
+std::string threadBindingName(ThreadBinding binding);
+
+// Pin the threads of a team of num_threads OpenMP threads and return the CPU of each, -1 when not
+// pinned. OpenMP runtimes keep the same system thread for each thread number while the team size
+// stays the same, so the pinning holds for the following parallel regions of that size. The
+// allowed CPUs are the affinity mask of the process when it is first called, so with None the
+// threads go back to the whole mask. Throws std::runtime_error if the mask cannot be set.
+std::vector<int> bindThreads(int num_threads, ThreadBinding binding);
+
+// Scaling studies.
+// Strong: every size is run on every thread count, the work per step stays the same.
+// Weak: the sizes are those of the smallest thread count and grow with the thread count so the
+//       work per thread stays the same: N p / p0 bodies for the tree kernels, which are close to
+//       linear in N, and N sqrt(p / p0) for direct summation, whose work grows as N^2.
+enum class ScalingMode { Strong, Weak };
+
+// Parse a mode name, "strong" or "weak", throws std::invalid_argument otherwise.
+ScalingMode parseScalingMode(const std::string& name);
+
+// Name of a mode, e.g. "weak".
+std::string scalingModeName(ScalingMode mode);
+
+// Settings of a scaling study.
+struct ScalingOptions {
+    ScalingMode mode = ScalingMode::Strong;
+    std::vector<long> sizes = {1024, 4096};
+    std::vector<int> threads = {1};
+    ThreadBinding binding = ThreadBinding::None;
+    IntegratorScheme scheme = IntegratorScheme::Leapfrog;
+    double dt = 0.001;
+
+    // Untimed steps before the repeats, and the number of timed repeats of steps steps each
+    int warmup_steps = 1;
+    int repeats = 5;
+    int steps = 5;
+    std::uint64_t seed = 42;
+};
+
+// One measurement: a size on a thread count. Speedup and efficiency are against the smallest
+// thread count of the same size (strong) or of the same base size (weak), so the first thread
+// count has efficiency 1. Interactions are those of direct summation, N (N - 1) per force
+// evaluation, also for the tree kernels, so the rates of all kernels compare.
+struct ScalingPoint {
+    int threads;
+    long base_size;
+    long num_bodies;
+    double median_seconds;
+    double min_seconds;
+    double max_seconds;
+    double speedup;
+    double efficiency;
+    double interactions_per_second;
+    std::vector<int> cpus;
+};
+
+// Report of a scaling study.
+struct ScalingReport {
+    ScalingOptions options;
+    std::string kernel;
+    int num_procs;
+    std::vector<ScalingPoint> points;
+};
+
+// Time integrator steps of random discs (PhiloxSystemGenerator) on every size and thread count of
+// the options. Each point generates its system, pins the threads, takes the warm-up steps and then
+// times repeats runs of steps steps; the seconds per step are the median, min and max over the
+// repeats. The OpenMP thread count is restored afterwards. Throws std::invalid_argument if a size
+// is below two bodies, a thread count is not positive or there are no repeats.
+ScalingReport runScalingStudy(const ScalingOptions& options, ForceEngine& force_engine);
+
+// Write a report as JSON, or as CSV with one row per point, throws std::runtime_error if the file cannot be written.
+void writeScalingJson(const std::string& path, const ScalingReport& report);
+void writeScalingCsv(const std::string& path, const ScalingReport& report);
+}
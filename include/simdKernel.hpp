@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Instruction set used by the vectorised direct-summation kernel.
+// Auto picks the widest path the running CPU supports.
+enum class SimdPath { Auto, Scalar, AVX2, AVX512 };
+
+// Relative tolerance of the vectorised kernel against particleAcceleration::calcAcceleration.
+// The AVX2 path refines a single-precision rsqrt estimate (12 bits) and the AVX-512 path
+// refines rsqrt14 (14 bits), both with two Newton steps, which leaves the softened 1/r^3
+// accurate to about 1e-13. Summing over bodies in a different order adds rounding noise,
+// so per-body accelerations agree with the pow()-based kernel to within 1e-10.
+// Separations whose r^2 + epsilon^2 lies outside the float range (below ~1e-38) are not supported.
+constexpr double simd_kernel_tolerance = 1e-10;
+
+// Detect the widest SIMD path supported by the CPU running the program.
+SimdPath detectSimdPath();
+
+// Name of a SIMD path, e.g. "avx2".
+std::string simdPathName(SimdPath path);
+
+// Parse a SIMD path name such as "avx512", throws std::invalid_argument otherwise.
+SimdPath parseSimdPath(const std::string& name);
+
+// Calculate the net acceleration of every body with vectorised direct summation.
+// Each instruction processes 4 (AVX2) or 8 (AVX-512) source bodies at once; the target itself and
+// bodies with r^2 + epsilon^2 == 0 contribute nothing.
+// With with_potential, the potential of every body is accumulated from the same reciprocal distances.
+void simdSumAcceleration(ParticleSystem& particle_system, const double& epsilon = 0.0, SimdPath path = SimdPath::Auto, bool with_potential = false);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "integrator.hpp"
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Space-filling curves through the cells of a 2^21 grid on the bounding cube of the bodies.
+// Morton: bits of the three cell coordinates interleaved, cheap but with jumps between octants.
+// Hilbert: every cell follows a face-neighbour of the previous one, so runs of bodies are more compact.
+enum class SpaceFillingCurve { Morton, Hilbert };
+
+// Parse a curve name, "morton" or "hilbert", throws std::invalid_argument otherwise.
+SpaceFillingCurve parseSpaceFillingCurve(const std::string& name);
+
+// Name of a curve, e.g. "hilbert".
+std::string spaceFillingCurveName(SpaceFillingCurve curve);
+
+// Hilbert key of a point with integer coordinates below 2^bits on each axis, bits at most 21.
+std::uint64_t hilbertKey(std::uint32_t ix, std::uint32_t iy, std::uint32_t iz, int bits = 21);
+
+// Keys of the bodies along a curve through the 2^bits cells per axis of their bounding cube.
+std::vector<std::uint64_t> spaceFillingKeys(const ParticleSystem& particle_system, SpaceFillingCurve curve, int bits = 21);
+
+// Stable least-significant-digit radix sort of keys whose bits above key_bits are zero, 8 bits per
+// pass, carrying values along. The threads count the digits of their own parts of the keys and
+// scatter them to the offsets of a shared prefix sum; passes on which every key has the same digit
+// are skipped. Throws std::invalid_argument if values and keys differ in length.
+void radixSort(std::vector<std::uint64_t>& keys, std::vector<std::size_t>& values, int key_bits = 64);
+
+// Order of the bodies along a curve through 2^10 cells per axis, enough to keep neighbours close in
+// memory with four radix sort passes: order[k] is the index of the k-th body on it.
+std::vector<std::size_t> spaceFillingOrder(const ParticleSystem& particle_system, SpaceFillingCurve curve);
+
+// Mean distance between bodies that are neighbours in memory, which grows as bodies that were
+// sorted along a curve move apart.
+double storageSpread(const ParticleSystem& particle_system);
+
+// The SpatialSorter class keeps the bodies of a particle system sorted along a space-filling curve
+// as they move, so that bodies close in space are close in memory for the tree builds, the tiled
+// kernels and neighbour searches. The particle system keeps the id of every body, so the indices
+// seen by the user stay the same.
+//
+// The bodies are sorted on the first call of update(), then every reorder_every calls if it is
+// positive, or otherwise whenever storageSpread() has grown to degradation times its value right
+// after the last sort.
+class SpatialSorter {
+    public:
+        SpatialSorter(SpaceFillingCurve curve = SpaceFillingCurve::Hilbert, long reorder_every = 0, double degradation = 2.0);
+
+        // Sort the bodies if due, carrying the per-body state of the integrator along. Returns true if sorted.
+        bool update(ParticleSystem& particle_system, Integrator& integrator);
+
+        // Sort the bodies now, carrying the per-body state of the integrator along.
+        void reorder(ParticleSystem& particle_system, Integrator& integrator);
+
+        // Accessor methods
+        SpaceFillingCurve getCurve() const;
+        long getReorderEvery() const;
+        double getDegradation() const;
+        long getReorders() const;
+        double getSeconds() const;
+
+    protected:
+        SpaceFillingCurve curve_;
+        long reorder_every_;
+        double degradation_;
+        long calls_;
+        long reorders_;
+        double sorted_spread_;
+        double seconds_;
+};
+}
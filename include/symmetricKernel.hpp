@@ -0,0 +1,18 @@
+#pragma once
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Calculate the net acceleration of every body with direct summation over unordered pairs.
+// Each pair (i, j) is evaluated once and applied with opposite signs to both bodies
+// (Newton's third law), which halves the work of the per-body kernels.
+//
+// The bodies are split into an even number of blocks, two per thread. Block pairs are
+// scheduled as a round robin tournament: within one round no two block pairs share a block,
+// so every thread writes to its own two blocks and no atomics or private copies are needed.
+// Bodies with r^2 + epsilon^2 == 0 contribute nothing. With with_potential, the potential of
+// every body is accumulated in the same sweep.
+void symmetricSumAcceleration(ParticleSystem& particle_system, const double& epsilon = 0.0, bool with_potential = false);
+}
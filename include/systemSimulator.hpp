@@ -1,3 +1,5 @@
+#pragma once
+
 #include <Eigen/Dense>
 #include <vector>
 #include <iostream>
@@ -6,6 +8,8 @@
 #include <memory>
 #include <string>
 #include "acceleration.hpp"
+#include "particleSystem.hpp"
+#include "fmm.hpp"
 
 using Eigen::Vector3d;
 
@@ -15,12 +19,21 @@ namespace n_body
 // Abstract base class for generating initial conditions
 class InitialConditionGenerator {
 public:
+    virtual ~InitialConditionGenerator() = default;
     virtual std::vector<particleAcceleration> generateInitialConditions() = 0;
+
+    // Generate the bodies straight into a particle system. By default the list of particles is
+    // converted; generators of large inputs override it to skip the list.
+    virtual ParticleSystem generateParticleSystem();
 };
 
 // Solar system initial condition generator
 class SolarSystemGenerator : public InitialConditionGenerator {
+private:
+    int seed;
 public:
+    // Constructor with the seed of the random orbital phases of the planets, 42 by default
+    SolarSystemGenerator(int seed = 42);
     std::vector<particleAcceleration> generateInitialConditions() override;
 };
 
@@ -45,16 +58,25 @@ class sysSimulator{
         // Constructor taking an initial condition generator
         sysSimulator (std::shared_ptr<InitialConditionGenerator> gen);
         
-        // Generate particle list using initial condition generator
+        // Generate particle list using initial condition generator. The simulator keeps the bodies as a
+        // particle system, the list is made from it on the first call.
         std::vector<particleAcceleration> particleListGenerator ();
 
-        // Add input data to particle list for calculations
+        // Generate the same particles as a structure-of-arrays particle system
+        ParticleSystem particleSystemGenerator ();
+
+        // Add input data to particle list for calculations. The simulator keeps one shared copy of the
+        // system, in O(N) memory; particles are not given lists of pointers to each other.
         void addSysInput (std::vector<particleAcceleration>& particle_list);
 
-        // Calculate kinetic energy for all particles
+        // Bytes held by the particle list and the particle system of the simulator.
+        std::size_t memoryUsage () const;
+
+        // Calculate kinetic energy for all particles. The energy functions fill lists kept by the
+        // simulator, which are reused from call to call, and return a copy of them.
         std::vector<double> kineticEnergy (std::vector<particleAcceleration>& particle_list);
 
-        // calculate the potential energy and parallelise the calculation using OpenMp
+        // Calculate kinetic energy in parallel using OpenMP
         std::vector<double> kineticEnergyPara (std::vector<particleAcceleration>& particle_list);
 
         // Calculate potential energy for all particles
@@ -63,6 +85,19 @@ class sysSimulator{
         // Calculate potential energy in parallel using OpenMP
         std::vector<double> potentialEnergyPara(std::vector<particleAcceleration>& particle_list); 
 
+        // Energy calculations for a structure-of-arrays particle system, with the softening epsilon of the forces
+        std::vector<double> kineticEnergy (ParticleSystem& particle_system);
+        std::vector<double> kineticEnergyPara (ParticleSystem& particle_system);
+        std::vector<double> potentialEnergy (ParticleSystem& particle_system, const double& epsilon = 0.0);
+        std::vector<double> potentialEnergyPara (ParticleSystem& particle_system, const double& epsilon = 0.0);
+
+        // Calculate potential energy for all bodies in O(N) from the potentials stored by the last force pass
+        // of a ForceEngine with setComputePotential(true). The positions must not have moved since that pass.
+        std::vector<double> potentialEnergyStored (ParticleSystem& particle_system);
+
+        // Calculate potential energy for all bodies in O(N) from the per-body potentials of the fast multipole method
+        std::vector<double> potentialEnergyFmm (ParticleSystem& particle_system, FmmSolver& fmm_solver, const double& epsilon = 0.0);
+
         // Calculate total energy for all particles
         std::vector<double> totalEnergy ();
 
@@ -74,12 +109,14 @@ class sysSimulator{
 
         // Print particle positions
         static void printPosition (std::vector<particleAcceleration>& particle_list, const std::string& label);
+        static void printPosition (ParticleSystem& particle_system, const std::string& label);
 
         // Release memory after particles have been added to particleAcceleration objects
         void releaseMemoryFromParticles(std::vector<particleAcceleration>& particle_list);
     
     protected:
         std::vector<particleAcceleration> particle_list_;
+        ParticleSystem particle_system_;
         std::vector<double> kinetic_energy_list_;
         std::vector<double> potential_energy_list_;
         std::vector<double> total_energy_list_;
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace n_body
+{
+
+// Counters of a TaskPool, summed over all threads since the last resetStatistics().
+// tasks: ranges executed. steals: ranges taken from another thread's deque.
+// failed_steals: steal attempts that found the victim empty or lost a race, i.e. idle polling.
+struct TaskPoolStatistics {
+    long tasks;
+    long steals;
+    long failed_steals;
+};
+
+// The TaskPool class shares irregular loops out between threads by work stealing.
+// parallelFor runs on the OpenMP threads: every thread starts with an equal contiguous share of
+// the iterations as one task in its own Chase-Lev deque. A thread takes its newest task from the
+// bottom of its deque, splits it in half until it is at most grain iterations long, pushing the
+// far halves back, and runs the rest. A thread with an empty deque steals the oldest, and so
+// largest, task from the top of a random victim's deque. Owners and thieves only meet through
+// atomic operations on the deque ends, there are no locks.
+//
+// Tasks are kept in per-thread arenas that are only appended to during a parallelFor and are
+// reused by the next one, so scheduling allocates nothing once the pool has warmed up.
+class TaskPool {
+    public:
+        // A pool for num_threads threads, omp_get_max_threads() if num_threads is 0.
+        explicit TaskPool(int num_threads = 0);
+        ~TaskPool();
+
+        // Call body(begin, end) on disjoint ranges covering [0, n), each at most grain long.
+        void parallelFor(long n, long grain, const std::function<void(long, long)>& body);
+
+        // Number of threads the pool schedules over.
+        int numThreads() const;
+
+        // Counters since construction or the last reset.
+        TaskPoolStatistics statistics() const;
+        void resetStatistics();
+
+    protected:
+        // A half-open range of iterations
+        struct Task {
+            long begin;
+            long end;
+        };
+
+        // Chase-Lev deque of indices into the arena of its thread, with the thread's counters.
+        // The arena is sized before a parallelFor so it never reallocates while others read it,
+        // and the deque never holds more tasks than the arena, so its slots never wrap around.
+        struct alignas(64) Worker {
+            std::vector<Task> arena;
+            long arena_used = 0;
+            std::unique_ptr<std::atomic<long>[]> slots;
+            long capacity = 0;
+            std::atomic<long> top {0};
+            std::atomic<long> bottom {0};
+            std::uint64_t random_state = 0;
+            long tasks = 0;
+            long steals = 0;
+            long failed_steals = 0;
+        };
+
+        // Deque operations: push and take by the owner, steal by any other thread. take and
+        // steal return false if the deque is empty or the race for its last task was lost.
+        static void push(Worker& worker, const Task& task);
+        static bool take(Worker& worker, Task& task);
+        static bool steal(Worker& victim, Task& task);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+};
+}
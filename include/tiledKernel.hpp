@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Number of bodies per tile that fits the source tile (x, y, z, mass) in half of the L1 data
+// cache of the running CPU, a multiple of 8 between 64 and 4096. Falls back to 512 bodies
+// when the cache size is unknown.
+std::size_t detectTileSize();
+
+// Calculate the net acceleration of every body with cache-blocked direct summation, the same
+// result as ParticleSystem::sumAcceleration for every body. Sources are split into tiles of
+// tile_size bodies and targets into blocks of 64; each source tile is loaded once per block of
+// targets and reused from cache by all of them, instead of streaming the whole system once per
+// target. Target blocks are shared out between threads.
+// A tile_size of 0 uses detectTileSize(), a tile_size of at least size() gives the untiled loop.
+// Bodies with r^2 + epsilon^2 == 0 contribute nothing. With with_potential, the potential of every
+// body is accumulated in the same sweep.
+void tiledSumAcceleration(ParticleSystem& particle_system, const double& epsilon = 0.0, std::size_t tile_size = 0,
+                          bool with_potential = false);
+}
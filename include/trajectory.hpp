@@ -0,0 +1,127 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "particleSystem.hpp"
+
+namespace n_body
+{
+
+// Binary trajectory file layout, all little-endian:
+//   header, 64 bytes:  char magic[8] = "NBTRAJ1", uint32 precision (4 or 8 bytes per value),
+//                      uint32 flags (bit 0: velocities stored), uint64 num_bodies, zero padding
+//   frame k, at 64 + k * frameBytes(): uint64 step, float64 time, then the contiguous blocks
+//                      x[N], y[N], z[N] and, with velocities, vx[N], vy[N], vz[N], each value
+//                      a float32 or float64.
+// Frames have a fixed size, so frame k can be found without reading the others and the number of
+// frames follows from the file size; a run that stops early leaves a readable file.
+enum class TrajectoryPrecision : std::uint32_t { Float32 = 4, Float64 = 8 };
+
+// Size of the header and of one frame in bytes.
+constexpr std::size_t trajectory_header_bytes = 64;
+std::size_t trajectoryFrameBytes(std::size_t num_bodies, TrajectoryPrecision precision, bool velocities);
+
+// The TrajectoryWriter class streams snapshots of a particle system to a binary trajectory file
+// from a background thread. write() converts the positions (and velocities) into a free buffer and
+// returns; the thread writes the other buffer to disk meanwhile. With two buffers, write() only
+// waits when the disk has not finished the previous frame by the time the next one is due.
+class TrajectoryWriter {
+    public:
+        // Create the file and write its header, throws std::runtime_error if it cannot be opened.
+        TrajectoryWriter(const std::string& path, std::size_t num_bodies,
+                         TrajectoryPrecision precision = TrajectoryPrecision::Float64, bool velocities = true);
+
+        // Write the remaining frames and close the file.
+        ~TrajectoryWriter();
+
+        TrajectoryWriter(const TrajectoryWriter&) = delete;
+        TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+        // Queue a snapshot of the particle system, which must have num_bodies bodies. Bodies are
+        // written in the order of their ids, so reordering the system does not change the frames.
+        // Throws std::runtime_error if an earlier frame could not be written.
+        void write(const ParticleSystem& particle_system, std::uint64_t step, double time);
+
+        // Write the remaining frames and close the file, rethrowing any write error. Called by the destructor.
+        void close();
+
+        // Frames handed to write(), and the seconds write() spent waiting for a free buffer.
+        std::size_t getFramesWritten() const;
+        double getWaitSeconds() const;
+
+    protected:
+        // Background thread, writes full buffers until close()
+        void writerLoop();
+
+        std::FILE* file_;
+        std::size_t num_bodies_;
+        TrajectoryPrecision precision_;
+        bool velocities_;
+        std::size_t frame_bytes_;
+
+        // Two frame buffers: full_[b] is set by write() and cleared by the thread once buffer b is on disk
+        std::vector<unsigned char> buffers_[2];
+        bool full_[2];
+        int next_buffer_;
+        bool closing_;
+        std::exception_ptr error_;
+        std::mutex mutex_;
+        std::condition_variable buffer_full_;
+        std::condition_variable buffer_free_;
+        std::thread thread_;
+
+        std::size_t frames_written_;
+        double wait_seconds_;
+};
+
+// The TrajectoryReader class maps a binary trajectory file into memory read-only, so frames are
+// read straight from the page cache without copying the file.
+class TrajectoryReader {
+    public:
+        // Map the file and check its header, throws std::runtime_error if it is not a trajectory file.
+        explicit TrajectoryReader(const std::string& path);
+        ~TrajectoryReader();
+
+        TrajectoryReader(const TrajectoryReader&) = delete;
+        TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+        // Accessor methods
+        std::size_t numBodies() const;
+        std::size_t numFrames() const;
+        TrajectoryPrecision getPrecision() const;
+        bool hasVelocities() const;
+
+        // Step and time of frame k.
+        std::uint64_t step(std::size_t frame) const;
+        double time(std::size_t frame) const;
+
+        // Start of block c of frame k, c = 0, 1, 2 for x, y, z and 3, 4, 5 for vx, vy, vz, holding
+        // numBodies() values of getPrecision(). Points into the mapping, valid while the reader lives.
+        const void* component(std::size_t frame, int c) const;
+
+        // Copy frame k into a particle system of numBodies() bodies, converting to double. Stored body k
+        // goes to the body with id k, wherever it sits, so the ids are kept. Velocities are left alone
+        // if the file has none.
+        void readFrame(std::size_t frame, ParticleSystem& particle_system) const;
+
+    protected:
+        const unsigned char* frame(std::size_t frame) const;
+
+        int fd_;
+        const unsigned char* data_;
+        std::size_t size_;
+        std::size_t num_bodies_;
+        TrajectoryPrecision precision_;
+        bool velocities_;
+        std::size_t frame_bytes_;
+        std::size_t num_frames_;
+};
+}
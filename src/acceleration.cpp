@@ -15,7 +15,7 @@ void particleAcceleration::addParticle (n_body::particleAcceleration& add_partic
 };
 
 // Get the list of particles.
-std::vector <n_body::particleAcceleration*> particleAcceleration::getParticle (){
+const std::vector <n_body::particleAcceleration*>& particleAcceleration::getParticle () const{
     return particle_list_;
 };
 
@@ -34,7 +34,7 @@ Vector3d particleAcceleration::calcAcceleration (const particleAcceleration* p_i
 };
 
 // Calculate the net acceleration of the current particle due to all other particles in the list.
-void particleAcceleration::sumAcceleration (std::vector<n_body::particleAcceleration*> particles_list, const double& epsilon){
+void particleAcceleration::sumAcceleration (const std::vector<n_body::particleAcceleration*>& particles_list, const double& epsilon){
 
     Vector3d sumAcceleration_i = Vector3d::Zero();
 
@@ -52,8 +52,26 @@ void particleAcceleration::sumAcceleration (std::vector<n_body::particleAccelera
     initialAcceleration(sumAcceleration_i);
 };
 
+// Calculate the net acceleration of the current particle due to all other particles of a shared system.
+void particleAcceleration::sumAcceleration (const std::vector<n_body::particleAcceleration>& system, const double& epsilon){
+
+    Vector3d sumAcceleration_i = Vector3d::Zero();
+    for (const particleAcceleration& p_i : system) {
+        if (&p_i != this) {
+            sumAcceleration_i += calcAcceleration(this, &p_i, epsilon);
+        }
+    }
+
+    initialAcceleration(sumAcceleration_i);
+};
+
+// Bytes held by the particle list.
+std::size_t particleAcceleration::memoryUsage () const{
+    return particle_list_.capacity() * sizeof(particleAcceleration*);
+}
+
 // Release memory allocated to the particle list.
 void particleAcceleration::releaseMemory() {
-    particle_list_.shrink_to_fit();
+    std::vector<n_body::particleAcceleration*>().swap(particle_list_);
 }
 }
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+#include "barnesHut.hpp"
+
+namespace n_body
+{
+
+// Constructor for the Barnes-Hut solver
+BarnesHutSolver::BarnesHutSolver(double theta, int leaf_size) : theta_(theta), tree_(leaf_size) {}
+
+// Accessor methods
+double BarnesHutSolver::getOpeningAngle() const {
+    return theta_;
+}
+
+void BarnesHutSolver::setOpeningAngle(double theta) {
+    theta_ = theta;
+}
+
+// Share the tree walks out with a work-stealing pool, or with OpenMP if null
+void BarnesHutSolver::setTaskPool(std::shared_ptr<TaskPool> task_pool) {
+    task_pool_ = std::move(task_pool);
+}
+
+const Octree& BarnesHutSolver::tree() const {
+    return tree_;
+}
+
+// Rebuild the tree and calculate the net acceleration of every body in the particle system
+void BarnesHutSolver::computeAcceleration(ParticleSystem& particle_system, const double& epsilon, bool with_potential) {
+    tree_.build(particle_system);
+
+    const std::vector<OctreeNode>& nodes = tree_.nodes();
+    const std::vector<std::size_t>& order = tree_.order();
+    const double* x = tree_.x();
+    const double* y = tree_.y();
+    const double* z = tree_.z();
+    const double* mass = tree_.mass();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    double* potential = particle_system.potential();
+    const double eps2 = epsilon * epsilon;
+
+    // Squared opening radius of every cell, where delta is the offset of the centre of mass
+    // from the geometric centre. This stops a heavy body near a cell corner (the central star)
+    // from being accepted by targets inside or next to the same cell.
+    open_radius2_.resize(nodes.size());
+    #pragma omp parallel for schedule(static)
+    for (long c = 0; c < static_cast<long>(nodes.size()); ++c) {
+        const OctreeNode& node = nodes[c];
+        double delta_x = node.com[0] - node.centre[0];
+        double delta_y = node.com[1] - node.centre[1];
+        double delta_z = node.com[2] - node.centre[2];
+        double delta = std::sqrt(delta_x * delta_x + delta_y * delta_y + delta_z * delta_z);
+        double radius = theta_ > 0.0 ? 2.0 * node.half_width / theta_ + delta : HUGE_VAL;
+        open_radius2_[c] = radius * radius;
+    }
+    const double* open_radius2 = open_radius2_.data();
+    const long n = static_cast<long>(tree_.size());
+
+    // Walk the tree once per body, in sorted order so neighbouring targets share cells in cache
+    auto walk = [&](long k) {
+        const double xi = x[k], yi = y[k], zi = z[k];
+        double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0, sum_potential = 0.0;
+
+        // The deepest path pushes at most 8 cells per level
+        int stack[8 * 24];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const int cell = stack[--top];
+            const OctreeNode& node = nodes[cell];
+
+            if (node.first_child < 0) {
+                for (int j = node.begin; j < node.end; ++j) {
+                    if (j != k) {
+                        double dx = x[j] - xi;
+                        double dy = y[j] - yi;
+                        double dz = z[j] - zi;
+                        double r2 = dx * dx + dy * dy + dz * dz + eps2;
+                        double inv_r = 1.0 / std::sqrt(r2);
+                        double scale = mass[j] * inv_r * inv_r * inv_r;
+                        sum_x += scale * dx;
+                        sum_y += scale * dy;
+                        sum_z += scale * dz;
+                        sum_potential -= mass[j] * inv_r;
+                    }
+                }
+                continue;
+            }
+
+            double dx = node.com[0] - xi;
+            double dy = node.com[1] - yi;
+            double dz = node.com[2] - zi;
+            double d2 = dx * dx + dy * dy + dz * dz;
+
+            // Opening criterion d > s / theta + delta
+            if (d2 > open_radius2[cell]) {
+                double r2 = d2 + eps2;
+                double inv_r = 1.0 / std::sqrt(r2);
+                double scale = node.mass * inv_r * inv_r * inv_r;
+                sum_x += scale * dx;
+                sum_y += scale * dy;
+                sum_z += scale * dz;
+                sum_potential -= node.mass * inv_r;
+            }
+            else {
+                for (int c = 0; c < node.num_children; ++c) {
+                    stack[top++] = node.first_child + c;
+                }
+            }
+        }
+
+        const std::size_t i = order[k];
+        ax[i] = sum_x;
+        ay[i] = sum_y;
+        az[i] = sum_z;
+        if (with_potential) {
+            potential[i] = sum_potential;
+        }
+    };
+
+    // Walks in dense clusters open many more cells than in the outskirts
+    if (task_pool_) {
+        task_pool_->parallelFor(n, 64, [&](long begin, long end) {
+            for (long k = begin; k < end; ++k) {
+                walk(k);
+            }
+        });
+        return;
+    }
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long k = 0; k < n; ++k) {
+        walk(k);
+    }
+}
+}
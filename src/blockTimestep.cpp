@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <omp.h>
+
+#include "blockTimestep.hpp"
+#include "integrator.hpp"
+#include "jerkKernel.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+// Constructor for the block timestepper
+BlockTimestepper::BlockTimestepper(double eta, int max_level)
+    : eta_(eta), max_level_(std::clamp(max_level, 0, 40)), initialised_(false), body_evaluations_(0)
+    {}
+
+// Accessor methods
+double BlockTimestepper::getAccuracy() const {
+    return eta_;
+}
+
+void BlockTimestepper::setAccuracy(double eta) {
+    eta_ = eta;
+}
+
+long BlockTimestepper::getBodyEvaluations() const {
+    return body_evaluations_;
+}
+
+// Number of bodies on each level
+std::vector<long> BlockTimestepper::levelCounts() const {
+    std::vector<long> counts(max_level_ + 1, 0);
+    for (int level : level_) {
+        ++counts[level];
+    }
+    return counts;
+}
+
+// Copy the jerks and levels into a state
+void BlockTimestepper::getState(IntegratorState& state) const {
+    if (initialised_) {
+        state.jx.assign(jx_.begin(), jx_.end());
+        state.jy.assign(jy_.begin(), jy_.end());
+        state.jz.assign(jz_.begin(), jz_.end());
+        state.level = level_;
+    }
+}
+
+// Continue from saved jerks and levels, every body at the start of a step
+void BlockTimestepper::setState(const IntegratorState& state) {
+    jx_.assign(state.jx.begin(), state.jx.end());
+    jy_.assign(state.jy.begin(), state.jy.end());
+    jz_.assign(state.jz.begin(), state.jz.end());
+    level_ = state.level;
+    for (int& level : level_) {
+        level = std::clamp(level, 0, max_level_);
+    }
+    time_.assign(level_.size(), 0);
+    predicted_ = ParticleSystem();
+    initialised_ = !state.level.empty() && state.jx.size() == state.level.size();
+}
+
+// Forget the stored accelerations, jerks and levels
+void BlockTimestepper::reset() {
+    initialised_ = false;
+}
+
+// Smallest level whose step is at most eta |a| / |j|
+int BlockTimestepper::desiredLevel(const double acceleration[3], const double jerk[3], const double& dt) const {
+    double acc_norm = std::sqrt(acceleration[0] * acceleration[0] + acceleration[1] * acceleration[1] + acceleration[2] * acceleration[2]);
+    double jerk_norm = std::sqrt(jerk[0] * jerk[0] + jerk[1] * jerk[1] + jerk[2] * jerk[2]);
+    if (jerk_norm == 0.0 || eta_ * acc_norm >= dt * jerk_norm) {
+        return 0;
+    }
+    double level = std::ceil(std::log2(dt * jerk_norm / (eta_ * acc_norm)));
+    return static_cast<int>(std::min(level, static_cast<double>(max_level_)));
+}
+
+// Calculate the accelerations and jerks of every body and pick the initial levels
+void BlockTimestepper::initialise(ParticleSystem& particle_system, const double& epsilon, const double& dt) {
+    NBODY_PROFILE_SCOPE(Force);
+    const long n = static_cast<long>(particle_system.size());
+    predicted_ = particle_system;
+    time_.assign(n, 0);
+    level_.assign(n, 0);
+    jx_.resize(n);
+    jy_.resize(n);
+    jz_.resize(n);
+
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    #pragma omp parallel if (n > 64)
+    {
+        NBODY_PROFILE_THREAD(Force);
+        #pragma omp for schedule(dynamic, 16) nowait
+        for (long i = 0; i < n; ++i) {
+            double acceleration[3], jerk[3];
+            sumAccelerationJerk(particle_system, i, epsilon, acceleration, jerk);
+            ax[i] = acceleration[0];
+            ay[i] = acceleration[1];
+            az[i] = acceleration[2];
+            jx_[i] = jerk[0];
+            jy_[i] = jerk[1];
+            jz_[i] = jerk[2];
+            level_[i] = desiredLevel(acceleration, jerk, dt);
+        }
+    }
+    NBODY_PROFILE_COUNT(Force, pairInteractions(n), 60.0 * pairInteractions(n), 104.0 * n);
+    body_evaluations_ += n;
+    initialised_ = true;
+}
+
+// Advance every body of the particle system by dt
+void BlockTimestepper::step(ParticleSystem& particle_system, const double& epsilon, const double& dt) {
+    if (!initialised_ || level_.size() != particle_system.size()) {
+        initialise(particle_system, epsilon, dt);
+    }
+
+    // Restored from a checkpoint, the predicted copy starts from the system as in initialise()
+    else if (predicted_.size() != particle_system.size()) {
+        predicted_ = particle_system;
+    }
+
+    const long n = static_cast<long>(particle_system.size());
+    const std::int64_t end = std::int64_t(1) << max_level_;
+    const double tick = std::ldexp(dt, -max_level_);
+    auto stepTicks = [&](int level) { return std::int64_t(1) << (max_level_ - level); };
+
+    double* x = particle_system.x();
+    double* y = particle_system.y();
+    double* z = particle_system.z();
+    double* vx = particle_system.vx();
+    double* vy = particle_system.vy();
+    double* vz = particle_system.vz();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    double* px = predicted_.x();
+    double* py = predicted_.y();
+    double* pz = predicted_.z();
+    double* pvx = predicted_.vx();
+    double* pvy = predicted_.vy();
+    double* pvz = predicted_.vz();
+
+    // Steps of every level divide dt, so all bodies reach the end of the step together
+    while (true) {
+        std::int64_t t_next = end + 1;
+        for (long i = 0; i < n; ++i) {
+            t_next = std::min(t_next, time_[i] + stepTicks(level_[i]));
+        }
+        if (t_next > end) {
+            break;
+        }
+        active_.clear();
+        for (long i = 0; i < n; ++i) {
+            if (time_[i] + stepTicks(level_[i]) == t_next) {
+                active_.push_back(i);
+            }
+        }
+
+        // Predict every body to the block time
+        #pragma omp parallel for schedule(static) if (n > 64)
+        for (long i = 0; i < n; ++i) {
+            const double t = (t_next - time_[i]) * tick;
+            const double t2 = t * t / 2.0;
+            const double t3 = t2 * t / 3.0;
+            px[i] = x[i] + vx[i] * t + ax[i] * t2 + jx_[i] * t3;
+            py[i] = y[i] + vy[i] * t + ay[i] * t2 + jy_[i] * t3;
+            pz[i] = z[i] + vz[i] * t + az[i] * t2 + jz_[i] * t3;
+            pvx[i] = vx[i] + ax[i] * t + jx_[i] * t2;
+            pvy[i] = vy[i] + ay[i] * t + jy_[i] * t2;
+            pvz[i] = vz[i] + az[i] * t + jz_[i] * t2;
+        }
+
+        // Evaluate and correct the active block only, the kernel reads the predicted system
+        const long num_active = static_cast<long>(active_.size());
+        {
+            // Most of the work is the acceleration and jerk of the active bodies, so the corrector counts as force too
+            NBODY_PROFILE_SCOPE(Force);
+            #pragma omp parallel if (num_active * n > 4096)
+            {
+                NBODY_PROFILE_THREAD(Force);
+                #pragma omp for schedule(dynamic, 4) nowait
+                for (long k = 0; k < num_active; ++k) {
+                    const std::size_t i = active_[k];
+                    double acceleration[3], jerk[3];
+                    sumAccelerationJerk(predicted_, i, epsilon, acceleration, jerk);
+
+                    const double t = stepTicks(level_[i]) * tick;
+                    const double new_vx = vx[i] + (ax[i] + acceleration[0]) * t / 2.0;
+                    const double new_vy = vy[i] + (ay[i] + acceleration[1]) * t / 2.0;
+                    const double new_vz = vz[i] + (az[i] + acceleration[2]) * t / 2.0;
+                    x[i] += (vx[i] + new_vx) * t / 2.0 + (ax[i] - acceleration[0]) * t * t / 12.0;
+                    y[i] += (vy[i] + new_vy) * t / 2.0 + (ay[i] - acceleration[1]) * t * t / 12.0;
+                    z[i] += (vz[i] + new_vz) * t / 2.0 + (az[i] - acceleration[2]) * t * t / 12.0;
+                    vx[i] = new_vx;
+                    vy[i] = new_vy;
+                    vz[i] = new_vz;
+                    ax[i] = acceleration[0];
+                    ay[i] = acceleration[1];
+                    az[i] = acceleration[2];
+                    jx_[i] = jerk[0];
+                    jy_[i] = jerk[1];
+                    jz_[i] = jerk[2];
+                    time_[i] = t_next;
+
+                    // Refine at once, coarsen by one level when the time is a multiple of the coarser step
+                    int level = desiredLevel(acceleration, jerk, dt);
+                    if (level > level_[i]) {
+                        level_[i] = level;
+                    }
+                    else if (level < level_[i] && t_next % stepTicks(level_[i] - 1) == 0) {
+                        level_[i] -= 1;
+                    }
+                }
+            }
+        }
+        NBODY_PROFILE_COUNT(Force, static_cast<double>(num_active) * (n - 1), 60.0 * num_active * (n - 1), 56.0 * n + 104.0 * num_active);
+        body_evaluations_ += num_active;
+    }
+
+    // Start the next step at time zero
+    std::fill(time_.begin(), time_.end(), 0);
+}
+}
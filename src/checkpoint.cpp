@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+#include "checkpoint.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+constexpr char checkpoint_magic[8] = {'N', 'B', 'C', 'H', 'K', 'P', 'T', '\0'};
+constexpr std::size_t checkpoint_header_bytes = 96;
+constexpr int checkpoint_blocks = 11;
+}
+
+// Write a checkpoint under a temporary name and rename it into place
+void saveCheckpoint(const std::string& path, const ParticleSystem& particle_system, const IntegratorState& state,
+                    const CheckpointMetadata& metadata) {
+    const std::uint64_t num_bodies = particle_system.size();
+    const bool jerks = !state.jx.empty();
+    const bool levels = !state.level.empty();
+    if ((jerks && (state.jx.size() != num_bodies || state.jy.size() != num_bodies || state.jz.size() != num_bodies))
+        || (levels && state.level.size() != num_bodies)) {
+        throw std::invalid_argument("Integrator state does not match the particle system");
+    }
+
+    unsigned char header[checkpoint_header_bytes] = {};
+    const std::uint32_t version = checkpoint_version;
+    const std::uint32_t scheme = static_cast<std::uint32_t>(metadata.scheme);
+    const std::uint64_t name_length = metadata.generator.size();
+    std::memcpy(header, checkpoint_magic, 8);
+    std::memcpy(header + 8, &version, 4);
+    std::memcpy(header + 12, &scheme, 4);
+    std::memcpy(header + 16, &num_bodies, 8);
+    std::memcpy(header + 24, &metadata.step, 8);
+    std::memcpy(header + 32, &metadata.time, 8);
+    std::memcpy(header + 40, &metadata.dt, 8);
+    std::memcpy(header + 48, &metadata.epsilon, 8);
+    std::memcpy(header + 56, &metadata.initial_energy, 8);
+    std::memcpy(header + 64, &metadata.seed, 8);
+    std::memcpy(header + 72, &metadata.num_generated, 8);
+    std::memcpy(header + 80, &name_length, 8);
+    const std::uint32_t acceleration_valid = state.acceleration_valid ? 1u : 0u;
+    const std::uint32_t flags = (jerks ? 1u : 0u) | (levels ? 2u : 0u);
+    std::memcpy(header + 88, &acceleration_valid, 4);
+    std::memcpy(header + 92, &flags, 4);
+
+    const std::string temporary_path = path + ".tmp";
+    std::FILE* file = std::fopen(temporary_path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Cannot open checkpoint file for writing: " + temporary_path);
+    }
+    bool written = std::fwrite(header, 1, checkpoint_header_bytes, file) == checkpoint_header_bytes;
+    written = written && std::fwrite(metadata.generator.data(), 1, name_length, file) == name_length;
+    const double* blocks[checkpoint_blocks] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                                               particle_system.vx(), particle_system.vy(), particle_system.vz(),
+                                               particle_system.ax(), particle_system.ay(), particle_system.az(),
+                                               particle_system.potential(), particle_system.mass()};
+    for (const double* block : blocks) {
+        written = written && std::fwrite(block, sizeof(double), num_bodies, file) == num_bodies;
+    }
+    std::vector<std::uint64_t> ids(particle_system.id(), particle_system.id() + num_bodies);
+    written = written && std::fwrite(ids.data(), sizeof(std::uint64_t), num_bodies, file) == num_bodies;
+    if (jerks) {
+        for (const std::vector<double>* block : {&state.jx, &state.jy, &state.jz}) {
+            written = written && std::fwrite(block->data(), sizeof(double), num_bodies, file) == num_bodies;
+        }
+    }
+    if (levels) {
+        std::vector<std::int32_t> level(state.level.begin(), state.level.end());
+        written = written && std::fwrite(level.data(), sizeof(std::int32_t), num_bodies, file) == num_bodies;
+    }
+
+    // The data must be on disk before the rename replaces the previous checkpoint
+    written = written && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        throw std::runtime_error("Cannot write checkpoint file: " + path);
+    }
+}
+
+// Read a checkpoint into a particle system
+CheckpointMetadata loadCheckpoint(const std::string& path, ParticleSystem& particle_system, IntegratorState& state) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::runtime_error("Cannot open checkpoint file: " + path);
+    }
+
+    // Close the file on every way out
+    auto fail = [&](const std::string& message) {
+        std::fclose(file);
+        throw std::runtime_error(message + ": " + path);
+    };
+
+    unsigned char header[checkpoint_header_bytes];
+    if (std::fread(header, 1, checkpoint_header_bytes, file) != checkpoint_header_bytes
+        || std::memcmp(header, checkpoint_magic, 8) != 0) {
+        fail("Not a checkpoint file");
+    }
+    std::uint32_t version, scheme;
+    std::uint64_t num_bodies, name_length;
+    std::uint32_t acceleration_valid, flags;
+    CheckpointMetadata metadata;
+    std::memcpy(&version, header + 8, 4);
+    std::memcpy(&scheme, header + 12, 4);
+    std::memcpy(&num_bodies, header + 16, 8);
+    std::memcpy(&metadata.step, header + 24, 8);
+    std::memcpy(&metadata.time, header + 32, 8);
+    std::memcpy(&metadata.dt, header + 40, 8);
+    std::memcpy(&metadata.epsilon, header + 48, 8);
+    std::memcpy(&metadata.initial_energy, header + 56, 8);
+    std::memcpy(&metadata.seed, header + 64, 8);
+    std::memcpy(&metadata.num_generated, header + 72, 8);
+    std::memcpy(&name_length, header + 80, 8);
+    std::memcpy(&acceleration_valid, header + 88, 4);
+    std::memcpy(&flags, header + 92, 4);
+    const bool jerks = (flags & 1u) != 0;
+    const bool levels = (flags & 2u) != 0;
+    if (version != checkpoint_version) {
+        fail("Unsupported checkpoint version " + std::to_string(version));
+    }
+    if (scheme > static_cast<std::uint32_t>(IntegratorScheme::Block)) {
+        fail("Unknown integrator in checkpoint");
+    }
+    metadata.scheme = static_cast<IntegratorScheme>(scheme);
+
+    // The sizes come from the file, so check them against its length before allocating
+    std::fseek(file, 0, SEEK_END);
+    const std::uint64_t file_size = static_cast<std::uint64_t>(std::ftell(file));
+    if (name_length > file_size || num_bodies > file_size
+        || file_size != checkpoint_header_bytes + name_length + (checkpoint_blocks + (jerks ? 3 : 0)) * sizeof(double) * num_bodies
+                        + sizeof(std::uint64_t) * num_bodies
+                        + (levels ? sizeof(std::int32_t) * num_bodies : 0)) {
+        fail("Truncated checkpoint file");
+    }
+    std::fseek(file, checkpoint_header_bytes, SEEK_SET);
+
+    metadata.generator.resize(name_length);
+    bool read = std::fread(&metadata.generator[0], 1, name_length, file) == name_length;
+    particle_system.resize(num_bodies);
+    double* blocks[checkpoint_blocks] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                                         particle_system.vx(), particle_system.vy(), particle_system.vz(),
+                                         particle_system.ax(), particle_system.ay(), particle_system.az(),
+                                         particle_system.potential(), particle_system.mass()};
+    for (double* block : blocks) {
+        read = read && std::fread(block, sizeof(double), num_bodies, file) == num_bodies;
+    }
+    std::vector<std::uint64_t> ids(num_bodies);
+    read = read && std::fread(ids.data(), sizeof(std::uint64_t), num_bodies, file) == num_bodies;
+    state = IntegratorState();
+    state.acceleration_valid = acceleration_valid != 0;
+    if (jerks) {
+        for (std::vector<double>* block : {&state.jx, &state.jy, &state.jz}) {
+            block->resize(num_bodies);
+            read = read && std::fread(block->data(), sizeof(double), num_bodies, file) == num_bodies;
+        }
+    }
+    if (levels) {
+        std::vector<std::int32_t> level(num_bodies);
+        read = read && std::fread(level.data(), sizeof(std::int32_t), num_bodies, file) == num_bodies;
+        state.level.assign(level.begin(), level.end());
+    }
+    if (!read) {
+        fail("Cannot read checkpoint file");
+    }
+    std::vector<char> seen(num_bodies, 0);
+    for (std::uint64_t id : ids) {
+        if (id >= num_bodies || seen[id]) {
+            fail("Body ids in checkpoint are not a permutation");
+        }
+        seen[id] = 1;
+    }
+    std::copy(ids.begin(), ids.end(), particle_system.id());
+    std::fclose(file);
+    return metadata;
+}
+
+// Constructor for the checkpoint writer, starts its thread
+CheckpointWriter::CheckpointWriter(const std::string& path)
+    : path_(path), pending_(false), closing_(false), saves_(0), save_seconds_(0.0)
+    {
+        thread_ = std::thread(&CheckpointWriter::writerLoop, this);
+    }
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    queued_.notify_one();
+    thread_.join();
+}
+
+// Queue a checkpoint of the particle system
+void CheckpointWriter::save(const ParticleSystem& particle_system, const IntegratorState& state, const CheckpointMetadata& metadata) {
+    NBODY_PROFILE_SCOPE(Output);
+    auto start_time = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    written_.wait(lock, [&]() { return !pending_; });
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+
+    // The snapshot reuses its storage, so this is a copy of the arrays only
+    snapshot_ = particle_system;
+    state_ = state;
+    metadata_ = metadata;
+    pending_ = true;
+    ++saves_;
+    lock.unlock();
+    queued_.notify_one();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    save_seconds_ += elapsed.count();
+    NBODY_PROFILE_COUNT(Output, 0.0, 0.0, 2.0 * particle_system.memoryUsage());
+}
+
+// Block until the queued checkpoint is on disk
+void CheckpointWriter::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    written_.wait(lock, [&]() { return !pending_; });
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+// Accessor methods
+long CheckpointWriter::getSaves() const {
+    return saves_;
+}
+
+double CheckpointWriter::getSaveSeconds() const {
+    return save_seconds_;
+}
+
+// Background thread, writes the snapshot whenever one is queued
+void CheckpointWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        queued_.wait(lock, [&]() { return pending_ || closing_; });
+        if (!pending_) {
+            break;
+        }
+
+        // save() waits for pending_ to clear, so the snapshot can be read without the lock
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            saveCheckpoint(path_, snapshot_, state_, metadata_);
+        }
+        catch (const std::exception&) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error) {
+            error_ = error;
+        }
+        pending_ = false;
+        written_.notify_all();
+    }
+}
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "commandLine.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Parse the whole of text as a number with parse (std::stod, std::stol, ...), naming the flag if it is not one
+template <typename Parse>
+auto parseNumber(const std::string& name, const std::string& text, Parse parse) {
+    std::size_t end = 0;
+    try {
+        auto value = parse(text, &end);
+        if (end == text.size()) {
+            return value;
+        }
+    }
+    catch (const std::logic_error&) {
+    }
+    throw std::invalid_argument("--" + name + " expects a number, got \"" + text + "\"");
+}
+}
+
+// Split argv into positional arguments and "--name value" flags.
+// A flag followed by another flag (or by nothing) is stored with an empty value.
+CommandLine::CommandLine(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::string value;
+            if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) {
+                value = argv[++i];
+            }
+            options_[arg.substr(2)] = value;
+        }
+        else {
+            positional_.push_back(arg);
+        }
+    }
+}
+
+// Positional arguments, in order
+const std::vector<std::string>& CommandLine::positional() const {
+    return positional_;
+}
+
+std::size_t CommandLine::numPositional() const {
+    return positional_.size();
+}
+
+// Check if a flag was given
+bool CommandLine::hasOption(const std::string& name) const {
+    return options_.count(name) > 0;
+}
+
+// Reject flags that are not among names
+void CommandLine::requireKnownOptions(const std::vector<std::string>& names) const {
+    for (const auto& [name, value] : options_) {
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            throw std::invalid_argument("Unknown option --" + name);
+        }
+    }
+}
+
+// Value of a flag, or default_value if it was not given
+std::string CommandLine::option(const std::string& name, const std::string& default_value) const {
+    auto it = options_.find(name);
+    return it == options_.end() ? default_value : it->second;
+}
+
+double CommandLine::optionDouble(const std::string& name, double default_value) const {
+    auto parse = [](const std::string& text, std::size_t* end) { return std::stod(text, end); };
+    return hasOption(name) ? parseNumber(name, option(name), parse) : default_value;
+}
+
+int CommandLine::optionInt(const std::string& name, int default_value) const {
+    auto parse = [](const std::string& text, std::size_t* end) { return std::stoi(text, end); };
+    return hasOption(name) ? parseNumber(name, option(name), parse) : default_value;
+}
+
+// Comma-separated integers of a flag
+std::vector<long> CommandLine::optionList(const std::string& name, const std::vector<long>& default_value) const {
+    if (!hasOption(name)) {
+        return default_value;
+    }
+    std::vector<long> values;
+    const std::string text = option(name);
+    std::size_t begin = 0;
+    while (begin <= text.size()) {
+        std::size_t end = std::min(text.find(',', begin), text.size());
+        values.push_back(parseNumber(name, text.substr(begin, end - begin), [](const std::string& entry, std::size_t* entry_end) { return std::stol(entry, entry_end); }));
+        begin = end + 1;
+    }
+    return values;
+}
+}
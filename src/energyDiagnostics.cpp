@@ -0,0 +1,137 @@
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+#include "energyDiagnostics.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+// Kinetic energy of every body
+void EnergyDiagnostics::computeKinetic(const ParticleSystem& particle_system) {
+    NBODY_PROFILE_SCOPE(Energy);
+    const double* vx = particle_system.vx();
+    const double* vy = particle_system.vy();
+    const double* vz = particle_system.vz();
+    const double* mass = particle_system.mass();
+    const long n = static_cast<long>(particle_system.size());
+    kinetic_.resize(n);
+    double* kinetic = kinetic_.data();
+
+    double sum_kinetic = 0.0;
+    #pragma omp parallel for schedule(static) reduction(+:sum_kinetic) if (n > 4096)
+    for (long i = 0; i < n; ++i) {
+        kinetic[i] = 0.5 * mass[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+        sum_kinetic += kinetic[i];
+    }
+    sum_kinetic_ = sum_kinetic;
+    NBODY_PROFILE_COUNT(Energy, 0.0, 7.0 * n, 40.0 * n);
+}
+
+// Potential energy of every body with the direct double loop
+void EnergyDiagnostics::computePotential(const ParticleSystem& particle_system, const double& epsilon) {
+    NBODY_PROFILE_SCOPE(Energy);
+    const double* __restrict x = particle_system.x();
+    const double* __restrict y = particle_system.y();
+    const double* __restrict z = particle_system.z();
+    const double* __restrict mass = particle_system.mass();
+    const double eps2 = epsilon * epsilon;
+    const long n = static_cast<long>(particle_system.size());
+    potential_.resize(n);
+    double* potential = potential_.data();
+
+    // Every body sums over all others, so threads write disjoint entries and only the total is reduced
+    auto row = [&](long i) {
+        const double xi = x[i], yi = y[i], zi = z[i];
+        double phi = 0.0;
+        #pragma omp simd reduction(+:phi)
+        for (long j = 0; j < n; ++j) {
+            double dx = x[j] - xi;
+            double dy = y[j] - yi;
+            double dz = z[j] - zi;
+            double r2 = dx * dx + dy * dy + dz * dz + eps2;
+            phi -= j != i ? mass[j] / std::sqrt(r2) : 0.0;
+        }
+        potential[i] = 0.5 * mass[i] * phi;
+    };
+
+    if (task_pool_ && n > 64) {
+        task_pool_->parallelFor(n, 16, [&](long begin, long end) {
+            for (long i = begin; i < end; ++i) {
+                row(i);
+            }
+        });
+    }
+    else {
+        #pragma omp parallel if (n > 64)
+        {
+            NBODY_PROFILE_THREAD(Energy);
+            #pragma omp for schedule(static) nowait
+            for (long i = 0; i < n; ++i) {
+                row(i);
+            }
+        }
+    }
+
+    double sum_potential = 0.0;
+    #pragma omp parallel for schedule(static) reduction(+:sum_potential) if (n > 4096)
+    for (long i = 0; i < n; ++i) {
+        sum_potential += potential[i];
+    }
+    sum_potential_ = sum_potential;
+    NBODY_PROFILE_COUNT(Energy, pairInteractions(n), 12.0 * pairInteractions(n), 40.0 * n);
+}
+
+// Potential energy of every body from per-body potentials
+void EnergyDiagnostics::computePotential(const ParticleSystem& particle_system, const double* phi) {
+    NBODY_PROFILE_SCOPE(Energy);
+    const double* mass = particle_system.mass();
+    const long n = static_cast<long>(particle_system.size());
+    potential_.resize(n);
+    double* potential = potential_.data();
+
+    double sum_potential = 0.0;
+    #pragma omp parallel for schedule(static) reduction(+:sum_potential) if (n > 4096)
+    for (long i = 0; i < n; ++i) {
+        potential[i] = 0.5 * mass[i] * phi[i];
+        sum_potential += potential[i];
+    }
+    sum_potential_ = sum_potential;
+    NBODY_PROFILE_COUNT(Energy, 0.0, 3.0 * n, 24.0 * n);
+}
+
+// Kinetic and potential energy
+void EnergyDiagnostics::compute(const ParticleSystem& particle_system, const double& epsilon) {
+    computeKinetic(particle_system);
+    computePotential(particle_system, epsilon);
+}
+
+// Share the potential double loop out with a work-stealing pool
+void EnergyDiagnostics::setTaskPool(std::shared_ptr<TaskPool> task_pool) {
+    task_pool_ = std::move(task_pool);
+}
+
+// Sums over all bodies
+double EnergyDiagnostics::kineticEnergy() const {
+    return sum_kinetic_;
+}
+
+double EnergyDiagnostics::potentialEnergy() const {
+    return sum_potential_;
+}
+
+double EnergyDiagnostics::totalEnergy() const {
+    return sum_kinetic_ + sum_potential_;
+}
+
+// Per-body energies
+const std::vector<double>& EnergyDiagnostics::kinetic() const {
+    return kinetic_;
+}
+
+const std::vector<double>& EnergyDiagnostics::potential() const {
+    return potential_;
+}
+}
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <omp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NBODY_X86_SIMD 1
+#endif
+
+#include "ensemble.hpp"
+#include "profiler.hpp"
+#include "simdKernel.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Systems per cache line of one component, the threads get runs of whole lines so no line is written by two threads
+constexpr std::size_t lanes_per_line = 64 / sizeof(double);
+
+// Systems [k_begin, k_end) of thread t out of num_threads
+void laneRange(std::size_t num_systems, int t, int num_threads, std::size_t& k_begin, std::size_t& k_end) {
+    const std::size_t num_lines = (num_systems + lanes_per_line - 1) / lanes_per_line;
+    const std::size_t lines_per_thread = (num_lines + num_threads - 1) / num_threads;
+    k_begin = std::min(num_systems, t * lines_per_thread * lanes_per_line);
+    k_end = std::min(num_systems, k_begin + lines_per_thread * lanes_per_line);
+}
+
+// Arrays of an ensemble, component c of body i of system k at c[i * num_systems + k]
+struct LaneArrays {
+    const double* __restrict x;
+    const double* __restrict y;
+    const double* __restrict z;
+    const double* __restrict mass;
+    double* __restrict ax;
+    double* __restrict ay;
+    double* __restrict az;
+    double eps2;
+    std::size_t num_bodies;
+    std::size_t num_systems;
+};
+
+// Accelerations of the systems [k_begin, k_end), each pair applied to both bodies with the systems
+// in the SIMD lanes. Bodies with r^2 + epsilon^2 == 0 contribute nothing; the mask is a select on
+// the result rather than a branch around the square root, so the loop still vectorizes. Inlined
+// into the copies below compiled for wider instruction sets.
+__attribute__((always_inline)) inline void sumLanesPortable(const LaneArrays& p, std::size_t k_begin, std::size_t k_end) {
+    const std::size_t K = p.num_systems;
+    for (std::size_t i = 0; i < p.num_bodies; ++i) {
+        std::fill(p.ax + i * K + k_begin, p.ax + i * K + k_end, 0.0);
+        std::fill(p.ay + i * K + k_begin, p.ay + i * K + k_end, 0.0);
+        std::fill(p.az + i * K + k_begin, p.az + i * K + k_end, 0.0);
+    }
+    for (std::size_t i = 0; i < p.num_bodies; ++i) {
+        for (std::size_t j = i + 1; j < p.num_bodies; ++j) {
+            const std::size_t bi = i * K, bj = j * K;
+            #pragma omp simd
+            for (std::size_t k = k_begin; k < k_end; ++k) {
+                const double dx = p.x[bj + k] - p.x[bi + k];
+                const double dy = p.y[bj + k] - p.y[bi + k];
+                const double dz = p.z[bj + k] - p.z[bi + k];
+                const double r2 = dx * dx + dy * dy + dz * dz + p.eps2;
+                const bool apart = r2 > 0.0;
+                const double inv_r = 1.0 / std::sqrt(apart ? r2 : 1.0);
+                const double inv_r3 = apart ? inv_r * inv_r * inv_r : 0.0;
+                const double scale_i = p.mass[bj + k] * inv_r3;
+                const double scale_j = p.mass[bi + k] * inv_r3;
+                p.ax[bi + k] += scale_i * dx;
+                p.ay[bi + k] += scale_i * dy;
+                p.az[bi + k] += scale_i * dz;
+                p.ax[bj + k] -= scale_j * dx;
+                p.ay[bj + k] -= scale_j * dy;
+                p.az[bj + k] -= scale_j * dz;
+            }
+        }
+    }
+}
+
+void sumLanes(const LaneArrays& p, std::size_t k_begin, std::size_t k_end) {
+    sumLanesPortable(p, k_begin, k_end);
+}
+
+#ifdef NBODY_X86_SIMD
+
+// Four systems per instruction
+__attribute__((target("avx2,fma")))
+void sumLanesAvx2(const LaneArrays& p, std::size_t k_begin, std::size_t k_end) {
+    sumLanesPortable(p, k_begin, k_end);
+}
+
+// Eight systems per instruction
+__attribute__((target("avx512f")))
+void sumLanesAvx512(const LaneArrays& p, std::size_t k_begin, std::size_t k_end) {
+    sumLanesPortable(p, k_begin, k_end);
+}
+
+#endif
+
+// Widest copy of the pair loop on the running CPU
+auto selectLaneSum() {
+    auto sum = &sumLanes;
+#ifdef NBODY_X86_SIMD
+    const SimdPath supported = detectSimdPath();
+    if (supported == SimdPath::AVX512) {
+        sum = &sumLanesAvx512;
+    }
+    else if (supported == SimdPath::AVX2) {
+        sum = &sumLanesAvx2;
+    }
+#endif
+    return sum;
+}
+}
+
+// Interleave the systems
+Ensemble::Ensemble(const std::vector<ParticleSystem>& systems, double epsilon)
+    : num_systems_(systems.size()), num_bodies_(systems.empty() ? 0 : systems.front().size()), epsilon_(epsilon),
+      acceleration_valid_(false), force_evaluations_(0) {
+    if (systems.empty()) {
+        throw std::invalid_argument("An ensemble needs at least one system");
+    }
+    const std::size_t size = num_bodies_ * num_systems_;
+    for (AlignedVector<double>* component : {&x_, &y_, &z_, &vx_, &vy_, &vz_, &ax_, &ay_, &az_, &mass_}) {
+        component->assign(size, 0.0);
+    }
+    for (std::size_t k = 0; k < num_systems_; ++k) {
+        const ParticleSystem& system = systems[k];
+        if (system.size() != num_bodies_) {
+            throw std::invalid_argument("Every system of an ensemble needs the same number of bodies");
+        }
+        for (std::size_t i = 0; i < num_bodies_; ++i) {
+            const std::size_t index = i * num_systems_ + k;
+            x_[index] = system.x()[i];
+            y_[index] = system.y()[i];
+            z_[index] = system.z()[i];
+            vx_[index] = system.vx()[i];
+            vy_[index] = system.vy()[i];
+            vz_[index] = system.vz()[i];
+            mass_[index] = system.mass()[i];
+        }
+    }
+}
+
+// Accelerations of the systems [k_begin, k_end)
+void Ensemble::computeAcceleration(std::size_t k_begin, std::size_t k_end) {
+    static const auto sum = selectLaneSum();
+    LaneArrays lanes {x_.data(), y_.data(), z_.data(), mass_.data(), ax_.data(), ay_.data(), az_.data(), epsilon_ * epsilon_, num_bodies_, num_systems_};
+    sum(lanes, k_begin, k_end);
+}
+
+void Ensemble::kick(const double& h, std::size_t k_begin, std::size_t k_end) {
+    for (std::size_t i = 0; i < num_bodies_; ++i) {
+        const std::size_t begin = i * num_systems_ + k_begin, end = i * num_systems_ + k_end;
+        #pragma omp simd
+        for (std::size_t index = begin; index < end; ++index) {
+            vx_[index] += h * ax_[index];
+            vy_[index] += h * ay_[index];
+            vz_[index] += h * az_[index];
+        }
+    }
+}
+
+void Ensemble::drift(const double& h, std::size_t k_begin, std::size_t k_end) {
+    for (std::size_t i = 0; i < num_bodies_; ++i) {
+        const std::size_t begin = i * num_systems_ + k_begin, end = i * num_systems_ + k_end;
+        #pragma omp simd
+        for (std::size_t index = begin; index < end; ++index) {
+            x_[index] += h * vx_[index];
+            y_[index] += h * vy_[index];
+            z_[index] += h * vz_[index];
+        }
+    }
+}
+
+// Kick-drift-kick substep of length h
+void Ensemble::leapfrogStep(const double& h, std::size_t k_begin, std::size_t k_end) {
+    kick(0.5 * h, k_begin, k_end);
+    drift(h, k_begin, k_end);
+    computeAcceleration(k_begin, k_end);
+    kick(0.5 * h, k_begin, k_end);
+}
+
+// One step of the systems [k_begin, k_end), with the updates of Integrator::step
+void Ensemble::step(IntegratorScheme scheme, const double& dt, std::size_t k_begin, std::size_t k_end, bool& acceleration_valid) {
+    if (!acceleration_valid) {
+        computeAcceleration(k_begin, k_end);
+        acceleration_valid = true;
+    }
+    switch (scheme) {
+        case IntegratorScheme::Euler:
+            drift(dt, k_begin, k_end);
+            kick(dt, k_begin, k_end);
+            acceleration_valid = false;
+            break;
+
+        case IntegratorScheme::Leapfrog:
+            leapfrogStep(dt, k_begin, k_end);
+            break;
+
+        case IntegratorScheme::VelocityVerlet: {
+            const double half_dt2 = 0.5 * dt * dt;
+            for (std::size_t i = 0; i < num_bodies_; ++i) {
+                const std::size_t begin = i * num_systems_ + k_begin, end = i * num_systems_ + k_end;
+                #pragma omp simd
+                for (std::size_t index = begin; index < end; ++index) {
+                    x_[index] += dt * vx_[index] + half_dt2 * ax_[index];
+                    y_[index] += dt * vy_[index] + half_dt2 * ay_[index];
+                    z_[index] += dt * vz_[index] + half_dt2 * az_[index];
+                }
+            }
+            kick(0.5 * dt, k_begin, k_end);
+            computeAcceleration(k_begin, k_end);
+            kick(0.5 * dt, k_begin, k_end);
+            break;
+        }
+
+        case IntegratorScheme::Yoshida4: {
+            // Substep weights w1, w0, w1 with 2 w1 + w0 = 1, as in Integrator
+            const double cbrt2 = std::cbrt(2.0);
+            const double w1 = 1.0 / (2.0 - cbrt2);
+            const double w0 = -cbrt2 / (2.0 - cbrt2);
+            leapfrogStep(w1 * dt, k_begin, k_end);
+            leapfrogStep(w0 * dt, k_begin, k_end);
+            leapfrogStep(w1 * dt, k_begin, k_end);
+            break;
+        }
+
+        case IntegratorScheme::Hermite:
+        case IntegratorScheme::Block:
+            break;
+    }
+}
+
+// Advance every system by num_steps steps of dt, each thread through all steps of its own systems
+void Ensemble::run(IntegratorScheme scheme, const double& dt, long num_steps) {
+    if (!supports(scheme)) {
+        throw std::invalid_argument("Ensembles do not support the " + integratorSchemeName(scheme) + " integrator");
+    }
+    NBODY_PROFILE_SCOPE(Integration);
+    const bool initial_valid = acceleration_valid_;
+    bool final_valid = initial_valid;
+
+    #pragma omp parallel
+    {
+        NBODY_PROFILE_THREAD(Integration);
+        std::size_t k_begin, k_end;
+        laneRange(num_systems_, omp_get_thread_num(), omp_get_num_threads(), k_begin, k_end);
+        bool acceleration_valid = initial_valid;
+        for (long s = 0; s < num_steps && k_begin < k_end; ++s) {
+            step(scheme, dt, k_begin, k_end, acceleration_valid);
+        }
+        // Every thread takes the same steps, so they agree on the validity
+        if (omp_get_thread_num() == 0) {
+            final_valid = acceleration_valid;
+        }
+    }
+
+    // Force evaluations per system, as Integrator counts them: Euler evaluates once at the start of
+    // every step, the others once per kick-drift-kick substep plus once if none were stored
+    long evaluations = num_steps * (scheme == IntegratorScheme::Yoshida4 ? 3 : 1);
+    if (scheme != IntegratorScheme::Euler && num_steps > 0 && !initial_valid) {
+        ++evaluations;
+    }
+    force_evaluations_ += evaluations;
+    acceleration_valid_ = final_valid;
+    NBODY_PROFILE_COUNT(Integration, static_cast<double>(evaluations) * num_systems_ * pairInteractions(num_bodies_),
+                        20.0 * evaluations * num_systems_ * pairInteractions(num_bodies_), 56.0 * evaluations * num_systems_ * num_bodies_);
+}
+
+// Total energy of every system
+std::vector<double> Ensemble::totalEnergy() const {
+    const std::size_t K = num_systems_;
+    const double eps2 = epsilon_ * epsilon_;
+    std::vector<double> energy(K, 0.0);
+    for (std::size_t i = 0; i < num_bodies_; ++i) {
+        for (std::size_t k = 0; k < K; ++k) {
+            const std::size_t index = i * K + k;
+            energy[k] += 0.5 * mass_[index] * (vx_[index] * vx_[index] + vy_[index] * vy_[index] + vz_[index] * vz_[index]);
+        }
+        for (std::size_t j = i + 1; j < num_bodies_; ++j) {
+            for (std::size_t k = 0; k < K; ++k) {
+                const std::size_t bi = i * K + k, bj = j * K + k;
+                const double dx = x_[bj] - x_[bi];
+                const double dy = y_[bj] - y_[bi];
+                const double dz = z_[bj] - z_[bi];
+                const double r2 = dx * dx + dy * dy + dz * dz + eps2;
+                energy[k] -= r2 > 0.0 ? mass_[bi] * mass_[bj] / std::sqrt(r2) : 0.0;
+            }
+        }
+    }
+    return energy;
+}
+
+// Copy of system k
+ParticleSystem Ensemble::getSystem(std::size_t k) const {
+    ParticleSystem system(num_bodies_);
+    for (std::size_t i = 0; i < num_bodies_; ++i) {
+        const std::size_t index = i * num_systems_ + k;
+        system.x()[i] = x_[index];
+        system.y()[i] = y_[index];
+        system.z()[i] = z_[index];
+        system.vx()[i] = vx_[index];
+        system.vy()[i] = vy_[index];
+        system.vz()[i] = vz_[index];
+        system.ax()[i] = ax_[index];
+        system.ay()[i] = ay_[index];
+        system.az()[i] = az_[index];
+        system.mass()[i] = mass_[index];
+    }
+    return system;
+}
+
+// Forget the stored accelerations
+void Ensemble::reset() {
+    acceleration_valid_ = false;
+}
+
+// Accessor methods
+std::size_t Ensemble::numSystems() const {
+    return num_systems_;
+}
+
+std::size_t Ensemble::numBodies() const {
+    return num_bodies_;
+}
+
+double Ensemble::getEpsilon() const {
+    return epsilon_;
+}
+
+long Ensemble::getForceEvaluations() const {
+    return force_evaluations_;
+}
+
+// Check if a scheme is supported by run()
+bool Ensemble::supports(IntegratorScheme scheme) {
+    return scheme == IntegratorScheme::Euler || scheme == IntegratorScheme::Leapfrog || scheme == IntegratorScheme::VelocityVerlet
+           || scheme == IntegratorScheme::Yoshida4;
+}
+}
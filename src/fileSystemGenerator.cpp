@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fileSystemGenerator.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+constexpr char initial_magic[8] = {'N', 'B', 'I', 'N', 'I', 'T', '1', '\0'};
+constexpr std::size_t initial_header_bytes = 64;
+constexpr int initial_blocks = 7;
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope
+class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("Cannot open initial conditions file: " + path);
+            }
+            struct stat status;
+            if (fstat(fd, &status) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Cannot read initial conditions file: " + path);
+            }
+            size_ = static_cast<std::size_t>(status.st_size);
+            if (size_ > 0) {
+                void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("Cannot map initial conditions file: " + path);
+                }
+                data_ = static_cast<const char*>(mapping);
+                madvise(mapping, size_, MADV_SEQUENTIAL);
+            }
+            ::close(fd);
+        }
+        ~MappedFile() {
+            if (data_ != nullptr) {
+                munmap(const_cast<char*>(data_), size_);
+            }
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return data_; }
+        std::size_t size() const { return size_; }
+        bool isBinary() const { return size_ >= initial_header_bytes && std::memcmp(data_, initial_magic, 8) == 0; }
+
+    protected:
+        const char* data_ = nullptr;
+        std::size_t size_ = 0;
+};
+
+// Copy the blocks of a binary file into the particle system
+ParticleSystem readBinary(const MappedFile& file, const std::string& path) {
+    std::uint32_t precision;
+    std::uint64_t num_bodies;
+    std::memcpy(&precision, file.data() + 8, 4);
+    std::memcpy(&num_bodies, file.data() + 16, 8);
+    if (precision != sizeof(double) || num_bodies > file.size()
+        || file.size() != initial_header_bytes + initial_blocks * sizeof(double) * num_bodies) {
+        throw std::runtime_error("Malformed binary initial conditions file: " + path);
+    }
+
+    ParticleSystem particle_system(num_bodies);
+    double* blocks[initial_blocks] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                                      particle_system.vx(), particle_system.vy(), particle_system.vz(),
+                                      particle_system.mass()};
+    const char* source = file.data() + initial_header_bytes;
+
+    // Copy in chunks of 1 MB, so several threads fault pages in and the copy keeps up with the disk
+    const long chunk = (1 << 20) / sizeof(double);
+    const long chunks_per_block = static_cast<long>((num_bodies + chunk - 1) / chunk);
+    const long num_chunks = initial_blocks * chunks_per_block;
+    #pragma omp parallel for schedule(dynamic) if (num_chunks > 1)
+    for (long k = 0; k < num_chunks; ++k) {
+        const long c = k / chunks_per_block;
+        const std::size_t begin = (k % chunks_per_block) * chunk;
+        const std::size_t count = std::min<std::size_t>(chunk, num_bodies - begin);
+        std::memcpy(blocks[c] + begin, source + (c * num_bodies + begin) * sizeof(double), count * sizeof(double));
+    }
+    return particle_system;
+}
+
+// Parse a CSV file straight from the mapping
+ParticleSystem readCsv(const MappedFile& file, const std::string& path) {
+    const char* p = file.data();
+    const char* end = p + file.size();
+
+    // Count the lines first so the arrays are allocated once
+    std::size_t max_bodies = 0;
+    for (const char* q = p; q < end; ++q) {
+        max_bodies += *q == '\n';
+    }
+    ParticleSystem particle_system(max_bodies + 1);
+    double* columns[initial_blocks] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                                       particle_system.vx(), particle_system.vy(), particle_system.vz(),
+                                       particle_system.mass()};
+
+    auto isSeparator = [](char c) { return c == ',' || c == ' ' || c == '\t' || c == '\r'; };
+    std::size_t num_bodies = 0;
+    long line = 0;
+    bool first_record = true;
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        ++line;
+        while (p < line_end && isSeparator(*p)) {
+            ++p;
+        }
+
+        // Skip empty lines, comments and a header line of column names before the first body
+        if (p == line_end || *p == '#') {
+            p = line_end + 1;
+            continue;
+        }
+        bool header = first_record && !(std::isdigit(static_cast<unsigned char>(*p)) || *p == '-' || *p == '+' || *p == '.');
+        first_record = false;
+        if (header) {
+            p = line_end + 1;
+            continue;
+        }
+
+        for (int c = 0; c < initial_blocks; ++c) {
+            while (p < line_end && isSeparator(*p)) {
+                ++p;
+            }
+            // from_chars does not accept a leading plus sign
+            if (p < line_end && *p == '+') {
+                ++p;
+            }
+            std::from_chars_result result = std::from_chars(p, line_end, columns[c][num_bodies]);
+            if (result.ec != std::errc()) {
+                throw std::runtime_error("Expected 7 numbers x,y,z,vx,vy,vz,mass on line " + std::to_string(line) + " of " + path);
+            }
+            p = result.ptr;
+        }
+        while (p < line_end && isSeparator(*p)) {
+            ++p;
+        }
+        if (p != line_end) {
+            throw std::runtime_error("Expected 7 numbers x,y,z,vx,vy,vz,mass on line " + std::to_string(line) + " of " + path);
+        }
+        ++num_bodies;
+        p = line_end + 1;
+    }
+    particle_system.resize(num_bodies);
+    return particle_system;
+}
+}
+
+// Write the positions, velocities and masses of a particle system
+void saveInitialConditions(const std::string& path, const ParticleSystem& particle_system, InitialConditionFormat format) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Cannot open initial conditions file for writing: " + path);
+    }
+    const std::uint64_t num_bodies = particle_system.size();
+    const double* blocks[initial_blocks] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                                            particle_system.vx(), particle_system.vy(), particle_system.vz(),
+                                            particle_system.mass()};
+    bool written = true;
+    if (format == InitialConditionFormat::Binary) {
+        unsigned char header[initial_header_bytes] = {};
+        const std::uint32_t precision = sizeof(double);
+        std::memcpy(header, initial_magic, 8);
+        std::memcpy(header + 8, &precision, 4);
+        std::memcpy(header + 16, &num_bodies, 8);
+        written = std::fwrite(header, 1, initial_header_bytes, file) == initial_header_bytes;
+        for (const double* block : blocks) {
+            written = written && std::fwrite(block, sizeof(double), num_bodies, file) == num_bodies;
+        }
+    }
+    else {
+        // 17 significant digits read back to the same doubles
+        written = std::fprintf(file, "x,y,z,vx,vy,vz,mass\n") > 0;
+        for (std::size_t i = 0; written && i < num_bodies; ++i) {
+            written = std::fprintf(file, "%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n", blocks[0][i], blocks[1][i], blocks[2][i],
+                                   blocks[3][i], blocks[4][i], blocks[5][i], blocks[6][i]) > 0;
+        }
+    }
+    if (std::fclose(file) != 0 || !written) {
+        throw std::runtime_error("Cannot write initial conditions file: " + path);
+    }
+}
+
+// Constructor for the file initial condition generator
+FileSystemGenerator::FileSystemGenerator(const std::string& path) : path_(path) {}
+
+// Format of the file, read from its first bytes
+InitialConditionFormat FileSystemGenerator::format() const {
+    MappedFile file(path_);
+    return file.isBinary() ? InitialConditionFormat::Binary : InitialConditionFormat::Csv;
+}
+
+// Read the bodies into a particle system
+ParticleSystem FileSystemGenerator::generateParticleSystem() {
+    MappedFile file(path_);
+    return file.isBinary() ? readBinary(file, path_) : readCsv(file, path_);
+}
+
+// The same bodies as a list of particles
+std::vector<particleAcceleration> FileSystemGenerator::generateInitialConditions() {
+    return generateParticleSystem().toParticleList();
+}
+}
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+
+#include "fmm.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+// Target cells at this level (or shallower leaves) are traversed as independent parallel tasks.
+constexpr int task_level = 3;
+
+// Monomials d^n of a vector for every term n, using the exponent table.
+void monomials(const double d[3], int order, int num_terms, const std::vector<int>& exponent, double* power) {
+    double px[64], py[64], pz[64];
+    px[0] = py[0] = pz[0] = 1.0;
+    for (int e = 1; e <= order; ++e) {
+        px[e] = px[e - 1] * d[0];
+        py[e] = py[e - 1] * d[1];
+        pz[e] = pz[e - 1] * d[2];
+    }
+    for (int t = 0; t < num_terms; ++t) {
+        power[t] = px[exponent[3 * t]] * py[exponent[3 * t + 1]] * pz[exponent[3 * t + 2]];
+    }
+}
+}
+
+// Constructor for the FMM solver
+FmmSolver::FmmSolver(int order, double theta, int leaf_size) : order_(order), theta_(theta), eps2_(0.0), tree_(leaf_size) {
+    setOrder(order);
+}
+
+// Accessor methods
+int FmmSolver::getOrder() const {
+    return order_;
+}
+
+void FmmSolver::setOrder(int order) {
+    order_ = std::min(std::max(order, 0), 30);
+    buildTables();
+}
+
+double FmmSolver::getOpeningAngle() const {
+    return theta_;
+}
+
+void FmmSolver::setOpeningAngle(double theta) {
+    theta_ = theta;
+}
+
+const std::vector<double>& FmmSolver::potential() const {
+    return potential_;
+}
+
+// Build the multi-index tables of the expansion operators for the current order
+void FmmSolver::buildTables() {
+    const int p = order_;
+    const int max_degree = 2 * p;
+    const int side = max_degree + 1;
+
+    // Enumerate exponents by degree, so terms of degree <= p come first
+    exponent_.clear();
+    index_.assign(side * side * side, -1);
+    num_terms_ = 0;
+    for (int degree = 0; degree <= max_degree; ++degree) {
+        for (int nx = degree; nx >= 0; --nx) {
+            for (int ny = degree - nx; ny >= 0; --ny) {
+                int nz = degree - nx - ny;
+                index_[(nx * side + ny) * side + nz] = static_cast<int>(exponent_.size() / 3);
+                exponent_.insert(exponent_.end(), {nx, ny, nz});
+            }
+        }
+        if (degree == p) {
+            num_terms_ = static_cast<int>(exponent_.size() / 3);
+        }
+    }
+    num_derivatives_ = static_cast<int>(exponent_.size() / 3);
+    auto index = [&](int nx, int ny, int nz) {
+        return (nx < 0 || ny < 0 || nz < 0) ? -1 : index_[(nx * side + ny) * side + nz];
+    };
+
+    // Lower neighbours used by the derivative recurrence and by L2P
+    lower_.assign(6 * num_derivatives_, -1);
+    for (int t = 0; t < num_derivatives_; ++t) {
+        const int* n = &exponent_[3 * t];
+        lower_[6 * t + 0] = index(n[0] - 1, n[1], n[2]);
+        lower_[6 * t + 1] = index(n[0], n[1] - 1, n[2]);
+        lower_[6 * t + 2] = index(n[0], n[1], n[2] - 1);
+        lower_[6 * t + 3] = index(n[0] - 2, n[1], n[2]);
+        lower_[6 * t + 4] = index(n[0], n[1] - 2, n[2]);
+        lower_[6 * t + 5] = index(n[0], n[1], n[2] - 2);
+    }
+
+    // Binomial coefficients up to 2p
+    std::vector<std::vector<double>> binomial(side, std::vector<double>(side, 0.0));
+    for (int a = 0; a <= max_degree; ++a) {
+        binomial[a][0] = 1.0;
+        for (int b = 1; b <= a; ++b) {
+            binomial[a][b] = binomial[a - 1][b - 1] + (b <= a - 1 ? binomial[a - 1][b] : 0.0);
+        }
+    }
+
+    // M2L: L_n -= sum_k (-1)^|k| C(n+k, n) D_{n+k} M_k
+    // shift (M2M and L2L): pairs k <= n with C(n, k) and the index of n - k
+    m2l_.assign(num_terms_, {});
+    shift_.assign(num_terms_, {});
+    for (int t = 0; t < num_terms_; ++t) {
+        const int* n = &exponent_[3 * t];
+        for (int s = 0; s < num_terms_; ++s) {
+            const int* k = &exponent_[3 * s];
+            int m[3] = {n[0] + k[0], n[1] + k[1], n[2] + k[2]};
+            double sign = ((k[0] + k[1] + k[2]) % 2 == 0) ? 1.0 : -1.0;
+            double coefficient = sign * binomial[m[0]][n[0]] * binomial[m[1]][n[1]] * binomial[m[2]][n[2]];
+            m2l_[t].push_back({s, index(m[0], m[1], m[2]), coefficient});
+
+            if (k[0] <= n[0] && k[1] <= n[1] && k[2] <= n[2]) {
+                double shift_coefficient = binomial[n[0]][k[0]] * binomial[n[1]][k[1]] * binomial[n[2]][k[2]];
+                shift_[t].push_back({s, index(n[0] - k[0], n[1] - k[1], n[2] - k[2]), shift_coefficient});
+            }
+        }
+    }
+}
+
+// Evaluate accelerations and potentials for the current positions
+void FmmSolver::evaluate(const ParticleSystem& particle_system, const double& epsilon) {
+    eps2_ = epsilon * epsilon;
+    tree_.build(particle_system);
+
+    const std::vector<OctreeNode>& nodes = tree_.nodes();
+    const std::size_t n = tree_.size();
+    const long num_nodes = static_cast<long>(nodes.size());
+    const int num_terms = num_terms_;
+    radius_.assign(nodes.size(), 0.0);
+    multipole_.assign(nodes.size() * num_terms, 0.0);
+    local_.assign(nodes.size() * num_terms, 0.0);
+    for (std::vector<double>* result : {&sorted_ax_, &sorted_ay_, &sorted_az_, &sorted_potential_, &ax_, &ay_, &az_, &potential_}) {
+        result->assign(n, 0.0);
+    }
+    if (n == 0) {
+        return;
+    }
+
+    const double* x = tree_.x();
+    const double* y = tree_.y();
+    const double* z = tree_.z();
+    const double* mass = tree_.mass();
+
+    // Group the cells by level for the upward and downward passes
+    int max_level = 0;
+    for (const OctreeNode& node : nodes) {
+        max_level = std::max(max_level, node.level);
+    }
+    std::vector<std::vector<int>> levels(max_level + 1);
+    for (long c = 0; c < num_nodes; ++c) {
+        levels[nodes[c].level].push_back(static_cast<int>(c));
+    }
+
+    // P2M: multipoles of the leaves about their centres
+    #pragma omp parallel
+    {
+        std::vector<double> power(num_terms);
+
+        #pragma omp for schedule(dynamic, 16)
+        for (long c = 0; c < num_nodes; ++c) {
+            const OctreeNode& node = nodes[c];
+            if (node.first_child >= 0) {
+                continue;
+            }
+            double* multipole = &multipole_[c * num_terms];
+            double radius2 = 0.0;
+            for (int k = node.begin; k < node.end; ++k) {
+                double d[3] = {x[k] - node.com[0], y[k] - node.com[1], z[k] - node.com[2]};
+                radius2 = std::max(radius2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+                monomials(d, order_, num_terms, exponent_, power.data());
+                for (int t = 0; t < num_terms; ++t) {
+                    multipole[t] += mass[k] * power[t];
+                }
+            }
+            radius_[c] = std::sqrt(radius2);
+        }
+    }
+
+    // M2M: shift the children's multipoles and radii to their parent, deepest level first
+    for (int level = max_level - 1; level >= 0; --level) {
+        const std::vector<int>& cells = levels[level];
+        #pragma omp parallel
+        {
+            std::vector<double> power(num_terms);
+
+            #pragma omp for schedule(dynamic, 16)
+            for (long i = 0; i < static_cast<long>(cells.size()); ++i) {
+                const OctreeNode& parent = nodes[cells[i]];
+                double* parent_multipole = &multipole_[static_cast<std::size_t>(cells[i]) * num_terms];
+                double parent_radius = 0.0;
+                for (int c = parent.first_child; c >= 0 && c < parent.first_child + parent.num_children; ++c) {
+                    const OctreeNode& child = nodes[c];
+                    const double* child_multipole = &multipole_[static_cast<std::size_t>(c) * num_terms];
+                    double d[3] = {child.com[0] - parent.com[0], child.com[1] - parent.com[1], child.com[2] - parent.com[2]};
+                    parent_radius = std::max(parent_radius, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + radius_[c]);
+                    monomials(d, order_, num_terms, exponent_, power.data());
+                    for (int t = 0; t < num_terms; ++t) {
+                        double sum = 0.0;
+                        for (const Term& term : shift_[t]) {
+                            sum += term.coefficient * power[term.target] * child_multipole[term.source];
+                        }
+                        parent_multipole[t] += sum;
+                    }
+                }
+                if (parent.first_child >= 0) {
+                    radius_[cells[i]] = parent_radius;
+                }
+            }
+        }
+    }
+
+    // Dual tree traversal: each task owns a disjoint target subtree, so M2L and P2P never race
+    std::vector<int> tasks;
+    std::vector<int> stack = {0};
+    while (!stack.empty()) {
+        int c = stack.back();
+        stack.pop_back();
+        if (nodes[c].level == task_level || nodes[c].first_child < 0) {
+            tasks.push_back(c);
+        }
+        else {
+            for (int child = nodes[c].first_child; child < nodes[c].first_child + nodes[c].num_children; ++child) {
+                stack.push_back(child);
+            }
+        }
+    }
+    #pragma omp parallel
+    {
+        std::vector<double> derivative(num_derivatives_);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (long i = 0; i < static_cast<long>(tasks.size()); ++i) {
+            interact(tasks[i], 0, derivative.data());
+        }
+    }
+
+    // L2L: pass local expansions down to the children, root first
+    for (int level = 0; level < max_level; ++level) {
+        const std::vector<int>& cells = levels[level];
+        #pragma omp parallel
+        {
+            std::vector<double> power(num_terms);
+
+            #pragma omp for schedule(dynamic, 16)
+            for (long i = 0; i < static_cast<long>(cells.size()); ++i) {
+                const OctreeNode& parent = nodes[cells[i]];
+                const double* parent_local = &local_[static_cast<std::size_t>(cells[i]) * num_terms];
+                for (int c = parent.first_child; c >= 0 && c < parent.first_child + parent.num_children; ++c) {
+                    const OctreeNode& child = nodes[c];
+                    double* child_local = &local_[static_cast<std::size_t>(c) * num_terms];
+                    double d[3] = {child.com[0] - parent.com[0], child.com[1] - parent.com[1], child.com[2] - parent.com[2]};
+                    monomials(d, order_, num_terms, exponent_, power.data());
+                    for (int t = 0; t < num_terms; ++t) {
+                        for (const Term& term : shift_[t]) {
+                            child_local[term.source] += term.coefficient * power[term.target] * parent_local[t];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // L2P: evaluate the local expansions and their gradients at the bodies of each leaf
+    #pragma omp parallel
+    {
+        std::vector<double> power(num_terms);
+
+        #pragma omp for schedule(dynamic, 16)
+        for (long c = 0; c < num_nodes; ++c) {
+            const OctreeNode& node = nodes[c];
+            if (node.first_child >= 0) {
+                continue;
+            }
+            const double* local = &local_[c * num_terms];
+            for (int k = node.begin; k < node.end; ++k) {
+                double d[3] = {x[k] - node.com[0], y[k] - node.com[1], z[k] - node.com[2]};
+                monomials(d, order_, num_terms, exponent_, power.data());
+                double phi = 0.0, grad_x = 0.0, grad_y = 0.0, grad_z = 0.0;
+                for (int t = 0; t < num_terms; ++t) {
+                    const int* e = &exponent_[3 * t];
+                    const int* lower = &lower_[6 * t];
+                    phi += local[t] * power[t];
+                    if (e[0] > 0) grad_x += e[0] * local[t] * power[lower[0]];
+                    if (e[1] > 0) grad_y += e[1] * local[t] * power[lower[1]];
+                    if (e[2] > 0) grad_z += e[2] * local[t] * power[lower[2]];
+                }
+                sorted_potential_[k] += phi;
+                sorted_ax_[k] -= grad_x;
+                sorted_ay_[k] -= grad_y;
+                sorted_az_[k] -= grad_z;
+            }
+        }
+    }
+
+    // Back to the order of the particle system
+    const std::vector<std::size_t>& order = tree_.order();
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < static_cast<long>(n); ++k) {
+        ax_[order[k]] = sorted_ax_[k];
+        ay_[order[k]] = sorted_ay_[k];
+        az_[order[k]] = sorted_az_[k];
+        potential_[order[k]] = sorted_potential_[k];
+    }
+}
+
+// Evaluate and store the net acceleration of every body in the particle system
+void FmmSolver::computeAcceleration(ParticleSystem& particle_system, const double& epsilon, bool with_potential) {
+    evaluate(particle_system, epsilon);
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    double* potential = particle_system.potential();
+    const long n = static_cast<long>(particle_system.size());
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+        ax[i] = ax_[i];
+        ay[i] = ay_[i];
+        az[i] = az_[i];
+        if (with_potential) {
+            potential[i] = potential_[i];
+        }
+    }
+}
+
+// Dual tree traversal of target cell a against source cell b
+void FmmSolver::interact(int a, int b, double* derivative) {
+    const OctreeNode& target = tree_.nodes()[a];
+    const OctreeNode& source = tree_.nodes()[b];
+    double dx = target.com[0] - source.com[0];
+    double dy = target.com[1] - source.com[1];
+    double dz = target.com[2] - source.com[2];
+    double reach = radius_[a] + radius_[b];
+    if (a != b && reach * reach < theta_ * theta_ * (dx * dx + dy * dy + dz * dz)) {
+        multipoleToLocal(a, b, derivative);
+        return;
+    }
+
+    const bool target_leaf = target.first_child < 0;
+    const bool source_leaf = source.first_child < 0;
+    if (target_leaf && source_leaf) {
+        particleToParticle(a, b);
+    }
+    else if (source_leaf || (!target_leaf && target.half_width >= source.half_width)) {
+        for (int c = target.first_child; c < target.first_child + target.num_children; ++c) {
+            interact(c, b, derivative);
+        }
+    }
+    else {
+        for (int c = source.first_child; c < source.first_child + source.num_children; ++c) {
+            interact(a, c, derivative);
+        }
+    }
+}
+
+// Translate the multipole of source cell b into the local expansion of target cell a
+void FmmSolver::multipoleToLocal(int a, int b, double* derivative) {
+    const OctreeNode& target = tree_.nodes()[a];
+    const OctreeNode& source = tree_.nodes()[b];
+    const double r[3] = {target.com[0] - source.com[0], target.com[1] - source.com[1], target.com[2] - source.com[2]};
+    const double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + eps2_;
+
+    // Taylor coefficients D_n = (1/n!) d^n/dr^n (r^2 + eps^2)^(-1/2), by degree:
+    // |n| r2 D_n = -(2|n| - 1) sum_i r_i D_{n-e_i} - (|n| - 1) sum_i D_{n-2e_i}
+    derivative[0] = 1.0 / std::sqrt(r2);
+    const double inv_r2 = 1.0 / r2;
+    for (int t = 1; t < num_derivatives_; ++t) {
+        const int* e = &exponent_[3 * t];
+        const int* lower = &lower_[6 * t];
+        const int degree = e[0] + e[1] + e[2];
+        double first = 0.0, second = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            if (lower[i] >= 0) first += r[i] * derivative[lower[i]];
+            if (lower[3 + i] >= 0) second += derivative[lower[3 + i]];
+        }
+        derivative[t] = -((2 * degree - 1) * first + (degree - 1) * second) * inv_r2 / degree;
+    }
+
+    const double* multipole = &multipole_[static_cast<std::size_t>(b) * num_terms_];
+    double* local = &local_[static_cast<std::size_t>(a) * num_terms_];
+    for (int t = 0; t < num_terms_; ++t) {
+        double sum = 0.0;
+        for (const Term& term : m2l_[t]) {
+            sum += term.coefficient * derivative[term.target] * multipole[term.source];
+        }
+        local[t] -= sum;
+    }
+}
+
+// Direct interaction of the bodies of leaf a with the bodies of leaf b
+void FmmSolver::particleToParticle(int a, int b) {
+    const OctreeNode& target = tree_.nodes()[a];
+    const OctreeNode& source = tree_.nodes()[b];
+    const double* x = tree_.x();
+    const double* y = tree_.y();
+    const double* z = tree_.z();
+    const double* mass = tree_.mass();
+
+    for (int k = target.begin; k < target.end; ++k) {
+        double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0, phi = 0.0;
+        for (int j = source.begin; j < source.end; ++j) {
+            if (j != k) {
+                double dx = x[j] - x[k];
+                double dy = y[j] - y[k];
+                double dz = z[j] - z[k];
+                double inv_r = 1.0 / std::sqrt(dx * dx + dy * dy + dz * dz + eps2_);
+                double scale = mass[j] * inv_r * inv_r * inv_r;
+                sum_x += scale * dx;
+                sum_y += scale * dy;
+                sum_z += scale * dz;
+                phi -= mass[j] * inv_r;
+            }
+        }
+        sorted_ax_[k] += sum_x;
+        sorted_ay_[k] += sum_y;
+        sorted_az_[k] += sum_z;
+        sorted_potential_[k] += phi;
+    }
+}
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <omp.h>
+
+#include "forceEngine.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+// Parse a kernel name
+ForceKernel parseForceKernel(const std::string& name) {
+    if (name == "direct") {
+        return ForceKernel::Direct;
+    }
+    if (name == "simd") {
+        return ForceKernel::Simd;
+    }
+    if (name == "symmetric") {
+        return ForceKernel::Symmetric;
+    }
+    if (name == "tiled") {
+        return ForceKernel::Tiled;
+    }
+    if (name == "bh") {
+        return ForceKernel::BarnesHut;
+    }
+    if (name == "fmm") {
+        return ForceKernel::Fmm;
+    }
+    if (name == "mixed") {
+        return ForceKernel::Mixed;
+    }
+    throw std::invalid_argument("Unknown force kernel: " + name);
+}
+
+// Name of a force kernel
+std::string forceKernelName(ForceKernel kernel) {
+    switch (kernel) {
+        case ForceKernel::Direct: return "direct";
+        case ForceKernel::Simd: return "simd";
+        case ForceKernel::Symmetric: return "symmetric";
+        case ForceKernel::Tiled: return "tiled";
+        case ForceKernel::BarnesHut: return "bh";
+        case ForceKernel::Fmm: return "fmm";
+        case ForceKernel::Mixed: return "mixed";
+    }
+    return "unknown";
+}
+
+// Constructor for the force engine
+ForceEngine::ForceEngine(ForceKernel kernel, double epsilon)
+    : kernel_(kernel), epsilon_(epsilon), simd_path_(SimdPath::Auto), tile_size_(0), compute_potential_(false), task_pool_(), work_stealing_(false), barnes_hut_(), fmm_()
+    {}
+
+// Calculate the net acceleration of every body in the particle system
+void ForceEngine::computeAcceleration(ParticleSystem& particle_system) {
+    NBODY_PROFILE_SCOPE(Force);
+    switch (kernel_) {
+        case ForceKernel::Direct: {
+            // Small systems such as the Solar System run serially, starting the threads would cost more than the loop
+            const long n = static_cast<long>(particle_system.size());
+            if (work_stealing_ && n > 64) {
+                task_pool_->parallelFor(n, 16, [&](long begin, long end) {
+                    for (long i = begin; i < end; ++i) {
+                        particle_system.sumAcceleration(i, epsilon_, compute_potential_);
+                    }
+                });
+                break;
+            }
+            #pragma omp parallel if (n > 64)
+            {
+                NBODY_PROFILE_THREAD(Force);
+                #pragma omp for nowait
+                for (long i = 0; i < n; ++i) {
+                    particle_system.sumAcceleration(i, epsilon_, compute_potential_);
+                }
+            }
+            break;
+        }
+        case ForceKernel::Simd:
+            simdSumAcceleration(particle_system, epsilon_, simd_path_, compute_potential_);
+            break;
+        case ForceKernel::Symmetric:
+            symmetricSumAcceleration(particle_system, epsilon_, compute_potential_);
+            break;
+        case ForceKernel::Tiled:
+            tiledSumAcceleration(particle_system, epsilon_, tile_size_, compute_potential_);
+            break;
+        case ForceKernel::BarnesHut:
+            barnes_hut_.computeAcceleration(particle_system, epsilon_, compute_potential_);
+            break;
+        case ForceKernel::Fmm:
+            fmm_.computeAcceleration(particle_system, epsilon_, compute_potential_);
+            break;
+        case ForceKernel::Mixed:
+            precisionSumAcceleration<float>(particle_system, epsilon_, tile_size_, compute_potential_);
+            break;
+    }
+
+    // Direct kernels do N (N - 1) interactions of 20 flops, 23 with the potential. The tree kernels
+    // do not count their interactions, only the arrays they read and write.
+    NBODY_PROFILE_COUNT(Force, isApproximate() ? 0.0 : pairInteractions(particle_system.size()),
+                        isApproximate() ? 0.0 : (compute_potential_ ? 23.0 : 20.0) * pairInteractions(particle_system.size()),
+                        (compute_potential_ ? 64.0 : 56.0) * particle_system.size());
+}
+
+// Accessor methods
+ForceKernel ForceEngine::getKernel() const {
+    return kernel_;
+}
+
+double ForceEngine::getEpsilon() const {
+    return epsilon_;
+}
+
+// Force a particular instruction set for the Simd kernel
+void ForceEngine::setSimdPath(SimdPath path) {
+    simd_path_ = path;
+}
+
+// Tile size of the Tiled and Mixed kernels
+void ForceEngine::setTileSize(std::size_t tile_size) {
+    tile_size_ = tile_size;
+}
+
+std::size_t ForceEngine::getTileSize() const {
+    return tile_size_;
+}
+
+// Accumulate the potential in the force pass
+void ForceEngine::setComputePotential(bool compute_potential) {
+    compute_potential_ = compute_potential;
+}
+
+bool ForceEngine::getComputePotential() const {
+    return compute_potential_;
+}
+
+// Share the per-body work out with a work-stealing pool
+void ForceEngine::setWorkStealing(bool work_stealing) {
+    if (work_stealing && !task_pool_) {
+        task_pool_ = std::make_shared<TaskPool>();
+    }
+    work_stealing_ = work_stealing;
+    barnes_hut_.setTaskPool(work_stealing ? task_pool_ : nullptr);
+}
+
+bool ForceEngine::getWorkStealing() const {
+    return work_stealing_;
+}
+
+std::shared_ptr<TaskPool> ForceEngine::getTaskPool() const {
+    return task_pool_;
+}
+
+// Opening angle of the BarnesHut and Fmm kernels
+void ForceEngine::setOpeningAngle(double theta) {
+    barnes_hut_.setOpeningAngle(theta);
+    fmm_.setOpeningAngle(theta);
+}
+
+double ForceEngine::getOpeningAngle() const {
+    return barnes_hut_.getOpeningAngle();
+}
+
+// Expansion order of the Fmm kernel
+void ForceEngine::setExpansionOrder(int order) {
+    fmm_.setOrder(order);
+}
+
+int ForceEngine::getExpansionOrder() const {
+    return fmm_.getOrder();
+}
+
+// Check if the kernel approximates direct summation
+bool ForceEngine::isApproximate() const {
+    return kernel_ == ForceKernel::BarnesHut || kernel_ == ForceKernel::Fmm;
+}
+
+// Compare the stored accelerations with direct summation on a random sample of bodies
+ForceError sampleForceError(const ParticleSystem& particle_system, const double& epsilon, std::size_t num_samples, int seed) {
+    const std::size_t n = particle_system.size();
+    std::vector<std::size_t> samples(n);
+    std::iota(samples.begin(), samples.end(), 0);
+    if (num_samples < n) {
+        std::mt19937 gen(seed);
+        std::shuffle(samples.begin(), samples.end(), gen);
+        samples.resize(num_samples);
+    }
+
+    // Direct summation for the sampled bodies only, same expression as ParticleSystem::sumAcceleration
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    const double* mass = particle_system.mass();
+    const double eps2 = epsilon * epsilon;
+    std::vector<double> relative_error(samples.size(), 0.0);
+    #pragma omp parallel for schedule(dynamic)
+    for (long s = 0; s < static_cast<long>(samples.size()); ++s) {
+        const std::size_t i = samples[s];
+        Eigen::Vector3d exact = Eigen::Vector3d::Zero();
+        for (std::size_t j = 0; j < n; ++j) {
+            if (j != i) {
+                Eigen::Vector3d r(x[j] - x[i], y[j] - y[i], z[j] - z[i]);
+                exact += mass[j] * r / std::pow(r.squaredNorm() + eps2, 3.0/2.0);
+            }
+        }
+        Eigen::Vector3d approx = particle_system.getAcceleration(i);
+        relative_error[s] = exact.norm() > 0.0 ? (approx - exact).norm() / exact.norm() : (approx - exact).norm();
+    }
+
+    ForceError error {0.0, 0.0, samples.size()};
+    for (double e : relative_error) {
+        error.mean_relative += e;
+        error.max_relative = std::max(error.max_relative, e);
+    }
+    if (!samples.empty()) {
+        error.mean_relative /= samples.size();
+    }
+    return error;
+}
+}
@@ -0,0 +1,113 @@
+#include <omp.h>
+
+#include "hermite.hpp"
+#include "integrator.hpp"
+#include "jerkKernel.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+// Number of single-body force evaluations
+long HermiteIntegrator::getBodyEvaluations() const {
+    return body_evaluations_;
+}
+
+// Forget the stored accelerations and jerks
+void HermiteIntegrator::reset() {
+    initialised_ = false;
+}
+
+// Copy the jerks into a state
+void HermiteIntegrator::getState(IntegratorState& state) const {
+    if (initialised_) {
+        state.jx.assign(jx_.begin(), jx_.end());
+        state.jy.assign(jy_.begin(), jy_.end());
+        state.jz.assign(jz_.begin(), jz_.end());
+    }
+}
+
+// Continue from saved jerks, the next step does not evaluate them again
+void HermiteIntegrator::setState(const IntegratorState& state) {
+    jx_.assign(state.jx.begin(), state.jx.end());
+    jy_.assign(state.jy.begin(), state.jy.end());
+    jz_.assign(state.jz.begin(), state.jz.end());
+    initialised_ = !state.jx.empty();
+}
+
+void HermiteIntegrator::computeAccelerationJerk(ParticleSystem& particle_system, const double& epsilon) {
+    sumAccelerationJerk(particle_system, epsilon, jx_.data(), jy_.data(), jz_.data());
+    body_evaluations_ += particle_system.size();
+}
+
+// Advance every body of the particle system by dt
+void HermiteIntegrator::step(ParticleSystem& particle_system, const double& epsilon, const double& dt) {
+    const long n = static_cast<long>(particle_system.size());
+    if (!initialised_ || static_cast<long>(jx_.size()) != n) {
+        jx_.resize(n);
+        jy_.resize(n);
+        jz_.resize(n);
+        computeAccelerationJerk(particle_system, epsilon);
+        initialised_ = true;
+    }
+
+    // Keep the state at the start of the step, the copies reuse their storage after the first step
+    previous_ = particle_system;
+    previous_jx_ = jx_;
+    previous_jy_ = jy_;
+    previous_jz_ = jz_;
+
+    double* x = particle_system.x();
+    double* y = particle_system.y();
+    double* z = particle_system.z();
+    double* vx = particle_system.vx();
+    double* vy = particle_system.vy();
+    double* vz = particle_system.vz();
+    const double* ax = particle_system.ax();
+    const double* ay = particle_system.ay();
+    const double* az = particle_system.az();
+    const double* x0 = previous_.x();
+    const double* y0 = previous_.y();
+    const double* z0 = previous_.z();
+    const double* vx0 = previous_.vx();
+    const double* vy0 = previous_.vy();
+    const double* vz0 = previous_.vz();
+    const double* ax0 = previous_.ax();
+    const double* ay0 = previous_.ay();
+    const double* az0 = previous_.az();
+    const double* jx0 = previous_jx_.data();
+    const double* jy0 = previous_jy_.data();
+    const double* jz0 = previous_jz_.data();
+    const double dt2 = dt * dt / 2.0;
+    const double dt3 = dt2 * dt / 3.0;
+
+    // Predict every body
+    #pragma omp parallel for schedule(static) if (n > 64)
+    for (long i = 0; i < n; ++i) {
+        x[i] += vx[i] * dt + ax[i] * dt2 + jx_[i] * dt3;
+        y[i] += vy[i] * dt + ay[i] * dt2 + jy_[i] * dt3;
+        z[i] += vz[i] * dt + az[i] * dt2 + jz_[i] * dt3;
+        vx[i] += ax[i] * dt + jx_[i] * dt2;
+        vy[i] += ay[i] * dt + jy_[i] * dt2;
+        vz[i] += az[i] * dt + jz_[i] * dt2;
+    }
+
+    // Evaluate at the predicted state
+    computeAccelerationJerk(particle_system, epsilon);
+
+    // Correct
+    const double dt12 = dt * dt / 12.0;
+    #pragma omp parallel for schedule(static) if (n > 64)
+    for (long i = 0; i < n; ++i) {
+        vx[i] = vx0[i] + (ax0[i] + ax[i]) * dt / 2.0 + (jx0[i] - jx_[i]) * dt12;
+        vy[i] = vy0[i] + (ay0[i] + ay[i]) * dt / 2.0 + (jy0[i] - jy_[i]) * dt12;
+        vz[i] = vz0[i] + (az0[i] + az[i]) * dt / 2.0 + (jz0[i] - jz_[i]) * dt12;
+        x[i] = x0[i] + (vx0[i] + vx[i]) * dt / 2.0 + (ax0[i] - ax[i]) * dt12;
+        y[i] = y0[i] + (vy0[i] + vy[i]) * dt / 2.0 + (ay0[i] - ay[i]) * dt12;
+        z[i] = z0[i] + (vz0[i] + vz[i]) * dt / 2.0 + (az0[i] - az[i]) * dt12;
+    }
+
+    // Copy of the previous state, predictor and corrector per body
+    NBODY_PROFILE_COUNT(Integration, 0.0, 72.0 * n, 584.0 * n);
+}
+}
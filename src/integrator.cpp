@@ -0,0 +1,204 @@
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "integrator.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+// Parse a scheme name
+IntegratorScheme parseIntegratorScheme(const std::string& name) {
+    if (name == "euler") {
+        return IntegratorScheme::Euler;
+    }
+    if (name == "leapfrog") {
+        return IntegratorScheme::Leapfrog;
+    }
+    if (name == "verlet") {
+        return IntegratorScheme::VelocityVerlet;
+    }
+    if (name == "yoshida4") {
+        return IntegratorScheme::Yoshida4;
+    }
+    if (name == "hermite") {
+        return IntegratorScheme::Hermite;
+    }
+    if (name == "block") {
+        return IntegratorScheme::Block;
+    }
+    throw std::invalid_argument("Unknown integrator: " + name);
+}
+
+// Name of an integration scheme
+std::string integratorSchemeName(IntegratorScheme scheme) {
+    switch (scheme) {
+        case IntegratorScheme::Euler: return "euler";
+        case IntegratorScheme::Leapfrog: return "leapfrog";
+        case IntegratorScheme::VelocityVerlet: return "verlet";
+        case IntegratorScheme::Yoshida4: return "yoshida4";
+        case IntegratorScheme::Hermite: return "hermite";
+        case IntegratorScheme::Block: return "block";
+    }
+    return "unknown";
+}
+
+// Constructor for the integrator
+Integrator::Integrator(IntegratorScheme scheme)
+    : scheme_(scheme), acceleration_valid_(false), force_evaluations_(0), body_evaluations_(0), hermite_(), block_()
+    {}
+
+// Accessor methods
+IntegratorScheme Integrator::getScheme() const {
+    return scheme_;
+}
+
+long Integrator::getForceEvaluations() const {
+    return force_evaluations_;
+}
+
+long Integrator::getBodyEvaluations() const {
+    return body_evaluations_ + hermite_.getBodyEvaluations() + block_.getBodyEvaluations();
+}
+
+// Accuracy parameter of the Block scheme
+void Integrator::setTimestepAccuracy(double eta) {
+    block_.setAccuracy(eta);
+}
+
+// State carried between steps
+IntegratorState Integrator::getState() const {
+    IntegratorState state;
+    state.acceleration_valid = acceleration_valid_;
+    if (scheme_ == IntegratorScheme::Hermite) {
+        hermite_.getState(state);
+    }
+    else if (scheme_ == IntegratorScheme::Block) {
+        block_.getState(state);
+    }
+    return state;
+}
+
+// Continue from a saved state
+void Integrator::setState(const IntegratorState& state) {
+    reset();
+    acceleration_valid_ = state.acceleration_valid;
+    if (scheme_ == IntegratorScheme::Hermite) {
+        hermite_.setState(state);
+    }
+    else if (scheme_ == IntegratorScheme::Block) {
+        block_.setState(state);
+    }
+}
+
+// Reorder the per-body state along with the bodies
+void Integrator::permute(const std::vector<std::size_t>& order) {
+    IntegratorState state = getState();
+    auto gather = [&](auto& values) {
+        if (!values.empty()) {
+            auto old_values = values;
+            for (std::size_t k = 0; k < order.size(); ++k) {
+                values[k] = old_values[order[k]];
+            }
+        }
+    };
+    gather(state.jx);
+    gather(state.jy);
+    gather(state.jz);
+    gather(state.level);
+    setState(state);
+}
+
+// Forget the stored accelerations
+void Integrator::reset() {
+    acceleration_valid_ = false;
+    hermite_.reset();
+    block_.reset();
+}
+
+void Integrator::computeAcceleration(ParticleSystem& particle_system, ForceEngine& force_engine) {
+    force_engine.computeAcceleration(particle_system);
+    ++force_evaluations_;
+    body_evaluations_ += particle_system.size();
+    acceleration_valid_ = true;
+}
+
+// Make sure the stored accelerations belong to the current positions
+void Integrator::ensureAcceleration(ParticleSystem& particle_system, ForceEngine& force_engine) {
+    if (!acceleration_valid_) {
+        computeAcceleration(particle_system, force_engine);
+    }
+}
+
+// Make sure the stored accelerations and potentials belong to the current positions
+bool Integrator::synchronise(ParticleSystem& particle_system, ForceEngine& force_engine) {
+    if (scheme_ == IntegratorScheme::Hermite || scheme_ == IntegratorScheme::Block) {
+        return false;
+    }
+    ensureAcceleration(particle_system, force_engine);
+    return true;
+}
+
+// Kick-drift-kick substep of length h
+void Integrator::leapfrogStep(ParticleSystem& particle_system, ForceEngine& force_engine, const double& h) {
+    particle_system.kick(0.5 * h);
+    particle_system.drift(h);
+    computeAcceleration(particle_system, force_engine);
+    particle_system.kick(0.5 * h);
+}
+
+// Advance every body of the particle system by dt
+void Integrator::step(ParticleSystem& particle_system, ForceEngine& force_engine, const double& dt) {
+    NBODY_PROFILE_SCOPE(Integration);
+    if (scheme_ == IntegratorScheme::Hermite) {
+        hermite_.step(particle_system, force_engine.getEpsilon(), dt);
+        return;
+    }
+    if (scheme_ == IntegratorScheme::Block) {
+        block_.step(particle_system, force_engine.getEpsilon(), dt);
+        return;
+    }
+    ensureAcceleration(particle_system, force_engine);
+    // Updates count their flops and the arrays they read and write per body, a kick or drift is 6 flops and 72 bytes
+
+    switch (scheme_) {
+        case IntegratorScheme::Euler:
+            particle_system.update(dt);
+            acceleration_valid_ = false;
+            NBODY_PROFILE_COUNT(Integration, 0.0, 12.0 * particle_system.size(), 120.0 * particle_system.size());
+            break;
+
+        case IntegratorScheme::Leapfrog:
+            leapfrogStep(particle_system, force_engine, dt);
+            NBODY_PROFILE_COUNT(Integration, 0.0, 18.0 * particle_system.size(), 216.0 * particle_system.size());
+            break;
+
+        case IntegratorScheme::VelocityVerlet: {
+            // x += v dt + a dt^2 / 2, and the a_old half of the velocity update
+            particle_system.driftAccelerated(dt);
+            particle_system.kick(0.5 * dt);
+            computeAcceleration(particle_system, force_engine);
+            particle_system.kick(0.5 * dt);
+            NBODY_PROFILE_COUNT(Integration, 0.0, 24.0 * particle_system.size(), 240.0 * particle_system.size());
+            break;
+        }
+
+        case IntegratorScheme::Yoshida4: {
+            // Substep weights w1, w0, w1 with 2 w1 + w0 = 1 cancel the third-order error
+            const double cbrt2 = std::cbrt(2.0);
+            const double w1 = 1.0 / (2.0 - cbrt2);
+            const double w0 = -cbrt2 / (2.0 - cbrt2);
+            leapfrogStep(particle_system, force_engine, w1 * dt);
+            leapfrogStep(particle_system, force_engine, w0 * dt);
+            leapfrogStep(particle_system, force_engine, w1 * dt);
+            NBODY_PROFILE_COUNT(Integration, 0.0, 54.0 * particle_system.size(), 648.0 * particle_system.size());
+            break;
+        }
+
+        case IntegratorScheme::Hermite:
+        case IntegratorScheme::Block:
+            break;
+    }
+}
+}
@@ -0,0 +1,83 @@
+#include <cmath>
+
+#include "jerkKernel.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+// Calculate the acceleration and jerk of body i due to all other bodies
+void sumAccelerationJerk(const ParticleSystem& particle_system, std::size_t i, const double& epsilon,
+                         double acceleration[3], double jerk[3]) {
+    const double* __restrict x = particle_system.x();
+    const double* __restrict y = particle_system.y();
+    const double* __restrict z = particle_system.z();
+    const double* __restrict vx = particle_system.vx();
+    const double* __restrict vy = particle_system.vy();
+    const double* __restrict vz = particle_system.vz();
+    const double* __restrict mass = particle_system.mass();
+    const double eps2 = epsilon * epsilon;
+    const double xi = x[i], yi = y[i], zi = z[i];
+    const double vxi = vx[i], vyi = vy[i], vzi = vz[i];
+    const std::size_t n = particle_system.size();
+
+    // Body i itself has zero separation and relative velocity, so it adds nothing even when epsilon > 0
+    double acc_x = 0.0, acc_y = 0.0, acc_z = 0.0;
+    double jerk_x = 0.0, jerk_y = 0.0, jerk_z = 0.0;
+    #pragma omp simd reduction(+:acc_x, acc_y, acc_z, jerk_x, jerk_y, jerk_z)
+    for (std::size_t j = 0; j < n; ++j) {
+        double dx = x[j] - xi;
+        double dy = y[j] - yi;
+        double dz = z[j] - zi;
+        double dvx = vx[j] - vxi;
+        double dvy = vy[j] - vyi;
+        double dvz = vz[j] - vzi;
+        double r2 = dx * dx + dy * dy + dz * dz + eps2;
+        double inv_r = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+        double inv_r2 = inv_r * inv_r;
+        double scale = mass[j] * inv_r2 * inv_r;
+        double rv = 3.0 * (dx * dvx + dy * dvy + dz * dvz) * inv_r2;
+        acc_x += scale * dx;
+        acc_y += scale * dy;
+        acc_z += scale * dz;
+        jerk_x += scale * (dvx - rv * dx);
+        jerk_y += scale * (dvy - rv * dy);
+        jerk_z += scale * (dvz - rv * dz);
+    }
+
+    acceleration[0] = acc_x;
+    acceleration[1] = acc_y;
+    acceleration[2] = acc_z;
+    jerk[0] = jerk_x;
+    jerk[1] = jerk_y;
+    jerk[2] = jerk_z;
+}
+
+// Calculate the acceleration and jerk of every body
+void sumAccelerationJerk(ParticleSystem& particle_system, const double& epsilon, double* jx, double* jy, double* jz) {
+    NBODY_PROFILE_SCOPE(Force);
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    const long n = static_cast<long>(particle_system.size());
+
+    #pragma omp parallel if (n > 64)
+    {
+        NBODY_PROFILE_THREAD(Force);
+        #pragma omp for schedule(static) nowait
+        for (long i = 0; i < n; ++i) {
+            double acceleration[3], jerk[3];
+            sumAccelerationJerk(particle_system, i, epsilon, acceleration, jerk);
+            ax[i] = acceleration[0];
+            ay[i] = acceleration[1];
+            az[i] = acceleration[2];
+            jx[i] = jerk[0];
+            jy[i] = jerk[1];
+            jz[i] = jerk[2];
+        }
+    }
+
+    // About 60 flops per interaction with the jerk, positions, velocities and masses read, accelerations and jerks written
+    NBODY_PROFILE_COUNT(Force, pairInteractions(n), 60.0 * pairInteractions(n), 104.0 * n);
+}
+}
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <omp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NBODY_X86_SIMD 1
+#endif
+
+#include "mixedKernel.hpp"
+#include "simdKernel.hpp"
+#include "tiledKernel.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Number of targets that share each source tile, as in the tiled kernel
+constexpr long target_block = 64;
+
+// Portable sweep of target (xi, yi, zi) over the sources [begin, end), summed in Scalar.
+// Used for double, for float without x86 vector instructions, and for the tails of the vector sweeps.
+template <typename Scalar, bool WithPotential>
+void sweepSources(const Scalar* __restrict x, const Scalar* __restrict y, const Scalar* __restrict z, const Scalar* __restrict mass,
+                  long begin, long end, Scalar xi, Scalar yi, Scalar zi, Scalar eps2,
+                  Scalar& sum_x, Scalar& sum_y, Scalar& sum_z, Scalar& sum_potential) {
+    Scalar acc_x = 0, acc_y = 0, acc_z = 0, acc_potential = 0;
+    #pragma omp simd reduction(+:acc_x, acc_y, acc_z, acc_potential)
+    for (long j = begin; j < end; ++j) {
+        Scalar dx = x[j] - xi;
+        Scalar dy = y[j] - yi;
+        Scalar dz = z[j] - zi;
+        Scalar r2 = dx * dx + dy * dy + dz * dz + eps2;
+        Scalar inv_r = r2 > Scalar(0) ? Scalar(1) / std::sqrt(r2) : Scalar(0);
+        Scalar scale = mass[j] * inv_r * inv_r * inv_r;
+        acc_x += scale * dx;
+        acc_y += scale * dy;
+        acc_z += scale * dz;
+        if (WithPotential) {
+            acc_potential -= mass[j] * inv_r;
+        }
+    }
+    sum_x += acc_x;
+    sum_y += acc_y;
+    sum_z += acc_z;
+    sum_potential += acc_potential;
+}
+
+#ifdef NBODY_X86_SIMD
+
+// Horizontal sum of the eight lanes of an AVX register
+__attribute__((target("avx2,fma")))
+inline float horizontalSum(__m256 v) {
+    __m128 low = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    low = _mm_add_ps(low, _mm_movehl_ps(low, low));
+    return _mm_cvtss_f32(_mm_add_ss(low, _mm_shuffle_ps(low, low, 1)));
+}
+
+// AVX2 sweep: eight sources per instruction. Division and square root are the slowest part of the
+// portable loop, so 1/r comes from the 12-bit rsqrt estimate refined with one Newton step
+// y <- y * (1.5 - 0.5 * r2 * y * y), which is accurate to the float rounding.
+template <bool WithPotential>
+__attribute__((target("avx2,fma")))
+void sweepSourcesAvx2(const float* x, const float* y, const float* z, const float* mass, long begin, long end, float xi, float yi, float zi, float eps2,
+                      float& sum_x, float& sum_y, float& sum_z, float& sum_potential) {
+    const __m256 xi_v = _mm256_set1_ps(xi);
+    const __m256 yi_v = _mm256_set1_ps(yi);
+    const __m256 zi_v = _mm256_set1_ps(zi);
+    const __m256 eps2_v = _mm256_set1_ps(eps2);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 three_halves = _mm256_set1_ps(1.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 acc_x = zero, acc_y = zero, acc_z = zero, acc_potential = zero;
+    const long end_vec = begin + (end - begin) / 8 * 8;
+
+    for (long j = begin; j < end_vec; j += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi_v);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi_v);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), zi_v);
+        __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps2_v)));
+
+        __m256 inv_r = _mm256_rsqrt_ps(r2);
+        inv_r = _mm256_mul_ps(inv_r, _mm256_fnmadd_ps(_mm256_mul_ps(_mm256_mul_ps(half, r2), inv_r), inv_r, three_halves));
+
+        // Zero the contribution of r2 == 0, where the estimate is infinite
+        inv_r = _mm256_and_ps(inv_r, _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+        __m256 mass_j = _mm256_loadu_ps(mass + j);
+        __m256 scale = _mm256_mul_ps(mass_j, _mm256_mul_ps(_mm256_mul_ps(inv_r, inv_r), inv_r));
+
+        acc_x = _mm256_fmadd_ps(scale, dx, acc_x);
+        acc_y = _mm256_fmadd_ps(scale, dy, acc_y);
+        acc_z = _mm256_fmadd_ps(scale, dz, acc_z);
+        if (WithPotential) {
+            acc_potential = _mm256_fnmadd_ps(mass_j, inv_r, acc_potential);
+        }
+    }
+    sum_x += horizontalSum(acc_x);
+    sum_y += horizontalSum(acc_y);
+    sum_z += horizontalSum(acc_z);
+    sum_potential += horizontalSum(acc_potential);
+    sweepSources<float, WithPotential>(x, y, z, mass, end_vec, end, xi, yi, zi, eps2, sum_x, sum_y, sum_z, sum_potential);
+}
+
+// AVX-512 sweep: sixteen sources per instruction, using the 14-bit rsqrt14 estimate refined with one Newton step.
+template <bool WithPotential>
+__attribute__((target("avx512f")))
+void sweepSourcesAvx512(const float* x, const float* y, const float* z, const float* mass, long begin, long end, float xi, float yi, float zi, float eps2,
+                        float& sum_x, float& sum_y, float& sum_z, float& sum_potential) {
+    const __m512 xi_v = _mm512_set1_ps(xi);
+    const __m512 yi_v = _mm512_set1_ps(yi);
+    const __m512 zi_v = _mm512_set1_ps(zi);
+    const __m512 eps2_v = _mm512_set1_ps(eps2);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 three_halves = _mm512_set1_ps(1.5f);
+    const __m512 zero = _mm512_setzero_ps();
+    __m512 acc_x = zero, acc_y = zero, acc_z = zero, acc_potential = zero;
+    const long end_vec = begin + (end - begin) / 16 * 16;
+
+    for (long j = begin; j < end_vec; j += 16) {
+        __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), xi_v);
+        __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), yi_v);
+        __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), zi_v);
+        __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, eps2_v)));
+
+        __m512 inv_r = _mm512_rsqrt14_ps(r2);
+        inv_r = _mm512_mul_ps(inv_r, _mm512_fnmadd_ps(_mm512_mul_ps(_mm512_mul_ps(half, r2), inv_r), inv_r, three_halves));
+
+        // Zero the contribution of r2 == 0, where the estimate is infinite
+        inv_r = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ), inv_r);
+        __m512 mass_j = _mm512_loadu_ps(mass + j);
+        __m512 scale = _mm512_mul_ps(mass_j, _mm512_mul_ps(_mm512_mul_ps(inv_r, inv_r), inv_r));
+
+        acc_x = _mm512_fmadd_ps(scale, dx, acc_x);
+        acc_y = _mm512_fmadd_ps(scale, dy, acc_y);
+        acc_z = _mm512_fmadd_ps(scale, dz, acc_z);
+        if (WithPotential) {
+            acc_potential = _mm512_fnmadd_ps(mass_j, inv_r, acc_potential);
+        }
+    }
+    sum_x += _mm512_reduce_add_ps(acc_x);
+    sum_y += _mm512_reduce_add_ps(acc_y);
+    sum_z += _mm512_reduce_add_ps(acc_z);
+    sum_potential += _mm512_reduce_add_ps(acc_potential);
+    sweepSources<float, WithPotential>(x, y, z, mass, end_vec, end, xi, yi, zi, eps2, sum_x, sum_y, sum_z, sum_potential);
+}
+
+#endif
+
+// Widest sweep of a source tile for Scalar on the running CPU
+template <typename Scalar, bool WithPotential>
+auto selectSweep() {
+    auto sweep = &sweepSources<Scalar, WithPotential>;
+#ifdef NBODY_X86_SIMD
+    if constexpr (std::is_same_v<Scalar, float>) {
+        static const SimdPath supported = detectSimdPath();
+        if (supported == SimdPath::AVX512) {
+            sweep = &sweepSourcesAvx512<WithPotential>;
+        }
+        else if (supported == SimdPath::AVX2) {
+            sweep = &sweepSourcesAvx2<WithPotential>;
+        }
+    }
+#endif
+    return sweep;
+}
+
+// Tiled sweep with Scalar pair terms and double sums, WithPotential also accumulates the potential
+template <typename Scalar, bool WithPotential>
+void precisionSum(ParticleSystem& particle_system, const double& epsilon, std::size_t tile_size) {
+    const auto sweep = selectSweep<Scalar, WithPotential>();
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    const double* mass = particle_system.mass();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    double* potential = particle_system.potential();
+    const long n = static_cast<long>(particle_system.size());
+    const Scalar eps2 = static_cast<Scalar>(epsilon * epsilon);
+    const std::size_t default_tile = detectTileSize() * sizeof(double) / sizeof(Scalar);
+    const long tile = static_cast<long>(tile_size == 0 ? default_tile : std::min<std::size_t>(tile_size, std::max<long>(n, 1)));
+    const long num_blocks = (n + target_block - 1) / target_block;
+
+    // Centre of the bounding box, subtracted in double before the positions are rounded to Scalar
+    double low_x = std::numeric_limits<double>::max(), low_y = low_x, low_z = low_x;
+    double high_x = std::numeric_limits<double>::lowest(), high_y = high_x, high_z = high_x;
+    #pragma omp parallel for reduction(min:low_x, low_y, low_z) reduction(max:high_x, high_y, high_z)
+    for (long i = 0; i < n; ++i) {
+        low_x = std::min(low_x, x[i]);
+        low_y = std::min(low_y, y[i]);
+        low_z = std::min(low_z, z[i]);
+        high_x = std::max(high_x, x[i]);
+        high_y = std::max(high_y, y[i]);
+        high_z = std::max(high_z, z[i]);
+    }
+    const double centre_x = 0.5 * (low_x + high_x), centre_y = 0.5 * (low_y + high_y), centre_z = 0.5 * (low_z + high_z);
+
+    std::vector<Scalar> xs(n), ys(n), zs(n), ms(n);
+    const Scalar* __restrict xr = xs.data();
+    const Scalar* __restrict yr = ys.data();
+    const Scalar* __restrict zr = zs.data();
+    const Scalar* __restrict mr = ms.data();
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static)
+        for (long i = 0; i < n; ++i) {
+            xs[i] = static_cast<Scalar>(x[i] - centre_x);
+            ys[i] = static_cast<Scalar>(y[i] - centre_y);
+            zs[i] = static_cast<Scalar>(z[i] - centre_z);
+            ms[i] = static_cast<Scalar>(mass[i]);
+        }
+
+        NBODY_PROFILE_THREAD(Force);
+        #pragma omp for schedule(dynamic) nowait
+        for (long block = 0; block < num_blocks; ++block) {
+            const long i_begin = block * target_block;
+            const long i_end = std::min(i_begin + target_block, n);
+            double sum_x[target_block] = {}, sum_y[target_block] = {}, sum_z[target_block] = {};
+            double sum_potential[target_block] = {};
+
+            // Every target of the block sweeps the same source tile while it is in cache
+            for (long j_begin = 0; j_begin < n; j_begin += tile) {
+                const long j_end = std::min(j_begin + tile, n);
+                for (long i = i_begin; i < i_end; ++i) {
+                    Scalar acc_x = 0, acc_y = 0, acc_z = 0, acc_potential = 0;
+                    // The target is left out of its own sweep: its -m_i / epsilon would swamp the float sum of the potential
+                    const long j_self = std::clamp(i, j_begin, j_end);
+                    sweep(xr, yr, zr, mr, j_begin, j_self, xr[i], yr[i], zr[i], eps2, acc_x, acc_y, acc_z, acc_potential);
+                    sweep(xr, yr, zr, mr, std::min(j_self + (j_self == i), j_end), j_end, xr[i], yr[i], zr[i], eps2, acc_x, acc_y, acc_z, acc_potential);
+                    // The partial sums of the tile join the running sums in double
+                    sum_x[i - i_begin] += acc_x;
+                    sum_y[i - i_begin] += acc_y;
+                    sum_z[i - i_begin] += acc_z;
+                    sum_potential[i - i_begin] += acc_potential;
+                }
+            }
+
+            for (long i = i_begin; i < i_end; ++i) {
+                ax[i] = sum_x[i - i_begin];
+                ay[i] = sum_y[i - i_begin];
+                az[i] = sum_z[i - i_begin];
+                if (WithPotential) {
+                    potential[i] = sum_potential[i - i_begin];
+                }
+            }
+        }
+    }
+}
+}
+
+// Calculate the net acceleration of every body with Scalar pair terms and double sums
+template <typename Scalar>
+void precisionSumAcceleration(ParticleSystem& particle_system, const double& epsilon, std::size_t tile_size, bool with_potential) {
+    with_potential ? precisionSum<Scalar, true>(particle_system, epsilon, tile_size) : precisionSum<Scalar, false>(particle_system, epsilon, tile_size);
+}
+
+template void precisionSumAcceleration<float>(ParticleSystem& particle_system, const double& epsilon, std::size_t tile_size, bool with_potential);
+template void precisionSumAcceleration<double>(ParticleSystem& particle_system, const double& epsilon, std::size_t tile_size, bool with_potential);
+}
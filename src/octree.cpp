@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+#include "octree.hpp"
+#include "spatialSort.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+// Number of bits of each coordinate in a Morton key, the deepest level of the tree.
+constexpr int max_level = 21;
+
+// Cells at this level are built as independent subtrees in parallel (up to 64 of them).
+constexpr int parallel_level = 2;
+
+// Spread the lower 21 bits of v so that there are two zero bits between each of them.
+std::uint64_t spreadBits(std::uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+}
+
+// Constructor for the octree
+Octree::Octree(int leaf_size) : leaf_size_(std::max(1, leaf_size)) {}
+
+// Morton key of a point with integer coordinates
+std::uint64_t Octree::mortonKey(std::uint32_t ix, std::uint32_t iy, std::uint32_t iz) {
+    return (spreadBits(ix) << 2) | (spreadBits(iy) << 1) | spreadBits(iz);
+}
+
+// Accessor methods
+const std::vector<OctreeNode>& Octree::nodes() const {
+    return nodes_;
+}
+
+const std::vector<std::size_t>& Octree::order() const {
+    return order_;
+}
+
+int Octree::getLeafSize() const {
+    return leaf_size_;
+}
+
+std::size_t Octree::size() const {
+    return order_.size();
+}
+
+// Sort the bodies and rebuild the tree for the current positions
+void Octree::build(const ParticleSystem& particle_system) {
+    const long n = static_cast<long>(particle_system.size());
+    const double* px = particle_system.x();
+    const double* py = particle_system.y();
+    const double* pz = particle_system.z();
+    const double* pmass = particle_system.mass();
+
+    nodes_.clear();
+    order_.resize(n);
+    keys_.resize(n);
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    mass_.resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    // Bounding cube of all bodies
+    double min_x = px[0], min_y = py[0], min_z = pz[0];
+    double max_x = px[0], max_y = py[0], max_z = pz[0];
+    #pragma omp parallel for reduction(min:min_x, min_y, min_z) reduction(max:max_x, max_y, max_z)
+    for (long i = 0; i < n; ++i) {
+        min_x = std::min(min_x, px[i]); max_x = std::max(max_x, px[i]);
+        min_y = std::min(min_y, py[i]); max_y = std::max(max_y, py[i]);
+        min_z = std::min(min_z, pz[i]); max_z = std::max(max_z, pz[i]);
+    }
+    const double centre[3] = {0.5 * (min_x + max_x), 0.5 * (min_y + max_y), 0.5 * (min_z + max_z)};
+    double half_width = 0.5 * std::max({max_x - min_x, max_y - min_y, max_z - min_z});
+    half_width = half_width > 0.0 ? half_width * (1.0 + 1e-12) : 1.0;
+
+    // Morton keys of the bodies, then sort bodies along the curve
+    const double cells = static_cast<double>(1u << max_level);
+    const double scale = cells / (2.0 * half_width);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+        auto cell = [&](double p, double low) {
+            return static_cast<std::uint32_t>(std::min(cells - 1.0, std::max(0.0, (p - low) * scale)));
+        };
+        keys_[i] = mortonKey(cell(px[i], centre[0] - half_width), cell(py[i], centre[1] - half_width), cell(pz[i], centre[2] - half_width));
+        order_[i] = i;
+    }
+    radixSort(keys_, order_, 3 * max_level);
+
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < n; ++k) {
+        std::size_t i = order_[k];
+        x_[k] = px[i];
+        y_[k] = py[i];
+        z_[k] = pz[i];
+        mass_[k] = pmass[i];
+    }
+
+    // Build the top levels serially, stopping at parallel_level
+    OctreeNode root;
+    root.centre[0] = centre[0];
+    root.centre[1] = centre[1];
+    root.centre[2] = centre[2];
+    root.half_width = half_width;
+    root.begin = 0;
+    root.end = static_cast<int>(n);
+    root.first_child = -1;
+    root.num_children = 0;
+    root.level = 0;
+    nodes_.push_back(root);
+    buildSubtree(nodes_, 0, parallel_level);
+    const std::size_t num_top = nodes_.size();
+
+    // Build the remaining subtrees concurrently, each into its own node list
+    std::vector<int> pending;
+    for (std::size_t i = 0; i < num_top; ++i) {
+        const OctreeNode& node = nodes_[i];
+        if (node.level == parallel_level && node.first_child < 0 && node.end - node.begin > leaf_size_) {
+            pending.push_back(static_cast<int>(i));
+        }
+    }
+    std::vector<std::vector<OctreeNode>> subtrees(pending.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (long p = 0; p < static_cast<long>(pending.size()); ++p) {
+        subtrees[p].push_back(nodes_[pending[p]]);
+        buildSubtree(subtrees[p], 0, -1);
+    }
+
+    // Splice the subtrees in, the subtree root replaces its pending cell
+    for (std::size_t p = 0; p < pending.size(); ++p) {
+        const int offset = static_cast<int>(nodes_.size()) - 1;
+        for (std::size_t k = 0; k < subtrees[p].size(); ++k) {
+            OctreeNode node = subtrees[p][k];
+            if (node.first_child >= 0) {
+                node.first_child += offset;
+            }
+            if (k == 0) {
+                nodes_[pending[p]] = node;
+            }
+            else {
+                nodes_.push_back(node);
+            }
+        }
+    }
+
+    // Children of the top cells are stored after their parents, so a reverse sweep fills in the moments
+    for (std::size_t i = num_top; i-- > 0;) {
+        computeMoments(nodes_, nodes_[i]);
+    }
+}
+
+// Build the subtree of nodes[node_index], appending its descendants to nodes
+void Octree::buildSubtree(std::vector<OctreeNode>& nodes, int node_index, int stop_level) const {
+    OctreeNode node = nodes[node_index];
+    node.first_child = -1;
+    node.num_children = 0;
+
+    if (node.end - node.begin <= leaf_size_ || node.level == max_level) {
+        computeMoments(nodes, node);
+        nodes[node_index] = node;
+        return;
+    }
+    if (node.level == stop_level) {
+        nodes[node_index] = node;
+        return;
+    }
+
+    // Bodies are sorted by key, so each child owns a contiguous run of the same octal digit
+    const int shift = 3 * (max_level - 1 - node.level);
+    const double child_half = 0.5 * node.half_width;
+    node.first_child = static_cast<int>(nodes.size());
+    int begin = node.begin;
+    while (begin < node.end) {
+        const int digit = static_cast<int>((keys_[begin] >> shift) & 7);
+        int end = begin + 1;
+        while (end < node.end && static_cast<int>((keys_[end] >> shift) & 7) == digit) {
+            ++end;
+        }
+
+        OctreeNode child;
+        child.centre[0] = node.centre[0] + ((digit & 4) ? child_half : -child_half);
+        child.centre[1] = node.centre[1] + ((digit & 2) ? child_half : -child_half);
+        child.centre[2] = node.centre[2] + ((digit & 1) ? child_half : -child_half);
+        child.half_width = child_half;
+        child.begin = begin;
+        child.end = end;
+        child.first_child = -1;
+        child.num_children = 0;
+        child.level = node.level + 1;
+        nodes.push_back(child);
+        ++node.num_children;
+        begin = end;
+    }
+    nodes[node_index] = node;
+
+    for (int c = 0; c < node.num_children; ++c) {
+        buildSubtree(nodes, node.first_child + c, stop_level);
+    }
+    computeMoments(nodes, nodes[node_index]);
+}
+
+// Set mass and centre of mass of a cell from its bodies or its children
+void Octree::computeMoments(std::vector<OctreeNode>& nodes, OctreeNode& node) const {
+    double mass = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+    if (node.first_child < 0) {
+        for (int k = node.begin; k < node.end; ++k) {
+            mass += mass_[k];
+            mx += mass_[k] * x_[k];
+            my += mass_[k] * y_[k];
+            mz += mass_[k] * z_[k];
+        }
+    }
+    else {
+        for (int c = 0; c < node.num_children; ++c) {
+            const OctreeNode& child = nodes[node.first_child + c];
+            mass += child.mass;
+            mx += child.mass * child.com[0];
+            my += child.mass * child.com[1];
+            mz += child.mass * child.com[2];
+        }
+    }
+    node.mass = mass;
+    if (mass > 0.0) {
+        node.com[0] = mx / mass;
+        node.com[1] = my / mass;
+        node.com[2] = mz / mass;
+    }
+    else {
+        node.com[0] = node.centre[0];
+        node.com[1] = node.centre[1];
+        node.com[2] = node.centre[2];
+    }
+}
+}
@@ -6,7 +6,7 @@ namespace n_body
 {
 // Particle constructor implementation
 Particle::Particle(const Eigen::Vector3d& position, const Eigen::Vector3d& velocity, double& mass)
-    : position_ (position), velocity_ (velocity), mass_ (mass)
+    : position_ (position), velocity_ (velocity), acceleration_ (Eigen::Vector3d::Zero()), mass_ (mass)
     {}
 // Accessor methods implementation
 Eigen::Vector3d Particle::getPosition() const {
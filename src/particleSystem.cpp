@@ -0,0 +1,270 @@
+#include <Eigen/Dense>
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <omp.h>
+#include "particleSystem.hpp"
+
+using Eigen::Vector3d;
+
+namespace n_body
+{
+
+// Construct a zero-initialised system of num_particles bodies
+ParticleSystem::ParticleSystem(std::size_t num_particles) {
+    resize(num_particles);
+}
+
+// Construct a system from a list of particles, keeping their order
+ParticleSystem::ParticleSystem(const std::vector<particleAcceleration>& particle_list) {
+    resize(particle_list.size());
+    for (std::size_t i = 0; i < particle_list.size(); ++i) {
+        uploadPosition(i, particle_list[i].getPosition());
+        uploadVelocity(i, particle_list[i].getVelocity());
+        initialAcceleration(i, particle_list[i].getAcceleration());
+        mass_[i] = particle_list[i].getMass();
+    }
+}
+
+// Number of bodies in the system
+std::size_t ParticleSystem::size() const {
+    return mass_.size();
+}
+
+// Bytes held by the component arrays
+std::size_t ParticleSystem::memoryUsage() const {
+    return (x_.capacity() + y_.capacity() + z_.capacity() + vx_.capacity() + vy_.capacity() + vz_.capacity()
+            + ax_.capacity() + ay_.capacity() + az_.capacity() + potential_.capacity() + mass_.capacity()) * sizeof(double)
+           + id_.capacity() * sizeof(std::size_t);
+}
+
+// Resize every component array
+void ParticleSystem::resize(std::size_t num_particles) {
+    for (AlignedVector<double>* component : {&x_, &y_, &z_, &vx_, &vy_, &vz_, &ax_, &ay_, &az_, &potential_, &mass_}) {
+        component->resize(num_particles, 0.0);
+    }
+
+    // New bodies get the next ids
+    const std::size_t old_size = id_.size();
+    id_.resize(num_particles);
+    for (std::size_t i = old_size; i < num_particles; ++i) {
+        id_[i] = i;
+    }
+
+    // Bodies kept after a shrink are renumbered to [0, num_particles), keeping the order of their ids
+    if (num_particles < old_size) {
+        std::vector<std::size_t> rank(old_size, 0);
+        for (std::size_t i = 0; i < num_particles; ++i) {
+            rank[id_[i]] = 1;
+        }
+        std::size_t next = 0;
+        for (std::size_t& r : rank) {
+            next += r;
+            r = next - 1;
+        }
+        for (std::size_t i = 0; i < num_particles; ++i) {
+            id_[i] = rank[id_[i]];
+        }
+    }
+}
+
+// Append a body to the end of the system
+void ParticleSystem::addParticle(const Eigen::Vector3d& position, const Eigen::Vector3d& velocity, double mass) {
+    std::size_t i = size();
+    resize(i + 1);
+    uploadPosition(i, position);
+    uploadVelocity(i, velocity);
+    mass_[i] = mass;
+}
+
+// Accessor methods implementation
+Eigen::Vector3d ParticleSystem::getPosition(std::size_t i) const {
+    return Vector3d(x_[i], y_[i], z_[i]);
+}
+
+Eigen::Vector3d ParticleSystem::getVelocity(std::size_t i) const {
+    return Vector3d(vx_[i], vy_[i], vz_[i]);
+}
+
+Eigen::Vector3d ParticleSystem::getAcceleration(std::size_t i) const {
+    return Vector3d(ax_[i], ay_[i], az_[i]);
+}
+
+double ParticleSystem::getMass(std::size_t i) const {
+    return mass_[i];
+}
+
+double ParticleSystem::getPotential(std::size_t i) const {
+    return potential_[i];
+}
+
+std::size_t ParticleSystem::getId(std::size_t i) const {
+    return id_[i];
+}
+
+// Index of every body by id
+std::vector<std::size_t> ParticleSystem::indexById() const {
+    std::vector<std::size_t> index(size());
+    for (std::size_t i = 0; i < size(); ++i) {
+        index[id_[i]] = i;
+    }
+    return index;
+}
+
+// Move body order[k] to index k, gathering every array in parallel
+void ParticleSystem::permute(const std::vector<std::size_t>& order) {
+    const long n = static_cast<long>(size());
+    if (order.size() != size()) {
+        throw std::invalid_argument("A permutation of " + std::to_string(order.size()) + " bodies cannot reorder " + std::to_string(size()));
+    }
+    std::vector<char> seen(n, 0);
+    for (std::size_t i : order) {
+        if (i >= size() || seen[i]) {
+            throw std::invalid_argument("Body order is not a permutation");
+        }
+        seen[i] = 1;
+    }
+
+    AlignedVector<double> gathered(n);
+    for (AlignedVector<double>* component : {&x_, &y_, &z_, &vx_, &vy_, &vz_, &ax_, &ay_, &az_, &potential_, &mass_}) {
+        const double* values = component->data();
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < n; ++k) {
+            gathered[k] = values[order[k]];
+        }
+        component->swap(gathered);
+    }
+    std::vector<std::size_t> ids(n);
+    for (long k = 0; k < n; ++k) {
+        ids[k] = id_[order[k]];
+    }
+    id_.swap(ids);
+}
+
+// Update the position of body i
+void ParticleSystem::uploadPosition(std::size_t i, const Eigen::Vector3d& position) {
+    x_[i] = position.x();
+    y_[i] = position.y();
+    z_[i] = position.z();
+}
+
+// Update the velocity of body i
+void ParticleSystem::uploadVelocity(std::size_t i, const Eigen::Vector3d& velocity) {
+    vx_[i] = velocity.x();
+    vy_[i] = velocity.y();
+    vz_[i] = velocity.z();
+}
+
+// Set the acceleration of body i
+void ParticleSystem::initialAcceleration(std::size_t i, const Eigen::Vector3d& acceleration) {
+    ax_[i] = acceleration.x();
+    ay_[i] = acceleration.y();
+    az_[i] = acceleration.z();
+}
+
+// Calculate the net acceleration of body i due to all other bodies in the system
+void ParticleSystem::sumAcceleration(std::size_t i, const double& epsilon, bool with_potential) {
+    const double eps2 = epsilon * epsilon;
+    const double xi = x_[i], yi = y_[i], zi = z_[i];
+    const std::size_t n = size();
+
+    double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0, sum_potential = 0.0;
+    for (std::size_t j = 0; j < n; ++j) {
+        if (j != i) {
+            double dx = x_[j] - xi;
+            double dy = y_[j] - yi;
+            double dz = z_[j] - zi;
+            double r2 = dx * dx + dy * dy + dz * dz + eps2;
+            double denominator = std::pow(r2, 3.0/2.0);
+            double scale = mass_[j] / denominator;
+            sum_x += scale * dx;
+            sum_y += scale * dy;
+            sum_z += scale * dz;
+
+            // The distance is already known, so the potential costs a square root and a division
+            if (with_potential) {
+                sum_potential -= mass_[j] / std::sqrt(r2);
+            }
+        }
+    }
+
+    ax_[i] = sum_x;
+    ay_[i] = sum_y;
+    az_[i] = sum_z;
+    if (with_potential) {
+        potential_[i] = sum_potential;
+    }
+}
+
+// Calculate the net acceleration of every body in the system
+void ParticleSystem::sumAcceleration(const double& epsilon, bool with_potential) {
+    for (std::size_t i = 0; i < size(); ++i) {
+        sumAcceleration(i, epsilon, with_potential);
+    }
+}
+
+// Update the position and velocity of body i based on its current acceleration
+void ParticleSystem::update(std::size_t i, const double& dt) {
+    x_[i] += dt * vx_[i];
+    y_[i] += dt * vy_[i];
+    z_[i] += dt * vz_[i];
+    vx_[i] += dt * ax_[i];
+    vy_[i] += dt * ay_[i];
+    vz_[i] += dt * az_[i];
+}
+
+// Update the position and velocity of every body in the system
+void ParticleSystem::update(const double& dt) {
+    for (std::size_t i = 0; i < size(); ++i) {
+        update(i, dt);
+    }
+}
+
+// Advance every velocity by dt times the current acceleration, on all threads for large systems
+void ParticleSystem::kick(const double& dt) {
+    const long n = static_cast<long>(size());
+    #pragma omp parallel for schedule(static) if (n > 4096)
+    for (long i = 0; i < n; ++i) {
+        vx_[i] += dt * ax_[i];
+        vy_[i] += dt * ay_[i];
+        vz_[i] += dt * az_[i];
+    }
+}
+
+// Advance every position by dt times the current velocity
+void ParticleSystem::drift(const double& dt) {
+    const long n = static_cast<long>(size());
+    #pragma omp parallel for schedule(static) if (n > 4096)
+    for (long i = 0; i < n; ++i) {
+        x_[i] += dt * vx_[i];
+        y_[i] += dt * vy_[i];
+        z_[i] += dt * vz_[i];
+    }
+}
+
+// Advance every position by dt times the velocity plus dt^2 / 2 times the acceleration
+void ParticleSystem::driftAccelerated(const double& dt) {
+    const long n = static_cast<long>(size());
+    const double half_dt2 = 0.5 * dt * dt;
+    #pragma omp parallel for schedule(static) if (n > 4096)
+    for (long i = 0; i < n; ++i) {
+        x_[i] += dt * vx_[i] + half_dt2 * ax_[i];
+        y_[i] += dt * vy_[i] + half_dt2 * ay_[i];
+        z_[i] += dt * vz_[i] + half_dt2 * az_[i];
+    }
+}
+
+// Convert the system back into a list of particles
+std::vector<particleAcceleration> ParticleSystem::toParticleList() const {
+    std::vector<particleAcceleration> particle_list;
+    particle_list.reserve(size());
+    for (std::size_t i = 0; i < size(); ++i) {
+        double mass_i = mass_[i];
+        particleAcceleration particle(getPosition(i), getVelocity(i), mass_i);
+        particle.initialAcceleration(getAcceleration(i));
+        particle_list.push_back(particle);
+    }
+    return particle_list;
+}
+}
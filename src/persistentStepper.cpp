@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <omp.h>
+
+#include "persistentStepper.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Softened acceleration of body i due to all bodies at positions (x, y, z)
+inline void bodyAcceleration(const double* __restrict x, const double* __restrict y, const double* __restrict z,
+                             const double* __restrict mass, long i, long n, double eps2,
+                             double& acc_x, double& acc_y, double& acc_z) {
+    const double xi = x[i], yi = y[i], zi = z[i];
+    double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0;
+    #pragma omp simd reduction(+:sum_x, sum_y, sum_z)
+    for (long j = 0; j < n; ++j) {
+        double dx = x[j] - xi;
+        double dy = y[j] - yi;
+        double dz = z[j] - zi;
+        double r2 = dx * dx + dy * dy + dz * dz + eps2;
+        double inv_r = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+        double scale = mass[j] * inv_r * inv_r * inv_r;
+        sum_x += scale * dx;
+        sum_y += scale * dy;
+        sum_z += scale * dz;
+    }
+    acc_x = sum_x;
+    acc_y = sum_y;
+    acc_z = sum_z;
+}
+}
+
+// Constructor for the persistent stepper
+PersistentStepper::PersistentStepper(IntegratorScheme scheme, double epsilon)
+    : scheme_(scheme), epsilon_(epsilon), acceleration_valid_(false), force_evaluations_(0)
+    {
+        if (scheme != IntegratorScheme::Euler && scheme != IntegratorScheme::Leapfrog && scheme != IntegratorScheme::VelocityVerlet) {
+            throw std::invalid_argument("Persistent stepping supports euler, leapfrog and verlet, not " + integratorSchemeName(scheme));
+        }
+    }
+
+// Accessor methods
+IntegratorScheme PersistentStepper::getScheme() const {
+    return scheme_;
+}
+
+long PersistentStepper::getForceEvaluations() const {
+    return force_evaluations_;
+}
+
+// Forget the stored accelerations
+void PersistentStepper::reset() {
+    acceleration_valid_ = false;
+}
+
+// Advance every body of the particle system by num_steps steps of dt
+void PersistentStepper::run(ParticleSystem& particle_system, const double& dt, long num_steps) {
+    const long n = static_cast<long>(particle_system.size());
+    if (n == 0 || num_steps <= 0) {
+        return;
+    }
+    // The force and update loops are fused, so the whole run counts as force
+    NBODY_PROFILE_SCOPE(Force);
+    x_next_.resize(n);
+    y_next_.resize(n);
+    z_next_.resize(n);
+
+    double* vx = particle_system.vx();
+    double* vy = particle_system.vy();
+    double* vz = particle_system.vz();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    const double* mass = particle_system.mass();
+    const double eps2 = epsilon_ * epsilon_;
+    const double half_dt = 0.5 * dt;
+    const bool euler = scheme_ == IntegratorScheme::Euler;
+    const bool evaluate_first = !euler && !acceleration_valid_;
+    const int num_threads = static_cast<int>(std::clamp<long>(n / 32, 1, omp_get_max_threads()));
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        // Every thread swaps its own copies of the buffer pointers after each barrier, so all agree
+        double* x = particle_system.x();
+        double* y = particle_system.y();
+        double* z = particle_system.z();
+        double* x_next = x_next_.data();
+        double* y_next = y_next_.data();
+        double* z_next = z_next_.data();
+        auto swapBuffers = [&]() {
+            std::swap(x, x_next);
+            std::swap(y, y_next);
+            std::swap(z, z_next);
+        };
+
+        if (evaluate_first) {
+            #pragma omp for schedule(static)
+            for (long i = 0; i < n; ++i) {
+                bodyAcceleration(x, y, z, mass, i, n, eps2, ax[i], ay[i], az[i]);
+            }
+        }
+
+        // Opening half kick and drift of the first step
+        if (!euler) {
+            #pragma omp for schedule(static)
+            for (long i = 0; i < n; ++i) {
+                vx[i] += half_dt * ax[i];
+                vy[i] += half_dt * ay[i];
+                vz[i] += half_dt * az[i];
+                x_next[i] = x[i] + dt * vx[i];
+                y_next[i] = y[i] + dt * vy[i];
+                z_next[i] = z[i] + dt * vz[i];
+            }
+            swapBuffers();
+        }
+
+        for (long s = 0; s < num_steps; ++s) {
+            const bool last = s + 1 == num_steps;
+
+            // Force and update of each body in one loop, the barrier ends the step
+            {
+                NBODY_PROFILE_THREAD(Force);
+                #pragma omp for schedule(static) nowait
+                for (long i = 0; i < n; ++i) {
+                    if (euler) {
+                        bodyAcceleration(x, y, z, mass, i, n, eps2, ax[i], ay[i], az[i]);
+                        x_next[i] = x[i] + dt * vx[i];
+                        y_next[i] = y[i] + dt * vy[i];
+                        z_next[i] = z[i] + dt * vz[i];
+                        vx[i] += dt * ax[i];
+                        vy[i] += dt * ay[i];
+                        vz[i] += dt * az[i];
+                    }
+                    else {
+                        // Closing half kick of this step, then opening half kick and drift of the next
+                        bodyAcceleration(x, y, z, mass, i, n, eps2, ax[i], ay[i], az[i]);
+                        vx[i] += half_dt * ax[i];
+                        vy[i] += half_dt * ay[i];
+                        vz[i] += half_dt * az[i];
+                        if (!last) {
+                            vx[i] += half_dt * ax[i];
+                            vy[i] += half_dt * ay[i];
+                            vz[i] += half_dt * az[i];
+                            x_next[i] = x[i] + dt * vx[i];
+                            y_next[i] = y[i] + dt * vy[i];
+                            z_next[i] = z[i] + dt * vz[i];
+                        }
+                    }
+                }
+            }
+            #pragma omp barrier
+            if (euler || !last) {
+                swapBuffers();
+            }
+        }
+
+        // The final positions may have ended up in the second buffer
+        if (x != particle_system.x()) {
+            #pragma omp for schedule(static)
+            for (long i = 0; i < n; ++i) {
+                x_next[i] = x[i];
+                y_next[i] = y[i];
+                z_next[i] = z[i];
+            }
+        }
+    }
+
+    NBODY_PROFILE_COUNT(Force, (num_steps + (evaluate_first ? 1 : 0)) * pairInteractions(n),
+                        20.0 * (num_steps + (evaluate_first ? 1 : 0)) * pairInteractions(n), 128.0 * num_steps * n);
+    force_evaluations_ += num_steps + (evaluate_first ? 1 : 0);
+    acceleration_valid_ = !euler;
+}
+}
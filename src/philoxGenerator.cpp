@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <omp.h>
+
+#include "philoxGenerator.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Sequence of uniform doubles of one body, from the Philox counters (index, k, stream) for k = 0, 1, ...
+class CounterStream {
+    public:
+        CounterStream(std::uint64_t seed, std::uint64_t index, std::uint32_t stream)
+            : key_{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)},
+              counter_{static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(index >> 32), 0, stream},
+              used_(2)
+            {}
+
+        // Uniform double in [0, 1) with 53 random bits, two per call of philox4x32
+        double uniform() {
+            if (used_ == 2) {
+                block_ = philox4x32(counter_, key_);
+                ++counter_[2];
+                used_ = 0;
+            }
+            std::uint64_t bits = (static_cast<std::uint64_t>(block_[2 * used_]) << 32) | block_[2 * used_ + 1];
+            ++used_;
+            return static_cast<double>(bits >> 11) * 0x1.0p-53;
+        }
+
+        // Isotropic unit vector
+        void direction(double& x, double& y, double& z) {
+            const double cos_theta = 2.0 * uniform() - 1.0;
+            const double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
+            const double phi = 2.0 * M_PI * uniform();
+            x = sin_theta * std::cos(phi);
+            y = sin_theta * std::sin(phi);
+            z = cos_theta;
+        }
+
+    protected:
+        std::array<std::uint32_t, 2> key_;
+        std::array<std::uint32_t, 4> counter_;
+        std::array<std::uint32_t, 4> block_;
+        int used_;
+};
+
+// Bodies per block of the centre of mass sums, fixed so the sums do not depend on the thread count
+constexpr long sum_block = 4096;
+
+// Move a system to its centre of mass frame
+void centreOfMass(ParticleSystem& particle_system) {
+    const long n = static_cast<long>(particle_system.size());
+    double* components[6] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                             particle_system.vx(), particle_system.vy(), particle_system.vz()};
+    const double* mass = particle_system.mass();
+    const long num_blocks = (n + sum_block - 1) / sum_block;
+    std::vector<double> partial(7 * num_blocks, 0.0);
+
+    #pragma omp parallel for schedule(static) if (num_blocks > 1)
+    for (long b = 0; b < num_blocks; ++b) {
+        for (long i = b * sum_block; i < std::min(n, (b + 1) * sum_block); ++i) {
+            for (int c = 0; c < 6; ++c) {
+                partial[7 * b + c] += mass[i] * components[c][i];
+            }
+            partial[7 * b + 6] += mass[i];
+        }
+    }
+    double total[7] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    for (long b = 0; b < num_blocks; ++b) {
+        for (int c = 0; c < 7; ++c) {
+            total[c] += partial[7 * b + c];
+        }
+    }
+    if (total[6] == 0.0) {
+        return;
+    }
+
+    #pragma omp parallel for schedule(static) if (n > sum_block)
+    for (long i = 0; i < n; ++i) {
+        for (int c = 0; c < 6; ++c) {
+            components[c][i] -= total[c] / total[6];
+        }
+    }
+}
+}
+
+// Philox4x32-10
+std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> counter, std::array<std::uint32_t, 2> key) {
+    for (int round = 0; round < 10; ++round) {
+        if (round > 0) {
+            key[0] += 0x9E3779B9u;
+            key[1] += 0xBB67AE85u;
+        }
+        const std::uint64_t product0 = static_cast<std::uint64_t>(0xD2511F53u) * counter[0];
+        const std::uint64_t product1 = static_cast<std::uint64_t>(0xCD9E8D57u) * counter[2];
+        counter = {static_cast<std::uint32_t>(product1 >> 32) ^ counter[1] ^ key[0], static_cast<std::uint32_t>(product1),
+                   static_cast<std::uint32_t>(product0 >> 32) ^ counter[3] ^ key[1], static_cast<std::uint32_t>(product0)};
+    }
+    return counter;
+}
+
+// Parse a distribution name
+SystemDistribution parseSystemDistribution(const std::string& name) {
+    if (name == "disc") {
+        return SystemDistribution::Disc;
+    }
+    if (name == "plummer") {
+        return SystemDistribution::Plummer;
+    }
+    if (name == "clumps") {
+        return SystemDistribution::Clumps;
+    }
+    throw std::invalid_argument("Unknown distribution: " + name);
+}
+
+// Name of a distribution
+std::string systemDistributionName(SystemDistribution distribution) {
+    switch (distribution) {
+        case SystemDistribution::Disc: return "disc";
+        case SystemDistribution::Plummer: return "plummer";
+        case SystemDistribution::Clumps: return "clumps";
+    }
+    return "unknown";
+}
+
+// Constructor for the parallel random generator
+PhiloxSystemGenerator::PhiloxSystemGenerator(std::uint64_t seed, long num_particles, SystemDistribution distribution, int num_clumps)
+    : seed_(seed), num_particles_(num_particles), distribution_(distribution), num_clumps_(num_clumps)
+    {
+        if (num_particles < 0 || num_clumps < 1) {
+            throw std::invalid_argument("The number of particles must not be negative and there must be at least one clump");
+        }
+    }
+
+// Fill a particle system in parallel
+ParticleSystem PhiloxSystemGenerator::generateParticleSystem() {
+    const long n = distribution_ == SystemDistribution::Disc ? num_particles_ + 1 : num_particles_;
+    ParticleSystem particle_system(n);
+    double* x = particle_system.x();
+    double* y = particle_system.y();
+    double* z = particle_system.z();
+    double* vx = particle_system.vx();
+    double* vy = particle_system.vy();
+    double* vz = particle_system.vz();
+    double* mass = particle_system.mass();
+
+    switch (distribution_) {
+        case SystemDistribution::Disc: {
+            // Central star, then circular orbits around it
+            mass[0] = 1.0;
+            #pragma omp parallel for schedule(static) if (n > 4096)
+            for (long i = 1; i < n; ++i) {
+                CounterStream random(seed_, i, 0);
+                mass[i] = 1.0 / 6000000 + (1.0 / 1000 - 1.0 / 6000000) * random.uniform();
+                const double r = 0.4 + (30 - 0.4) * random.uniform();
+                const double theta = 2 * M_PI * random.uniform();
+                x[i] = r * std::sin(theta);
+                y[i] = r * std::cos(theta);
+                vx[i] = -(1 / std::sqrt(r)) * std::cos(theta);
+                vy[i] = (1 / std::sqrt(r)) * std::sin(theta);
+            }
+            break;
+        }
+
+        case SystemDistribution::Plummer: {
+            #pragma omp parallel for schedule(static) if (n > 4096)
+            for (long i = 0; i < n; ++i) {
+                CounterStream random(seed_, i, 0);
+                mass[i] = 1.0 / n;
+
+                // Radius from the inverted cumulative mass m(r) = r^3 / (1 + r^2)^(3/2)
+                double r;
+                do {
+                    const double m = random.uniform();
+                    const double cbrt_m = std::cbrt(m);
+                    r = m > 0.0 ? cbrt_m / std::sqrt(1.0 - cbrt_m * cbrt_m) : 0.0;
+                } while (!(r > 0.0 && r <= 10.0));
+                double ex, ey, ez;
+                random.direction(ex, ey, ez);
+                x[i] = r * ex;
+                y[i] = r * ey;
+                z[i] = r * ez;
+
+                // Speed q v_escape, with q drawn from g(q) = q^2 (1 - q^2)^(7/2) by rejection (g < 0.1)
+                double q, g, s;
+                do {
+                    q = random.uniform();
+                    g = 0.1 * random.uniform();
+                    s = 1.0 - q * q;
+                } while (g > q * q * s * s * s * std::sqrt(s));
+                const double speed = q * std::sqrt(2.0 / std::sqrt(1.0 + r * r));
+                random.direction(ex, ey, ez);
+                vx[i] = speed * ex;
+                vy[i] = speed * ey;
+                vz[i] = speed * ez;
+            }
+            centreOfMass(particle_system);
+            break;
+        }
+
+        case SystemDistribution::Clumps: {
+            // Clump centres come from their own stream, so they do not depend on the bodies
+            std::vector<double> centres(3 * num_clumps_);
+            for (int c = 0; c < num_clumps_; ++c) {
+                CounterStream random(seed_, c, 1);
+                const double r = 10.0 * std::cbrt(random.uniform());
+                random.direction(centres[3 * c], centres[3 * c + 1], centres[3 * c + 2]);
+                for (int k = 0; k < 3; ++k) {
+                    centres[3 * c + k] *= r;
+                }
+            }
+
+            #pragma omp parallel for schedule(static) if (n > 4096)
+            for (long i = 0; i < n; ++i) {
+                CounterStream random(seed_, i, 0);
+                const int c = static_cast<int>(i % num_clumps_);
+                const double r = 0.1 * std::cbrt(random.uniform());
+                double ex, ey, ez;
+                random.direction(ex, ey, ez);
+                mass[i] = 1.0 / n;
+                x[i] = centres[3 * c] + r * ex;
+                y[i] = centres[3 * c + 1] + r * ey;
+                z[i] = centres[3 * c + 2] + r * ez;
+            }
+            centreOfMass(particle_system);
+            break;
+        }
+    }
+    return particle_system;
+}
+
+// The same bodies as a list of particles
+std::vector<particleAcceleration> PhiloxSystemGenerator::generateInitialConditions() {
+    return generateParticleSystem().toParticleList();
+}
+}
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <omp.h>
+
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Innermost open scope of the calling thread
+thread_local ProfileScope* current_scope = nullptr;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rate of work per second, 0 if the phase took no time
+double rate(double work, double seconds) {
+    return seconds > 0.0 ? work / seconds : 0.0;
+}
+
+std::ofstream openReport(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open profile report for writing: " + path);
+    }
+    file << std::setprecision(9);
+    return file;
+}
+}
+
+// Name of a phase
+std::string profilePhaseName(ProfilePhase phase) {
+    switch (phase) {
+        case ProfilePhase::Force: return "force";
+        case ProfilePhase::Integration: return "integration";
+        case ProfilePhase::Energy: return "energy";
+        case ProfilePhase::Output: return "output";
+    }
+    return "unknown";
+}
+
+// Constructor for the profiler
+Profiler::Profiler() {
+    reset();
+}
+
+// The profiler the macros record into
+Profiler& Profiler::global() {
+    static Profiler profiler;
+    return profiler;
+}
+
+// Clear every total and restart the wall clock
+void Profiler::reset() {
+    start_ = std::chrono::steady_clock::now();
+    calls_.fill(0);
+    seconds_.fill(0.0);
+    interactions_.fill(0.0);
+    flops_.fill(0.0);
+    bytes_.fill(0.0);
+    thread_times_.assign(thread_times_.size(), ThreadTimes{});
+}
+
+// Record one call of a phase
+void Profiler::addTime(ProfilePhase phase, double seconds) {
+    ++calls_[static_cast<int>(phase)];
+    seconds_[static_cast<int>(phase)] += seconds;
+}
+
+// Record busy time of one thread, threads beyond the reserved ones are dropped
+void Profiler::addThreadTime(ProfilePhase phase, int thread, double seconds) {
+    if (thread >= 0 && thread < static_cast<int>(thread_times_.size())) {
+        thread_times_[thread].seconds[static_cast<int>(phase)] += seconds;
+    }
+}
+
+// Add work done in a phase
+void Profiler::count(ProfilePhase phase, double interactions, double flops, double bytes) {
+    interactions_[static_cast<int>(phase)] += interactions;
+    flops_[static_cast<int>(phase)] += flops;
+    bytes_[static_cast<int>(phase)] += bytes;
+}
+
+// Make room for the busy times of num_threads threads
+void Profiler::reserveThreads(int num_threads) {
+    if (num_threads > static_cast<int>(thread_times_.size())) {
+        thread_times_.resize(num_threads, ThreadTimes{});
+    }
+}
+
+// Totals of every phase
+ProfileReport Profiler::report() const {
+    ProfileReport report;
+    report.wall_seconds = secondsSince(start_);
+    for (int p = 0; p < num_profile_phases; ++p) {
+        PhaseProfile phase {static_cast<ProfilePhase>(p), calls_[p], seconds_[p], interactions_[p], flops_[p], bytes_[p], 0, 0.0, 0.0, 0.0};
+
+        // Only the threads that took part in the phase count towards the imbalance
+        double min_seconds = std::numeric_limits<double>::max();
+        double sum_seconds = 0.0;
+        for (const ThreadTimes& times : thread_times_) {
+            if (times.seconds[p] > 0.0) {
+                ++phase.threads;
+                min_seconds = std::min(min_seconds, times.seconds[p]);
+                sum_seconds += times.seconds[p];
+                phase.max_thread_seconds = std::max(phase.max_thread_seconds, times.seconds[p]);
+            }
+        }
+        if (phase.threads > 0) {
+            phase.min_thread_seconds = min_seconds;
+            phase.mean_thread_seconds = sum_seconds / phase.threads;
+        }
+        report.phases.push_back(phase);
+    }
+    return report;
+}
+
+// Start timing a phase on the calling thread
+ProfileScope::ProfileScope(ProfilePhase phase)
+    : phase_(phase), start_(std::chrono::steady_clock::now()), nested_seconds_(0.0), parent_(current_scope)
+    {
+        Profiler::global().reserveThreads(omp_get_max_threads());
+        current_scope = this;
+    }
+
+// Record the time of the phase without its nested scopes
+ProfileScope::~ProfileScope() {
+    const double seconds = secondsSince(start_);
+    Profiler::global().addTime(phase_, seconds - nested_seconds_);
+    if (parent_ != nullptr) {
+        parent_->nested_seconds_ += seconds;
+    }
+    current_scope = parent_;
+}
+
+// Start timing the share of the calling thread
+ProfileThreadScope::ProfileThreadScope(ProfilePhase phase)
+    : phase_(phase), thread_(omp_get_thread_num()), start_(std::chrono::steady_clock::now())
+    {}
+
+ProfileThreadScope::~ProfileThreadScope() {
+    Profiler::global().addThreadTime(phase_, thread_, secondsSince(start_));
+}
+
+// Write a report as JSON
+void writeProfileJson(const std::string& path, const ProfileReport& report) {
+    std::ofstream file = openReport(path);
+    file << "{\n  \"wall_seconds\": " << report.wall_seconds << ",\n  \"phases\": [";
+    for (std::size_t p = 0; p < report.phases.size(); ++p) {
+        const PhaseProfile& phase = report.phases[p];
+        file << (p == 0 ? "\n" : ",\n")
+             << "    {\"phase\": \"" << profilePhaseName(phase.phase) << "\", \"calls\": " << phase.calls
+             << ", \"seconds\": " << phase.seconds << ", \"fraction\": " << rate(phase.seconds, report.wall_seconds)
+             << ", \"interactions\": " << phase.interactions << ", \"flops\": " << phase.flops << ", \"bytes\": " << phase.bytes
+             << ", \"interactions_per_second\": " << rate(phase.interactions, phase.seconds)
+             << ", \"flops_per_second\": " << rate(phase.flops, phase.seconds)
+             << ", \"bytes_per_second\": " << rate(phase.bytes, phase.seconds)
+             << ", \"threads\": " << phase.threads << ", \"min_thread_seconds\": " << phase.min_thread_seconds
+             << ", \"mean_thread_seconds\": " << phase.mean_thread_seconds << ", \"max_thread_seconds\": " << phase.max_thread_seconds
+             << ", \"imbalance\": " << rate(phase.max_thread_seconds, phase.mean_thread_seconds) << "}";
+    }
+    file << "\n  ]\n}\n";
+    if (!file) {
+        throw std::runtime_error("Cannot write profile report: " + path);
+    }
+}
+
+// Write a report as CSV, one row per phase
+void writeProfileCsv(const std::string& path, const ProfileReport& report) {
+    std::ofstream file = openReport(path);
+    file << "phase,calls,seconds,fraction,interactions,flops,bytes,interactions_per_second,flops_per_second,bytes_per_second,"
+         << "threads,min_thread_seconds,mean_thread_seconds,max_thread_seconds,imbalance\n";
+    for (const PhaseProfile& phase : report.phases) {
+        file << profilePhaseName(phase.phase) << "," << phase.calls << "," << phase.seconds << "," << rate(phase.seconds, report.wall_seconds) << ","
+             << phase.interactions << "," << phase.flops << "," << phase.bytes << ","
+             << rate(phase.interactions, phase.seconds) << "," << rate(phase.flops, phase.seconds) << "," << rate(phase.bytes, phase.seconds) << ","
+             << phase.threads << "," << phase.min_thread_seconds << "," << phase.mean_thread_seconds << "," << phase.max_thread_seconds << ","
+             << rate(phase.max_thread_seconds, phase.mean_thread_seconds) << "\n";
+    }
+    if (!file) {
+        throw std::runtime_error("Cannot write profile report: " + path);
+    }
+}
+}
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "scalingStudy.hpp"
+#include "philoxGenerator.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// CPUs in the affinity mask of the process, read on the first call
+const std::vector<int>& allowedCpus() {
+    static const std::vector<int> cpus = []() {
+        std::vector<int> allowed;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    allowed.push_back(cpu);
+                }
+            }
+        }
+        if (allowed.empty()) {
+            allowed.push_back(0);
+        }
+        return allowed;
+    }();
+    return cpus;
+}
+
+// Work of one force evaluation over num_bodies bodies, in units that make the weak sizes comparable
+double forceWork(long num_bodies, bool approximate) {
+    return approximate ? static_cast<double>(num_bodies) : static_cast<double>(num_bodies) * (num_bodies - 1);
+}
+
+std::ofstream openReport(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open scaling report for writing: " + path);
+    }
+    file << std::setprecision(9);
+    return file;
+}
+
+// CPUs of a point as "0 2 4", "" when not pinned
+std::string cpuList(const std::vector<int>& cpus) {
+    std::string list;
+    for (int cpu : cpus) {
+        if (cpu >= 0) {
+            list += (list.empty() ? "" : " ") + std::to_string(cpu);
+        }
+    }
+    return list;
+}
+}
+
+// Parse a binding name
+ThreadBinding parseThreadBinding(const std::string& name) {
+    if (name == "none") {
+        return ThreadBinding::None;
+    }
+    if (name == "close") {
+        return ThreadBinding::Close;
+    }
+    if (name == "spread") {
+        return ThreadBinding::Spread;
+    }
+    throw std::invalid_argument("Unknown thread binding: " + name);
+}
+
+// Name of a binding
+std::string threadBindingName(ThreadBinding binding) {
+    switch (binding) {
+        case ThreadBinding::None: return "none";
+        case ThreadBinding::Close: return "close";
+        case ThreadBinding::Spread: return "spread";
+    }
+    return "unknown";
+}
+
+// Parse a mode name
+ScalingMode parseScalingMode(const std::string& name) {
+    if (name == "strong") {
+        return ScalingMode::Strong;
+    }
+    if (name == "weak") {
+        return ScalingMode::Weak;
+    }
+    throw std::invalid_argument("Unknown scaling mode: " + name);
+}
+
+// Name of a mode
+std::string scalingModeName(ScalingMode mode) {
+    switch (mode) {
+        case ScalingMode::Strong: return "strong";
+        case ScalingMode::Weak: return "weak";
+    }
+    return "unknown";
+}
+
+// Pin the threads of a team of num_threads threads
+std::vector<int> bindThreads(int num_threads, ThreadBinding binding) {
+    const std::vector<int>& allowed = allowedCpus();
+    const int num_allowed = static_cast<int>(allowed.size());
+    std::vector<int> cpus(num_threads, -1);
+    bool failed = false;
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        const int t = omp_get_thread_num();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (binding == ThreadBinding::None) {
+            for (int cpu : allowed) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        else {
+            // More threads than CPUs wrap around, so some CPUs run two threads
+            const int index = binding == ThreadBinding::Spread && num_threads <= num_allowed ? t * num_allowed / num_threads : t % num_allowed;
+            cpus[t] = allowed[index];
+            CPU_SET(allowed[index], &set);
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            #pragma omp atomic write
+            failed = true;
+        }
+    }
+    if (failed) {
+        throw std::runtime_error("Cannot set the CPU affinity of the OpenMP threads");
+    }
+    return cpus;
+}
+
+// Time integrator steps on every size and thread count
+ScalingReport runScalingStudy(const ScalingOptions& options, ForceEngine& force_engine) {
+    if (options.sizes.empty() || options.threads.empty() || options.repeats < 1 || options.steps < 1 || options.warmup_steps < 0) {
+        throw std::invalid_argument("A scaling study needs sizes, thread counts, repeats and steps");
+    }
+    for (long size : options.sizes) {
+        if (size < 2) {
+            throw std::invalid_argument("Scaling sizes must be at least two bodies");
+        }
+    }
+    std::vector<int> threads = options.threads;
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+    if (threads.front() < 1) {
+        throw std::invalid_argument("Scaling thread counts must be positive");
+    }
+
+    ScalingReport report;
+    report.options = options;
+    report.kernel = forceKernelName(force_engine.getKernel());
+    report.num_procs = omp_get_num_procs();
+    const int original_threads = omp_get_max_threads();
+    const bool approximate = force_engine.isApproximate();
+    const int base_threads = threads.front();
+
+    for (long base_size : options.sizes) {
+        double base_rate = 0.0;
+        for (int p : threads) {
+            // Weak scaling keeps the work per thread of the smallest thread count
+            const double growth = static_cast<double>(p) / base_threads;
+            long num_bodies = base_size;
+            if (options.mode == ScalingMode::Weak) {
+                num_bodies = std::lround(base_size * (approximate ? growth : std::sqrt(growth)));
+            }
+
+            omp_set_num_threads(p);
+            ScalingPoint point {p, base_size, num_bodies, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, bindThreads(p, options.binding)};
+            ParticleSystem particle_system = PhiloxSystemGenerator(options.seed, num_bodies - 1).generateParticleSystem();
+            Integrator integrator(options.scheme);
+            for (int s = 0; s < options.warmup_steps; ++s) {
+                integrator.step(particle_system, force_engine, options.dt);
+            }
+
+            // Seconds per step of every repeat
+            std::vector<double> seconds;
+            const long evaluations_before = integrator.getBodyEvaluations();
+            double total_seconds = 0.0;
+            for (int r = 0; r < options.repeats; ++r) {
+                auto start_time = std::chrono::steady_clock::now();
+                for (int s = 0; s < options.steps; ++s) {
+                    integrator.step(particle_system, force_engine, options.dt);
+                }
+                std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+                total_seconds += elapsed_time.count();
+                seconds.push_back(elapsed_time.count() / options.steps);
+            }
+            std::sort(seconds.begin(), seconds.end());
+            const std::size_t middle = seconds.size() / 2;
+            point.median_seconds = seconds.size() % 2 == 1 ? seconds[middle] : 0.5 * (seconds[middle - 1] + seconds[middle]);
+            point.min_seconds = seconds.front();
+            point.max_seconds = seconds.back();
+            const double body_evaluations = static_cast<double>(integrator.getBodyEvaluations() - evaluations_before);
+            point.interactions_per_second = total_seconds > 0.0 ? body_evaluations * (num_bodies - 1) / total_seconds : 0.0;
+
+            // Work per second against the smallest thread count, which makes the weak sizes comparable
+            const double rate = forceWork(num_bodies, approximate) / point.median_seconds;
+            if (p == base_threads) {
+                base_rate = rate;
+            }
+            point.speedup = rate / base_rate;
+            point.efficiency = point.speedup * base_threads / p;
+            report.points.push_back(point);
+        }
+    }
+
+    omp_set_num_threads(original_threads);
+    if (options.binding != ThreadBinding::None) {
+        bindThreads(original_threads, ThreadBinding::None);
+    }
+    return report;
+}
+
+// Write a report as JSON
+void writeScalingJson(const std::string& path, const ScalingReport& report) {
+    std::ofstream file = openReport(path);
+    const ScalingOptions& options = report.options;
+    file << "{\n  \"mode\": \"" << scalingModeName(options.mode) << "\", \"kernel\": \"" << report.kernel
+         << "\", \"integrator\": \"" << integratorSchemeName(options.scheme) << "\", \"binding\": \"" << threadBindingName(options.binding)
+         << "\",\n  \"num_procs\": " << report.num_procs << ", \"dt\": " << options.dt << ", \"warmup_steps\": " << options.warmup_steps
+         << ", \"repeats\": " << options.repeats << ", \"steps\": " << options.steps << ", \"seed\": " << options.seed << ",\n  \"points\": [";
+    for (std::size_t k = 0; k < report.points.size(); ++k) {
+        const ScalingPoint& point = report.points[k];
+        file << (k == 0 ? "\n" : ",\n")
+             << "    {\"threads\": " << point.threads << ", \"base_size\": " << point.base_size << ", \"num_bodies\": " << point.num_bodies
+             << ", \"median_seconds\": " << point.median_seconds << ", \"min_seconds\": " << point.min_seconds << ", \"max_seconds\": " << point.max_seconds
+             << ", \"speedup\": " << point.speedup << ", \"efficiency\": " << point.efficiency
+             << ", \"interactions_per_second\": " << point.interactions_per_second << ", \"cpus\": [";
+        bool first = true;
+        for (int cpu : point.cpus) {
+            if (cpu >= 0) {
+                file << (first ? "" : ", ") << cpu;
+                first = false;
+            }
+        }
+        file << "]}";
+    }
+    file << "\n  ]\n}\n";
+    if (!file) {
+        throw std::runtime_error("Cannot write scaling report: " + path);
+    }
+}
+
+// Write a report as CSV, one row per point
+void writeScalingCsv(const std::string& path, const ScalingReport& report) {
+    std::ofstream file = openReport(path);
+    const ScalingOptions& options = report.options;
+    file << "mode,kernel,integrator,binding,threads,base_size,num_bodies,median_seconds,min_seconds,max_seconds,speedup,efficiency,interactions_per_second,cpus\n";
+    for (const ScalingPoint& point : report.points) {
+        file << scalingModeName(options.mode) << "," << report.kernel << "," << integratorSchemeName(options.scheme) << "," << threadBindingName(options.binding) << ","
+             << point.threads << "," << point.base_size << "," << point.num_bodies << "," << point.median_seconds << "," << point.min_seconds << "," << point.max_seconds << ","
+             << point.speedup << "," << point.efficiency << "," << point.interactions_per_second << "," << cpuList(point.cpus) << "\n";
+    }
+    if (!file) {
+        throw std::runtime_error("Cannot write scaling report: " + path);
+    }
+}
+}
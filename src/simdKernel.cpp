@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <omp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NBODY_X86_SIMD 1
+#endif
+
+#include "simdKernel.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Scalar fallback, also used for the tail of the vector loops.
+// Accumulates the acceleration (and with WithPotential the potential) of target (xi, yi, zi) due to sources [begin, end).
+template <bool WithPotential>
+inline void scalarAccumulate(const double* x, const double* y, const double* z, const double* mass,
+                             std::size_t begin, std::size_t end, double xi, double yi, double zi, double eps2,
+                             double& sum_x, double& sum_y, double& sum_z, double& sum_potential) {
+    for (std::size_t j = begin; j < end; ++j) {
+        double dx = x[j] - xi;
+        double dy = y[j] - yi;
+        double dz = z[j] - zi;
+        double r2 = dx * dx + dy * dy + dz * dz + eps2;
+        if (r2 > 0.0) {
+            double inv_r = 1.0 / std::sqrt(r2);
+            double scale = mass[j] * inv_r * inv_r * inv_r;
+            sum_x += scale * dx;
+            sum_y += scale * dy;
+            sum_z += scale * dz;
+            if (WithPotential) {
+                sum_potential -= mass[j] * inv_r;
+            }
+        }
+    }
+}
+
+// The same over [begin, end) without the target i itself: its -m_i / epsilon would swamp the potential
+template <bool WithPotential>
+inline void scalarAccumulateOthers(const double* x, const double* y, const double* z, const double* mass,
+                                   std::size_t begin, std::size_t end, std::size_t i, double eps2,
+                                   double& sum_x, double& sum_y, double& sum_z, double& sum_potential) {
+    const std::size_t j_self = std::clamp(i, begin, end);
+    scalarAccumulate<WithPotential>(x, y, z, mass, begin, j_self, x[i], y[i], z[i], eps2, sum_x, sum_y, sum_z, sum_potential);
+    scalarAccumulate<WithPotential>(x, y, z, mass, std::min(j_self + (j_self == i), end), end, x[i], y[i], z[i], eps2, sum_x, sum_y, sum_z, sum_potential);
+}
+
+template <bool WithPotential>
+void sumAccelerationScalar(ParticleSystem& particle_system, double eps2) {
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    const double* mass = particle_system.mass();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    const long n = static_cast<long>(particle_system.size());
+
+    double* potential = particle_system.potential();
+
+    #pragma omp parallel
+    {
+        NBODY_PROFILE_THREAD(Force);
+        #pragma omp for schedule(static) nowait
+        for (long i = 0; i < n; ++i) {
+            double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0, sum_potential = 0.0;
+            scalarAccumulateOthers<WithPotential>(x, y, z, mass, 0, n, i, eps2, sum_x, sum_y, sum_z, sum_potential);
+            ax[i] = sum_x;
+            ay[i] = sum_y;
+            az[i] = sum_z;
+            if (WithPotential) {
+                potential[i] = sum_potential;
+            }
+        }
+    }
+}
+
+#ifdef NBODY_X86_SIMD
+
+// Horizontal sum of the four lanes of an AVX register
+__attribute__((target("avx2,fma")))
+inline double horizontalSum(__m256d v) {
+    __m128d low = _mm256_castpd256_pd128(v);
+    __m128d high = _mm256_extractf128_pd(v, 1);
+    low = _mm_add_pd(low, high);
+    return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+}
+
+// AVX2 path: four source bodies per instruction.
+// There is no double-precision rsqrt in AVX2, so the estimate comes from the single-precision
+// instruction and is refined with two Newton steps y <- y * (1.5 - 0.5 * r2 * y * y).
+template <bool WithPotential>
+__attribute__((target("avx2,fma")))
+void sumAccelerationAvx2(ParticleSystem& particle_system, double eps2) {
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    const double* mass = particle_system.mass();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    const long n = static_cast<long>(particle_system.size());
+    double* potential = particle_system.potential();
+    const long n_vec = n - n % 4;
+
+    #pragma omp parallel
+    {
+        NBODY_PROFILE_THREAD(Force);
+        #pragma omp for schedule(static) nowait
+        for (long i = 0; i < n; ++i) {
+            const __m256d xi = _mm256_set1_pd(x[i]);
+            const __m256d yi = _mm256_set1_pd(y[i]);
+            const __m256d zi = _mm256_set1_pd(z[i]);
+            const __m256d eps2_v = _mm256_set1_pd(eps2);
+            const __m256d half = _mm256_set1_pd(0.5);
+            const __m256d three_halves = _mm256_set1_pd(1.5);
+            const __m256d zero = _mm256_setzero_pd();
+            __m256d sum_x = zero, sum_y = zero, sum_z = zero, sum_potential = zero;
+
+            // The target is left out of its own sweep by masking its lane in the block that holds it
+            const long self_block = i - i % 4;
+            const __m256d self_lane = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_set_epi64x(3, 2, 1, 0), _mm256_set1_epi64x(i % 4)));
+
+            for (long j = 0; j < n_vec; j += 4) {
+                __m256d dx = _mm256_sub_pd(_mm256_load_pd(x + j), xi);
+                __m256d dy = _mm256_sub_pd(_mm256_load_pd(y + j), yi);
+                __m256d dz = _mm256_sub_pd(_mm256_load_pd(z + j), zi);
+                __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, eps2_v)));
+
+                __m256d inv_r = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(r2)));
+                __m256d half_r2 = _mm256_mul_pd(half, r2);
+                inv_r = _mm256_mul_pd(inv_r, _mm256_fnmadd_pd(_mm256_mul_pd(half_r2, inv_r), inv_r, three_halves));
+                inv_r = _mm256_mul_pd(inv_r, _mm256_fnmadd_pd(_mm256_mul_pd(half_r2, inv_r), inv_r, three_halves));
+
+                // Zero the contribution of r2 == 0, where the estimate is infinite, and of the target
+                inv_r = _mm256_and_pd(inv_r, _mm256_cmp_pd(r2, zero, _CMP_GT_OQ));
+                inv_r = _mm256_andnot_pd(j == self_block ? self_lane : zero, inv_r);
+                __m256d inv_r3 = _mm256_mul_pd(_mm256_mul_pd(inv_r, inv_r), inv_r);
+                __m256d mass_j = _mm256_load_pd(mass + j);
+                __m256d scale = _mm256_mul_pd(mass_j, inv_r3);
+
+                sum_x = _mm256_fmadd_pd(scale, dx, sum_x);
+                sum_y = _mm256_fmadd_pd(scale, dy, sum_y);
+                sum_z = _mm256_fmadd_pd(scale, dz, sum_z);
+                if (WithPotential) {
+                    sum_potential = _mm256_fnmadd_pd(mass_j, inv_r, sum_potential);
+                }
+            }
+
+            double sx = horizontalSum(sum_x), sy = horizontalSum(sum_y), sz = horizontalSum(sum_z);
+            double sp = horizontalSum(sum_potential);
+            scalarAccumulateOthers<WithPotential>(x, y, z, mass, n_vec, n, i, eps2, sx, sy, sz, sp);
+            ax[i] = sx;
+            ay[i] = sy;
+            az[i] = sz;
+            if (WithPotential) {
+                potential[i] = sp;
+            }
+        }
+    }
+}
+
+// AVX-512 path: eight source bodies per instruction, using the 14-bit rsqrt14 estimate
+// refined with two Newton steps.
+template <bool WithPotential>
+__attribute__((target("avx512f")))
+void sumAccelerationAvx512(ParticleSystem& particle_system, double eps2) {
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    const double* mass = particle_system.mass();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    const long n = static_cast<long>(particle_system.size());
+    double* potential = particle_system.potential();
+    const long n_vec = n - n % 8;
+
+    #pragma omp parallel
+    {
+        NBODY_PROFILE_THREAD(Force);
+        #pragma omp for schedule(static) nowait
+        for (long i = 0; i < n; ++i) {
+            const __m512d xi = _mm512_set1_pd(x[i]);
+            const __m512d yi = _mm512_set1_pd(y[i]);
+            const __m512d zi = _mm512_set1_pd(z[i]);
+            const __m512d eps2_v = _mm512_set1_pd(eps2);
+            const __m512d half = _mm512_set1_pd(0.5);
+            const __m512d three_halves = _mm512_set1_pd(1.5);
+            const __m512d zero = _mm512_setzero_pd();
+            __m512d sum_x = zero, sum_y = zero, sum_z = zero, sum_potential = zero;
+
+            // The target is left out of its own sweep by masking its lane in the block that holds it
+            const long self_block = i - i % 8;
+            const __mmask8 others = static_cast<__mmask8>(~(1u << (i % 8)));
+
+            for (long j = 0; j < n_vec; j += 8) {
+                __m512d dx = _mm512_sub_pd(_mm512_load_pd(x + j), xi);
+                __m512d dy = _mm512_sub_pd(_mm512_load_pd(y + j), yi);
+                __m512d dz = _mm512_sub_pd(_mm512_load_pd(z + j), zi);
+                __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, eps2_v)));
+
+                __m512d inv_r = _mm512_rsqrt14_pd(r2);
+                __m512d half_r2 = _mm512_mul_pd(half, r2);
+                inv_r = _mm512_mul_pd(inv_r, _mm512_fnmadd_pd(_mm512_mul_pd(half_r2, inv_r), inv_r, three_halves));
+                inv_r = _mm512_mul_pd(inv_r, _mm512_fnmadd_pd(_mm512_mul_pd(half_r2, inv_r), inv_r, three_halves));
+
+                // Zero the contribution of r2 == 0, where the estimate is infinite, and of the target
+                __mmask8 nonzero = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ) & (j == self_block ? others : __mmask8(0xff));
+                inv_r = _mm512_maskz_mov_pd(nonzero, inv_r);
+                __m512d inv_r3 = _mm512_mul_pd(_mm512_mul_pd(inv_r, inv_r), inv_r);
+                __m512d mass_j = _mm512_load_pd(mass + j);
+                __m512d scale = _mm512_mul_pd(mass_j, inv_r3);
+
+                sum_x = _mm512_fmadd_pd(scale, dx, sum_x);
+                sum_y = _mm512_fmadd_pd(scale, dy, sum_y);
+                sum_z = _mm512_fmadd_pd(scale, dz, sum_z);
+                if (WithPotential) {
+                    sum_potential = _mm512_fnmadd_pd(mass_j, inv_r, sum_potential);
+                }
+            }
+
+            double sx = _mm512_reduce_add_pd(sum_x), sy = _mm512_reduce_add_pd(sum_y), sz = _mm512_reduce_add_pd(sum_z);
+            double sp = _mm512_reduce_add_pd(sum_potential);
+            scalarAccumulateOthers<WithPotential>(x, y, z, mass, n_vec, n, i, eps2, sx, sy, sz, sp);
+            ax[i] = sx;
+            ay[i] = sy;
+            az[i] = sz;
+            if (WithPotential) {
+                potential[i] = sp;
+            }
+        }
+    }
+}
+
+#endif
+}
+
+// Detect the widest SIMD path supported by the CPU running the program
+SimdPath detectSimdPath() {
+#ifdef NBODY_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdPath::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SimdPath::AVX2;
+    }
+#endif
+    return SimdPath::Scalar;
+}
+
+// Name of a SIMD path
+std::string simdPathName(SimdPath path) {
+    switch (path) {
+        case SimdPath::Auto: return "auto";
+        case SimdPath::Scalar: return "scalar";
+        case SimdPath::AVX2: return "avx2";
+        case SimdPath::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+// Parse a SIMD path name
+SimdPath parseSimdPath(const std::string& name) {
+    for (SimdPath path : {SimdPath::Auto, SimdPath::Scalar, SimdPath::AVX2, SimdPath::AVX512}) {
+        if (name == simdPathName(path)) {
+            return path;
+        }
+    }
+    throw std::invalid_argument("Unknown SIMD path: " + name);
+}
+
+// Calculate the net acceleration of every body with vectorised direct summation
+void simdSumAcceleration(ParticleSystem& particle_system, const double& epsilon, SimdPath path, bool with_potential) {
+    static const SimdPath supported = detectSimdPath();
+    if (path == SimdPath::Auto) {
+        path = supported;
+    }
+    // Never run an instruction set the CPU does not have
+    if (path == SimdPath::AVX512 && supported != SimdPath::AVX512) {
+        path = supported;
+    }
+    if (path == SimdPath::AVX2 && supported == SimdPath::Scalar) {
+        path = SimdPath::Scalar;
+    }
+
+    const double eps2 = epsilon * epsilon;
+#ifdef NBODY_X86_SIMD
+    if (path == SimdPath::AVX512) {
+        with_potential ? sumAccelerationAvx512<true>(particle_system, eps2) : sumAccelerationAvx512<false>(particle_system, eps2);
+        return;
+    }
+    if (path == SimdPath::AVX2) {
+        with_potential ? sumAccelerationAvx2<true>(particle_system, eps2) : sumAccelerationAvx2<false>(particle_system, eps2);
+        return;
+    }
+#endif
+    with_potential ? sumAccelerationScalar<true>(particle_system, eps2) : sumAccelerationScalar<false>(particle_system, eps2);
+}
+}
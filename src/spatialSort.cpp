@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <omp.h>
+
+#include "octree.hpp"
+#include "spatialSort.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+// Bits of each cell coordinate, as in the octree
+constexpr int curve_bits = 21;
+
+// Bits of each coordinate that decide the order in memory, 2^30 cells are far more than there are bodies
+constexpr int order_bits = 10;
+
+// Bits and buckets of a radix sort digit
+constexpr int digit_bits = 8;
+constexpr std::size_t num_buckets = std::size_t(1) << digit_bits;
+
+// Below this many keys the radix sort runs on one thread
+constexpr long parallel_sort_size = 1 << 14;
+}
+
+// Parse a curve name
+SpaceFillingCurve parseSpaceFillingCurve(const std::string& name) {
+    if (name == "morton") {
+        return SpaceFillingCurve::Morton;
+    }
+    if (name == "hilbert") {
+        return SpaceFillingCurve::Hilbert;
+    }
+    throw std::invalid_argument("Unknown space-filling curve: " + name);
+}
+
+// Name of a curve
+std::string spaceFillingCurveName(SpaceFillingCurve curve) {
+    switch (curve) {
+        case SpaceFillingCurve::Morton:
+            return "morton";
+        case SpaceFillingCurve::Hilbert:
+            return "hilbert";
+    }
+    return "unknown";
+}
+
+// Hilbert key with Skilling's transform: undo the rotations and reflections of every level from the
+// top down, Gray-decode, then interleave the bits as for a Morton key
+std::uint64_t hilbertKey(std::uint32_t ix, std::uint32_t iy, std::uint32_t iz, int bits) {
+    std::uint32_t X[3] = {ix, iy, iz};
+    const std::uint32_t top = 1u << (std::clamp(bits, 1, curve_bits) - 1);
+    for (std::uint32_t q = top; q > 1; q >>= 1) {
+        const std::uint32_t p = q - 1;
+        for (int i = 0; i < 3; ++i) {
+            if (X[i] & q) {
+                X[0] ^= p;
+            }
+            else {
+                const std::uint32_t t = (X[0] ^ X[i]) & p;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+    X[1] ^= X[0];
+    X[2] ^= X[1];
+    std::uint32_t t = 0;
+    for (std::uint32_t q = top; q > 1; q >>= 1) {
+        if (X[2] & q) {
+            t ^= q - 1;
+        }
+    }
+    for (std::uint32_t& x : X) {
+        x ^= t;
+    }
+    return Octree::mortonKey(X[0], X[1], X[2]);
+}
+
+// Keys of the bodies along a curve through the cells of their bounding cube, computed on the coarse grid directly
+std::vector<std::uint64_t> spaceFillingKeys(const ParticleSystem& particle_system, SpaceFillingCurve curve, int bits) {
+    const long n = static_cast<long>(particle_system.size());
+    const double* px = particle_system.x();
+    const double* py = particle_system.y();
+    const double* pz = particle_system.z();
+    std::vector<std::uint64_t> keys(n);
+    if (n == 0) {
+        return keys;
+    }
+
+    // Bounding cube of all bodies
+    double min_x = px[0], min_y = py[0], min_z = pz[0];
+    double max_x = px[0], max_y = py[0], max_z = pz[0];
+    #pragma omp parallel for reduction(min:min_x, min_y, min_z) reduction(max:max_x, max_y, max_z)
+    for (long i = 0; i < n; ++i) {
+        min_x = std::min(min_x, px[i]); max_x = std::max(max_x, px[i]);
+        min_y = std::min(min_y, py[i]); max_y = std::max(max_y, py[i]);
+        min_z = std::min(min_z, pz[i]); max_z = std::max(max_z, pz[i]);
+    }
+    double width = std::max({max_x - min_x, max_y - min_y, max_z - min_z});
+    width = width > 0.0 ? width * (1.0 + 1e-12) : 1.0;
+
+    bits = std::clamp(bits, 1, curve_bits);
+    const double cells = static_cast<double>(1u << bits);
+    const double scale = cells / width;
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+        auto cell = [&](double p, double low) {
+            return static_cast<std::uint32_t>(std::min(cells - 1.0, std::max(0.0, (p - low) * scale)));
+        };
+        const std::uint32_t ix = cell(px[i], min_x), iy = cell(py[i], min_y), iz = cell(pz[i], min_z);
+        keys[i] = curve == SpaceFillingCurve::Hilbert ? hilbertKey(ix, iy, iz, bits) : Octree::mortonKey(ix, iy, iz);
+    }
+    return keys;
+}
+
+// Stable radix sort of keys carrying values along, one pass per digit. Key and value are moved
+// together as one record, so every scatter writes one stream per digit instead of two.
+void radixSort(std::vector<std::uint64_t>& keys, std::vector<std::size_t>& values, int key_bits) {
+    const long n = static_cast<long>(keys.size());
+    if (values.size() != keys.size()) {
+        throw std::invalid_argument("Radix sort needs one value per key");
+    }
+    struct Record {
+        std::uint64_t key;
+        std::size_t value;
+    };
+    std::vector<Record> records(n), sorted(n);
+    std::vector<std::size_t> offsets(num_buckets * omp_get_max_threads());
+    const int num_passes = (std::clamp(key_bits, 0, 64) + digit_bits - 1) / digit_bits;
+
+    #pragma omp parallel for schedule(static) if (n >= parallel_sort_size)
+    for (long i = 0; i < n; ++i) {
+        records[i] = {keys[i], values[i]};
+    }
+
+    for (int pass = 0; pass < num_passes; ++pass) {
+        const int shift = pass * digit_bits;
+        bool constant_digit = false;
+
+        #pragma omp parallel if (n >= parallel_sort_size)
+        {
+            const int t = omp_get_thread_num();
+            const int num_threads = omp_get_num_threads();
+            const long begin = n * t / num_threads, end = n * (t + 1) / num_threads;
+            std::size_t* count = offsets.data() + t * num_buckets;
+
+            // Digits of this thread's part of the keys
+            std::fill(count, count + num_buckets, 0);
+            for (long i = begin; i < end; ++i) {
+                ++count[(records[i].key >> shift) & (num_buckets - 1)];
+            }
+            #pragma omp barrier
+
+            // Turn the counts into the first position of every digit and thread, digit-major so the sort is stable
+            #pragma omp single
+            {
+                std::size_t position = 0;
+                for (std::size_t digit = 0; digit < num_buckets; ++digit) {
+                    std::size_t digit_count = 0;
+                    for (int u = 0; u < num_threads; ++u) {
+                        const std::size_t c = offsets[u * num_buckets + digit];
+                        offsets[u * num_buckets + digit] = position;
+                        position += c;
+                        digit_count += c;
+                    }
+                    constant_digit = constant_digit || digit_count == static_cast<std::size_t>(n);
+                }
+            }
+
+            if (!constant_digit) {
+                for (long i = begin; i < end; ++i) {
+                    sorted[count[(records[i].key >> shift) & (num_buckets - 1)]++] = records[i];
+                }
+            }
+        }
+
+        if (!constant_digit) {
+            records.swap(sorted);
+        }
+    }
+
+    #pragma omp parallel for schedule(static) if (n >= parallel_sort_size)
+    for (long i = 0; i < n; ++i) {
+        keys[i] = records[i].key;
+        values[i] = records[i].value;
+    }
+}
+
+// Order of the bodies along a curve
+std::vector<std::size_t> spaceFillingOrder(const ParticleSystem& particle_system, SpaceFillingCurve curve) {
+    std::vector<std::uint64_t> keys = spaceFillingKeys(particle_system, curve, order_bits);
+    std::vector<std::size_t> order(keys.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    radixSort(keys, order, 3 * order_bits);
+    return order;
+}
+
+// Mean distance between neighbours in memory
+double storageSpread(const ParticleSystem& particle_system) {
+    const long n = static_cast<long>(particle_system.size());
+    if (n < 2) {
+        return 0.0;
+    }
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    double sum = 0.0;
+    #pragma omp parallel for reduction(+:sum)
+    for (long i = 1; i < n; ++i) {
+        const double dx = x[i] - x[i - 1];
+        const double dy = y[i] - y[i - 1];
+        const double dz = z[i] - z[i - 1];
+        sum += std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    return sum / static_cast<double>(n - 1);
+}
+
+// Constructor for the spatial sorter
+SpatialSorter::SpatialSorter(SpaceFillingCurve curve, long reorder_every, double degradation)
+    : curve_(curve), reorder_every_(reorder_every), degradation_(degradation), calls_(0), reorders_(0), sorted_spread_(0.0), seconds_(0.0) {}
+
+// Sort the bodies if due
+bool SpatialSorter::update(ParticleSystem& particle_system, Integrator& integrator) {
+    ++calls_;
+    bool due = reorders_ == 0;
+    if (!due && reorder_every_ > 0) {
+        due = calls_ % reorder_every_ == 0;
+    }
+    else if (!due) {
+        due = storageSpread(particle_system) > degradation_ * sorted_spread_;
+    }
+    if (due) {
+        reorder(particle_system, integrator);
+    }
+    return due;
+}
+
+// Sort the bodies now
+void SpatialSorter::reorder(ParticleSystem& particle_system, Integrator& integrator) {
+    auto start_time = std::chrono::steady_clock::now();
+    const std::vector<std::size_t> order = spaceFillingOrder(particle_system, curve_);
+    particle_system.permute(order);
+    integrator.permute(order);
+    sorted_spread_ = storageSpread(particle_system);
+    ++reorders_;
+    std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+    seconds_ += elapsed_time.count();
+}
+
+// Accessor methods
+SpaceFillingCurve SpatialSorter::getCurve() const {
+    return curve_;
+}
+
+long SpatialSorter::getReorderEvery() const {
+    return reorder_every_;
+}
+
+double SpatialSorter::getDegradation() const {
+    return degradation_;
+}
+
+long SpatialSorter::getReorders() const {
+    return reorders_;
+}
+
+double SpatialSorter::getSeconds() const {
+    return seconds_;
+}
+}
@@ -0,0 +1,128 @@
+#include <cmath>
+#include <omp.h>
+
+#include "symmetricKernel.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+// Pointers to the arrays touched by the pair kernels
+struct PairArrays {
+    const double* __restrict x;
+    const double* __restrict y;
+    const double* __restrict z;
+    const double* __restrict mass;
+    double* __restrict ax;
+    double* __restrict ay;
+    double* __restrict az;
+    double* __restrict potential;
+    double eps2;
+};
+
+// Interactions of every body in [a_begin, a_end) with every body in [b_begin, b_end).
+// The two ranges must not overlap. Body i gathers its sum in registers, body j is scattered to.
+template <bool WithPotential>
+inline void blockPair(const PairArrays& p, long a_begin, long a_end, long b_begin, long b_end) {
+    for (long i = a_begin; i < a_end; ++i) {
+        const double xi = p.x[i], yi = p.y[i], zi = p.z[i], mi = p.mass[i];
+        double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0, sum_potential = 0.0;
+        #pragma omp simd reduction(+:sum_x, sum_y, sum_z, sum_potential)
+        for (long j = b_begin; j < b_end; ++j) {
+            double dx = p.x[j] - xi;
+            double dy = p.y[j] - yi;
+            double dz = p.z[j] - zi;
+            double r2 = dx * dx + dy * dy + dz * dz + p.eps2;
+            double inv_r = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+            double inv_r3 = inv_r * inv_r * inv_r;
+            double scale_i = p.mass[j] * inv_r3;
+            double scale_j = mi * inv_r3;
+            sum_x += scale_i * dx;
+            sum_y += scale_i * dy;
+            sum_z += scale_i * dz;
+            p.ax[j] -= scale_j * dx;
+            p.ay[j] -= scale_j * dy;
+            p.az[j] -= scale_j * dz;
+            if (WithPotential) {
+                sum_potential -= p.mass[j] * inv_r;
+                p.potential[j] -= mi * inv_r;
+            }
+        }
+        p.ax[i] += sum_x;
+        p.ay[i] += sum_y;
+        p.az[i] += sum_z;
+        if (WithPotential) {
+            p.potential[i] += sum_potential;
+        }
+    }
+}
+
+// Interactions of the bodies in [begin, end) with each other, each pair once.
+template <bool WithPotential>
+inline void blockSelf(const PairArrays& p, long begin, long end) {
+    for (long i = begin; i + 1 < end; ++i) {
+        blockPair<WithPotential>(p, i, i + 1, i + 1, end);
+    }
+}
+
+// Tournament over the block pairs, WithPotential also accumulates the potential
+template <bool WithPotential>
+void symmetricSum(const PairArrays& p, long n) {
+    // Two blocks per thread, so each round of the tournament gives every thread one block pair
+    const long num_blocks = 2 * static_cast<long>(omp_get_max_threads());
+    const long num_rounds = num_blocks - 1;
+    auto blockBegin = [&](long b) { return n * b / num_blocks; };
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static)
+        for (long i = 0; i < n; ++i) {
+            p.ax[i] = 0.0;
+            p.ay[i] = 0.0;
+            p.az[i] = 0.0;
+            if (WithPotential) {
+                p.potential[i] = 0.0;
+            }
+        }
+
+        // Pairs inside one block
+        {
+            NBODY_PROFILE_THREAD(Force);
+            #pragma omp for schedule(static) nowait
+            for (long b = 0; b < num_blocks; ++b) {
+                blockSelf<WithPotential>(p, blockBegin(b), blockBegin(b + 1));
+            }
+        }
+        #pragma omp barrier
+
+        // Pairs of different blocks, round robin (circle method): block num_blocks - 1 stays fixed
+        // and meets block r, the others are paired r + k with r - k. The barrier at the end of
+        // each round keeps the rounds apart, so no block is written by two threads at once.
+        for (long r = 0; r < num_rounds; ++r) {
+            {
+                NBODY_PROFILE_THREAD(Force);
+                #pragma omp for schedule(static) nowait
+                for (long k = 0; k < num_blocks / 2; ++k) {
+                    long a = k == 0 ? num_blocks - 1 : (r + k) % num_rounds;
+                    long b = k == 0 ? r : (r - k + num_rounds) % num_rounds;
+                    blockPair<WithPotential>(p, blockBegin(a), blockBegin(a + 1), blockBegin(b), blockBegin(b + 1));
+                }
+            }
+            #pragma omp barrier
+        }
+    }
+}
+}
+
+// Calculate the net acceleration of every body, evaluating each unordered pair once
+void symmetricSumAcceleration(ParticleSystem& particle_system, const double& epsilon, bool with_potential) {
+    const long n = static_cast<long>(particle_system.size());
+    const PairArrays p {particle_system.x(), particle_system.y(), particle_system.z(), particle_system.mass(),
+                        particle_system.ax(), particle_system.ay(), particle_system.az(), particle_system.potential(),
+                        epsilon * epsilon};
+    with_potential ? symmetricSum<true>(p, n) : symmetricSum<false>(p, n);
+}
+}
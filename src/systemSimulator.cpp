@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <cmath>
 #include <omp.h>
 
 
@@ -15,6 +16,9 @@ using Eigen::Vector3d;
 namespace n_body
 {
 
+// Constructor for solar system generator
+SolarSystemGenerator::SolarSystemGenerator(int seed): seed(seed) {}
+
 // Generate initial conditions for solar system
 std::vector<particleAcceleration> SolarSystemGenerator::generateInitialConditions() {
 
@@ -22,8 +26,7 @@ std::vector<particleAcceleration> SolarSystemGenerator::generateInitialCondition
     std::vector<double> masses = {1., 1./6023600, 1./408524, 1./332946.038, 1./3098710, 1./1047.55, 1./3499, 1./22962, 1./19352};
     std::vector<double> distances = {0.0, 0.4, 0.7, 1, 1.5, 5.2, 9.5, 19.2, 30.1};
 
-    // generates random angle sigma for each of the planets 
-    int seed = 42; // have a fixed seed value that allows to reproduce results consistently
+    // generates random angle sigma for each of the planets, the seed allows to reproduce results consistently
     std::mt19937 gen(seed);
     std::uniform_real_distribution<double> randomly_theta (0, 2 * M_PI);
     
@@ -87,33 +90,46 @@ std::vector<particleAcceleration> RandomSystemGenerator::generateInitialConditio
     return particles;
 }
 
+// Convert the list of particles into a particle system
+ParticleSystem InitialConditionGenerator::generateParticleSystem() {
+    return ParticleSystem(generateInitialConditions());
+}
+
 // Constructor for system simulator
 sysSimulator::sysSimulator (std::shared_ptr<InitialConditionGenerator> gen) : generator(gen){
-    std::vector<particleAcceleration> particle_list = generator->generateInitialConditions();
-    addSysInput(particle_list);
-    particle_list_ = particle_list;
+    particle_system_ = generator->generateParticleSystem();
 }
 
 // Generate particle list using initial condition generator
 std::vector<particleAcceleration> sysSimulator::particleListGenerator (){
+        if (particle_list_.size() != particle_system_.size()) {
+            particle_list_ = particle_system_.toParticleList();
+        }
         return particle_list_;
 }
 
+// Generate the same particles as a structure-of-arrays particle system
+ParticleSystem sysSimulator::particleSystemGenerator (){
+        return particle_system_;
+}
+
 // Add input data to particle list for calculations
 void sysSimulator::addSysInput (std::vector<particleAcceleration>& particle_list) {
 
-    // developer can comment/uncomment the code below to parallelised the loop
-    #pragma omp parallel for schedule(dynamic) collapse(1)
-    
-    for (particleAcceleration& p_i : particle_list) {
-        for (particleAcceleration& p_j : particle_list) {
-            if (&p_i != &p_j) {
-                p_i.addParticle(p_j);
-            }
-        }
-    }
+    // Forces are summed over the shared list (particleAcceleration::sumAcceleration(system)) or the
+    // particle system, so no particle needs its own pointers to the N - 1 others
     releaseMemoryFromParticles(particle_list);
+    particle_list_ = particle_list;
+    particle_system_ = ParticleSystem(particle_list_);
+}
 
+// Bytes held by the particle list and the particle system
+std::size_t sysSimulator::memoryUsage () const {
+    std::size_t bytes = particle_list_.capacity() * sizeof(particleAcceleration);
+    for (const particleAcceleration& particle : particle_list_) {
+        bytes += particle.memoryUsage();
+    }
+    return bytes + particle_system_.memoryUsage();
 }
 
 // Release memory after particles have been added to particleAcceleration objects
@@ -134,124 +150,205 @@ void sysSimulator::printPosition (std::vector<particleAcceleration>& particle_li
     }
 }
 
+// Print particle positions of a structure-of-arrays particle system, by id so reordered bodies keep their names
+void sysSimulator::printPosition (ParticleSystem& particle_system, const std::string& label){
+    std::cout << label << " positions:" << std::endl;
+    std::vector<std::string> planet {"sun", "Mercury", "Venus", "Earth", "Mars", "Jupiter", "Saturn", "Uranus", "Neptune"};
+    std::vector<std::size_t> index = particle_system.indexById();
+    for (std::size_t id = 0; id < particle_system.size(); ++id) {
+        std::cout << planet[id] << ": "<< particle_system.getPosition(index[id]).transpose() << std::endl;
+    }
+}
+
 // Calculate kinetic energy for all particles
 std::vector<double> sysSimulator::kineticEnergy (std::vector<particleAcceleration>& particle_list) {
-    std::vector<double> kinetic_energy_list;
-    for (const n_body::particleAcceleration particle : particle_list){
-        double kin_energy = 0.0;
-        double mass = particle.getMass();
-        Eigen::Vector3d velocity = particle.getVelocity();
-        kin_energy = 0.5 * mass * velocity.squaredNorm();
-        kinetic_energy_list.push_back(kin_energy);
+    kinetic_energy_list_.resize(particle_list.size());
+    for (std::size_t i = 0; i < particle_list.size(); ++i){
+        const particleAcceleration& particle = particle_list[i];
+        kinetic_energy_list_[i] = 0.5 * particle.getMass() * particle.getVelocity().squaredNorm();
     }
-    kinetic_energy_list_ = kinetic_energy_list;
     return kinetic_energy_list_;
 }
 
-// calculate the potential energy and parallelise the calculation using OpenMp
+// calculate the kinetic energy and parallelise the calculation using OpenMp
 std::vector<double> sysSimulator::kineticEnergyPara (std::vector<particleAcceleration>& particle_list) {
-    std::vector<double> kinetic_energy_list(particle_list.size(), 0.0);
-
-    #pragma omp parallel
-    {
-        std::vector<double> local_kinetic_energy_list(particle_list.size(), 0.0);
-
-        #pragma omp for
-        for (int i = 0; i < particle_list.size(); ++i) {
-            double kin_energy = 0.0;
-            double mass = particle_list[i].getMass();
-            Eigen::Vector3d velocity = particle_list[i].getVelocity();
-            kin_energy = 0.5 * mass * velocity.squaredNorm();
-            local_kinetic_energy_list[i] = kin_energy;
-        }
+    const long n = static_cast<long>(particle_list.size());
+    kinetic_energy_list_.resize(n);
 
-        #pragma omp critical
-        for (int i = 0; i < particle_list.size(); ++i) {
-            kinetic_energy_list[i] += local_kinetic_energy_list[i];
-        }
+    // Every thread writes its own entries of the shared list, there is nothing to merge
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+        kinetic_energy_list_[i] = 0.5 * particle_list[i].getMass() * particle_list[i].getVelocity().squaredNorm();
     }
-
-    kinetic_energy_list_ = kinetic_energy_list;
     return kinetic_energy_list_;
 }
 
 // Calculate potential energy for all particles
 std::vector<double> sysSimulator::potentialEnergy (std::vector<particleAcceleration>& particle_list) {
-    std::vector<double> potential_energy_list;
-    for (particleAcceleration &p_i : particle_list) {
-        // initial potential energy for each particle
+    potential_energy_list_.resize(particle_list.size());
+    for (std::size_t i = 0; i < particle_list.size(); ++i) {
+        const particleAcceleration& p_i = particle_list[i];
+        const Eigen::Vector3d position_i = p_i.getPosition();
         double pot_energy = 0.0;
-        for (const particleAcceleration &p_j : particle_list) {
-            if (&p_i != &p_j) {
-                double mass_i = p_i.getMass();
-                double mass_j = p_j.getMass();
-                Eigen::Vector3d position_i = p_i.getPosition();
-                Eigen::Vector3d position_j = p_j.getPosition();
-                double dis_i_j = (position_i - position_j).norm();
-                pot_energy += -0.5 * (mass_i * mass_j) / dis_i_j;
-            }
-            else{
-                continue;
+        for (std::size_t j = 0; j < particle_list.size(); ++j) {
+            if (i != j) {
+                const particleAcceleration& p_j = particle_list[j];
+                double dis_i_j = (position_i - p_j.getPosition()).norm();
+                pot_energy += -0.5 * (p_i.getMass() * p_j.getMass()) / dis_i_j;
             }
         }
-        potential_energy_list.push_back(pot_energy);
-        
+        potential_energy_list_[i] = pot_energy;
     }
-    potential_energy_list_ = potential_energy_list;
     return potential_energy_list_;
 }
 
 // Calculate potential energy in parallel using OpenMP
 std::vector<double> sysSimulator::potentialEnergyPara(std::vector<particleAcceleration>& particle_list) {
+    const long n = static_cast<long>(particle_list.size());
+    potential_energy_list_.resize(n);
+
+    // Body i sums over all others into a local, so each entry is written once by one thread
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+        const particleAcceleration& p_i = particle_list[i];
+        const Eigen::Vector3d position_i = p_i.getPosition();
+        double pot_energy = 0.0;
+        for (long j = 0; j < n; ++j) {
+            if (i != j) {
+                const particleAcceleration& p_j = particle_list[j];
+                double dis_i_j = (position_i - p_j.getPosition()).norm();
+                pot_energy += -0.5 * (p_i.getMass() * p_j.getMass()) / dis_i_j;
+            }
+        }
+        potential_energy_list_[i] = pot_energy;
+    }
+    return potential_energy_list_;
+}
+
+// Calculate kinetic energy for all bodies of a particle system
+std::vector<double> sysSimulator::kineticEnergy (ParticleSystem& particle_system) {
+    const double* vx = particle_system.vx();
+    const double* vy = particle_system.vy();
+    const double* vz = particle_system.vz();
+    const double* mass = particle_system.mass();
+
+    kinetic_energy_list_.resize(particle_system.size());
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        kinetic_energy_list_[i] = 0.5 * mass[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+    }
+    return kinetic_energy_list_;
+}
 
-    std::vector<double> potential_energy_list(particle_list.size(), 0.0);
-
-    #pragma omp parallel
-    {
-        std::vector<double> local_potential_energy_list(particle_list.size(), 0.0);
-
-        #pragma omp for
-        for (int i = 0; i < particle_list.size(); ++i) {
-            for (int j = 0; j < particle_list.size(); ++j) {
-                if (i != j) {
-                    double mass_i = particle_list[i].getMass();
-                    double mass_j = particle_list[j].getMass();
-                    Eigen::Vector3d position_i = particle_list[i].getPosition();
-                    Eigen::Vector3d position_j = particle_list[j].getPosition();
-                    double dis_i_j = (position_i - position_j).norm();
-                    local_potential_energy_list[i] += -0.5 * (mass_i * mass_j) / dis_i_j;
-                }
+// Calculate kinetic energy for all bodies of a particle system in parallel using OpenMP
+std::vector<double> sysSimulator::kineticEnergyPara (ParticleSystem& particle_system) {
+    const double* vx = particle_system.vx();
+    const double* vy = particle_system.vy();
+    const double* vz = particle_system.vz();
+    const double* mass = particle_system.mass();
+    const int n = static_cast<int>(particle_system.size());
+
+    kinetic_energy_list_.resize(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        kinetic_energy_list_[i] = 0.5 * mass[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+    }
+    return kinetic_energy_list_;
+}
+
+// Calculate potential energy for all bodies of a particle system
+std::vector<double> sysSimulator::potentialEnergy (ParticleSystem& particle_system, const double& epsilon) {
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    const double* mass = particle_system.mass();
+    const double eps2 = epsilon * epsilon;
+    const std::size_t n = particle_system.size();
+
+    potential_energy_list_.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        double pot_energy = 0.0;
+        for (std::size_t j = 0; j < n; ++j) {
+            if (i != j) {
+                double dx = x[i] - x[j];
+                double dy = y[i] - y[j];
+                double dz = z[i] - z[j];
+                pot_energy += -0.5 * (mass[i] * mass[j]) / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
             }
         }
+        potential_energy_list_[i] = pot_energy;
+    }
+    return potential_energy_list_;
+}
 
-        #pragma omp critical
-        for (int i = 0; i < particle_list.size(); ++i) {
-            potential_energy_list[i] += local_potential_energy_list[i];
+// Calculate potential energy for all bodies of a particle system in parallel using OpenMP
+std::vector<double> sysSimulator::potentialEnergyPara (ParticleSystem& particle_system, const double& epsilon) {
+    const double* x = particle_system.x();
+    const double* y = particle_system.y();
+    const double* z = particle_system.z();
+    const double* mass = particle_system.mass();
+    const double eps2 = epsilon * epsilon;
+    const int n = static_cast<int>(particle_system.size());
+
+    potential_energy_list_.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; ++i) {
+        double pot_energy = 0.0;
+        for (int j = 0; j < n; ++j) {
+            if (i != j) {
+                double dx = x[i] - x[j];
+                double dy = y[i] - y[j];
+                double dz = z[i] - z[j];
+                pot_energy += -0.5 * (mass[i] * mass[j]) / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+            }
         }
+        potential_energy_list_[i] = pot_energy;
     }
+    return potential_energy_list_;
+}
 
-    potential_energy_list_ = potential_energy_list;
+// Calculate potential energy for all bodies from the per-body potentials of the fast multipole method
+std::vector<double> sysSimulator::potentialEnergyFmm (ParticleSystem& particle_system, FmmSolver& fmm_solver, const double& epsilon) {
+    fmm_solver.evaluate(particle_system, epsilon);
+    const std::vector<double>& potential = fmm_solver.potential();
+    const double* mass = particle_system.mass();
+    const int n = static_cast<int>(particle_system.size());
+
+    // Each pair is shared between its two bodies, as in potentialEnergy
+    potential_energy_list_.resize(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        potential_energy_list_[i] = 0.5 * mass[i] * potential[i];
+    }
+    return potential_energy_list_;
+}
+
+// Calculate potential energy for all bodies from the potentials left by the last force pass
+std::vector<double> sysSimulator::potentialEnergyStored (ParticleSystem& particle_system) {
+    const double* potential = particle_system.potential();
+    const double* mass = particle_system.mass();
+    const int n = static_cast<int>(particle_system.size());
+
+    // Each pair is shared between its two bodies, as in potentialEnergy
+    potential_energy_list_.resize(n);
+    for (int i = 0; i < n; ++i) {
+        potential_energy_list_[i] = 0.5 * mass[i] * potential[i];
+    }
     return potential_energy_list_;
 }
 
 // Calculate total energy for all particles
 std::vector<double> sysSimulator::totalEnergy (){
-    std::vector<double> total_energy_list;
-    for (int i = 0; i < kinetic_energy_list_.size(); ++i){
-        double tot_energy = 0.0;
-        double kin_energy = kinetic_energy_list_[i];
-        double pot_energy = potential_energy_list_[i];
-        tot_energy = kin_energy + pot_energy;
-        total_energy_list.push_back(tot_energy);
+    total_energy_list_.resize(kinetic_energy_list_.size());
+    for (std::size_t i = 0; i < kinetic_energy_list_.size(); ++i){
+        total_energy_list_[i] = kinetic_energy_list_[i] + potential_energy_list_[i];
     }
-    total_energy_list_ = total_energy_list;
     return total_energy_list_;
 }
 
 // Calculate sum of all individual particle energies
 double sysSimulator::sumTotalEnergy (){
     double sum_tot_energy = 0.0;
-    for (int i = 0; i < total_energy_list_.size(); ++i){
+    for (std::size_t i = 0; i < total_energy_list_.size(); ++i){
         sum_tot_energy += total_energy_list_[i];
     } 
     sum_tot_energy_ = sum_tot_energy;
@@ -260,9 +357,10 @@ double sysSimulator::sumTotalEnergy (){
 
 // Calculate sum of all individual particle energies in parallel using OpenMP
 double sysSimulator::sumTotalEnergyPara (){
+    const long n = static_cast<long>(total_energy_list_.size());
     double sum_tot_energy = 0.0;
-    #pragma omp parallel for reduction(+:sum_tot_energy)
-    for (int i = 0; i < total_energy_list_.size(); ++i){
+    #pragma omp parallel for schedule(static) reduction(+:sum_tot_energy)
+    for (long i = 0; i < n; ++i){
         sum_tot_energy += total_energy_list_[i];
     } 
     sum_tot_energy_ = sum_tot_energy;
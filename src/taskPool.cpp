@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <omp.h>
+
+#include "taskPool.hpp"
+
+namespace n_body
+{
+
+// Constructor for the task pool
+TaskPool::TaskPool(int num_threads) {
+    num_threads = std::max(1, num_threads > 0 ? num_threads : omp_get_max_threads());
+    for (int t = 0; t < num_threads; ++t) {
+        workers_.push_back(std::make_unique<Worker>());
+        workers_.back()->random_state = 0x9E3779B97F4A7C15ull * (t + 1);
+    }
+}
+
+TaskPool::~TaskPool() = default;
+
+int TaskPool::numThreads() const {
+    return static_cast<int>(workers_.size());
+}
+
+// Counters since construction or the last reset
+TaskPoolStatistics TaskPool::statistics() const {
+    TaskPoolStatistics statistics {0, 0, 0};
+    for (const std::unique_ptr<Worker>& worker : workers_) {
+        statistics.tasks += worker->tasks;
+        statistics.steals += worker->steals;
+        statistics.failed_steals += worker->failed_steals;
+    }
+    return statistics;
+}
+
+void TaskPool::resetStatistics() {
+    for (std::unique_ptr<Worker>& worker : workers_) {
+        worker->tasks = 0;
+        worker->steals = 0;
+        worker->failed_steals = 0;
+    }
+}
+
+// Add a task at the bottom of the owner's deque
+void TaskPool::push(Worker& worker, const Task& task) {
+    const long index = worker.arena_used++;
+    worker.arena[index] = task;
+    const long b = worker.bottom.load(std::memory_order_relaxed);
+    worker.slots[b].store(index, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    worker.bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+// Take the newest task from the bottom of the owner's deque
+bool TaskPool::take(Worker& worker, Task& task) {
+    const long b = worker.bottom.load(std::memory_order_relaxed) - 1;
+    worker.bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long t = worker.top.load(std::memory_order_relaxed);
+    if (t > b) {
+        worker.bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+    const long index = worker.slots[b].load(std::memory_order_relaxed);
+
+    // The last task may be stolen at the same time, whoever moves top first gets it
+    if (t == b) {
+        bool won = worker.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        worker.bottom.store(b + 1, std::memory_order_relaxed);
+        if (!won) {
+            return false;
+        }
+    }
+    task = worker.arena[index];
+    return true;
+}
+
+// Steal the oldest task from the top of another thread's deque
+bool TaskPool::steal(Worker& victim, Task& task) {
+    long t = victim.top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const long b = victim.bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return false;
+    }
+    const long index = victim.slots[t].load(std::memory_order_relaxed);
+    if (!victim.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return false;
+    }
+    task = victim.arena[index];
+    return true;
+}
+
+// Call body on disjoint ranges of at most grain iterations covering [0, n)
+void TaskPool::parallelFor(long n, long grain, const std::function<void(long, long)>& body) {
+    if (n <= 0) {
+        return;
+    }
+    grain = std::max(grain, 1L);
+    const int num_threads = numThreads();
+
+    // Nothing to share out, run the chunks in order
+    if (num_threads == 1 || n <= grain) {
+        for (long begin = 0; begin < n; begin += grain) {
+            body(begin, std::min(begin + grain, n));
+            ++workers_[0]->tasks;
+        }
+        return;
+    }
+
+    // Halving stops at tasks longer than grain / 2, so there are at most 2 n / grain + num_threads
+    // of them and at most twice as many tasks in all. Every thread can hold that many.
+    const long capacity = 2 * (2 * n / grain + num_threads) + 2;
+    for (int t = 0; t < num_threads; ++t) {
+        Worker& worker = *workers_[t];
+        if (worker.capacity < capacity) {
+            worker.arena.resize(capacity);
+            worker.slots = std::make_unique<std::atomic<long>[]>(capacity);
+            worker.capacity = capacity;
+        }
+        worker.arena_used = 0;
+        worker.top.store(0, std::memory_order_relaxed);
+        worker.bottom.store(0, std::memory_order_relaxed);
+
+        // Every thread starts with an equal contiguous share
+        push(worker, Task {n * t / num_threads, n * (t + 1) / num_threads});
+    }
+    std::atomic<long> remaining(n);
+
+    // A thread missing from the team leaves its share to be stolen by the others
+    #pragma omp parallel num_threads(num_threads)
+    {
+        const int me = omp_get_thread_num();
+        Worker& worker = *workers_[me];
+        Task task;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!take(worker, task)) {
+                // xorshift64 picks the victim
+                worker.random_state ^= worker.random_state << 13;
+                worker.random_state ^= worker.random_state >> 7;
+                worker.random_state ^= worker.random_state << 17;
+                const int victim = static_cast<int>(worker.random_state % num_threads);
+                if (victim == me || !steal(*workers_[victim], task)) {
+                    ++worker.failed_steals;
+                    std::this_thread::yield();
+                    continue;
+                }
+                ++worker.steals;
+            }
+
+            // Keep the near half and leave the far half to be taken later or stolen
+            while (task.end - task.begin > grain) {
+                const long middle = task.begin + (task.end - task.begin) / 2;
+                push(worker, Task {middle, task.end});
+                task.end = middle;
+            }
+            body(task.begin, task.end);
+            ++worker.tasks;
+            remaining.fetch_sub(task.end - task.begin, std::memory_order_acq_rel);
+        }
+    }
+}
+}
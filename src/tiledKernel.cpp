@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+#include <omp.h>
+
+#include "tiledKernel.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+// Number of targets that share each source tile, small enough for their running sums to stay in registers and L1
+constexpr long target_block = 64;
+
+// Tile size from the L1 data cache size
+std::size_t detectTileSize() {
+    long cache_size = -1;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    cache_size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+    if (cache_size <= 0) {
+        return 512;
+    }
+
+    // Half of L1 for the source tile, four doubles per body
+    std::size_t tile_size = static_cast<std::size_t>(cache_size) / 2 / (4 * sizeof(double));
+    tile_size = std::clamp<std::size_t>(tile_size, 64, 4096);
+    return tile_size / 8 * 8;
+}
+
+namespace
+{
+
+// Sum the pull of the sources [begin, end) on the body at (xi, yi, zi), WithPotential also accumulates its potential
+template <bool WithPotential>
+inline void sweepSources(const double* __restrict x, const double* __restrict y, const double* __restrict z, const double* __restrict mass,
+                         long begin, long end, double xi, double yi, double zi, double eps2,
+                         double& acc_x, double& acc_y, double& acc_z, double& acc_potential) {
+    #pragma omp simd reduction(+:acc_x, acc_y, acc_z, acc_potential)
+    for (long j = begin; j < end; ++j) {
+        double dx = x[j] - xi;
+        double dy = y[j] - yi;
+        double dz = z[j] - zi;
+        double r2 = dx * dx + dy * dy + dz * dz + eps2;
+        double inv_r = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+        double scale = mass[j] * inv_r * inv_r * inv_r;
+        acc_x += scale * dx;
+        acc_y += scale * dy;
+        acc_z += scale * dz;
+        if (WithPotential) {
+            acc_potential -= mass[j] * inv_r;
+        }
+    }
+}
+
+// Tiled sweep, WithPotential also accumulates the potential
+template <bool WithPotential>
+void tiledSum(ParticleSystem& particle_system, const double& epsilon, std::size_t tile_size) {
+    const double* __restrict x = particle_system.x();
+    const double* __restrict y = particle_system.y();
+    const double* __restrict z = particle_system.z();
+    const double* __restrict mass = particle_system.mass();
+    double* ax = particle_system.ax();
+    double* ay = particle_system.ay();
+    double* az = particle_system.az();
+    double* potential = particle_system.potential();
+    const double eps2 = epsilon * epsilon;
+    const long n = static_cast<long>(particle_system.size());
+    const long tile = static_cast<long>(tile_size == 0 ? detectTileSize() : std::min<std::size_t>(tile_size, std::max<long>(n, 1)));
+    const long num_blocks = (n + target_block - 1) / target_block;
+
+    #pragma omp parallel
+    {
+        NBODY_PROFILE_THREAD(Force);
+        #pragma omp for schedule(dynamic) nowait
+        for (long block = 0; block < num_blocks; ++block) {
+            const long i_begin = block * target_block;
+            const long i_end = std::min(i_begin + target_block, n);
+            double sum_x[target_block] = {}, sum_y[target_block] = {}, sum_z[target_block] = {};
+            double sum_potential[target_block] = {};
+
+            // Every target of the block sweeps the same source tile while it is in cache
+            for (long j_begin = 0; j_begin < n; j_begin += tile) {
+                const long j_end = std::min(j_begin + tile, n);
+                for (long i = i_begin; i < i_end; ++i) {
+                    const double xi = x[i], yi = y[i], zi = z[i];
+                    double acc_x = 0.0, acc_y = 0.0, acc_z = 0.0, acc_potential = 0.0;
+                    // The target is left out of its own sweep: its -m_i / epsilon would swamp the potential
+                    const long j_self = std::clamp(i, j_begin, j_end);
+                    sweepSources<WithPotential>(x, y, z, mass, j_begin, j_self, xi, yi, zi, eps2, acc_x, acc_y, acc_z, acc_potential);
+                    sweepSources<WithPotential>(x, y, z, mass, std::min(j_self + (j_self == i), j_end), j_end, xi, yi, zi, eps2, acc_x, acc_y, acc_z, acc_potential);
+                    sum_x[i - i_begin] += acc_x;
+                    sum_y[i - i_begin] += acc_y;
+                    sum_z[i - i_begin] += acc_z;
+                    sum_potential[i - i_begin] += acc_potential;
+                }
+            }
+
+            for (long i = i_begin; i < i_end; ++i) {
+                ax[i] = sum_x[i - i_begin];
+                ay[i] = sum_y[i - i_begin];
+                az[i] = sum_z[i - i_begin];
+                if (WithPotential) {
+                    potential[i] = sum_potential[i - i_begin];
+                }
+            }
+        }
+    }
+}
+}
+
+// Calculate the net acceleration of every body with cache-blocked direct summation
+void tiledSumAcceleration(ParticleSystem& particle_system, const double& epsilon, std::size_t tile_size, bool with_potential) {
+    with_potential ? tiledSum<true>(particle_system, epsilon, tile_size) : tiledSum<false>(particle_system, epsilon, tile_size);
+}
+}
@@ -0,0 +1,316 @@
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trajectory.hpp"
+#include "profiler.hpp"
+
+namespace n_body
+{
+
+namespace
+{
+
+constexpr char trajectory_magic[8] = {'N', 'B', 'T', 'R', 'A', 'J', '1', '\0'};
+constexpr std::size_t frame_header_bytes = 16;
+
+// Copy n doubles into a block of the given precision, value i to position ids[i] when ids are given
+void storeBlock(unsigned char* block, const double* values, const std::size_t* ids, std::size_t n, TrajectoryPrecision precision) {
+    if (precision == TrajectoryPrecision::Float64) {
+        double* doubles = reinterpret_cast<double*>(block);
+        if (ids == nullptr) {
+            std::memcpy(block, values, n * sizeof(double));
+        }
+        else {
+            for (std::size_t i = 0; i < n; ++i) {
+                doubles[ids[i]] = values[i];
+            }
+        }
+        return;
+    }
+    float* floats = reinterpret_cast<float*>(block);
+    for (std::size_t i = 0; i < n; ++i) {
+        floats[ids == nullptr ? i : ids[i]] = static_cast<float>(values[i]);
+    }
+}
+
+// Copy a block of the given precision into n doubles, value i from position ids[i] when ids are given
+void loadBlock(double* values, const unsigned char* block, const std::size_t* ids, std::size_t n, TrajectoryPrecision precision) {
+    if (precision == TrajectoryPrecision::Float64) {
+        const double* doubles = reinterpret_cast<const double*>(block);
+        if (ids == nullptr) {
+            std::memcpy(values, block, n * sizeof(double));
+        }
+        else {
+            for (std::size_t i = 0; i < n; ++i) {
+                values[i] = doubles[ids[i]];
+            }
+        }
+        return;
+    }
+    const float* floats = reinterpret_cast<const float*>(block);
+    for (std::size_t i = 0; i < n; ++i) {
+        values[i] = floats[ids == nullptr ? i : ids[i]];
+    }
+}
+
+// Ids of a particle system, or nullptr when every body sits at the index of its id
+const std::size_t* reorderedIds(const ParticleSystem& particle_system) {
+    const std::size_t* ids = particle_system.id();
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        if (ids[i] != i) {
+            return ids;
+        }
+    }
+    return nullptr;
+}
+}
+
+// Size of one frame in bytes
+std::size_t trajectoryFrameBytes(std::size_t num_bodies, TrajectoryPrecision precision, bool velocities) {
+    return frame_header_bytes + (velocities ? 6 : 3) * num_bodies * static_cast<std::size_t>(precision);
+}
+
+// Create the file, write its header and start the writer thread
+TrajectoryWriter::TrajectoryWriter(const std::string& path, std::size_t num_bodies, TrajectoryPrecision precision, bool velocities)
+    : file_(std::fopen(path.c_str(), "wb")), num_bodies_(num_bodies), precision_(precision), velocities_(velocities),
+      frame_bytes_(trajectoryFrameBytes(num_bodies, precision, velocities)), full_{false, false}, next_buffer_(0),
+      closing_(false), frames_written_(0), wait_seconds_(0.0)
+    {
+        if (file_ == nullptr) {
+            throw std::runtime_error("Cannot open trajectory file for writing: " + path);
+        }
+        unsigned char header[trajectory_header_bytes] = {};
+        std::uint32_t precision_bytes = static_cast<std::uint32_t>(precision);
+        std::uint32_t flags = velocities ? 1u : 0u;
+        std::uint64_t bodies = num_bodies;
+        std::memcpy(header, trajectory_magic, 8);
+        std::memcpy(header + 8, &precision_bytes, 4);
+        std::memcpy(header + 12, &flags, 4);
+        std::memcpy(header + 16, &bodies, 8);
+        if (std::fwrite(header, 1, trajectory_header_bytes, file_) != trajectory_header_bytes) {
+            std::fclose(file_);
+            throw std::runtime_error("Cannot write trajectory header: " + path);
+        }
+        buffers_[0].resize(frame_bytes_);
+        buffers_[1].resize(frame_bytes_);
+        thread_ = std::thread(&TrajectoryWriter::writerLoop, this);
+    }
+
+TrajectoryWriter::~TrajectoryWriter() {
+    try {
+        close();
+    }
+    catch (const std::exception&) {
+        // Nothing can be reported from a destructor, call close() to see write errors
+    }
+}
+
+// Queue a snapshot of the particle system
+void TrajectoryWriter::write(const ParticleSystem& particle_system, std::uint64_t step, double time) {
+    NBODY_PROFILE_SCOPE(Output);
+    if (particle_system.size() != num_bodies_) {
+        throw std::invalid_argument("Trajectory frame has a different number of bodies than the file");
+    }
+
+    // Wait for the thread to finish with the buffer, only if the disk has fallen behind
+    auto start_time = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    buffer_free_.wait(lock, [&]() { return !full_[next_buffer_] || error_ || !thread_.joinable(); });
+    std::chrono::duration<double> waited = std::chrono::steady_clock::now() - start_time;
+    wait_seconds_ += waited.count();
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+    if (!thread_.joinable()) {
+        throw std::runtime_error("Trajectory writer is closed");
+    }
+    const int b = next_buffer_;
+    lock.unlock();
+
+    // The thread does not touch a free buffer, so it is filled without the lock
+    unsigned char* buffer = buffers_[b].data();
+    std::memcpy(buffer, &step, 8);
+    std::memcpy(buffer + 8, &time, 8);
+    unsigned char* block = buffer + frame_header_bytes;
+    const std::size_t block_bytes = num_bodies_ * static_cast<std::size_t>(precision_);
+    const double* components[6] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                                   particle_system.vx(), particle_system.vy(), particle_system.vz()};
+
+    // Bodies reordered in memory are written back in the order of their ids
+    const std::size_t* ids = reorderedIds(particle_system);
+    for (int c = 0; c < (velocities_ ? 6 : 3); ++c) {
+        storeBlock(block + c * block_bytes, components[c], ids, num_bodies_, precision_);
+    }
+
+    lock.lock();
+    full_[b] = true;
+    next_buffer_ = 1 - b;
+    ++frames_written_;
+    buffer_full_.notify_one();
+    NBODY_PROFILE_COUNT(Output, 0.0, 0.0, (velocities_ ? 6.0 : 3.0) * num_bodies_ * (sizeof(double) + static_cast<std::size_t>(precision_)));
+}
+
+// Background thread, writes the buffers in the order they were filled
+void TrajectoryWriter::writerLoop() {
+    int b = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        buffer_full_.wait(lock, [&]() { return full_[b] || closing_; });
+        if (!full_[b]) {
+            break;
+        }
+        lock.unlock();
+        bool written = std::fwrite(buffers_[b].data(), 1, frame_bytes_, file_) == frame_bytes_;
+        lock.lock();
+        if (!written && !error_) {
+            error_ = std::make_exception_ptr(std::runtime_error("Cannot write trajectory frame"));
+        }
+        full_[b] = false;
+        b = 1 - b;
+        buffer_free_.notify_all();
+    }
+}
+
+// Write the remaining frames and close the file
+void TrajectoryWriter::close() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closing_ = true;
+        }
+        buffer_full_.notify_one();
+        thread_.join();
+        buffer_free_.notify_all();
+    }
+    if (file_ != nullptr) {
+        if (std::fclose(file_) != 0 && !error_) {
+            error_ = std::make_exception_ptr(std::runtime_error("Cannot close trajectory file"));
+        }
+        file_ = nullptr;
+    }
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+// Accessor methods
+std::size_t TrajectoryWriter::getFramesWritten() const {
+    return frames_written_;
+}
+
+double TrajectoryWriter::getWaitSeconds() const {
+    return wait_seconds_;
+}
+
+// Map the file and check its header
+TrajectoryReader::TrajectoryReader(const std::string& path)
+    : fd_(-1), data_(nullptr), size_(0), num_bodies_(0), precision_(TrajectoryPrecision::Float64),
+      velocities_(false), frame_bytes_(0), num_frames_(0)
+    {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            throw std::runtime_error("Cannot open trajectory file: " + path);
+        }
+        struct stat status;
+        if (fstat(fd_, &status) != 0 || static_cast<std::size_t>(status.st_size) < trajectory_header_bytes) {
+            ::close(fd_);
+            throw std::runtime_error("Not a trajectory file: " + path);
+        }
+        size_ = static_cast<std::size_t>(status.st_size);
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("Cannot map trajectory file: " + path);
+        }
+        data_ = static_cast<const unsigned char*>(mapping);
+
+        std::uint32_t precision_bytes, flags;
+        std::uint64_t bodies;
+        std::memcpy(&precision_bytes, data_ + 8, 4);
+        std::memcpy(&flags, data_ + 12, 4);
+        std::memcpy(&bodies, data_ + 16, 8);
+        if (std::memcmp(data_, trajectory_magic, 8) != 0 || (precision_bytes != 4 && precision_bytes != 8)) {
+            munmap(const_cast<unsigned char*>(data_), size_);
+            ::close(fd_);
+            throw std::runtime_error("Not a trajectory file: " + path);
+        }
+        num_bodies_ = bodies;
+        precision_ = static_cast<TrajectoryPrecision>(precision_bytes);
+        velocities_ = (flags & 1u) != 0;
+        frame_bytes_ = trajectoryFrameBytes(num_bodies_, precision_, velocities_);
+
+        // A partly written last frame is left out
+        num_frames_ = (size_ - trajectory_header_bytes) / frame_bytes_;
+    }
+
+TrajectoryReader::~TrajectoryReader() {
+    munmap(const_cast<unsigned char*>(data_), size_);
+    ::close(fd_);
+}
+
+// Accessor methods
+std::size_t TrajectoryReader::numBodies() const {
+    return num_bodies_;
+}
+
+std::size_t TrajectoryReader::numFrames() const {
+    return num_frames_;
+}
+
+TrajectoryPrecision TrajectoryReader::getPrecision() const {
+    return precision_;
+}
+
+bool TrajectoryReader::hasVelocities() const {
+    return velocities_;
+}
+
+const unsigned char* TrajectoryReader::frame(std::size_t frame) const {
+    if (frame >= num_frames_) {
+        throw std::out_of_range("Trajectory frame out of range");
+    }
+    return data_ + trajectory_header_bytes + frame * frame_bytes_;
+}
+
+// Step and time of a frame
+std::uint64_t TrajectoryReader::step(std::size_t frame) const {
+    std::uint64_t step;
+    std::memcpy(&step, this->frame(frame), 8);
+    return step;
+}
+
+double TrajectoryReader::time(std::size_t frame) const {
+    double time;
+    std::memcpy(&time, this->frame(frame) + 8, 8);
+    return time;
+}
+
+// Start of one component block of a frame
+const void* TrajectoryReader::component(std::size_t frame, int c) const {
+    if (c < 0 || c >= (velocities_ ? 6 : 3)) {
+        throw std::out_of_range("Trajectory component out of range");
+    }
+    return this->frame(frame) + frame_header_bytes + c * num_bodies_ * static_cast<std::size_t>(precision_);
+}
+
+// Copy a frame into a particle system
+void TrajectoryReader::readFrame(std::size_t frame, ParticleSystem& particle_system) const {
+    if (particle_system.size() != num_bodies_) {
+        throw std::invalid_argument("Particle system has a different number of bodies than the trajectory");
+    }
+    double* components[6] = {particle_system.x(), particle_system.y(), particle_system.z(),
+                             particle_system.vx(), particle_system.vy(), particle_system.vz()};
+    // Bodies reordered in memory are read from the positions of their ids
+    const std::size_t* ids = reorderedIds(particle_system);
+    for (int c = 0; c < (velocities_ ? 6 : 3); ++c) {
+        loadBlock(components[c], static_cast<const unsigned char*>(component(frame, c)), ids, num_bodies_, precision_);
+    }
+}
+}
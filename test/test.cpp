@@ -2,9 +2,40 @@
 #include <catch2/catch_approx.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include "systemSimulator.hpp"
+#include "simdKernel.hpp"
+#include "symmetricKernel.hpp"
+#include "tiledKernel.hpp"
+#include "mixedKernel.hpp"
+#include "forceEngine.hpp"
+#include "integrator.hpp"
+#include "fixedSystem.hpp"
+#include "ensemble.hpp"
+#include "jerkKernel.hpp"
+#include "energyDiagnostics.hpp"
+#include "persistentStepper.hpp"
+#include "taskPool.hpp"
+#include "trajectory.hpp"
+#include "checkpoint.hpp"
+#include "fileSystemGenerator.hpp"
+#include "philoxGenerator.hpp"
+#include "profiler.hpp"
+#include "scalingStudy.hpp"
+#include "spatialSort.hpp"
+#include "commandLine.hpp"
 #include <Eigen/Dense>
 #include <vector>
+#include <atomic>
 #include <iostream>
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <omp.h>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <random>
 
 using Catch::Matchers::WithinRel;
 using Eigen::Vector3d;
@@ -143,6 +174,174 @@ TEST_CASE("Zero acceleration with equal particles on either side", "[acceleratio
     }
 }
 
+TEST_CASE("Vectorised kernel matches gravitational force between two particles", "[acceleration]") {
+
+    // Set initial conditions, same as the two particle case above
+    n_body::ParticleSystem particle_system;
+    particle_system.addParticle(Vector3d(0, 0, 0), Vector3d::Zero(), 0.1);
+    particle_system.addParticle(Vector3d(1, 0, 0), Vector3d::Zero(), 0.1);
+
+    // Check every SIMD path the CPU supports
+    for (n_body::SimdPath path : {n_body::SimdPath::Scalar, n_body::SimdPath::AVX2, n_body::SimdPath::AVX512}) {
+        n_body::simdSumAcceleration(particle_system, 0.0, path);
+        REQUIRE(particle_system.getAcceleration(0).isApprox(Vector3d(0.1, 0, 0), n_body::simd_kernel_tolerance));
+        REQUIRE(particle_system.getAcceleration(1).isApprox(Vector3d(-0.1, 0, 0), n_body::simd_kernel_tolerance));
+    }
+}
+
+TEST_CASE("Vectorised kernel gives no acceleration for coincident particles", "[acceleration]") {
+
+    // Set initial conditions, same as the self interaction case above
+    n_body::ParticleSystem particle_system;
+    particle_system.addParticle(Vector3d(1, 0, 0), Vector3d::Zero(), 1.0);
+    particle_system.addParticle(Vector3d(1, 0, 0), Vector3d::Zero(), 1.0);
+
+    for (n_body::SimdPath path : {n_body::SimdPath::Scalar, n_body::SimdPath::AVX2, n_body::SimdPath::AVX512}) {
+        n_body::simdSumAcceleration(particle_system, 1.0, path);
+        REQUIRE(particle_system.getAcceleration(0).norm() == 0.0);
+        REQUIRE(particle_system.getAcceleration(1).norm() == 0.0);
+    }
+}
+
+TEST_CASE("Vectorised kernel matches calcAcceleration within the documented tolerance", "[acceleration]") {
+
+    // Set initial conditions, 37 bodies so the vector loops also have a scalar tail
+    int num_particles = 36;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    for (double epsilon : {0.0, 0.01}) {
+
+        // Calculate the expected acceleration with the existing kernel
+        std::vector<Vector3d> expected_acceleration;
+        for (n_body::particleAcceleration& p_i : particle_list) {
+            Vector3d sum_acceleration = Vector3d::Zero();
+            for (n_body::particleAcceleration& p_j : particle_list) {
+                if (&p_i != &p_j) {
+                    sum_acceleration += n_body::particleAcceleration::calcAcceleration(&p_i, &p_j, epsilon);
+                }
+            }
+            expected_acceleration.push_back(sum_acceleration);
+        }
+
+        for (n_body::SimdPath path : {n_body::SimdPath::Scalar, n_body::SimdPath::AVX2, n_body::SimdPath::AVX512}) {
+            n_body::simdSumAcceleration(particle_system, epsilon, path);
+            for (std::size_t i = 0; i < particle_list.size(); ++i) {
+                REQUIRE(particle_system.getAcceleration(i).isApprox(expected_acceleration[i], n_body::simd_kernel_tolerance));
+            }
+        }
+    }
+}
+
+TEST_CASE("Symmetric pairwise kernel matches direct summation and conserves momentum", "[acceleration]") {
+
+    // Set initial conditions, an odd number of bodies so the blocks have different sizes
+    int num_particles = 101;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::ParticleSystem reference = particle_system;
+
+    for (double epsilon : {0.0, 0.01}) {
+        reference.sumAcceleration(epsilon);
+        n_body::symmetricSumAcceleration(particle_system, epsilon);
+
+        // Each pair is applied with opposite signs, so the net force vanishes
+        Vector3d net_force = Vector3d::Zero();
+        for (std::size_t i = 0; i < particle_system.size(); ++i) {
+            REQUIRE(particle_system.getAcceleration(i).isApprox(reference.getAcceleration(i), 1e-12));
+            net_force += particle_system.getMass(i) * particle_system.getAcceleration(i);
+        }
+        REQUIRE(net_force.norm() < 1e-12);
+    }
+}
+
+TEST_CASE("Tiled kernel matches direct summation for any tile size", "[acceleration]") {
+
+    // Set initial conditions, tile sizes that do and do not divide the number of bodies
+    int num_particles = 100;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::ParticleSystem reference = particle_system;
+    REQUIRE(n_body::detectTileSize() % 8 == 0);
+
+    for (double epsilon : {0.0, 0.01}) {
+        reference.sumAcceleration(epsilon);
+        for (std::size_t tile_size : {0, 1, 8, 33, 100, 1000}) {
+            n_body::tiledSumAcceleration(particle_system, epsilon, tile_size);
+            for (std::size_t i = 0; i < particle_system.size(); ++i) {
+                REQUIRE(particle_system.getAcceleration(i).isApprox(reference.getAcceleration(i), 1e-12));
+            }
+        }
+    }
+}
+
+TEST_CASE("Force kernels accumulate the softened potential in the force pass", "[acceleration]") {
+
+    // Set initial conditions
+    int num_particles = 101;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    // Zero opening angle makes Barnes-Hut and the fast multipole method exact
+    for (double epsilon : {0.0, 0.01}) {
+        std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_system, epsilon);
+        for (n_body::ForceKernel kernel : {n_body::ForceKernel::Direct, n_body::ForceKernel::Simd, n_body::ForceKernel::Symmetric,
+                                           n_body::ForceKernel::Tiled, n_body::ForceKernel::BarnesHut, n_body::ForceKernel::Fmm}) {
+            n_body::ForceEngine force_engine(kernel, epsilon);
+            force_engine.setOpeningAngle(0.0);
+            force_engine.setComputePotential(true);
+            force_engine.computeAcceleration(particle_system);
+
+            std::vector<double> potential_energy_list_stored = simulator.potentialEnergyStored(particle_system);
+            for (std::size_t i = 0; i < particle_system.size(); ++i) {
+                REQUIRE(potential_energy_list_stored[i] == Approx(potential_energy_list[i]).epsilon(1e-10));
+            }
+        }
+    }
+
+    // Every SIMD path leaves the target out of its own sweep, so a tiny softening costs no digits of the potential
+    for (double epsilon : {1e-6, 1e-9}) {
+        std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_system, epsilon);
+        for (n_body::SimdPath path : {n_body::SimdPath::Scalar, n_body::SimdPath::AVX2, n_body::SimdPath::AVX512}) {
+            n_body::simdSumAcceleration(particle_system, epsilon, path, true);
+            std::vector<double> potential_energy_list_stored = simulator.potentialEnergyStored(particle_system);
+            for (std::size_t i = 0; i < particle_system.size(); ++i) {
+                REQUIRE(potential_energy_list_stored[i] == Approx(potential_energy_list[i]).epsilon(1e-12));
+            }
+        }
+    }
+
+    // The tiled sweep leaves each target out instead of cancelling its -m_i / epsilon, which keeps every digit at tiny softening
+    std::vector<double> potential_energy_list_tiny = simulator.potentialEnergy(particle_system, 1e-9);
+    n_body::ForceEngine tiled_engine(n_body::ForceKernel::Tiled, 1e-9);
+    tiled_engine.setTileSize(32);
+    tiled_engine.setComputePotential(true);
+    tiled_engine.computeAcceleration(particle_system);
+    std::vector<double> potential_energy_list_tiled = simulator.potentialEnergyStored(particle_system);
+    for (std::size_t i = 0; i < potential_energy_list_tiny.size(); ++i) {
+        REQUIRE(potential_energy_list_tiled[i] == Approx(potential_energy_list_tiny[i]).epsilon(1e-13));
+    }
+
+    // After a leapfrog step the potentials of its force pass are already current
+    n_body::ForceEngine force_engine(n_body::ForceKernel::Simd, 0.01);
+    force_engine.setComputePotential(true);
+    n_body::Integrator integrator(n_body::IntegratorScheme::Leapfrog);
+    integrator.step(particle_system, force_engine, 0.001);
+    long force_evaluations = integrator.getForceEvaluations();
+    REQUIRE(integrator.synchronise(particle_system, force_engine));
+    REQUIRE(integrator.getForceEvaluations() == force_evaluations);
+    std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_system, 0.01);
+    std::vector<double> potential_energy_list_stored = simulator.potentialEnergyStored(particle_system);
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        REQUIRE(potential_energy_list_stored[i] == Approx(potential_energy_list[i]).epsilon(1e-10));
+    }
+}
+
 TEST_CASE("Solar System particles list Generator", "[generator]"){
 
     // Create a simulator with a Solar System generator
@@ -170,6 +369,68 @@ TEST_CASE("Solar System particles list Generator", "[generator]"){
     }
 }
 
+TEST_CASE("Mixed-precision kernel stays within its tolerance and drifts like the double loop", "[acceleration]") {
+
+    // Set initial conditions, a size that leaves tails after the vector sweeps
+    int num_particles = 300;
+    int seed = 42;
+    double epsilon = 0.01;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem initial_system = simulator.particleSystemGenerator();
+    n_body::ParticleSystem particle_system = initial_system;
+    n_body::ParticleSystem reference = initial_system;
+    const int num_bodies = static_cast<int>(initial_system.size());
+
+    // The double instantiation is the tiled loop up to rounding
+    reference.sumAcceleration(epsilon);
+    n_body::precisionSumAcceleration<double>(particle_system, epsilon, 64);
+    for (int i = 0; i < num_bodies; ++i) {
+        REQUIRE(particle_system.getAcceleration(i).isApprox(reference.getAcceleration(i), 1e-12));
+    }
+
+    // Float pair terms, also far from the origin where the positions themselves have few float digits
+    for (double offset : {0.0, 1e4}) {
+        for (int i = 0; i < num_bodies; ++i) {
+            particle_system.uploadPosition(i, initial_system.getPosition(i) + Vector3d::Constant(offset));
+        }
+        n_body::ForceEngine force_engine(n_body::ForceKernel::Mixed, epsilon);
+        force_engine.setComputePotential(true);
+        force_engine.computeAcceleration(particle_system);
+        n_body::ForceError error = n_body::sampleForceError(particle_system, epsilon, num_bodies);
+        REQUIRE(error.max_relative < n_body::mixed_kernel_tolerance);
+        REQUIRE(error.mean_relative < 1e-5);
+
+        std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_system, epsilon);
+        std::vector<double> potential_energy_list_stored = simulator.potentialEnergyStored(particle_system);
+        for (int i = 0; i < num_bodies; ++i) {
+            REQUIRE(potential_energy_list_stored[i] == Approx(potential_energy_list[i]).epsilon(n_body::mixed_kernel_tolerance));
+        }
+    }
+
+    // The total energy drifts by as little over leapfrog steps with float pair terms as with double ones
+    auto energyDrift = [&](n_body::ForceKernel kernel) {
+        particle_system = initial_system;
+        n_body::ForceEngine force_engine(kernel, epsilon);
+        n_body::Integrator integrator(n_body::IntegratorScheme::Leapfrog);
+        simulator.kineticEnergy(particle_system);
+        simulator.potentialEnergy(particle_system, epsilon);
+        simulator.totalEnergy();
+        double initial_energy = simulator.sumTotalEnergy();
+        for (int step = 0; step < 50; ++step) {
+            integrator.step(particle_system, force_engine, 0.001);
+        }
+        simulator.kineticEnergy(particle_system);
+        simulator.potentialEnergy(particle_system, epsilon);
+        simulator.totalEnergy();
+        return std::abs(simulator.sumTotalEnergy() - initial_energy) / std::abs(initial_energy);
+    };
+    double double_drift = energyDrift(n_body::ForceKernel::Tiled);
+    double mixed_drift = energyDrift(n_body::ForceKernel::Mixed);
+    REQUIRE(mixed_drift < 1e-6);
+    REQUIRE(mixed_drift < 10 * double_drift + 1e-8);
+    REQUIRE(n_body::parseForceKernel("mixed") == n_body::ForceKernel::Mixed);
+}
+
 TEST_CASE("Testing total energy calculation with OpenMP parallelization", "[parallelization]") {
 
     // Set initial conditions
@@ -211,4 +472,1202 @@ TEST_CASE("Testing kinetic and potential energy calculation with OpenMP parallel
         REQUIRE(potential_energy_list_final[i] == Approx(potential_energy_list_final_para[i]));
         REQUIRE(kinetic_energy_list_final[i] == Approx(kinetic_energy_list_final_para[i]));
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Energy diagnostics match the simulator energies and reuse their buffers", "[parallelization]") {
+
+    // Set initial conditions, enough bodies for the parallel loops to start
+    int num_particles = 500;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    // Calculate energy values with the simulator and the diagnostics
+    std::vector<double> kinetic_energy_list = simulator.kineticEnergy(particle_system);
+    std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_system, 0.01);
+    std::vector<double> potential_energy_list_para = simulator.potentialEnergyPara(particle_system, 0.01);
+    simulator.totalEnergy();
+    double sum_total_energy = simulator.sumTotalEnergy();
+    n_body::EnergyDiagnostics energy;
+    energy.compute(particle_system, 0.01);
+
+    for (int i = 0; i < num_particles; ++i) {
+        REQUIRE(energy.kinetic()[i] == Approx(kinetic_energy_list[i]));
+        REQUIRE(energy.potential()[i] == Approx(potential_energy_list[i]));
+        REQUIRE(potential_energy_list_para[i] == Approx(potential_energy_list[i]));
+    }
+    REQUIRE(energy.totalEnergy() == Approx(sum_total_energy));
+    REQUIRE(simulator.sumTotalEnergyPara() == Approx(sum_total_energy));
+
+    // A second measurement of the same number of bodies writes into the same buffers
+    const double* kinetic = energy.kinetic().data();
+    const double* potential = energy.potential().data();
+    particle_system.kick(0.1);
+    energy.compute(particle_system, 0.01);
+    REQUIRE(energy.kinetic().data() == kinetic);
+    REQUIRE(energy.potential().data() == potential);
+}
+
+TEST_CASE("Particle system stores the same bodies as the particle list", "[particlesystem]") {
+
+    // Set initial conditions
+    int num_particles = 8;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    // Check every component array is aligned to a cache line
+    REQUIRE(reinterpret_cast<std::uintptr_t>(particle_system.x()) % 64 == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(particle_system.mass()) % 64 == 0);
+
+    // Check if the bodies match, in the same order
+    REQUIRE(particle_system.size() == particle_list.size());
+    for (std::size_t i = 0; i < particle_list.size(); ++i) {
+        REQUIRE(particle_system.getPosition(i) == particle_list[i].getPosition());
+        REQUIRE(particle_system.getVelocity(i) == particle_list[i].getVelocity());
+        REQUIRE(particle_system.getMass(i) == particle_list[i].getMass());
+    }
+}
+
+TEST_CASE("Particle system acceleration and update match the particle list", "[particlesystem]") {
+
+    // Set initial conditions
+    int num_particles = 16;
+    int seed = 42;
+    double epsilon = 0.01;
+    double dt = 0.01;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    std::vector<n_body::particleAcceleration> particle_list = simulator.particleListGenerator();
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    std::vector<n_body::particleAcceleration*> particle_ptr_list;
+    for (auto& p : particle_list) {
+        particle_ptr_list.push_back(&p);
+    }
+
+    // Perform a few simulation steps with both layouts
+    for (int timestep = 0; timestep < 10; ++timestep) {
+        for (n_body::particleAcceleration* p_i : particle_ptr_list) {
+            p_i->sumAcceleration(particle_ptr_list, epsilon);
+        }
+        for (n_body::particleAcceleration* p_i : particle_ptr_list) {
+            p_i->update(dt);
+        }
+        particle_system.sumAcceleration(epsilon);
+        particle_system.update(dt);
+    }
+
+    // Check if the states match
+    for (std::size_t i = 0; i < particle_list.size(); ++i) {
+        REQUIRE(particle_system.getPosition(i).isApprox(particle_list[i].getPosition(), 1e-12));
+        REQUIRE(particle_system.getVelocity(i).isApprox(particle_list[i].getVelocity(), 1e-12));
+    }
+
+    // Check if the energies match
+    std::vector<double> kinetic_energy_list = simulator.kineticEnergy(particle_list);
+    std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_list);
+    std::vector<double> kinetic_energy_list_soa = simulator.kineticEnergy(particle_system);
+    std::vector<double> potential_energy_list_soa = simulator.potentialEnergy(particle_system);
+    for (std::size_t i = 0; i < particle_list.size(); ++i) {
+        REQUIRE(kinetic_energy_list[i] == Approx(kinetic_energy_list_soa[i]));
+        REQUIRE(potential_energy_list[i] == Approx(potential_energy_list_soa[i]));
+    }
+}
+
+TEST_CASE("Simulator shares one system view in linear memory", "[particlesystem]") {
+
+    // Set initial conditions
+    int seed = 42;
+    double epsilon = 0.01;
+    n_body::sysSimulator small_simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, 500));
+    n_body::sysSimulator large_simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, 1000));
+    std::vector<n_body::particleAcceleration> particle_list = large_simulator.particleListGenerator();
+    n_body::ParticleSystem particle_system = large_simulator.particleSystemGenerator();
+
+    // The list is only made when asked for, so both simulators hold one
+    small_simulator.particleListGenerator();
+
+    // No particle holds pointers to the others, and twice the bodies take about twice the memory
+    for (const n_body::particleAcceleration& particle : particle_list) {
+        REQUIRE(particle.getParticle().empty());
+    }
+    REQUIRE(large_simulator.memoryUsage() < 2.1 * small_simulator.memoryUsage());
+
+    // Summing over the shared list gives the same accelerations as the particle system
+    particle_system.sumAcceleration(epsilon);
+    for (std::size_t i = 0; i < particle_list.size(); ++i) {
+        particle_list[i].sumAcceleration(particle_list, epsilon);
+        REQUIRE(particle_list[i].getAcceleration().isApprox(particle_system.getAcceleration(i), 1e-12));
+    }
+}
+
+TEST_CASE("Work-stealing pool runs every iteration exactly once", "[taskpool]") {
+
+    // More threads than cores, so threads are descheduled in the middle of their deques
+    n_body::TaskPool task_pool(4);
+    REQUIRE(task_pool.numThreads() == 4);
+    const long n = 10007;
+
+    for (long grain : {1, 7, 64, 100000}) {
+        std::vector<std::atomic<int>> visits(n);
+        std::atomic<long> longest_task(0);
+        task_pool.resetStatistics();
+        task_pool.parallelFor(n, grain, [&](long begin, long end) {
+            long length = longest_task.load();
+            while (end - begin > length && !longest_task.compare_exchange_weak(length, end - begin)) {}
+            for (long i = begin; i < end; ++i) {
+                visits[i].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        REQUIRE(longest_task.load() <= grain);
+        for (long i = 0; i < n; ++i) {
+            REQUIRE(visits[i].load() == 1);
+        }
+        n_body::TaskPoolStatistics statistics = task_pool.statistics();
+        REQUIRE(statistics.tasks >= (n + grain - 1) / grain);
+        REQUIRE(statistics.steals >= 0);
+    }
+}
+
+TEST_CASE("Work stealing gives the same forces and energies as OpenMP scheduling", "[taskpool]") {
+
+    // Set initial conditions
+    int num_particles = 1000;
+    int seed = 42;
+    double epsilon = 0.01;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::ParticleSystem reference = particle_system;
+
+    // Each body is still summed by one thread in the same order, so the results are identical
+    for (n_body::ForceKernel kernel : {n_body::ForceKernel::Direct, n_body::ForceKernel::BarnesHut}) {
+        n_body::ForceEngine force_engine(kernel, epsilon);
+        force_engine.computeAcceleration(reference);
+        force_engine.setWorkStealing(true);
+        REQUIRE(force_engine.getTaskPool() != nullptr);
+        force_engine.computeAcceleration(particle_system);
+        for (int i = 0; i < num_particles; ++i) {
+            REQUIRE(particle_system.getAcceleration(i) == reference.getAcceleration(i));
+        }
+    }
+
+    n_body::EnergyDiagnostics energy, energy_stealing;
+    energy_stealing.setTaskPool(std::make_shared<n_body::TaskPool>(4));
+    energy.computePotential(particle_system, epsilon);
+    energy_stealing.computePotential(particle_system, epsilon);
+    for (int i = 0; i < num_particles; ++i) {
+        REQUIRE(energy_stealing.potential()[i] == energy.potential()[i]);
+    }
+}
+
+TEST_CASE("Octree covers every body exactly once and conserves mass", "[barneshut]") {
+
+    // Set initial conditions
+    int num_particles = 2000;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    n_body::Octree tree(8);
+    tree.build(particle_system);
+    const std::vector<n_body::OctreeNode>& nodes = tree.nodes();
+
+    // Check the leaves partition the sorted bodies and hold at most leaf_size of them
+    std::vector<int> count(particle_system.size(), 0);
+    double total_mass = 0.0;
+    for (const n_body::OctreeNode& node : nodes) {
+        if (node.first_child < 0) {
+            REQUIRE(node.end - node.begin <= tree.getLeafSize());
+            for (int k = node.begin; k < node.end; ++k) {
+                ++count[tree.order()[k]];
+            }
+        }
+        total_mass += (node.level == 0) ? node.mass : 0.0;
+    }
+    for (int c : count) {
+        REQUIRE(c == 1);
+    }
+
+    double expected_mass = 0.0;
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        expected_mass += particle_system.getMass(i);
+    }
+    REQUIRE(total_mass == Approx(expected_mass));
+}
+
+TEST_CASE("Barnes-Hut with zero opening angle matches direct summation", "[barneshut]") {
+
+    // Set initial conditions
+    int num_particles = 300;
+    int seed = 42;
+    double epsilon = 0.001;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::ParticleSystem reference = particle_system;
+
+    n_body::BarnesHutSolver solver(0.0);
+    solver.computeAcceleration(particle_system, epsilon);
+    reference.sumAcceleration(epsilon);
+
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        REQUIRE(particle_system.getAcceleration(i).isApprox(reference.getAcceleration(i), 1e-10));
+    }
+}
+
+TEST_CASE("Barnes-Hut force error decreases with the opening angle", "[barneshut]") {
+
+    // Set initial conditions
+    int num_particles = 2000;
+    int seed = 42;
+    double epsilon = 0.001;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    n_body::ForceEngine force_engine(n_body::ForceKernel::BarnesHut, epsilon);
+    force_engine.setOpeningAngle(0.8);
+    force_engine.computeAcceleration(particle_system);
+    n_body::ForceError coarse_error = n_body::sampleForceError(particle_system, epsilon, 200);
+
+    force_engine.setOpeningAngle(0.3);
+    force_engine.computeAcceleration(particle_system);
+    n_body::ForceError fine_error = n_body::sampleForceError(particle_system, epsilon, 200);
+
+    REQUIRE(fine_error.num_samples == 200);
+    REQUIRE(fine_error.mean_relative < coarse_error.mean_relative);
+    REQUIRE(fine_error.max_relative < 1e-2);
+}
+
+TEST_CASE("Fast multipole accelerations and potentials match direct summation", "[fmm]") {
+
+    // Set initial conditions
+    int num_particles = 1000;
+    int seed = 42;
+    double epsilon = 0.001;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::ParticleSystem reference = particle_system;
+    reference.sumAcceleration(epsilon);
+
+    // Expected potential by direct summation with the same softening
+    std::vector<double> expected_potential(particle_system.size(), 0.0);
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        for (std::size_t j = 0; j < particle_system.size(); ++j) {
+            if (i != j) {
+                double r2 = (particle_system.getPosition(i) - particle_system.getPosition(j)).squaredNorm();
+                expected_potential[i] -= particle_system.getMass(j) / std::sqrt(r2 + epsilon * epsilon);
+            }
+        }
+    }
+
+    // Check that a higher expansion order is more accurate, and order 6 is close to direct summation
+    double previous_error = 1.0;
+    for (int order : {2, 4, 6}) {
+        n_body::FmmSolver fmm_solver(order, 0.5);
+        fmm_solver.computeAcceleration(particle_system, epsilon);
+
+        double mean_force_error = 0.0, max_potential_error = 0.0;
+        for (std::size_t i = 0; i < particle_system.size(); ++i) {
+            Vector3d exact = reference.getAcceleration(i);
+            mean_force_error += (particle_system.getAcceleration(i) - exact).norm() / exact.norm() / particle_system.size();
+            max_potential_error = std::max(max_potential_error, std::abs(fmm_solver.potential()[i] / expected_potential[i] - 1.0));
+        }
+        REQUIRE(mean_force_error < previous_error);
+        previous_error = mean_force_error;
+
+        if (order == 6) {
+            REQUIRE(mean_force_error < 1e-4);
+            REQUIRE(max_potential_error < 1e-3);
+        }
+    }
+}
+
+TEST_CASE("Fast multipole with zero opening angle is exact", "[fmm]") {
+
+    // Set initial conditions
+    int num_particles = 200;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::ParticleSystem reference = particle_system;
+
+    n_body::FmmSolver fmm_solver(4, 0.0);
+    fmm_solver.computeAcceleration(particle_system, 0.01);
+    reference.sumAcceleration(0.01);
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        REQUIRE(particle_system.getAcceleration(i).isApprox(reference.getAcceleration(i), 1e-10));
+    }
+}
+
+TEST_CASE("Fast multipole potential energy matches the direct double loop", "[fmm]") {
+
+    // Set initial conditions
+    int num_particles = 500;
+    int seed = 42;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    n_body::FmmSolver fmm_solver(6, 0.5);
+    std::vector<double> potential_energy_list = simulator.potentialEnergy(particle_system);
+    std::vector<double> potential_energy_list_fmm = simulator.potentialEnergyFmm(particle_system, fmm_solver);
+
+    double sum_potential = 0.0, sum_potential_fmm = 0.0;
+    for (std::size_t i = 0; i < potential_energy_list.size(); ++i) {
+        REQUIRE(potential_energy_list_fmm[i] == Approx(potential_energy_list[i]).epsilon(1e-5));
+        sum_potential += potential_energy_list[i];
+        sum_potential_fmm += potential_energy_list_fmm[i];
+    }
+    REQUIRE(sum_potential_fmm == Approx(sum_potential).epsilon(1e-7));
+}
+
+TEST_CASE("Symplectic integrators conserve the energy of the Solar System", "[integrator]") {
+
+    // Set initial conditions, 10 years with a timestep 10 times larger than the Euler runs in the README
+    double dt = 0.1;
+    int num_timesteps = static_cast<int>(10 * 2 * M_PI / dt);
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::SolarSystemGenerator>());
+    n_body::ForceEngine force_engine;
+
+    auto energyDrift = [&](n_body::IntegratorScheme scheme) {
+        n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+        simulator.kineticEnergy(particle_system);
+        simulator.potentialEnergy(particle_system);
+        simulator.totalEnergy();
+        double initial_energy = simulator.sumTotalEnergy();
+
+        n_body::Integrator integrator(scheme);
+        for (int timestep = 0; timestep < num_timesteps; ++timestep) {
+            integrator.step(particle_system, force_engine, dt);
+        }
+
+        simulator.kineticEnergy(particle_system);
+        simulator.potentialEnergy(particle_system);
+        simulator.totalEnergy();
+        return std::abs(simulator.sumTotalEnergy() / initial_energy - 1.0);
+    };
+
+    double euler_drift = energyDrift(n_body::IntegratorScheme::Euler);
+    double leapfrog_drift = energyDrift(n_body::IntegratorScheme::Leapfrog);
+    double verlet_drift = energyDrift(n_body::IntegratorScheme::VelocityVerlet);
+    double yoshida_drift = energyDrift(n_body::IntegratorScheme::Yoshida4);
+
+    REQUIRE(euler_drift > 1e-2);
+    REQUIRE(leapfrog_drift < 1e-5);
+    REQUIRE(verlet_drift == Catch::Approx(leapfrog_drift).epsilon(1e-3));
+    REQUIRE(yoshida_drift < leapfrog_drift);
+}
+
+TEST_CASE("Fixed-size engine follows the integrator on the Solar System", "[integrator]") {
+
+    // Set initial conditions, one year of steps
+    double dt = 0.01;
+    int num_timesteps = static_cast<int>(2 * M_PI / dt);
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::SolarSystemGenerator>());
+    n_body::ForceEngine force_engine;
+
+    for (n_body::IntegratorScheme scheme : {n_body::IntegratorScheme::Euler, n_body::IntegratorScheme::Leapfrog,
+                                            n_body::IntegratorScheme::VelocityVerlet, n_body::IntegratorScheme::Yoshida4}) {
+        n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+        n_body::SolarSystem solar_system(particle_system);
+        n_body::Integrator integrator(scheme);
+        for (int timestep = 0; timestep < num_timesteps; ++timestep) {
+            integrator.step(particle_system, force_engine, dt);
+        }
+        solar_system.run(scheme, dt, num_timesteps);
+
+        // Same trajectory up to the order of the pair sums, and as many force evaluations
+        n_body::ParticleSystem fixed_system = particle_system;
+        solar_system.copyTo(fixed_system);
+        for (std::size_t i = 0; i < n_body::num_solar_system_bodies; ++i) {
+            REQUIRE(fixed_system.getPosition(i).isApprox(particle_system.getPosition(i), 1e-10));
+            REQUIRE(fixed_system.getVelocity(i).isApprox(particle_system.getVelocity(i), 1e-10));
+        }
+        REQUIRE(solar_system.getForceEvaluations() == integrator.getForceEvaluations());
+
+        // Each pair counted once gives the energy of the per-body lists
+        simulator.kineticEnergy(particle_system);
+        simulator.potentialEnergy(particle_system);
+        simulator.totalEnergy();
+        REQUIRE(solar_system.totalEnergy() == Approx(simulator.sumTotalEnergy()).epsilon(1e-9));
+    }
+
+    // Softened accelerations match direct summation with the same epsilon
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::FixedSystem<n_body::num_solar_system_bodies, true> softened(particle_system, 0.01);
+    softened.computeAcceleration();
+    softened.copyTo(particle_system);
+    n_body::ParticleSystem reference = simulator.particleSystemGenerator();
+    reference.sumAcceleration(0.01);
+    for (std::size_t i = 0; i < n_body::num_solar_system_bodies; ++i) {
+        REQUIRE(particle_system.getAcceleration(i).isApprox(reference.getAcceleration(i), 1e-12));
+    }
+
+    REQUIRE_THROWS_AS(n_body::SolarSystem(particle_system, 0.01), std::invalid_argument);
+    REQUIRE_THROWS_AS((n_body::FixedSystem<8, false>(particle_system)), std::invalid_argument);
+    REQUIRE_THROWS_AS(softened.step(n_body::IntegratorScheme::Hermite, dt), std::invalid_argument);
+    REQUIRE(n_body::parseSolarSystemEngine("generic") == n_body::SolarSystemEngine::Generic);
+    REQUIRE_THROWS_AS(n_body::parseSolarSystemEngine("fixd"), std::invalid_argument);
+}
+
+TEST_CASE("Ensemble follows the integrator on every system", "[integrator]") {
+
+    // Solar Systems with different planet phases, a number that does not fill whole SIMD lanes
+    double dt = 0.01;
+    int num_timesteps = 100;
+    int num_systems = 11;
+    std::vector<n_body::ParticleSystem> systems;
+    for (int k = 0; k < num_systems; ++k) {
+        systems.emplace_back(n_body::SolarSystemGenerator(42 + k).generateInitialConditions());
+    }
+    REQUIRE_FALSE(systems[0].getPosition(1).isApprox(systems[1].getPosition(1), 1e-6));
+    REQUIRE(n_body::ParticleSystem(n_body::SolarSystemGenerator(43).generateInitialConditions()).getPosition(1) == systems[1].getPosition(1));
+
+    for (n_body::IntegratorScheme scheme : {n_body::IntegratorScheme::Euler, n_body::IntegratorScheme::Leapfrog,
+                                            n_body::IntegratorScheme::VelocityVerlet, n_body::IntegratorScheme::Yoshida4}) {
+        n_body::Ensemble ensemble(systems, 0.0);
+        ensemble.run(scheme, dt, num_timesteps / 2);
+        ensemble.run(scheme, dt, num_timesteps - num_timesteps / 2);
+        std::vector<double> energy = ensemble.totalEnergy();
+
+        // Same trajectory and force evaluations as each system on its own
+        n_body::ForceEngine force_engine;
+        for (int k = 0; k < num_systems; ++k) {
+            n_body::ParticleSystem particle_system = systems[k];
+            n_body::Integrator integrator(scheme);
+            for (int timestep = 0; timestep < num_timesteps; ++timestep) {
+                integrator.step(particle_system, force_engine, dt);
+            }
+            n_body::ParticleSystem ensemble_system = ensemble.getSystem(k);
+            for (std::size_t i = 0; i < particle_system.size(); ++i) {
+                REQUIRE(ensemble_system.getPosition(i).isApprox(particle_system.getPosition(i), 1e-10));
+                REQUIRE(ensemble_system.getVelocity(i).isApprox(particle_system.getVelocity(i), 1e-10));
+            }
+            REQUIRE(ensemble.getForceEvaluations() == integrator.getForceEvaluations());
+            REQUIRE(energy[k] == Approx(n_body::SolarSystem(ensemble_system).totalEnergy()).epsilon(1e-12));
+        }
+    }
+
+    // Softened random systems match a softened integrator run
+    std::vector<n_body::ParticleSystem> random_systems;
+    for (int k = 0; k < 3; ++k) {
+        random_systems.emplace_back(n_body::RandomSystemGenerator(7 + k, 16).generateInitialConditions());
+    }
+    n_body::Ensemble ensemble(random_systems, 0.01);
+    ensemble.run(n_body::IntegratorScheme::Leapfrog, dt, 20);
+    n_body::ForceEngine force_engine(n_body::ForceKernel::Direct, 0.01);
+    n_body::Integrator integrator(n_body::IntegratorScheme::Leapfrog);
+    for (int timestep = 0; timestep < 20; ++timestep) {
+        integrator.step(random_systems[2], force_engine, dt);
+    }
+    for (std::size_t i = 0; i < random_systems[2].size(); ++i) {
+        REQUIRE(ensemble.getSystem(2).getPosition(i).isApprox(random_systems[2].getPosition(i), 1e-10));
+    }
+
+    // Coincident bodies without softening contribute nothing, as in the simd kernel, instead of spreading NaN over the system
+    std::vector<n_body::ParticleSystem> coincident_systems = {systems[0], systems[1]};
+    coincident_systems[1].x()[2] = coincident_systems[1].x()[1];
+    coincident_systems[1].y()[2] = coincident_systems[1].y()[1];
+    coincident_systems[1].z()[2] = coincident_systems[1].z()[1];
+    n_body::Ensemble coincident(coincident_systems, 0.0);
+    coincident.run(n_body::IntegratorScheme::Euler, dt, 1);
+    n_body::ForceEngine unsoftened_engine(n_body::ForceKernel::Simd, 0.0);
+    n_body::Integrator coincident_integrator(n_body::IntegratorScheme::Euler);
+    coincident_integrator.step(coincident_systems[1], unsoftened_engine, dt);
+    REQUIRE(std::isfinite(coincident.totalEnergy()[1]));
+    for (std::size_t i = 0; i < coincident_systems[1].size(); ++i) {
+        REQUIRE(coincident.getSystem(1).getVelocity(i).allFinite());
+        REQUIRE(coincident.getSystem(1).getVelocity(i).isApprox(coincident_systems[1].getVelocity(i), 1e-10));
+    }
+
+    REQUIRE_THROWS_AS(n_body::Ensemble(std::vector<n_body::ParticleSystem>()), std::invalid_argument);
+    random_systems.push_back(systems[0]);
+    REQUIRE_THROWS_AS(n_body::Ensemble(random_systems), std::invalid_argument);
+    REQUIRE_THROWS_AS(ensemble.run(n_body::IntegratorScheme::Hermite, dt, 1), std::invalid_argument);
+}
+
+TEST_CASE("Integrators reuse accelerations between steps", "[integrator]") {
+
+    // Set initial conditions
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::SolarSystemGenerator>());
+    n_body::ForceEngine force_engine;
+
+    // One evaluation to start, then one per step for second order and three per step for fourth order
+    std::vector<std::pair<n_body::IntegratorScheme, long>> expected_evaluations = {
+        {n_body::IntegratorScheme::Euler, 100},
+        {n_body::IntegratorScheme::Leapfrog, 101},
+        {n_body::IntegratorScheme::VelocityVerlet, 101},
+        {n_body::IntegratorScheme::Yoshida4, 301}};
+    for (const auto& [scheme, evaluations] : expected_evaluations) {
+        n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+        n_body::Integrator integrator(scheme);
+        for (int timestep = 0; timestep < 100; ++timestep) {
+            integrator.step(particle_system, force_engine, 0.01);
+        }
+        REQUIRE(integrator.getForceEvaluations() == evaluations);
+        REQUIRE(n_body::parseIntegratorScheme(n_body::integratorSchemeName(scheme)) == scheme);
+    }
+}
+
+TEST_CASE("Persistent stepper follows the same trajectory as the integrator", "[integrator]") {
+
+    // Set initial conditions, enough bodies for a team of threads
+    int num_particles = 200;
+    int seed = 42;
+    double epsilon = 0.01;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ForceEngine force_engine(n_body::ForceKernel::Direct, epsilon);
+
+    for (n_body::IntegratorScheme scheme : {n_body::IntegratorScheme::Euler, n_body::IntegratorScheme::Leapfrog, n_body::IntegratorScheme::VelocityVerlet}) {
+        n_body::ParticleSystem reference = simulator.particleSystemGenerator();
+        n_body::ParticleSystem particle_system = reference;
+        n_body::Integrator integrator(scheme);
+        for (int timestep = 0; timestep < 20; ++timestep) {
+            integrator.step(reference, force_engine, 0.001);
+        }
+
+        // Runs of odd and even length end in either position buffer
+        n_body::PersistentStepper stepper(scheme, epsilon);
+        stepper.run(particle_system, 0.001, 7);
+        stepper.run(particle_system, 0.001, 13);
+        REQUIRE(stepper.getForceEvaluations() == integrator.getForceEvaluations());
+        for (int i = 0; i < num_particles; ++i) {
+            REQUIRE(particle_system.getPosition(i).isApprox(reference.getPosition(i), 1e-10));
+            REQUIRE(particle_system.getVelocity(i).isApprox(reference.getVelocity(i), 1e-10));
+        }
+    }
+    REQUIRE_THROWS_AS(n_body::PersistentStepper(n_body::IntegratorScheme::Hermite), std::invalid_argument);
+}
+
+TEST_CASE("Jerk kernel matches the time derivative of the acceleration", "[integrator]") {
+
+    // Set initial conditions
+    int num_particles = 32;
+    int seed = 42;
+    double epsilon = 0.01;
+    double h = 1e-5;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+
+    // Central difference of the accelerations after moving every body along its velocity
+    n_body::ParticleSystem forward = particle_system;
+    n_body::ParticleSystem backward = particle_system;
+    forward.drift(h);
+    backward.drift(-h);
+    forward.sumAcceleration(epsilon);
+    backward.sumAcceleration(epsilon);
+    particle_system.sumAcceleration(epsilon);
+
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        double acceleration[3], jerk[3];
+        n_body::sumAccelerationJerk(particle_system, i, epsilon, acceleration, jerk);
+        Vector3d expected_jerk = (forward.getAcceleration(i) - backward.getAcceleration(i)) / (2.0 * h);
+        REQUIRE(Vector3d(acceleration[0], acceleration[1], acceleration[2]).isApprox(particle_system.getAcceleration(i), 1e-12));
+        REQUIRE(Vector3d(jerk[0], jerk[1], jerk[2]).isApprox(expected_jerk, 1e-5));
+    }
+}
+
+TEST_CASE("Block timesteps spend fewer force evaluations on wide orbits", "[integrator]") {
+
+    // Set initial conditions, one year of a random system with radii from 0.4 to 30
+    int num_particles = 64;
+    int seed = 42;
+    double epsilon = 0.01;
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(seed, num_particles));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    simulator.kineticEnergy(particle_system);
+    simulator.potentialEnergy(particle_system);
+    simulator.totalEnergy();
+    double initial_energy = simulator.sumTotalEnergy();
+
+    n_body::BlockTimestepper block_timestepper(0.01);
+    double dt = 0.25;
+    for (int timestep = 0; timestep < 2 * M_PI / dt; ++timestep) {
+        block_timestepper.step(particle_system, epsilon, dt);
+    }
+
+    // Bodies spread over several levels
+    std::vector<long> level_counts = block_timestepper.levelCounts();
+    REQUIRE(std::count_if(level_counts.begin(), level_counts.end(), [](long count) { return count > 0; }) > 3);
+
+    // An order of magnitude fewer evaluations than one shared step of 0.001, the step of the innermost orbits
+    double shared_evaluations = (num_particles + 1) * 2 * M_PI / 0.001;
+    REQUIRE(block_timestepper.getBodyEvaluations() < shared_evaluations / 10);
+
+    // Energy is still conserved through the sumTotalEnergy path
+    simulator.kineticEnergy(particle_system);
+    simulator.potentialEnergy(particle_system);
+    simulator.totalEnergy();
+    REQUIRE(simulator.sumTotalEnergy() == Catch::Approx(initial_energy).epsilon(1e-4));
+}
+
+TEST_CASE("Hermite integrator converges at fourth order with one evaluation per step", "[integrator]") {
+
+    // Set initial conditions, 10 years of the Solar System
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::SolarSystemGenerator>());
+    n_body::ForceEngine force_engine;
+
+    auto energyDrift = [&](double dt, n_body::IntegratorScheme scheme) {
+        n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+        simulator.kineticEnergy(particle_system);
+        simulator.potentialEnergy(particle_system);
+        simulator.totalEnergy();
+        double initial_energy = simulator.sumTotalEnergy();
+
+        n_body::Integrator integrator(scheme);
+        int num_timesteps = static_cast<int>(std::round(10 * 2 * M_PI / dt));
+        for (int timestep = 0; timestep < num_timesteps; ++timestep) {
+            integrator.step(particle_system, force_engine, dt);
+        }
+        REQUIRE(integrator.getBodyEvaluations() == (num_timesteps + 1) * static_cast<long>(particle_system.size()));
+
+        simulator.kineticEnergy(particle_system);
+        simulator.potentialEnergy(particle_system);
+        simulator.totalEnergy();
+        return std::abs(simulator.sumTotalEnergy() / initial_energy - 1.0);
+    };
+
+    // Halving the step cuts the error by about 2^4
+    double coarse_drift = energyDrift(0.02, n_body::IntegratorScheme::Hermite);
+    double fine_drift = energyDrift(0.01, n_body::IntegratorScheme::Hermite);
+    REQUIRE(fine_drift < coarse_drift / 10);
+    REQUIRE(fine_drift < 1e-7);
+}
+
+TEST_CASE("Trajectory files round-trip the particle system frame by frame", "[trajectory]") {
+
+    // Set initial conditions
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(7, 100));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::ForceEngine force_engine;
+    n_body::Integrator integrator(n_body::IntegratorScheme::Leapfrog);
+    const std::string path64 = "test_trajectory64.nbt";
+    const std::string path32 = "test_trajectory32.nbt";
+
+    // Keep a copy of every frame to compare against
+    std::vector<n_body::ParticleSystem> frames;
+    {
+        n_body::TrajectoryWriter writer64(path64, particle_system.size());
+        n_body::TrajectoryWriter writer32(path32, particle_system.size(), n_body::TrajectoryPrecision::Float32, false);
+        for (int step = 0; step <= 50; ++step) {
+            if (step % 10 == 0) {
+                writer64.write(particle_system, step, step * 0.001);
+                writer32.write(particle_system, step, step * 0.001);
+                frames.push_back(particle_system);
+            }
+            integrator.step(particle_system, force_engine, 0.001);
+        }
+        writer64.close();
+        REQUIRE(writer64.getFramesWritten() == 6);
+    }
+
+    // Double precision is exact
+    n_body::TrajectoryReader reader64(path64);
+    REQUIRE(reader64.numBodies() == particle_system.size());
+    REQUIRE(reader64.numFrames() == frames.size());
+    REQUIRE(reader64.hasVelocities());
+    n_body::ParticleSystem restored(particle_system.size());
+    for (std::size_t k = 0; k < frames.size(); ++k) {
+        REQUIRE(reader64.step(k) == 10 * k);
+        REQUIRE(reader64.time(k) == 10 * k * 0.001);
+        reader64.readFrame(k, restored);
+        for (std::size_t i = 0; i < restored.size(); ++i) {
+            REQUIRE(restored.x()[i] == frames[k].x()[i]);
+            REQUIRE(restored.z()[i] == frames[k].z()[i]);
+            REQUIRE(restored.vy()[i] == frames[k].vy()[i]);
+        }
+    }
+
+    // A system reordered in memory gets every body by its id
+    std::vector<std::size_t> reversed(restored.size());
+    for (std::size_t i = 0; i < reversed.size(); ++i) {
+        reversed[i] = reversed.size() - 1 - i;
+    }
+    restored.permute(reversed);
+    reader64.readFrame(2, restored);
+    for (std::size_t i = 0; i < restored.size(); ++i) {
+        REQUIRE(restored.x()[i] == frames[2].x()[restored.id()[i]]);
+        REQUIRE(restored.vz()[i] == frames[2].vz()[restored.id()[i]]);
+    }
+    REQUIRE(restored.id()[0] == restored.size() - 1);
+
+    // Single precision rounds to float and leaves out the velocities
+    n_body::TrajectoryReader reader32(path32);
+    REQUIRE(reader32.getPrecision() == n_body::TrajectoryPrecision::Float32);
+    REQUIRE_FALSE(reader32.hasVelocities());
+    REQUIRE(reader32.numFrames() == frames.size());
+    const float* y = static_cast<const float*>(reader32.component(3, 1));
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        REQUIRE(y[i] == static_cast<float>(frames[3].y()[i]));
+    }
+    REQUIRE_THROWS_AS(reader32.component(3, 3), std::out_of_range);
+    REQUIRE_THROWS_AS(reader32.step(frames.size()), std::out_of_range);
+
+    std::remove(path64.c_str());
+    std::remove(path32.c_str());
+
+    // Anything else is rejected
+    const std::string bad_path = "test_trajectory_bad.nbt";
+    std::ofstream(bad_path) << "not a trajectory file, but long enough to hold a header of sixty-four bytes";
+    REQUIRE_THROWS_AS(n_body::TrajectoryReader(bad_path), std::runtime_error);
+    std::remove(bad_path.c_str());
+}
+
+TEST_CASE("A run split across a checkpoint restart matches an uninterrupted run exactly", "[checkpoint]") {
+
+    // Set initial conditions
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(11, 200));
+    n_body::ForceEngine force_engine(n_body::ForceKernel::Simd, 0.01);
+    const std::string path = "test_checkpoint.nbc";
+    const double dt = 0.001;
+
+    for (n_body::IntegratorScheme scheme : {n_body::IntegratorScheme::Leapfrog, n_body::IntegratorScheme::Yoshida4,
+                                            n_body::IntegratorScheme::Hermite, n_body::IntegratorScheme::Block}) {
+
+        // Uninterrupted run of 40 steps
+        n_body::ParticleSystem reference = simulator.particleSystemGenerator();
+        n_body::Integrator integrator(scheme);
+        for (int step = 0; step < 40; ++step) {
+            integrator.step(reference, force_engine, dt);
+        }
+
+        // 20 steps, a checkpoint from the background writer, then a fresh integrator for the other 20
+        n_body::ParticleSystem first_half = simulator.particleSystemGenerator();
+        n_body::Integrator first_integrator(scheme);
+        for (int step = 0; step < 20; ++step) {
+            first_integrator.step(first_half, force_engine, dt);
+        }
+        n_body::CheckpointMetadata metadata;
+        metadata.step = 20;
+        metadata.time = 20 * dt;
+        metadata.dt = dt;
+        metadata.epsilon = force_engine.getEpsilon();
+        metadata.scheme = scheme;
+        metadata.generator = "random";
+        metadata.seed = 11;
+        metadata.num_generated = 200;
+        {
+            n_body::CheckpointWriter writer(path);
+            writer.save(first_half, first_integrator.getState(), metadata);
+            writer.wait();
+            REQUIRE(writer.getSaves() == 1);
+        }
+
+        n_body::ParticleSystem restarted;
+        n_body::IntegratorState state;
+        n_body::CheckpointMetadata loaded = n_body::loadCheckpoint(path, restarted, state);
+        REQUIRE(loaded.step == 20);
+        REQUIRE(loaded.dt == dt);
+        REQUIRE(loaded.scheme == scheme);
+        REQUIRE(loaded.generator == "random");
+        REQUIRE(loaded.seed == 11);
+        REQUIRE(restarted.size() == reference.size());
+        n_body::Integrator second_integrator(loaded.scheme);
+        second_integrator.setState(state);
+        for (std::uint64_t step = loaded.step; step < 40; ++step) {
+            second_integrator.step(restarted, force_engine, loaded.dt);
+        }
+
+        // Bit for bit the same state
+        for (std::size_t i = 0; i < reference.size(); ++i) {
+            REQUIRE(restarted.x()[i] == reference.x()[i]);
+            REQUIRE(restarted.y()[i] == reference.y()[i]);
+            REQUIRE(restarted.z()[i] == reference.z()[i]);
+            REQUIRE(restarted.vx()[i] == reference.vx()[i]);
+            REQUIRE(restarted.vy()[i] == reference.vy()[i]);
+            REQUIRE(restarted.vz()[i] == reference.vz()[i]);
+            REQUIRE(restarted.mass()[i] == reference.mass()[i]);
+        }
+    }
+
+    // A truncated file is rejected
+    {
+        std::ifstream input(path, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        std::ofstream(path, std::ios::binary) << contents.substr(0, contents.size() - 8);
+    }
+    n_body::ParticleSystem rejected;
+    n_body::IntegratorState rejected_state;
+    REQUIRE_THROWS_AS(n_body::loadCheckpoint(path, rejected, rejected_state), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Space-filling curve reordering keeps the bodies and their ids", "[spatialsort]") {
+
+    // The first 64 Hilbert keys fill the cube [0, 4)^3, each cell a face neighbour of the one before
+    std::vector<std::pair<std::uint64_t, std::array<int, 3>>> cells;
+    for (int ix = 0; ix < 4; ++ix) {
+        for (int iy = 0; iy < 4; ++iy) {
+            for (int iz = 0; iz < 4; ++iz) {
+                cells.push_back({n_body::hilbertKey(ix, iy, iz), {ix, iy, iz}});
+            }
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+    for (std::size_t k = 0; k < cells.size(); ++k) {
+        REQUIRE(cells[k].first == k);
+        if (k > 0) {
+            int steps = 0;
+            for (int c = 0; c < 3; ++c) {
+                steps += std::abs(cells[k].second[c] - cells[k - 1].second[c]);
+            }
+            REQUIRE(steps == 1);
+        }
+    }
+
+    // The radix sort is a stable sort, also on the parallel path
+    std::mt19937_64 generator(5);
+    for (std::size_t n : {std::size_t(1000), std::size_t(50000)}) {
+        std::vector<std::uint64_t> keys(n);
+        std::vector<std::size_t> values(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            keys[i] = generator() % (n / 4) * 0x9e3779b97f4a7c15ULL;
+            values[i] = i;
+        }
+        std::vector<std::pair<std::uint64_t, std::size_t>> expected(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            expected[i] = {keys[i], i};
+        }
+        std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        n_body::radixSort(keys, values);
+        for (std::size_t i = 0; i < n; ++i) {
+            REQUIRE(keys[i] == expected[i].first);
+            REQUIRE(values[i] == expected[i].second);
+        }
+    }
+
+    // Runs sorted every few steps follow the unsorted runs body by body, with the per-body state of Hermite and Block
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(3, 300));
+    n_body::ForceEngine force_engine(n_body::ForceKernel::Direct, 0.01);
+    for (n_body::IntegratorScheme scheme : {n_body::IntegratorScheme::Leapfrog, n_body::IntegratorScheme::Hermite, n_body::IntegratorScheme::Block}) {
+        for (n_body::SpaceFillingCurve curve : {n_body::SpaceFillingCurve::Morton, n_body::SpaceFillingCurve::Hilbert}) {
+            n_body::ParticleSystem reference = simulator.particleSystemGenerator();
+            n_body::ParticleSystem sorted = reference;
+            n_body::Integrator reference_integrator(scheme);
+            n_body::Integrator sorted_integrator(scheme);
+            n_body::SpatialSorter sorter(curve, 7);
+            const double unsorted_spread = n_body::storageSpread(sorted);
+            for (int step = 0; step < 30; ++step) {
+                sorter.update(sorted, sorted_integrator);
+                if (step == 0) {
+                    REQUIRE(n_body::storageSpread(sorted) < 0.5 * unsorted_spread);
+                }
+                reference_integrator.step(reference, force_engine, 0.001);
+                sorted_integrator.step(sorted, force_engine, 0.001);
+            }
+            REQUIRE(sorter.getReorders() == 5);
+            REQUIRE(sorted_integrator.getForceEvaluations() == reference_integrator.getForceEvaluations());
+
+            std::vector<std::size_t> index = sorted.indexById();
+            for (std::size_t id = 0; id < reference.size(); ++id) {
+                REQUIRE(sorted.getId(index[id]) == id);
+                REQUIRE(sorted.getPosition(index[id]).isApprox(reference.getPosition(id), 1e-10));
+                REQUIRE(sorted.getVelocity(index[id]).isApprox(reference.getVelocity(id), 1e-10));
+                REQUIRE(sorted.getMass(index[id]) == reference.getMass(id));
+            }
+        }
+    }
+
+    // Checkpoints keep the ids, trajectory frames are written in id order
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::Integrator integrator(n_body::IntegratorScheme::Leapfrog);
+    n_body::SpatialSorter sorter;
+    REQUIRE(sorter.update(particle_system, integrator));
+    REQUIRE_FALSE(sorter.update(particle_system, integrator));
+    const std::string checkpoint_path = "test_sorted_checkpoint.nbc";
+    n_body::saveCheckpoint(checkpoint_path, particle_system, integrator.getState(), n_body::CheckpointMetadata());
+    n_body::ParticleSystem restored;
+    n_body::IntegratorState state;
+    n_body::loadCheckpoint(checkpoint_path, restored, state);
+    std::remove(checkpoint_path.c_str());
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        REQUIRE(restored.getId(i) == particle_system.getId(i));
+    }
+
+    const std::string trajectory_path = "test_sorted_trajectory.nbt";
+    {
+        n_body::TrajectoryWriter writer(trajectory_path, particle_system.size());
+        writer.write(particle_system, 0, 0.0);
+    }
+    n_body::TrajectoryReader reader(trajectory_path);
+    n_body::ParticleSystem frame(particle_system.size());
+    reader.readFrame(0, frame);
+    std::remove(trajectory_path.c_str());
+    n_body::ParticleSystem generated = simulator.particleSystemGenerator();
+    for (std::size_t id = 0; id < generated.size(); ++id) {
+        REQUIRE(frame.getPosition(id) == generated.getPosition(id));
+    }
+
+    // Shrinking a reordered system renumbers the ids it keeps, in the same order
+    n_body::ParticleSystem shrunk = generated;
+    std::vector<std::size_t> reversed(shrunk.size());
+    for (std::size_t i = 0; i < reversed.size(); ++i) {
+        reversed[i] = reversed.size() - 1 - i;
+    }
+    shrunk.permute(reversed);
+    shrunk.resize(generated.size() / 2);
+    std::vector<std::size_t> shrunk_index = shrunk.indexById();
+    for (std::size_t i = 0; i < shrunk.size(); ++i) {
+        REQUIRE(shrunk.id()[i] == shrunk.size() - 1 - i);
+        REQUIRE(shrunk_index[shrunk.id()[i]] == i);
+        REQUIRE(shrunk.getPosition(i) == generated.getPosition(generated.size() - 1 - i));
+    }
+
+    REQUIRE_THROWS_AS(particle_system.permute(std::vector<std::size_t>(particle_system.size(), 0)), std::invalid_argument);
+    REQUIRE_THROWS_AS(n_body::parseSpaceFillingCurve("peano"), std::invalid_argument);
+}
+
+TEST_CASE("File generator reads CSV and binary initial conditions", "[generator]") {
+
+    // Write a random system in both formats
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::RandomSystemGenerator>(5, 300));
+    n_body::ParticleSystem original = simulator.particleSystemGenerator();
+    const std::string csv_path = "test_initial.csv";
+    const std::string binary_path = "test_initial.nbi";
+    n_body::saveInitialConditions(csv_path, original, n_body::InitialConditionFormat::Csv);
+    n_body::saveInitialConditions(binary_path, original);
+
+    for (const std::string& path : {csv_path, binary_path}) {
+        auto generator = std::make_shared<n_body::FileSystemGenerator>(path);
+        REQUIRE(generator->format() == (path == csv_path ? n_body::InitialConditionFormat::Csv : n_body::InitialConditionFormat::Binary));
+
+        // Both formats give back the same doubles
+        n_body::sysSimulator file_simulator = n_body::sysSimulator(generator);
+        n_body::ParticleSystem loaded = file_simulator.particleSystemGenerator();
+        REQUIRE(loaded.size() == original.size());
+        for (std::size_t i = 0; i < original.size(); ++i) {
+            REQUIRE(loaded.x()[i] == original.x()[i]);
+            REQUIRE(loaded.y()[i] == original.y()[i]);
+            REQUIRE(loaded.vx()[i] == original.vx()[i]);
+            REQUIRE(loaded.vy()[i] == original.vy()[i]);
+            REQUIRE(loaded.mass()[i] == original.mass()[i]);
+        }
+
+        // The list of particles is made from the same bodies
+        std::vector<n_body::particleAcceleration> particle_list = file_simulator.particleListGenerator();
+        REQUIRE(particle_list.size() == original.size());
+        REQUIRE(particle_list[7].getPosition() == original.getPosition(7));
+    }
+
+    // Comments, blank lines, white space and a missing final newline are accepted
+    std::ofstream("test_initial_hand.csv") << "# two bodies\n1 0 0  0 1 0  1e-3\n\n-1,0,0,0,-1,0,+2.5e-3";
+    n_body::ParticleSystem hand = n_body::FileSystemGenerator("test_initial_hand.csv").generateParticleSystem();
+    REQUIRE(hand.size() == 2);
+    REQUIRE(hand.x()[1] == -1.0);
+    REQUIRE(hand.mass()[1] == 2.5e-3);
+
+    // A catalogue may open with comment lines before its column header
+    std::ofstream("test_initial_catalogue.csv") << "# catalogue\n# units: AU, AU/yr, solar masses\n\nx,y,z,vx,vy,vz,mass\n1,0,0,0,1,0,1e-3\n";
+    REQUIRE(n_body::FileSystemGenerator("test_initial_catalogue.csv").generateParticleSystem().size() == 1);
+
+    // Malformed files are rejected, including a header after the first body
+    std::ofstream("test_initial_late_header.csv") << "1,0,0,0,1,0,1e-3\nx,y,z,vx,vy,vz,mass\n";
+    REQUIRE_THROWS_AS(n_body::FileSystemGenerator("test_initial_late_header.csv").generateParticleSystem(), std::runtime_error);
+    std::ofstream("test_initial_bad.csv") << "x,y,z,vx,vy,vz,mass\n1,2,3,4,5,6\n";
+    REQUIRE_THROWS_AS(n_body::FileSystemGenerator("test_initial_bad.csv").generateParticleSystem(), std::runtime_error);
+    REQUIRE_THROWS_AS(n_body::FileSystemGenerator("test_initial_missing.csv").generateParticleSystem(), std::runtime_error);
+
+    for (const char* path : {"test_initial.csv", "test_initial.nbi", "test_initial_hand.csv", "test_initial_catalogue.csv", "test_initial_late_header.csv", "test_initial_bad.csv"}) {
+        std::remove(path);
+    }
+}
+
+TEST_CASE("Philox generator is reproducible for any thread count", "[generator]") {
+
+    // Known-answer vectors of Philox4x32-10 from the Random123 distribution
+    REQUIRE(n_body::philox4x32({0, 0, 0, 0}, {0, 0}) == std::array<std::uint32_t, 4>{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+    REQUIRE(n_body::philox4x32({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff})
+            == std::array<std::uint32_t, 4>{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+    REQUIRE(n_body::philox4x32({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0})
+            == std::array<std::uint32_t, 4>{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1});
+
+    // The same bodies with one thread and with four
+    const int max_threads = omp_get_max_threads();
+    for (n_body::SystemDistribution distribution : {n_body::SystemDistribution::Disc, n_body::SystemDistribution::Plummer, n_body::SystemDistribution::Clumps}) {
+        n_body::PhiloxSystemGenerator generator(7, 20000, distribution);
+        omp_set_num_threads(1);
+        n_body::ParticleSystem serial = generator.generateParticleSystem();
+        omp_set_num_threads(4);
+        n_body::ParticleSystem parallel = generator.generateParticleSystem();
+        omp_set_num_threads(max_threads);
+        REQUIRE(serial.size() == (distribution == n_body::SystemDistribution::Disc ? 20001 : 20000));
+        REQUIRE(parallel.size() == serial.size());
+        bool identical = true;
+        for (std::size_t i = 0; i < serial.size(); ++i) {
+            identical = identical && parallel.x()[i] == serial.x()[i] && parallel.z()[i] == serial.z()[i]
+                        && parallel.vy()[i] == serial.vy()[i] && parallel.mass()[i] == serial.mass()[i];
+        }
+        REQUIRE(identical);
+    }
+
+    // A different seed gives different bodies
+    n_body::ParticleSystem first = n_body::PhiloxSystemGenerator(1, 100, n_body::SystemDistribution::Plummer).generateParticleSystem();
+    n_body::ParticleSystem second = n_body::PhiloxSystemGenerator(2, 100, n_body::SystemDistribution::Plummer).generateParticleSystem();
+    REQUIRE(first.x()[0] != second.x()[0]);
+    REQUIRE_THROWS_AS(n_body::parseSystemDistribution("ring"), std::invalid_argument);
+}
+
+TEST_CASE("Plummer sphere starts in virial equilibrium", "[generator]") {
+
+    // 2T + W = 0 for a system in equilibrium, so 2T / |W| is close to one
+    n_body::sysSimulator simulator = n_body::sysSimulator(std::make_shared<n_body::PhiloxSystemGenerator>(3, 4000, n_body::SystemDistribution::Plummer));
+    n_body::ParticleSystem particle_system = simulator.particleSystemGenerator();
+    n_body::EnergyDiagnostics energy;
+    energy.compute(particle_system, 0.0);
+    REQUIRE(2 * energy.kineticEnergy() / std::abs(energy.potentialEnergy()) == Catch::Approx(1.0).margin(0.1));
+
+    // Total mass one, at rest at the origin
+    double total_mass = 0.0, momentum = 0.0;
+    for (std::size_t i = 0; i < particle_system.size(); ++i) {
+        total_mass += particle_system.mass()[i];
+        momentum += particle_system.mass()[i] * particle_system.vx()[i];
+    }
+    REQUIRE(total_mass == Catch::Approx(1.0));
+    REQUIRE(std::abs(momentum) < 1e-12);
+
+    // Cold clumps have no kinetic energy
+    n_body::ParticleSystem clumps = n_body::PhiloxSystemGenerator(3, 1000, n_body::SystemDistribution::Clumps, 4).generateParticleSystem();
+    energy.compute(clumps, 0.0);
+    REQUIRE(energy.kineticEnergy() == 0.0);
+}
+
+TEST_CASE("Profiler takes nested phases out of their parents and records per-thread busy time", "[profiler]") {
+
+    // Spin rather than sleep, so the time is spent on the thread
+    auto spin = [](double seconds) {
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < seconds) {}
+    };
+
+    n_body::Profiler& profiler = n_body::Profiler::global();
+    profiler.reset();
+    {
+        n_body::ProfileScope integration(n_body::ProfilePhase::Integration);
+        spin(0.002);
+        {
+            n_body::ProfileScope force(n_body::ProfilePhase::Force);
+            spin(0.05);
+        }
+        profiler.count(n_body::ProfilePhase::Integration, 0.0, 12.0, 120.0);
+
+        // Thread i works i + 1 times as long as thread 0, on more threads than omp_get_max_threads() may allow for
+        profiler.reserveThreads(4);
+        #pragma omp parallel num_threads(4)
+        {
+            n_body::ProfileThreadScope busy(n_body::ProfilePhase::Energy);
+            spin(0.002 * (omp_get_thread_num() + 1));
+        }
+    }
+    n_body::ProfileReport report = profiler.report();
+    const n_body::PhaseProfile& force = report.phases[static_cast<int>(n_body::ProfilePhase::Force)];
+    const n_body::PhaseProfile& integration = report.phases[static_cast<int>(n_body::ProfilePhase::Integration)];
+    const n_body::PhaseProfile& energy = report.phases[static_cast<int>(n_body::ProfilePhase::Energy)];
+    REQUIRE(force.calls == 1);
+    REQUIRE(integration.calls == 1);
+    REQUIRE(force.seconds >= 0.05);
+    REQUIRE(integration.seconds >= 0.002);
+    REQUIRE(integration.seconds < 0.05);
+    REQUIRE(force.seconds + integration.seconds <= report.wall_seconds);
+    REQUIRE(integration.flops == 12.0);
+    REQUIRE(integration.bytes == 120.0);
+
+    // Every thread of the region has its own busy time
+    REQUIRE(energy.threads == 4);
+    REQUIRE(energy.min_thread_seconds >= 0.002);
+    REQUIRE(energy.max_thread_seconds >= 0.008);
+    REQUIRE(energy.min_thread_seconds <= energy.mean_thread_seconds);
+    REQUIRE(energy.mean_thread_seconds <= energy.max_thread_seconds);
+
+    // The library phases record themselves only in builds with NBODY_PROFILING
+    profiler.reset();
+    n_body::ParticleSystem particle_system(n_body::RandomSystemGenerator(3, 99).generateInitialConditions());
+    n_body::ForceEngine(n_body::ForceKernel::Simd, 0.01).computeAcceleration(particle_system);
+    report = profiler.report();
+    REQUIRE(report.phases[0].calls == (n_body::profiling_enabled ? 1 : 0));
+    REQUIRE(report.phases[0].interactions == (n_body::profiling_enabled ? 100.0 * 99.0 : 0.0));
+
+    // One row per phase under the header
+    n_body::writeProfileCsv("test_profile.csv", report);
+    n_body::writeProfileJson("test_profile.json", report);
+    std::ifstream csv("test_profile.csv");
+    std::string line;
+    int rows = 0;
+    while (std::getline(csv, line)) {
+        ++rows;
+    }
+    REQUIRE(rows == 1 + n_body::num_profile_phases);
+    std::ifstream json("test_profile.json");
+    std::getline(json, line);
+    REQUIRE(line == "{");
+    std::remove("test_profile.csv");
+    std::remove("test_profile.json");
+}
+
+TEST_CASE("Scaling study measures every size on every thread count", "[scaling]") {
+
+    n_body::ScalingOptions options;
+    options.sizes = {64, 100};
+    options.threads = {2, 1};
+    options.binding = n_body::ThreadBinding::Close;
+    options.repeats = 3;
+    options.steps = 2;
+    const int max_threads = omp_get_max_threads();
+    n_body::ForceEngine force_engine(n_body::ForceKernel::Direct, 0.01);
+
+    // Strong scaling keeps the sizes, the smallest thread count is the baseline of each size
+    n_body::ScalingReport strong = n_body::runScalingStudy(options, force_engine);
+    REQUIRE(strong.points.size() == 4);
+    REQUIRE(strong.points[0].threads == 1);
+    REQUIRE(strong.points[0].efficiency == 1.0);
+    REQUIRE(strong.points[2].base_size == 100);
+    REQUIRE(strong.points[2].speedup == 1.0);
+    for (const n_body::ScalingPoint& point : strong.points) {
+        REQUIRE(point.num_bodies == point.base_size);
+        REQUIRE(point.min_seconds <= point.median_seconds);
+        REQUIRE(point.median_seconds <= point.max_seconds);
+        REQUIRE(point.interactions_per_second > 0.0);
+        REQUIRE(point.efficiency == Catch::Approx(point.speedup / point.threads));
+        REQUIRE(point.cpus.size() == static_cast<std::size_t>(point.threads));
+        for (int cpu : point.cpus) {
+            REQUIRE(cpu >= 0);
+        }
+    }
+    REQUIRE(omp_get_max_threads() == max_threads);
+
+    // Weak scaling grows direct summation as sqrt(p) and the tree kernels as p
+    options.mode = n_body::ScalingMode::Weak;
+    options.sizes = {64};
+    options.binding = n_body::ThreadBinding::None;
+    n_body::ScalingReport weak = n_body::runScalingStudy(options, force_engine);
+    REQUIRE(weak.points[1].num_bodies == 91);
+    REQUIRE(weak.points[1].cpus[0] == -1);
+    n_body::ForceEngine tree_engine(n_body::ForceKernel::BarnesHut, 0.01);
+    REQUIRE(n_body::runScalingStudy(options, tree_engine).points[1].num_bodies == 128);
+
+    options.sizes = {1};
+    REQUIRE_THROWS_AS(n_body::runScalingStudy(options, force_engine), std::invalid_argument);
+    REQUIRE_THROWS_AS(n_body::parseThreadBinding("compact"), std::invalid_argument);
+    REQUIRE(n_body::parseScalingMode("weak") == n_body::ScalingMode::Weak);
+}
+
+TEST_CASE("Command line rejects unknown flags and values that are not numbers", "[commandline]") {
+
+    std::vector<std::string> words = {"program", "0.01", "1", "--kernel", "simd", "--theta", "0.7", "--tile", "--threads", "1,2,4"};
+    std::vector<char*> argv;
+    for (std::string& word : words) {
+        argv.push_back(word.data());
+    }
+    n_body::CommandLine command_line(static_cast<int>(argv.size()), argv.data());
+    REQUIRE(command_line.numPositional() == 2);
+    REQUIRE(command_line.option("kernel") == "simd");
+    REQUIRE(command_line.optionDouble("theta", 0.5) == 0.7);
+    REQUIRE(command_line.optionList("threads", {}) == std::vector<long>{1, 2, 4});
+    REQUIRE(command_line.optionInt("order", 4) == 4);
+
+    // A flag without its value, or a value with trailing text, is an error rather than a crash or a silent default
+    REQUIRE_THROWS_AS(command_line.optionInt("tile", 0), std::invalid_argument);
+    REQUIRE_THROWS_AS(command_line.optionInt("kernel", 0), std::invalid_argument);
+    REQUIRE_THROWS_AS(command_line.optionDouble("threads", 0.0), std::invalid_argument);
+
+    REQUIRE_NOTHROW(command_line.requireKnownOptions({"kernel", "theta", "tile", "threads"}));
+    REQUIRE_THROWS_AS(command_line.requireKnownOptions({"kernel", "theta", "threads"}), std::invalid_argument);
+}